@@ -3,7 +3,11 @@
 #include "./ui_GameStartWindow.h"
 
 #include "../NetworkApi/MsgPlayerQuery.hpp"
+#include "../NetworkApi/MsgFleetLayout.hpp"
+#include "../NetworkApi/MsgServerBusy.hpp"
+#include "../NetworkApi/FleetBoard.hpp"
 #include "../NetworkApi/ServerPeer.hpp"
+#include "../NetworkApi/PeerAwaiter.hpp"
 
 /// Настройки - IP сервера
 extern QString _ip;
@@ -19,7 +23,9 @@ extern net::ServerPeer* _server;
 GameStartWindow::GameStartWindow(GameWindow *mainWindow):
         QWidget(nullptr),
         gameWindow_(mainWindow),
-        ui_(new Ui::GameStartWindow)
+        ui_(new Ui::GameStartWindow),
+        awaiter_(nullptr),
+        serverPort_(0)
 {
     // Инициализация UI
     ui_->setupUi(this);
@@ -33,6 +39,147 @@ GameStartWindow::~GameStartWindow()
     delete ui_;
 }
 
+/**
+ * Отправить серверу расстановку кораблей (до запроса на подключение к игре)
+ * @return Удалось ли отправить
+ * @details Если расстановки обоих игроков корректны, итоги ходов определяет сервер
+ */
+bool GameStartWindow::sendFleetLayout()
+{
+    net::MsgFleetLayout::FleetLayout layout = {};
+    for(unsigned y = 0; y < net::FleetBoard::FIELD_SIZE; y++){
+        for(unsigned x = 0; x < net::FleetBoard::FIELD_SIZE; x++){
+            if(this->gameWindow_->myField_->findAt(QPoint(static_cast<int>(x), static_cast<int>(y))) != nullptr){
+                net::FleetBoard::setCell(layout.cells, x, y);
+            }
+        }
+    }
+    return _server->sendMessage(net::MsgFleetLayout(layout));
+}
+
+/**
+ * Сообщить игроку, что сервер перегружен (если ответ сервера - отказ по перегрузке)
+ * @param response Ответ сервера
+ * @return Был ли ответ отказом по перегрузке
+ */
+bool GameStartWindow::showServerBusy(net::Msg& response)
+{
+    if(response.getType() != net::MSG_SERVER_BUSY)
+        return false;
+
+    // Сервер закрывает соединение сразу после отказа - повторная попытка выполняется заново нажатием кнопки
+    unsigned retryAfter = (response.toMsgServerBusy().getRetryAfter() + 999) / 1000;
+    QMessageBox msgBox;
+    msgBox.setWindowTitle("Сервер занят.");
+    msgBox.setText(QString("Сервер перегружен. Повторите попытку через %1 с.").arg(retryAfter));
+    msgBox.setIcon(QMessageBox::Icon::Warning);
+    msgBox.exec();
+    return true;
+}
+
+/**
+ * Ожидать ответа сервера на запрос подключения к игре, не блокируя интерфейс
+ * @param onResponse Обработчик ответа (MSG_UNDEFINED - ответа нет, либо соединение разорвано)
+ * @details Пока ответ не получен, окно не принимает ввод (повторный запрос невозможен)
+ */
+void GameStartWindow::awaitResponse(std::function<void(net::Msg&)> onResponse)
+{
+    this->awaiter_ = new net::PeerAwaiter(*_server, this);
+    this->setEnabled(false);
+
+    this->awaiter_->recv(RESPONSE_TIMEOUT, [this, onResponse](net::Msg& response){
+        // Объект ожидания больше не нужен (сообщения далее обрабатывает главное окно)
+        QObject::disconnect(_server->getSocket(), nullptr, this->awaiter_, nullptr);
+        this->awaiter_->deleteLater();
+        this->awaiter_ = nullptr;
+        this->setEnabled(true);
+        onResponse(response);
+    });
+}
+
+/**
+ * Закрыть соединение с сервером после неудачного запроса
+ * @details Запрос мог быть отклонен другим сервером (за маршрутизатором соединение закреплено за сервером,
+ * выбранным при первом запросе), а ответ, не полученный в срок, пришел бы в ответ на следующий запрос,
+ * поэтому следующий запрос устанавливает новое соединение
+ */
+void GameStartWindow::dropConnection()
+{
+    delete _server;
+    _server = nullptr;
+}
+
+/**
+ * Сообщить игроку, что подключиться к серверу не удалось
+ */
+void GameStartWindow::showConnectionFailed()
+{
+    // Сообщение
+    QMessageBox msgBox;
+    msgBox.setWindowTitle("Ошибка.");
+    msgBox.setText("Невозможно наладить подключение с игровым сервером. Убедитесь что настройки подключения корректны и сервер доступен.");
+    msgBox.setIcon(QMessageBox::Icon::Critical);
+    msgBox.exec();
+}
+
+/**
+ * Подключиться к серверу, не блокируя интерфейс
+ * @param onConnected Обработчик успешного подключения (вызывается циклом событий, при неудаче игроку выводится сообщение)
+ * @details Открытое соединение с тем же сервером используется повторно (сервер оставляет его открытым после
+ * окончания игры), иначе устанавливается новое. Сервер сравнивается по адресу из настроек, с которым соединение
+ * установлено (у соединения через локальный сокет адреса собеседника нет). После неудачного запроса соединение
+ * закрывается (dropConnection)
+ */
+void GameStartWindow::connectServer(std::function<void()> onConnected)
+{
+    if(_server != nullptr && _server->isConnected() && this->serverIp_ == _ip && this->serverPort_ == _port){
+        // Сообщения прежней игры больше не передаются главному окну
+        QObject::disconnect(_server->getSocket(), SIGNAL(readyRead()), this->gameWindow_, SLOT(onReadyReadServerMessage()));
+        onConnected();
+        return;
+    }
+
+    delete _server;
+    _server = new net::ServerPeer(_ip.toStdString().c_str(), _port, false);
+    this->serverIp_ = _ip;
+    this->serverPort_ = _port;
+
+    // Подключение через локальный сокет завершается сразу, ошибка адреса - тоже
+    QTcpSocket* socket = _server->getSocket();
+    if(socket->state() == QAbstractSocket::ConnectedState){
+        onConnected();
+        return;
+    }
+    if(socket->state() == QAbstractSocket::UnconnectedState){
+        this->dropConnection();
+        this->showConnectionFailed();
+        return;
+    }
+
+    // Подключение TCP завершается сигналом сокета, либо по сроку. Таймер служит и получателем сигналов сокета,
+    // поэтому после первого из событий остальные отключаются вместе с ним
+    auto deadline = new QTimer(this);
+    deadline->setSingleShot(true);
+    this->setEnabled(false);
+    auto finish = [this, socket, deadline, onConnected](bool connected){
+        deadline->stop();
+        QObject::disconnect(socket, nullptr, deadline, nullptr);
+        deadline->deleteLater();
+        this->setEnabled(true);
+        if(connected){
+            onConnected();
+        }else{
+            this->dropConnection();
+            this->showConnectionFailed();
+        }
+    };
+    connect(socket, &QTcpSocket::connected, deadline, [finish]{ finish(true); });
+    connect(socket, static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+            deadline, [finish]{ finish(false); });
+    connect(deadline, &QTimer::timeout, deadline, [finish]{ finish(false); });
+    deadline->start(CONNECT_TIMEOUT);
+}
+
 /// S L O T S
 
 /**
@@ -40,50 +187,47 @@ GameStartWindow::~GameStartWindow()
  */
 void GameStartWindow::on_btnNewSession_clicked()
 {
-    // Попытка создать сервер-peer
-    _server = new net::ServerPeer(_ip.toStdString().c_str(), _port);
-
-    // Если удалось подключиться
-    if(_server->isConnected()){
-        // Отправляем серверу сообщение о запросе новой игровой сессии
+    // Если удалось подключиться (либо соединение прежней игры еще открыто)
+    this->connectServer([this]{
+        // Отправляем серверу расстановку кораблей и сообщение о запросе новой игровой сессии
+        this->sendFleetLayout();
         _server->sendMessage(net::MsgPlayerQuery());
-        // Тут же ожидаем ответа от сервера
-        auto response = _server->waitForMessage();
-        // Если пришел ответ и игрок был присоединен к новой сессии
-        if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined)
-        {
-            // Вывести ключ сессии
-            this->ui_->editSessionKeyNew->setText(QString::number(response.toMsgPlayerResponse().getResponseData().sessionKey));
-            // Сменить состояние
-            this->gameWindow_->currentState_ = GameWindow::GameClientState::CONNECTED_NEW;
-            this->gameWindow_->onStateChange();
-            // Сделать таб подключения к существующей сессии не активным
-            this->ui_->tabJoinToSession->setEnabled(false);
-            // Сделать кнопку создания сессии не активной
-            this->ui_->btnNewSession->setEnabled(false);
-
-            // Обработчик события готовности сокета к чтению
-            connect(_server->getSocket(),SIGNAL(readyRead()),this->gameWindow_,SLOT(onReadyReadServerMessage()));
-        }
-        // Если пришел не корректный ответ или игрок не был присоединен
-        else {
-            // Сообщение
-            QMessageBox msgBox;
-            msgBox.setWindowTitle("Ошибка.");
-            msgBox.setText("Ошибка на сервере. Сервер отправил не корректный ответ.");
-            msgBox.setIcon(QMessageBox::Icon::Critical);
-            msgBox.exec();
-        }
-    }
-    // Если подключение не удалось
-    else{
-        // Сообщение
-        QMessageBox msgBox;
-        msgBox.setWindowTitle("Ошибка.");
-        msgBox.setText("Невозможно наладить подключение с игровым сервером. Убедитесь что настройки подключения корректны и сервер доступен.");
-        msgBox.setIcon(QMessageBox::Icon::Critical);
-        msgBox.exec();
-    }
+        // Ожидаем ответа от сервера (обработчик вызывается циклом событий)
+        this->awaitResponse([this](net::Msg& response){
+            // Если пришел ответ и игрок был присоединен к новой сессии
+            if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined)
+            {
+                // Вывести ключ сессии
+                this->ui_->editSessionKeyNew->setText(QString::number(response.toMsgPlayerResponse().getResponseData().sessionKey));
+                // Сменить состояние
+                this->gameWindow_->currentState_ = GameWindow::GameClientState::CONNECTED_NEW;
+                this->gameWindow_->onStateChange();
+                // Сделать таб подключения к существующей сессии не активным
+                this->ui_->tabJoinToSession->setEnabled(false);
+                // Сделать кнопку создания сессии не активной
+                this->ui_->btnNewSession->setEnabled(false);
+
+                // Обработчик события готовности сокета к чтению
+                connect(_server->getSocket(),SIGNAL(readyRead()),this->gameWindow_,SLOT(onReadyReadServerMessage()));
+                // Сообщения, пришедшие вместе с ответом, уже в буфере (события готовности к чтению для них не будет)
+                if(_server->hasMessage()){
+                    QMetaObject::invokeMethod(this->gameWindow_, "onReadyReadServerMessage", Qt::QueuedConnection);
+                }
+            }
+            // Если пришел не корректный ответ или игрок не был присоединен (отказ из-за перегрузки сервера сообщается отдельно)
+            else{
+                this->dropConnection();
+                if(!this->showServerBusy(response)){
+                    // Сообщение
+                    QMessageBox msgBox;
+                    msgBox.setWindowTitle("Ошибка.");
+                    msgBox.setText("Ошибка на сервере. Сервер отправил не корректный ответ.");
+                    msgBox.setIcon(QMessageBox::Icon::Critical);
+                    msgBox.exec();
+                }
+            }
+        });
+    });
 }
 
 /**
@@ -91,48 +235,109 @@ void GameStartWindow::on_btnNewSession_clicked()
  */
 void GameStartWindow::on_btnJoin_clicked()
 {
-    // Попытка создать сервер-peer
-    _server = new net::ServerPeer(_ip.toStdString().c_str(), _port);
-
-    // Если удалось подключиться
-    if(_server->isConnected()){
-        // Отправляем серверу сообщение о запросе новой игровой сессии
-        _server->sendMessage(net::MsgPlayerQuery(this->ui_->editSessionKeyJoin->text().toUInt()));
-        // Тут же ожидаем ответа от сервера
-        auto response = _server->waitForMessage();
-        // Если пришел ответ и игрок был присоединен к новой сессии
-        if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined)
-        {
-            // Сменить состояние
-            this->gameWindow_->currentState_ = GameWindow::GameClientState::CONNECTED_JOINED;
-            this->gameWindow_->onStateChange();
-            // Сделать таб создания новой сессии не активным
-            this->ui_->tabNewSession->setEnabled(false);
-            // Сделать кнопку подключения к сессии не активной
-            this->ui_->btnJoin->setEnabled(false);
-            // Закрыть текущее окно
-            this->close();
-
-            // Обработчик события готовности сокета к чтению
-            connect(_server->getSocket(),SIGNAL(readyRead()),this->gameWindow_,SLOT(onReadyReadServerMessage()));
-        }
-        // Если пришел не корректный ответ или игрок не был присоединен
-        else {
-            // Сообщение
-            QMessageBox msgBox;
-            msgBox.setWindowTitle("Ошибка.");
-            msgBox.setText("Вероятно такая сессия не существует, либо произошла ошибка на сервере. Попробуйте еще раз");
-            msgBox.setIcon(QMessageBox::Icon::Critical);
-            msgBox.exec();
-        }
-    }
-    // Если подключение не удалось
-    else{
+    // Ключ сессии (номер сервера хранится в старших разрядах, поэтому ключ не умещается в 32 разряда).
+    // Зарезервированные ключи означают новую сессию и поиск соперника - присоединиться по ним нельзя
+    bool valid = false;
+    qulonglong enteredKey = this->ui_->editSessionKeyJoin->text().trimmed().toULongLong(&valid);
+    auto sessionKey = static_cast<uintptr_t>(enteredKey);
+    if(!valid || sessionKey != enteredKey || sessionKey == net::SESSION_KEY_NEW || sessionKey == net::SESSION_KEY_ANY){
         // Сообщение
         QMessageBox msgBox;
         msgBox.setWindowTitle("Ошибка.");
-        msgBox.setText("Невозможно наладить подключение с игровым сервером. Убедитесь что настройки подключения корректны и сервер доступен.");
+        msgBox.setText("Некорректный ключ сессии. Введите ключ, полученный создателем сессии.");
         msgBox.setIcon(QMessageBox::Icon::Critical);
         msgBox.exec();
+        return;
     }
+
+    // Если удалось подключиться (либо соединение прежней игры еще открыто)
+    this->connectServer([this, sessionKey]{
+        // Отправляем серверу расстановку кораблей и сообщение о подключении к сессии
+        this->sendFleetLayout();
+        _server->sendMessage(net::MsgPlayerQuery(sessionKey));
+        // Ожидаем ответа от сервера (обработчик вызывается циклом событий)
+        this->awaitResponse([this](net::Msg& response){
+            // Если пришел ответ и игрок был присоединен к новой сессии
+            if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined)
+            {
+                // Сменить состояние
+                this->gameWindow_->currentState_ = GameWindow::GameClientState::CONNECTED_JOINED;
+                this->gameWindow_->onStateChange();
+                // Сделать таб создания новой сессии не активным
+                this->ui_->tabNewSession->setEnabled(false);
+                // Сделать кнопку подключения к сессии не активной
+                this->ui_->btnJoin->setEnabled(false);
+                // Закрыть текущее окно
+                this->close();
+
+                // Обработчик события готовности сокета к чтению
+                connect(_server->getSocket(),SIGNAL(readyRead()),this->gameWindow_,SLOT(onReadyReadServerMessage()));
+                // Сообщения, пришедшие вместе с ответом, уже в буфере (события готовности к чтению для них не будет)
+                if(_server->hasMessage()){
+                    QMetaObject::invokeMethod(this->gameWindow_, "onReadyReadServerMessage", Qt::QueuedConnection);
+                }
+            }
+            // Если пришел не корректный ответ или игрок не был присоединен (отказ из-за перегрузки сервера сообщается отдельно)
+            else{
+                this->dropConnection();
+                if(!this->showServerBusy(response)){
+                    // Сообщение
+                    QMessageBox msgBox;
+                    msgBox.setWindowTitle("Ошибка.");
+                    msgBox.setText("Вероятно такая сессия не существует, либо произошла ошибка на сервере. Попробуйте еще раз");
+                    msgBox.setIcon(QMessageBox::Icon::Critical);
+                    msgBox.exec();
+                }
+            }
+        });
+    });
+}
+
+/**
+ * Обработка события нажатия на кнопку поиска соперника
+ */
+void GameStartWindow::on_btnMatch_clicked()
+{
+    // Если удалось подключиться (либо соединение прежней игры еще открыто)
+    this->connectServer([this]{
+        // Отправляем серверу расстановку кораблей и сообщение о поиске любого соперника
+        this->sendFleetLayout();
+        _server->sendMessage(net::MsgPlayerQuery(net::SESSION_KEY_ANY));
+        // Ожидаем ответа от сервера (обработчик вызывается циклом событий)
+        this->awaitResponse([this](net::Msg& response){
+            // Если пришел ответ и игрок был поставлен в очередь, либо сразу присоединен к ожидающему игроку
+            if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined)
+            {
+                // Сменить состояние (если соперник уже найден, следом придет сообщение о начале игры)
+                this->gameWindow_->currentState_ = GameWindow::GameClientState::CONNECTED_NEW;
+                this->gameWindow_->onStateChange();
+                // Сделать таб подключения к существующей сессии не активным
+                this->ui_->tabJoinToSession->setEnabled(false);
+                // Сделать кнопки не активными
+                this->ui_->btnNewSession->setEnabled(false);
+                this->ui_->btnMatch->setEnabled(false);
+                // Закрыть текущее окно
+                this->close();
+
+                // Обработчик события готовности сокета к чтению
+                connect(_server->getSocket(),SIGNAL(readyRead()),this->gameWindow_,SLOT(onReadyReadServerMessage()));
+                // Сообщения, пришедшие вместе с ответом, уже в буфере (события готовности к чтению для них не будет)
+                if(_server->hasMessage()){
+                    QMetaObject::invokeMethod(this->gameWindow_, "onReadyReadServerMessage", Qt::QueuedConnection);
+                }
+            }
+            // Если пришел не корректный ответ или игрок не был поставлен в очередь (отказ из-за перегрузки сервера сообщается отдельно)
+            else{
+                this->dropConnection();
+                if(!this->showServerBusy(response)){
+                    // Сообщение
+                    QMessageBox msgBox;
+                    msgBox.setWindowTitle("Ошибка.");
+                    msgBox.setText("Сервер не смог начать поиск соперника. Попробуйте еще раз");
+                    msgBox.setIcon(QMessageBox::Icon::Critical);
+                    msgBox.exec();
+                }
+            }
+        });
+    });
 }
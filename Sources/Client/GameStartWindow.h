@@ -1,12 +1,17 @@
 #pragma once
 
+#include <functional>
 #include <QWidget>
 
+#include "../NetworkApi/Msg.hpp"
+
 // Класс для взаимодействия с UI интерфейсом
 QT_BEGIN_NAMESPACE
 namespace Ui { class GameStartWindow; }
 QT_END_NAMESPACE
 
+namespace net { class PeerAwaiter; }
+
 class GameWindow;
 class GameStartWindow final : public QWidget
 {
@@ -35,11 +40,64 @@ private slots:
      */
     void on_btnJoin_clicked();
 
+    /**
+     * Обработка события нажатия на кнопку поиска соперника
+     */
+    void on_btnMatch_clicked();
+
 private:
+    /**
+     * Подключиться к серверу, не блокируя интерфейс
+     * @param onConnected Обработчик успешного подключения (при неудаче игроку выводится сообщение)
+     */
+    void connectServer(std::function<void()> onConnected);
+
+    /**
+     * Сообщить игроку, что подключиться к серверу не удалось
+     */
+    void showConnectionFailed();
+
+    /**
+     * Закрыть соединение с сервером после неудачного запроса
+     */
+    void dropConnection();
+
+    /**
+     * Отправить серверу расстановку кораблей (до запроса на подключение к игре)
+     * @return Удалось ли отправить
+     */
+    bool sendFleetLayout();
+
+    /**
+     * Сообщить игроку, что сервер перегружен (если ответ сервера - отказ по перегрузке)
+     * @param response Ответ сервера
+     * @return Был ли ответ отказом по перегрузке
+     */
+    bool showServerBusy(net::Msg& response);
+
+    /**
+     * Ожидать ответа сервера на запрос подключения к игре, не блокируя интерфейс
+     * @param onResponse Обработчик ответа (MSG_UNDEFINED - ответа нет, либо соединение разорвано)
+     */
+    void awaitResponse(std::function<void(net::Msg&)> onResponse);
+
+    /// Срок ожидания ответа сервера на запрос подключения к игре (мс)
+    static constexpr int RESPONSE_TIMEOUT = 10000;
+
+    /// Срок ожидания подключения к серверу (мс)
+    static constexpr int CONNECT_TIMEOUT = 5000;
+
     /// Указатель на главное окно игры
     GameWindow* gameWindow_;
 
     /// Указатель на UI объект
     Ui::GameStartWindow* ui_;
 
+    /// Ожидание ответа сервера (nullptr - ответ не ожидается)
+    net::PeerAwaiter* awaiter_;
+
+    /// Адрес и порт сервера из настроек, с которыми установлено текущее соединение
+    QString serverIp_;
+    unsigned serverPort_;
+
 };
@@ -284,7 +284,8 @@ void GameWindow::onSettingsButtonClicked()
 void GameWindow::onReadyReadServerMessage()
 {
     // Проверка на всякий случай (хотя казалось бы, нахуя? Но пусть будет..)
-    if(_server != nullptr && _server->isConnected())
+    // Сервер не делает пауз между отправками, поэтому за одно событие читаются все полученные сообщения
+    while(_server != nullptr && _server->isConnected() && _server->hasMessage())
     {
         // Читаем сообщение
         net::Msg serverMessage = _server->readMessage();
@@ -300,7 +301,9 @@ void GameWindow::onReadyReadServerMessage()
             // Состояние игры
             case net::MSG_GAME_STATUS:
             {
-                if(serverMessage.toMsgGameStatus().getStatus() == net::GAME_RUNNING){
+                if(serverMessage.toMsgGameStatus().getStatus() == net::GAME_RUNNING ||
+                   serverMessage.toMsgGameStatus().getStatus() == net::GAME_RUNNING_AUTHORITATIVE){
+                    this->authoritativeServer_ = serverMessage.toMsgGameStatus().getStatus() == net::GAME_RUNNING_AUTHORITATIVE;
                     this->currentState_ = GameClientState::WHOSE_TURN;
                 }
                 else if(serverMessage.toMsgGameStatus().getStatus() == net::GAME_OVER_WIN){
@@ -352,6 +355,8 @@ void GameWindow::onReadyReadServerMessage()
                 auto point = QPoint{static_cast<int>(shotDetails.x), static_cast<int>(shotDetails.y)};
                 // Найти часть корабля по координатам
                 auto shipPart = myField_->findAt(point);
+                // Итог хода
+                uint8_t shotResults = net::SHOT_RESULT_MISS;
 
                 // Если такая часть найдена
                 if(shipPart != nullptr){
@@ -359,26 +364,22 @@ void GameWindow::onReadyReadServerMessage()
                     shipPart->isDestroyed = true;
                     // Если корабль, которому принадлежит часть уничтожен
                     if(shipPart->ship->isDestroyed()){
-                        // Если все корабли на поле уничтожены - сообщить о победе
-                        if(myField_->allShipsDestroyed()){
-                            _server->sendMessage(net::MsgShotResults(net::SHOT_RESULT_WIN));
-                        }
-                        // Если не все корабли уничтожены, а только этот - сообщить об уничтожении
-                        else{
-                            _server->sendMessage(net::MsgShotResults(net::SHOT_RESULT_DESTROYED));
-                        }
+                        // Если все корабли на поле уничтожены - победа противника, иначе уничтожен только этот
+                        shotResults = myField_->allShipsDestroyed() ? net::SHOT_RESULT_WIN : net::SHOT_RESULT_DESTROYED;
                     }
                     // Если корабль не уничтожен - обычное попадание
                     else{
-                        _server->sendMessage(net::MsgShotResults(net::SHOT_RESULT_HIT));
+                        shotResults = net::SHOT_RESULT_HIT;
                     }
                 }
-                // Если часть не найдена - отправить сообщение о промашке
+                // Если часть не найдена - отметить промашку на поле
                 else{
-                    // Отметить промашку на поле
                     myField_->shotAt(point,GameField::ShotType::MISS);
-                    // Отправить сообщение
-                    _server->sendMessage(net::MsgShotResults(net::SHOT_RESULT_MISS));
+                }
+
+                // Сообщить итог (если его не определил сервер)
+                if(!this->authoritativeServer_){
+                    _server->sendMessage(net::MsgShotResults(shotResults));
                 }
 
                 break;
@@ -78,6 +78,9 @@ private:
         ENDGAME_DISCONNECTED
     } currentState_ = PREPARING;
 
+    /// Итоги ходов определяет сервер (отвечать на выстрелы противника не нужно)
+    bool authoritativeServer_ = false;
+
     /// Окно настроек подключения
     SettingsWindow* settingsWindow_ = nullptr;
     /// Окно присоединения к игре
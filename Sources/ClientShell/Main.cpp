@@ -1,11 +1,21 @@
 #include <iostream>
+#include <set>
+#include <deque>
 
 #include "../NetworkApi/Msg.hpp"
 #include "../NetworkApi/MsgGameStatus.hpp"
 #include "../NetworkApi/MsgShotAvailable.hpp"
 #include "../NetworkApi/MsgPlayerQuery.hpp"
 #include "../NetworkApi/MsgPlayerResponse.hpp"
+#include "../NetworkApi/MsgShotDetails.hpp"
 #include "../NetworkApi/MsgShotResults.hpp"
+#include "../NetworkApi/MsgLobbySubscribe.hpp"
+#include "../NetworkApi/MsgLobbyUpdate.hpp"
+#include "../NetworkApi/MsgResumeToken.hpp"
+#include "../NetworkApi/MsgResume.hpp"
+#include "../NetworkApi/MsgResumeState.hpp"
+#include "../NetworkApi/MsgServerBusy.hpp"
+#include "../NetworkApi/FleetBoard.hpp"
 #include "../NetworkApi/ServerPeer.hpp"
 
 /// Прослушиваемый порт
@@ -16,10 +26,104 @@ std::string _ip;
 unsigned _connectionType = 0;
 /// Ключ игровой сессии
 uintptr_t _sessionKey = 0;
+/// Токен возобновления текущей игры (0 - не выдан)
+uint64_t _resumeToken = 0;
 
 // Типы подключения
 constexpr unsigned CON_TYPE_NEW = 0;
 constexpr unsigned CON_TYPE_JOIN = 1;
+constexpr unsigned CON_TYPE_MATCH = 2;
+constexpr unsigned CON_TYPE_BROWSE = 3;
+
+/**
+ * Кол-во отмеченных клеток битовой карты
+ * @param cells Битовая карта (2 слова, см. FleetBoard)
+ * @return Кол-во
+ */
+static unsigned countCells(const uint64_t cells[2])
+{
+    unsigned count = 0;
+    for(unsigned index = 0; index < net::FleetBoard::CELLS; index++){
+        if(net::FleetBoard::testCell(cells, index)) count++;
+    }
+    return count;
+}
+
+/**
+ * Вывести итог выстрела
+ * @param result Итог (SHOT_RESULT_*)
+ */
+static void printShotResult(uint8_t result)
+{
+    std::cout << "Answer received: ";
+    if(result == net::SHOT_RESULT_MISS){
+        std::cout << "Miss" << std::endl;
+    }else if(result == net::SHOT_RESULT_HIT){
+        std::cout << "Hit" << std::endl;
+    }else if(result == net::SHOT_RESULT_DESTROYED){
+        std::cout << "Destroyed" << std::endl;
+    }else if(result == net::SHOT_RESULT_WIN){
+        std::cout << "Win" << std::endl;
+    }else{
+        std::cout << "Unrecognized (" << result << ")" << std::endl;
+    }
+}
+
+/**
+ * Вернуться в игру после разрыва соединения (по токену возобновления)
+ * @param server Соединение с сервером (заменяется новым)
+ * @param pending Сообщения, которые игра получила бы до разрыва (восстанавливаются по снимку игры)
+ * @return Возобновлена ли игра
+ */
+static bool resumeGame(net::ServerPeer& server, std::deque<net::Msg>& pending)
+{
+    server = net::ServerPeer(_ip.c_str(), _port);
+    if(!server.isConnected() || !server.sendMessage(net::MsgResume(_sessionKey, _resumeToken)))
+        return false;
+
+    auto response = server.waitForMessage();
+    if(response.getType() != net::MSG_RESUME_STATE || !response.toMsgResumeState().getState().resumed)
+        return false;
+
+    net::MsgResumeState::ResumeState state = response.toMsgResumeState().getState();
+    std::cout << "Game resumed. Your shots: " << countCells(state.enemyShots) << " (hits: " << countCells(state.enemyHits)
+              << "), enemy shots: " << countCells(state.ownShots) << "." << std::endl;
+
+    // Ход игрока, либо ожидание хода соперника (выстрел соперника, ожидающий ответа, передается повторно).
+    // Если ожидается итог собственного выстрела - он придет от сервера
+    if(state.turn && state.awaitingResults){
+        std::cout << "Waiting for answer to your shot..." << std::endl;
+    }else{
+        pending.push_back(net::MsgShotAvailable(state.turn != 0));
+        if(state.awaitingResults){
+            net::MsgShotDetails::ShotDetails details = {state.shotX, state.shotY};
+            pending.push_back(net::MsgShotDetails(details));
+        }
+    }
+    return true;
+}
+
+/**
+ * Сообщить об отклоненном запросе подключения к игре и установить новое соединение с сервером
+ * @param server Соединение с сервером (заменяется новым)
+ * @param response Ответ сервера на запрос
+ * @param request Название запроса (для вывода)
+ * @details Перегруженный сервер закрывает соединение после отказа, а за маршрутизатором соединение закреплено
+ * за сервером, выбранным по первому запросу, - поэтому повторный запрос выполняется на новом соединении
+ */
+static void reconnectAfterRefusal(net::ServerPeer& server, net::Msg& response, const char* request)
+{
+    if(response.getType() == net::MSG_SERVER_BUSY){
+        std::cout << "Server is busy. Retry in " << (response.toMsgServerBusy().getRetryAfter() + 999) / 1000 << " s." << std::endl;
+    }else{
+        std::cout << request << " request refused." << std::endl;
+    }
+
+    server = net::ServerPeer(_ip.c_str(), _port);
+    if(!server.isConnected()){
+        throw std::runtime_error("Error: Can not establish connection to server.");
+    }
+}
 
 /**
  * Точка входа
@@ -36,8 +140,8 @@ int main(int argc, char* argv[])
 
     try
     {
-        // Ввод IP адреса
-        std::cout << "Please enter IP: ";
+        // Ввод IP адреса (либо "unix:<путь>" - локальный сокет сервера на той же машине)
+        std::cout << "Please enter IP (or unix:<path>): ";
         std::getline(std::cin, _ip);
 
         // Ввод прослушиваемого порта
@@ -45,17 +149,6 @@ int main(int argc, char* argv[])
         std::cin >> _port;
         std::cin.ignore();
 
-        // Тип подключения (новая сессия или присоединение)
-        std::cout << "Please select connection type (0 - new, 1 - join): ";
-        std::cin >> _connectionType;
-        std::cin.ignore();
-
-        // Ввод ID'а сессии (если нужно)
-        if(_connectionType == 1){
-            std::cout << "Please enter session ID: ";
-            std::cin >> _sessionKey;
-        }
-
         // Объект для взаимодействия с сервером
         net::ServerPeer server(_ip.c_str(),_port);
 
@@ -66,169 +159,291 @@ int main(int argc, char* argv[])
 
         std::cout << "Connected to " << _ip << "(" << _port << ")" << std::endl;
 
-        // Присоединился ли игрок к игре
-        bool joined = false;
-
-        // Если запрашиваем новую сессию
-        if(_connectionType == CON_TYPE_NEW)
+        // Соединение остается открытым после окончания игры (сервер ожидает запроса следующей игры)
+        for(;;)
         {
-            if(server.sendMessage(net::MsgPlayerQuery())){
-                auto response = server.waitForMessage();
-                if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined){
-                    std::cout << "Joined to game. Session key - " << response.toMsgPlayerResponse().getResponseData().sessionKey << std::endl;
-                    joined = true;
-                }else{
-                    //TODO: Handle error
+            // Тип подключения (новая сессия или присоединение)
+            std::cout << "Please select connection type (0 - new, 1 - join, 2 - match with anyone, 3 - browse open sessions): ";
+            std::cin >> _connectionType;
+            std::cin.ignore();
+
+            // Ввод ID'а сессии (если нужно)
+            if(_connectionType == 1){
+                std::cout << "Please enter session ID: ";
+                std::cin >> _sessionKey;
+            }
+
+            // Выбор сессии из списка ожидающих второго игрока (далее - присоединение по ключу)
+            if(_connectionType == CON_TYPE_BROWSE)
+            {
+                if(!server.sendMessage(net::MsgLobbySubscribe())){
+                    throw std::runtime_error("Error: Can not send query to server.");
                 }
-            } else {
-                throw std::runtime_error("Error: Can not send query to server.");
+
+                // Снимок списка может занимать несколько сообщений
+                std::set<uintptr_t> openSessions;
+                bool truncated = false;
+                for(;;)
+                {
+                    auto update = server.waitForMessage();
+                    if(update.getType() != net::MSG_LOBBY_UPDATE){
+                        throw std::runtime_error("Error: Can not receive open sessions list.");
+                    }
+
+                    net::MsgLobbyUpdate::LobbyUpdate data = update.toMsgLobbyUpdate().getUpdate();
+                    for(unsigned i = 0; i < data.added; i++) openSessions.insert(data.keys[i]);
+                    for(unsigned i = data.added; i < static_cast<unsigned>(data.added + data.removed); i++) openSessions.erase(data.keys[i]);
+                    if(data.flags & net::MsgLobbyUpdate::LOBBY_SNAPSHOT_END){
+                        truncated = (data.flags & net::MsgLobbyUpdate::LOBBY_SNAPSHOT_TRUNCATED) != 0;
+                        break;
+                    }
+                }
+
+                std::cout << "Open sessions (" << openSessions.size() << "):" << std::endl;
+                for(uintptr_t key : openSessions){
+                    std::cout << "  " << key << std::endl;
+                }
+                if(truncated){
+                    std::cout << "  ... (more sessions are open than the server lists)" << std::endl;
+                }
+
+                std::cout << "Please enter session ID: ";
+                std::cin >> _sessionKey;
+                _connectionType = CON_TYPE_JOIN;
             }
-        }
-        // Если подключаемся к существующей сессии
-        else if(_connectionType == CON_TYPE_JOIN)
-        {
-            if(server.sendMessage(net::MsgPlayerQuery(_sessionKey))){
-                auto response = server.waitForMessage();
-                if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined){
-                    std::cout << "Joined to game." << std::endl;
-                    joined = true;
-                }else{
-                    //TODO: Handle error
+
+            // Присоединился ли игрок к игре
+            bool joined = false;
+
+            // Если запрашиваем новую сессию
+            if(_connectionType == CON_TYPE_NEW)
+            {
+                if(server.sendMessage(net::MsgPlayerQuery())){
+                    auto response = server.waitForMessage();
+                    if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined){
+                        _sessionKey = response.toMsgPlayerResponse().getResponseData().sessionKey;
+                        std::cout << "Joined to game. Session key - " << _sessionKey << std::endl;
+                        joined = true;
+                    }
+                    // Запрос отклонен (либо ответ не получен) - снова выбор типа подключения на новом соединении
+                    else{
+                        reconnectAfterRefusal(server, response, "New session");
+                        continue;
+                    }
+                } else {
+                    throw std::runtime_error("Error: Can not send query to server.");
                 }
             }
-            else {
-                throw std::runtime_error("Error: Can not send query to server.");
+            // Если подключаемся к существующей сессии
+            else if(_connectionType == CON_TYPE_JOIN)
+            {
+                if(server.sendMessage(net::MsgPlayerQuery(_sessionKey))){
+                    // Изменения списка сессий, отправленные до запроса, пропускаются
+                    auto response = server.waitForMessage();
+                    while(response.getType() == net::MSG_LOBBY_UPDATE){
+                        response = server.waitForMessage();
+                    }
+                    if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined){
+                        std::cout << "Joined to game." << std::endl;
+                        joined = true;
+                    }
+                    // Запрос отклонен (либо ответ не получен) - снова выбор типа подключения на новом соединении
+                    else{
+                        reconnectAfterRefusal(server, response, "Join");
+                        continue;
+                    }
+                }
+                else {
+                    throw std::runtime_error("Error: Can not send query to server.");
+                }
+            }
+            // Если ищем любого соперника
+            else if(_connectionType == CON_TYPE_MATCH)
+            {
+                if(server.sendMessage(net::MsgPlayerQuery(net::SESSION_KEY_ANY))){
+                    auto response = server.waitForMessage();
+                    if(response.getType() == net::MSG_PLR_RESPONSE && response.toMsgPlayerResponse().getResponseData().joined){
+                        _sessionKey = response.toMsgPlayerResponse().getResponseData().sessionKey;
+                        std::cout << "Joined to matchmaking. Session key - " << _sessionKey << std::endl;
+                        joined = true;
+                    }
+                    // Запрос отклонен (либо ответ не получен) - снова выбор типа подключения на новом соединении
+                    else{
+                        reconnectAfterRefusal(server, response, "Matchmaking");
+                        continue;
+                    }
+                }
+                else {
+                    throw std::runtime_error("Error: Can not send query to server.");
+                }
             }
-        }
-
-        // Если удалось присоединиться к игровой сессии
-        if(joined)
-        {
-            // Ожидаем сообщения о статусе игры
-            std::cout << "Waiting for game startup..." << std::endl;
-            auto msgGameStartup = server.waitForMessage();
 
-            // Если получили сообщение о статусе игры
-            if(msgGameStartup.getType() == net::MSG_GAME_STATUS)
+            // Если удалось присоединиться к игровой сессии
+            if(joined)
             {
-                // Если игра запущена
-                if(msgGameStartup.toMsgGameStatus().getStatus() == net::GAME_RUNNING)
-                {
-                    std::cout << "Game in process." << std::endl;
+                // Ожидаем сообщения о статусе игры
+                std::cout << "Waiting for game startup..." << std::endl;
+                auto msgGameStartup = server.waitForMessage();
 
-                    // Запуск основного цикла
-                    while(true)
+                // Если получили сообщение о статусе игры
+                if(msgGameStartup.getType() == net::MSG_GAME_STATUS)
+                {
+                    // Если игра запущена
+                    if(msgGameStartup.toMsgGameStatus().getStatus() == net::GAME_RUNNING)
                     {
-                        // Ожидаем информацию о том чей ход
-                        std::cout << "Whose turn?" << std::endl;
-                        auto serverMsg = server.waitForMessage();
+                        std::cout << "Game in process." << std::endl;
+
+                        // Сообщения, восстановленные по снимку игры после возвращения (читаются раньше сообщений сервера)
+                        std::deque<net::Msg> pending;
+                        auto nextMessage = [&]() -> net::Msg {
+                            if(pending.empty())
+                                return server.waitForMessage();
+                            net::Msg message = std::move(pending.front());
+                            pending.pop_front();
+                            return message;
+                        };
+                        _resumeToken = 0;
 
-                        // Если это информация о ходе
-                        if(serverMsg.getType() == net::MSG_SHOT_AVAILABLE)
+                        // Запуск основного цикла
+                        while(true)
                         {
-                            /// Если игрок ходит
-                            if(serverMsg.toMsgShotAvailable().isAvailable())
+                            // Ожидаем информацию о том чей ход
+                            std::cout << "Whose turn?" << std::endl;
+                            auto serverMsg = nextMessage();
+
+                            // Если это информация о ходе
+                            if(serverMsg.getType() == net::MSG_SHOT_AVAILABLE)
                             {
-                                std::cout << "My turn!" << std::endl;
+                                /// Если игрок ходит
+                                if(serverMsg.toMsgShotAvailable().isAvailable())
+                                {
+                                    std::cout << "My turn!" << std::endl;
 
-                                // Ввод хода
-                                net::MsgShotDetails::ShotDetails details = {};
-                                std::cout << "x: "; std::cin >> details.x;
-                                std::cout << "y: "; std::cin >> details.y;
-                                std::cin.ignore();
+                                    // Ввод хода
+                                    net::MsgShotDetails::ShotDetails details = {};
+                                    std::cout << "x: "; std::cin >> details.x;
+                                    std::cout << "y: "; std::cin >> details.y;
+                                    std::cin.ignore();
 
-                                // Отправка хода серверу
-                                if(server.sendMessage(net::MsgShotDetails(details)))
-                                {
-                                    std::cout << "Sent. Waiting for answer" << std::endl;
-                                    auto msgResult = server.waitForMessage();
-                                    if(msgResult.getType() == net::MSG_SHOT_RESULTS){
-                                        std::cout << "Answer received: ";
-                                        uint8_t result = msgResult.toMsgShotResults().getResults();
-
-                                        if(result == net::SHOT_RESULT_MISS){
-                                            std::cout << "Miss" << std::endl;
-                                        }else if(result == net::SHOT_RESULT_HIT){
-                                            std::cout << "Hit" << std::endl;
-                                        }else if(result == net::SHOT_RESULT_DESTROYED){
-                                            std::cout << "Destroyed" << std::endl;
-                                        }else if(result == net::SHOT_RESULT_WIN){
-                                            std::cout << "Win" << std::endl;
+                                    // Отправка хода серверу
+                                    if(server.sendMessage(net::MsgShotDetails(details)))
+                                    {
+                                        std::cout << "Sent. Waiting for answer" << std::endl;
+                                        auto msgResult = nextMessage();
+                                        if(msgResult.getType() == net::MSG_SHOT_RESULTS){
+                                            printShotResult(msgResult.toMsgShotResults().getResults());
                                         }else{
-                                            std::cout << "Unrecognized (" << result << ")" << std::endl;
+                                            // Сообщение обрабатывается основным циклом (при разрыве соединения - возвращение в игру)
+                                            pending.push_front(std::move(msgResult));
                                         }
-                                    }else{
-                                        //TODO: Handle error
+                                    }
+                                    else {
+                                        throw std::runtime_error("Error: Can not send to server.");
                                     }
                                 }
-                                else {
-                                    throw std::runtime_error("Error: Can not send to server.");
-                                }
-                            }
-                            /// Если игрок ожидает
-                            else
-                            {
-                                std::cout << "2nd player's turn. Waiting..." << std::endl;
-
-                                // Ожидаем информацию о ходе
-                                auto shotDetails = server.waitForMessage();
-                                if(shotDetails.getType() == net::MSG_SHOT_DETAILS)
+                                /// Если игрок ожидает
+                                else
                                 {
-                                    // Вывод информации о ходе противника
-                                    auto details = shotDetails.toMsgShotDetails().getDetails();
-                                    std::cout << "2nd players shot: x = " << details.x << ", y = " << details.y << std::endl;
-
-                                    // Ввод ответа (попал, не попал и прочее)
-                                    uint8_t result;
-                                    short iResult;
-                                    std::cout << "Answer to player (0 - miss, 1 - hit, 2 - destroyed, 3 - win): ";
-                                    std::cin >> iResult;
-                                    result = static_cast<uint8_t>(iResult);
-                                    std::cin.ignore();
+                                    std::cout << "2nd player's turn. Waiting..." << std::endl;
+
+                                    // Ожидаем информацию о ходе
+                                    auto shotDetails = nextMessage();
+                                    if(shotDetails.getType() == net::MSG_SHOT_DETAILS)
+                                    {
+                                        // Вывод информации о ходе противника
+                                        auto details = shotDetails.toMsgShotDetails().getDetails();
+                                        std::cout << "2nd players shot: x = " << details.x << ", y = " << details.y << std::endl;
+
+                                        // Ввод ответа (попал, не попал и прочее)
+                                        uint8_t result;
+                                        short iResult;
+                                        std::cout << "Answer to player (0 - miss, 1 - hit, 2 - destroyed, 3 - win): ";
+                                        std::cin >> iResult;
+                                        result = static_cast<uint8_t>(iResult);
+                                        std::cin.ignore();
 
-                                    // Отправка ответа
-                                    if(server.sendMessage(net::MsgShotResults(result))){
-                                        std::cout << "Answer sent. " << std::endl;
+                                        // Отправка ответа
+                                        if(server.sendMessage(net::MsgShotResults(result))){
+                                            std::cout << "Answer sent. " << std::endl;
+                                        }else{
+                                            throw std::runtime_error("Error: Can not send to server.");
+                                        }
                                     }else{
-                                        throw std::runtime_error("Error: Can not send to server.");
+                                        // Сообщение обрабатывается основным циклом (при разрыве соединения - возвращение в игру)
+                                        pending.push_front(std::move(shotDetails));
                                     }
-                                }else{
-                                    //TODO: Handle error
                                 }
                             }
-                        }
-                        else if(serverMsg.getType() == net::MSG_GAME_STATUS) {
-                            switch(serverMsg.toMsgGameStatus().getStatus())
-                            {
-                                case net::GAME_OVER_DISCONNECTED:
-                                    std::cout << "2nd player disconnected." << std::endl;
+                            // Токен для возвращения в игру после разрыва соединения
+                            else if(serverMsg.getType() == net::MSG_RESUME_TOKEN) {
+                                _resumeToken = serverMsg.toMsgResumeToken().getToken();
+                                std::cout << "Resume token: " << _resumeToken << std::endl;
+                            }
+                            // Итог выстрела, сделанного до разрыва соединения
+                            else if(serverMsg.getType() == net::MSG_SHOT_RESULTS) {
+                                printShotResult(serverMsg.toMsgShotResults().getResults());
+                            }
+                            // Соединение разорвано - игрок может вернуться в игру по токену (пока сервер ожидает его)
+                            else if(serverMsg.getType() == net::MSG_UNDEFINED) {
+                                if(_resumeToken == 0){
+                                    std::cout << "Connection lost." << std::endl;
                                     break;
-                                case net::GAME_OVER_WIN:
-                                    std::cout << "You win" << std::endl;
+                                }
+                                std::cout << "Connection lost. Resume game? (y/n): ";
+                                std::string answer;
+                                std::getline(std::cin >> std::ws, answer);
+                                if(answer != "y" && answer != "Y")
                                     break;
-                                case net::GAME_OVER_LOOSE:
-                                    std::cout << "You loose" << std::endl;
+                                if(!resumeGame(server, pending)){
+                                    std::cout << "Can't resume game." << std::endl;
                                     break;
+                                }
+                            }
+                            else if(serverMsg.getType() == net::MSG_GAME_STATUS) {
+                                switch(serverMsg.toMsgGameStatus().getStatus())
+                                {
+                                    case net::GAME_OVER_DISCONNECTED:
+                                        std::cout << "2nd player disconnected." << std::endl;
+                                        break;
+                                    case net::GAME_OVER_WIN:
+                                        std::cout << "You win" << std::endl;
+                                        break;
+                                    case net::GAME_OVER_LOOSE:
+                                        std::cout << "You loose" << std::endl;
+                                        break;
+                                }
+                                break;
+                            } else {
+                                std::cout << "Unexpected message type. Expected types -"
+                                          << (int)net::MSG_SHOT_AVAILABLE << ", " << (int)net::MSG_GAME_STATUS << " got - "
+                                          << (int)serverMsg.getType()
+                                          << std::endl;
                             }
-                            break;
-                        } else {
-                            std::cout << "Unexpected message type. Expected types -"
-                                      << (int)net::MSG_SHOT_AVAILABLE << ", " << (int)net::MSG_GAME_STATUS << " got - "
-                                      << (int)serverMsg.getType()
-                                      << std::endl;
                         }
+                    } else {
+                        std::cout << "Can't start game. Expected status - "
+                                  << (int)net::GAME_RUNNING << ", got - "
+                                  << (int)msgGameStartup.toMsgGameStatus().getStatus()
+                                  << std::endl;
                     }
                 } else {
-                    std::cout << "Can't start game. Expected status - "
-                              << (int)net::GAME_RUNNING << ", got - "
-                              << (int)msgGameStartup.toMsgGameStatus().getStatus()
+                    std::cout << "Received wrong message. Expected - "
+                              << (int)net::MSG_GAME_STATUS << ", got - "
+                              << (int)msgGameStartup.getType()
                               << std::endl;
                 }
-            } else {
-                std::cout << "Received wrong message. Expected - "
-                          << (int)net::MSG_GAME_STATUS << ", got - "
-                          << (int)msgGameStartup.getType()
-                          << std::endl;
+            }
+
+            // Следующая игра на том же соединении
+            std::cout << "Play again on the same connection? (y/n): ";
+            std::string answer;
+            std::getline(std::cin >> std::ws, answer);
+            if(answer != "y" && answer != "Y")
+                break;
+
+            // Сервер закрывает соединение, если не оставляет его для следующей игры
+            if(!server.isConnected()){
+                throw std::runtime_error("Error: Connection closed by server.");
             }
         }
     }
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <QTcpServer>
+#include <QTcpSocket>
+
 #include "Msg.hpp"
-#include "MsgShotDetails.hpp"
-#include "MsgPlayerResponse.hpp"
+#include "MsgCodec.hpp"
+#include "MsgChannel.hpp"
 
 #include <thread>
 #include <chrono>
@@ -17,6 +20,17 @@ namespace net
     protected:
         /// Подключение (сокет)
         QTcpSocket* connection_;
+        /// Исходящие сообщения, ожидающие записи в сокет (см. postMessage)
+        QByteArray outbox_;
+        /// Пределы очереди исходящих данных (0 - без предела, см. setOutboxLimits)
+        qint64 outboxHighWater_;
+        qint64 outboxLimit_;
+        /// Байт в буфере записи сокета после последней записи очереди
+        qint64 unsentBytes_;
+        /// Отключен как медленный получатель (очередь превысила предел)
+        bool slowConsumer_;
+        /// Канал, к которому относятся следующие входящие сообщения (см. waitForChannelMessage)
+        uint32_t inboundChannel_;
 
     public:
         /**
@@ -24,13 +38,18 @@ namespace net
          * @param connectionSocket Соединение
          */
         explicit BasePeer(QTcpSocket* connectionSocket):
-                connection_(connectionSocket){}
+                connection_(connectionSocket),
+                outboxHighWater_(0),
+                outboxLimit_(0),
+                unsentBytes_(0),
+                slowConsumer_(false),
+                inboundChannel_(0){}
 
         /**
-        * Очистка
+        * Очистка (удаление сокета откладывается, см. releaseConnection)
         */
         ~BasePeer(){
-            delete connection_;
+            this->releaseConnection();
         }
 
         /**
@@ -51,8 +70,14 @@ namespace net
          * @param other R-value ссылка на другой объект
          * @details Нельзя копировать объект, но можно обменяться с ним ресурсом
          */
-        BasePeer(BasePeer&& other) noexcept : connection_(nullptr){
+        BasePeer(BasePeer&& other) noexcept : connection_(nullptr), outboxHighWater_(0), outboxLimit_(0), unsentBytes_(0), slowConsumer_(false), inboundChannel_(0){
             std::swap(connection_,other.connection_);
+            std::swap(outbox_,other.outbox_);
+            std::swap(outboxHighWater_,other.outboxHighWater_);
+            std::swap(outboxLimit_,other.outboxLimit_);
+            std::swap(unsentBytes_,other.unsentBytes_);
+            std::swap(slowConsumer_,other.slowConsumer_);
+            std::swap(inboundChannel_,other.inboundChannel_);
         }
 
         /**
@@ -63,10 +88,20 @@ namespace net
         BasePeer& operator=(BasePeer&& other) noexcept{
             if (this == &other) return *this;
 
-            delete connection_;
-            connection_= nullptr;
+            // Прежний сокет удаляется так же, как в деструкторе (присваивание возможно из обработчика его сигнала)
+            this->releaseConnection();
+            outbox_.clear();
+            unsentBytes_ = 0;
+            slowConsumer_ = false;
+            inboundChannel_ = 0;
 
             std::swap(connection_,other.connection_);
+            std::swap(outbox_,other.outbox_);
+            std::swap(outboxHighWater_,other.outboxHighWater_);
+            std::swap(outboxLimit_,other.outboxLimit_);
+            std::swap(unsentBytes_,other.unsentBytes_);
+            std::swap(slowConsumer_,other.slowConsumer_);
+            std::swap(inboundChannel_,other.inboundChannel_);
 
             return *this;
         }
@@ -79,6 +114,30 @@ namespace net
             return connection_;
         }
 
+        /**
+         * Размер полезной нагрузки сообщения заданного типа
+         * @param msgType Тип сообщения
+         * @return Размер в байтах
+         */
+        static size_t payloadSizeOf(uint8_t msgType){
+            return MsgCodec::payloadSizeOf(msgType);
+        }
+
+        /**
+         * Получено ли сообщение целиком (не блокирует)
+         * @return Да или нет
+         */
+        bool hasMessage(){
+            if(connection_ == nullptr || connection_->bytesAvailable() < static_cast<qint64>(sizeof(uint8_t)))
+                return false;
+
+            // Тип сообщения читается без извлечения из буфера сокета
+            uint8_t msgType = MSG_UNDEFINED;
+            connection_->peek(reinterpret_cast<char*>(&msgType), sizeof(uint8_t));
+
+            return connection_->bytesAvailable() >= static_cast<qint64>(sizeof(uint8_t) + payloadSizeOf(msgType));
+        }
+
         /**
          * Читать сообщение
          * @param maxAttempts Количество попыток при неудачном прочтении полезной нагрузки
@@ -97,27 +156,7 @@ namespace net
                 connection_->read(reinterpret_cast<char*>(&msgType), sizeof(uint8_t));
 
                 // В зависимости от типа определить размер полезной нагрузки
-                switch(msgType){
-                    case MSG_SHOT_AVAILABLE:
-                        payloadSize = sizeof(bool);
-                        break;
-                    case MSG_GAME_STATUS:
-                    case MSG_SHOT_RESULTS:
-                        payloadSize = sizeof(uint8_t);
-                        break;
-                    case MSG_SHOT_DETAILS:
-                        payloadSize = sizeof(MsgShotDetails::ShotDetails);
-                        break;
-                    case MSG_PLR_QUERY:
-                        payloadSize = sizeof(uintptr_t);
-                        break;
-                    case MSG_PLR_RESPONSE:
-                        payloadSize = sizeof(MsgPlayerResponse::PlayerResponse);
-                        break;
-                    default:
-                        payloadSize = 0;
-                        break;
-                }
+                payloadSize = payloadSizeOf(msgType);
             }
 
             // Создать объект сообщения
@@ -128,7 +167,7 @@ namespace net
                 // Читать покуда не будут прочтены все байты полезной нагрузки и покуда не превышено кол-во попыток (если считать не получается)
                 size_t readBytesTotal = 0;
                 do {
-                    size_t readBytes = connection_->read(msg.payload_,msg.payloadSize_ - readBytesTotal);
+                    size_t readBytes = connection_->read(msg.payload_ + readBytesTotal,msg.payloadSize_ - readBytesTotal);
                     readBytesTotal += readBytes;
                     if(readBytes == 0) maxAttempts--;
                 } while(readBytesTotal < msg.payloadSize_ && maxAttempts > 0);
@@ -145,12 +184,25 @@ namespace net
          * @return Объект сообщения
          */
         Msg waitForMessage(int timeout = -1, unsigned maxAttempts = 10){
-            // Ожидать готовности чтения
-            if(connection_ != nullptr && connection_->waitForReadyRead(timeout))
+            for(;;)
             {
-                return this->readMessage(maxAttempts);
+                Msg message(MSG_UNDEFINED, 0);
+
+                // Сообщение могло прийти вместе с предыдущим и уже находиться в буфере сокета
+                if(this->hasMessage())
+                {
+                    message = this->readMessage(maxAttempts);
+                }
+                // Ожидать готовности чтения
+                else if(connection_ != nullptr && connection_->waitForReadyRead(timeout))
+                {
+                    message = this->readMessage(maxAttempts);
+                }
+
+                // Проверочные сообщения сервера не относятся к игре - ожидается следующее
+                if(message.getType() != MSG_HEARTBEAT)
+                    return message;
             }
-            return Msg(MSG_UNDEFINED, 0);
         }
 
         /**
@@ -175,6 +227,119 @@ namespace net
             return false;
         }
 
+        /**
+         * Отправка сообщения в канал соединения (несколько игр на одном соединении, см. MsgChannel)
+         * @param channel Номер канала
+         * @param message Сообщение
+         * @param timeout Время ожидания окончания записи данных
+         * @return Удалось ли отправить
+         * @details Метка канала и сообщение пишутся одной записью (без паузы перед отправкой)
+         */
+        bool sendChannelMessage(uint32_t channel, const Msg& message, int timeout = -1){
+            if(connection_ == nullptr)
+                return false;
+
+            std::string data;
+            MsgCodec::encode(MsgChannel(channel), data);
+            MsgCodec::encode(message, data);
+            connection_->write(data.data(), static_cast<qint64>(data.size()));
+            return connection_->waitForBytesWritten(timeout);
+        }
+
+        /**
+         * Ожидать сообщения любого канала соединения
+         * @param channel Канал, к которому относится сообщение (для MSG_CHANNEL_CLOSE - закрытый сервером канал)
+         * @param timeout Время ожидания получения
+         * @return Объект сообщения (MSG_UNDEFINED - сообщения нет, либо соединение разорвано)
+         */
+        Msg waitForChannelMessage(uint32_t& channel, int timeout = -1){
+            for(;;)
+            {
+                // Метка канала относит к нему все следующие сообщения
+                Msg message = this->waitForMessage(timeout);
+                if(message.getType() == MSG_CHANNEL){
+                    inboundChannel_ = message.toMsgChannel().getChannel();
+                    continue;
+                }
+
+                channel = message.getType() == MSG_CHANNEL_CLOSE ? message.toMsgChannel().getChannel() : inboundChannel_;
+                return message;
+            }
+        }
+
+        /**
+         * Отправка сообщения без ожидания (для работы в цикле событий)
+         * @param message Сообщение
+         * @return Удалось ли поместить сообщение в очередь отправки
+         * @details Сообщение только помещается в очередь, сокет не затрагивается. Поэтому вызов допустим из любого потока
+         * (например, из потока пула, выполняющего сессию), но запись в сокет выполняет его владелец через flushOutbox
+         */
+        bool postMessage(const Msg& message){
+            if(connection_ == nullptr)
+                return false;
+
+            // Получателю с большой очередью проверочные сообщения не нужны (о разрыве сообщит сама очередь)
+            if(message.type_ == MSG_HEARTBEAT && outboxHighWater_ > 0 && this->queuedBytes() >= outboxHighWater_)
+                return true;
+
+            outbox_.append(reinterpret_cast<const char*>(&message.type_), sizeof(uint8_t));
+            outbox_.append(message.payload_, static_cast<int>(message.payloadSize_));
+            return true;
+        }
+
+        /**
+         * Записать в сокет очередь исходящих сообщений (вызывается только из потока сокета)
+         * @return Удалось ли записать
+         */
+        bool flushOutbox(){
+            if(outbox_.isEmpty())
+                return true;
+
+            bool written = false;
+            if(connection_ != nullptr && connection_->state() == QTcpSocket::ConnectedState){
+                written = connection_->write(outbox_) == outbox_.size();
+                unsentBytes_ = connection_->bytesToWrite();
+
+                // Получатель не успевает принимать данные - соединение разрывается, чтобы его очередь не росла
+                // без предела (разрыв обрабатывается как обычное отключение)
+                if(outboxLimit_ > 0 && unsentBytes_ > outboxLimit_){
+                    slowConsumer_ = true;
+                    written = false;
+                    connection_->abort();
+                }
+            }
+
+            outbox_.clear();
+            return written;
+        }
+
+        /**
+         * Задать пределы очереди исходящих данных (0 - без предела)
+         * @param highWater Объем, начиная с которого проверочные сообщения не ставятся в очередь
+         * @param limit Объем, при превышении которого получатель отключается как медленный
+         */
+        void setOutboxLimits(qint64 highWater, qint64 limit){
+            outboxHighWater_ = highWater;
+            outboxLimit_ = limit;
+        }
+
+        /**
+         * Объем исходящих данных, еще не отправленных получателю (очередь и буфер записи сокета на момент
+         * последней записи очереди)
+         * @return Кол-во байт
+         */
+        qint64 queuedBytes() const{
+            return outbox_.size() + unsentBytes_;
+        }
+
+        /**
+         * Отключен ли игрок как медленный получатель
+         * @return Да или нет
+         */
+        bool isSlowConsumer() const{
+            return slowConsumer_;
+        }
+
         /**
          * Подключен ли игрок
          * @return Да или нет
@@ -182,5 +347,23 @@ namespace net
         bool isConnected(){
             return (this->connection_ != nullptr) && (this->connection_->state() == QTcpSocket::ConnectedState);
         }
+
+    private:
+        /**
+         * Отказаться от сокета
+         * @details Сокет может уничтожаться изнутри обработчика собственного сигнала (серверный цикл событий),
+         * поэтому его удаление откладывается до закрытия соединения (дописываются отправленные ранее данные)
+         */
+        void releaseConnection(){
+            if(connection_ != nullptr){
+                if(connection_->state() == QAbstractSocket::UnconnectedState){
+                    connection_->deleteLater();
+                }else{
+                    QObject::connect(connection_, SIGNAL(disconnected()), connection_, SLOT(deleteLater()));
+                    connection_->disconnectFromHost();
+                }
+                connection_ = nullptr;
+            }
+        }
     };
 }
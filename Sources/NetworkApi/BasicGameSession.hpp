@@ -0,0 +1,715 @@
+#pragma once
+
+#include "Msg.hpp"
+#include "MsgGameStatus.hpp"
+#include "MsgShotAvailable.hpp"
+#include "MsgShotDetails.hpp"
+#include "MsgShotResults.hpp"
+#include "MsgSpectatorEvent.hpp"
+#include "MsgResumeToken.hpp"
+#include "MsgResumeState.hpp"
+#include "FleetBoard.hpp"
+
+#include <vector>
+#include <random>
+#include <chrono>
+
+namespace net
+{
+    /**
+     * Игровая сессия (правила игры и очередность ходов)
+     * Не зависит от транспорта: игрок (Peer) должен уметь помещать сообщение в очередь отправки (postMessage)
+     * и сообщать о состоянии соединения (isConnected) по флагу, который сбрасывается событием отключения
+     * (markDisconnected), а не по сокету - сессия может выполняться в потоке пула. Для наблюдателей сессия только накапливает события
+     * (см. takeSpectatorEvents) - рассылает их сервер, поэтому число наблюдателей не влияет на обработку ходов.
+     * Возобновляемая сессия (см. setResumable) при отключении игрока приостанавливается: игрок может вернуться
+     * по токену (см. resume), срок ожидания отслеживает сервер (см. onResumeExpired)
+     * @tparam Peer Тип игрока
+     */
+    template <typename Peer>
+    class BasicGameSession
+    {
+    public:
+        /// Этап игровой сессии
+        enum Stage {
+            // Ожидание второго игрока
+            LOBBY,
+            // Ожидание хода активного игрока
+            AWAITING_SHOT,
+            // Ожидание итогов хода от ожидающего игрока
+            AWAITING_RESULTS,
+            // Игра завершена
+            FINISHED
+        };
+
+        /// Состояние сессии без игроков (для передачи сессии другому процессу)
+        struct State {
+            // Этап
+            uint8_t stage;
+            // Индекс активного игрока
+            uint8_t activePlayerIndex;
+            // Итоги ходов определяет сессия
+            uint8_t authoritative;
+            // Счетчик ходов
+            uint64_t moves;
+            // Клетки кораблей и клетки, по которым стреляли (для каждого игрока)
+            uint64_t ships[2][2];
+            uint64_t shots[2][2];
+            // Возобновляемая ли сессия, токены возобновления игроков
+            uint8_t resumable;
+            uint64_t resumeTokens[2];
+            // Выстрел, ожидающий итога (итоги ходов определяют клиенты)
+            uint64_t pendingShot[2];
+            // Клетки поля каждого игрока, по которым стреляли, и попадания среди них (итоги ходов определяют клиенты)
+            uint64_t relayShots[2][2];
+            uint64_t relayHits[2][2];
+        };
+
+    private:
+        /// Массив игроков
+        std::vector<Peer> players_;
+        /// Индекс активного игрока
+        int activePlayerIndex_;
+        /// Текущий этап
+        Stage stage_;
+        /// Счетчик ходов (меняется при каждой смене этапа ожидания, позволяет отличить просроченный ход от текущего)
+        uint64_t moves_;
+        /// Расстановки кораблей игроков (если переданы)
+        FleetBoard fleets_[2];
+        /// Итоги ходов определяет сессия (обе расстановки известны)
+        bool authoritative_;
+        /// Накапливаются ли события для наблюдателей
+        bool spectated_ = false;
+        /// События для наблюдателей с прошлого извлечения
+        std::vector<MsgSpectatorEvent::SpectatorEvent> spectatorEvents_;
+        /// Можно ли вернуться в игру после разрыва соединения
+        bool resumable_ = false;
+        /// Токены возобновления игроков (выдаются при начале игры, 0 - не выдан)
+        uint64_t resumeTokens_[2] = {0, 0};
+        /// Выстрел, переданный ожидающему игроку (итог еще не получен)
+        MsgShotDetails::ShotDetails pendingShot_ = {0, 0};
+        /// Поля игроков по итогам, переданным клиентами (итоги ходов определяют клиенты): клетки, по которым
+        /// стреляли, и попадания среди них - для снимка игры вернувшемуся игроку
+        uint64_t relayShots_[2][2] = {{0, 0}, {0, 0}};
+        uint64_t relayHits_[2][2] = {{0, 0}, {0, 0}};
+
+    public:
+        /**
+         * Конструктор
+         */
+        BasicGameSession():activePlayerIndex_(0),stage_(LOBBY),moves_(0),authoritative_(false){};
+
+        /**
+         * Деструктор
+         */
+        ~BasicGameSession() = default;
+
+        /**
+         * Запрет копирования через инициализацию
+         * @param other Ссылка на копируемый объекта
+         */
+        BasicGameSession(const BasicGameSession& other) = delete;
+
+        /**
+         * Запрет копирования через присваивание
+         * @param other Ссылка на копируемый объекта
+         * @return Ссылка на текущий объект
+         */
+        BasicGameSession& operator=(const BasicGameSession& other) = delete;
+
+        /**
+         * Конструктор перемещения
+         * @param other R-value ссылка на другой объект
+         * @details Нельзя копировать объект, но можно обменяться с ним ресурсом
+         */
+        BasicGameSession(BasicGameSession&& other) noexcept : activePlayerIndex_(0),stage_(LOBBY),moves_(0),authoritative_(false){
+            std::swap(activePlayerIndex_,other.activePlayerIndex_);
+            std::swap(stage_,other.stage_);
+            std::swap(moves_,other.moves_);
+            std::swap(fleets_,other.fleets_);
+            std::swap(authoritative_,other.authoritative_);
+            std::swap(players_,other.players_);
+            std::swap(spectated_,other.spectated_);
+            std::swap(spectatorEvents_,other.spectatorEvents_);
+            std::swap(resumable_,other.resumable_);
+            std::swap(resumeTokens_,other.resumeTokens_);
+            std::swap(pendingShot_,other.pendingShot_);
+            std::swap(relayShots_,other.relayShots_);
+            std::swap(relayHits_,other.relayHits_);
+        }
+
+        /**
+         * Перемещение через присваивание
+         * @param other R-value ссылка на другой объект
+         * @return Ссылка на текущий объект
+         */
+        BasicGameSession& operator=(BasicGameSession&& other) noexcept{
+            if (this == &other) return *this;
+
+            activePlayerIndex_ = 0;
+            stage_ = LOBBY;
+            moves_ = 0;
+            authoritative_ = false;
+
+            std::swap(activePlayerIndex_,other.activePlayerIndex_);
+            std::swap(stage_,other.stage_);
+            std::swap(moves_,other.moves_);
+            std::swap(fleets_,other.fleets_);
+            std::swap(authoritative_,other.authoritative_);
+            std::swap(players_,other.players_);
+            std::swap(spectated_,other.spectated_);
+            std::swap(spectatorEvents_,other.spectatorEvents_);
+            std::swap(resumable_,other.resumable_);
+            std::swap(resumeTokens_,other.resumeTokens_);
+            std::swap(pendingShot_,other.pendingShot_);
+            std::swap(relayShots_,other.relayShots_);
+            std::swap(relayHits_,other.relayHits_);
+
+            return *this;
+        }
+
+        /**
+         * Добавить игрока
+         * @param playerPeer Игрок
+         * @return Удалось ли добавить ? (можно добавить не более двух)
+         */
+        bool addPlayer(Peer&& playerPeer){
+            if(players_.size() < 2){
+                players_.push_back(std::move(playerPeer));
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * Задать расстановку кораблей игрока (до начала игры)
+         * @param playerIndex Индекс игрока
+         * @param fleet Расстановка (проверенная, см. FleetBoard::load)
+         */
+        void setFleet(int playerIndex, const FleetBoard& fleet){
+            if(playerIndex >= 0 && playerIndex < 2 && stage_ == LOBBY){
+                fleets_[playerIndex] = fleet;
+            }
+        }
+
+        /**
+         * Определяет ли сессия итоги ходов
+         * @return Да или нет
+         */
+        bool isAuthoritative() const{
+            return authoritative_;
+        }
+
+        /**
+         * Получить состояние сессии (без игроков)
+         * @return Состояние
+         */
+        State getState() const{
+            State state = {};
+            state.stage = static_cast<uint8_t>(stage_);
+            state.activePlayerIndex = static_cast<uint8_t>(activePlayerIndex_);
+            state.authoritative = authoritative_ ? 1 : 0;
+            state.moves = moves_;
+            for(int i = 0; i < 2; i++){
+                memcpy(state.ships[i], fleets_[i].cells(), sizeof(state.ships[i]));
+                memcpy(state.shots[i], fleets_[i].shots(), sizeof(state.shots[i]));
+                state.resumeTokens[i] = resumeTokens_[i];
+            }
+            state.resumable = resumable_ ? 1 : 0;
+            state.pendingShot[0] = pendingShot_.x;
+            state.pendingShot[1] = pendingShot_.y;
+            memcpy(state.relayShots, relayShots_, sizeof(state.relayShots));
+            memcpy(state.relayHits, relayHits_, sizeof(state.relayHits));
+            return state;
+        }
+
+        /**
+         * Восстановить состояние сессии (игроки добавляются до этого в прежнем порядке)
+         * @param state Состояние
+         * @details Расстановки проверяются заново, выстрелы по ним повторяются
+         */
+        void setState(const State& state){
+            stage_ = state.stage <= FINISHED ? static_cast<Stage>(state.stage) : FINISHED;
+            activePlayerIndex_ = state.activePlayerIndex != 0 ? 1 : 0;
+            moves_ = state.moves;
+            for(int i = 0; i < 2; i++){
+                fleets_[i] = FleetBoard();
+                if((state.ships[i][0] | state.ships[i][1]) != 0 && fleets_[i].load(state.ships[i])){
+                    fleets_[i].replayShots(state.shots[i]);
+                }
+            }
+            authoritative_ = state.authoritative != 0 && fleets_[0].isValid() && fleets_[1].isValid();
+            resumable_ = state.resumable != 0;
+            resumeTokens_[0] = state.resumeTokens[0];
+            resumeTokens_[1] = state.resumeTokens[1];
+            pendingShot_.x = static_cast<size_t>(state.pendingShot[0]);
+            pendingShot_.y = static_cast<size_t>(state.pendingShot[1]);
+            memcpy(relayShots_, state.relayShots, sizeof(relayShots_));
+            memcpy(relayHits_, state.relayHits, sizeof(relayHits_));
+        }
+
+        /**
+         * Разрешить возвращение в игру после разрыва соединения (до начала игры)
+         * @param resumable Выдавать ли игрокам токены возобновления
+         */
+        void setResumable(bool resumable){
+            if(stage_ == LOBBY){
+                resumable_ = resumable;
+            }
+        }
+
+        /**
+         * Найти отключенного игрока, который может вернуться в игру по токену
+         * @param token Токен возобновления
+         * @return Индекс игрока, либо -1 (токен не подходит, игрок подключен, либо игра не идет)
+         */
+        int findResumable(uint64_t token){
+            if(!resumable_ || token == 0 || (stage_ != AWAITING_SHOT && stage_ != AWAITING_RESULTS))
+                return -1;
+
+            for(size_t i = 0; i < players_.size() && i < 2; i++){
+                if(resumeTokens_[i] == token && !players_[i].isConnected()){
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+
+        /**
+         * Вернуть игрока в игру на новом соединении (отправляет ему снимок игры)
+         * @param playerIndex Индекс игрока (см. findResumable)
+         * @param playerPeer Игрок на новом соединении
+         * @details Прежнее соединение игрока уничтожается. Сообщения, отправленные игроку за время отключения,
+         * утеряны - снимок содержит все, что нужно для продолжения игры
+         */
+        void resume(int playerIndex, Peer&& playerPeer){
+            {
+                Peer previous(std::move(players_[playerIndex]));
+            }
+            players_[playerIndex] = std::move(playerPeer);
+            players_[playerIndex].postMessage(MsgResumeState(this->resumeState(playerIndex)));
+        }
+
+        /**
+         * Включить или выключить накопление событий для наблюдателей
+         * @param spectated Есть ли у сессии наблюдатели
+         */
+        void setSpectated(bool spectated){
+            spectated_ = spectated;
+            if(!spectated_) spectatorEvents_.clear();
+        }
+
+        /**
+         * Извлечь события для наблюдателей, накопленные с прошлого извлечения
+         * @param out События (дописываются)
+         * @return Были ли события
+         */
+        bool takeSpectatorEvents(std::vector<MsgSpectatorEvent::SpectatorEvent>& out){
+            if(spectatorEvents_.empty())
+                return false;
+
+            out.insert(out.end(), spectatorEvents_.begin(), spectatorEvents_.end());
+            spectatorEvents_.clear();
+            return true;
+        }
+
+        /**
+         * Получить события, описывающие текущее состояние игры (для нового наблюдателя)
+         * @param out События (дописываются)
+         * @details Поля игроков известны, только если итоги ходов определяет сессия
+         */
+        void spectatorSnapshot(std::vector<MsgSpectatorEvent::SpectatorEvent>& out) const{
+            if(authoritative_){
+                for(int i = 0; i < 2; i++){
+                    const uint64_t* shots = fleets_[i].shots();
+                    const uint64_t* ships = fleets_[i].cells();
+                    out.push_back(MsgSpectatorEvent::SpectatorEvent{shots[0], shots[1], MsgSpectatorEvent::SPECTATOR_BOARD, static_cast<uint8_t>(i), 0});
+                    out.push_back(MsgSpectatorEvent::SpectatorEvent{shots[0] & ships[0], shots[1] & ships[1], MsgSpectatorEvent::SPECTATOR_HITS, static_cast<uint8_t>(i), 0});
+                }
+            }
+            if(stage_ == AWAITING_SHOT || stage_ == AWAITING_RESULTS){
+                out.push_back(MsgSpectatorEvent::SpectatorEvent{0, 0, MsgSpectatorEvent::SPECTATOR_TURN, static_cast<uint8_t>(activePlayerIndex_), 0});
+            }
+        }
+
+        /**
+         * Рандомизация индекса активного игрока
+         */
+        void randomizePlayers(){
+            std::mt19937 gen(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+            std::uniform_int_distribution<> dis(0, 1);
+            activePlayerIndex_ = dis(gen);
+        }
+
+        /**
+         * Сменить игроков местами
+         */
+        void swapPlayers(){
+            activePlayerIndex_ = activePlayerIndex_ == 0 ? 1 : 0;
+        }
+
+        /**
+         * Получить активного игрока (тот кто ходит)
+         * @return Ссылка на объект игрока
+         */
+        Peer& getActivePlayer(){
+            return players_[activePlayerIndex_];
+        }
+
+        /**
+         * Получить ожидающего игрока (тот кто ожидает хода противника)
+         * @return Ссылка на объект игрока
+         */
+        Peer& getWaitingPlayer(){
+            return players_[activePlayerIndex_ == 0 ? 1 : 0];
+        }
+
+        /**
+         * Все ли игроки подключены
+         * @return Да или нет
+         */
+        bool allConnected(){
+            for(Peer& player : players_){
+                if(!player.isConnected()){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Отправить сообщение всем подключенным игрокам
+         * @param message Сообщение
+         * @details Сообщение помещается в очереди игроков и записывается потоком сокетов (flushOutbox),
+         * отключенным игрокам оно не доставляется. Состояние сокетов здесь не проверяется, поскольку
+         * сессия может выполняться в потоке пула
+         */
+        void sendToConnected(const Msg& message){
+            for(Peer& player : players_){
+                player.postMessage(message);
+            }
+        }
+
+        /**
+         * Записать в сокеты очереди исходящих сообщений всех игроков (вызывается только из потока сокетов)
+         */
+        void flushOutboxes(){
+            for(Peer& player : players_){
+                player.flushOutbox();
+            }
+        }
+
+        /**
+         * Кол-во игроков в сессии
+         * @return Кол-во
+         */
+        size_t playersCount() const{
+            return players_.size();
+        }
+
+        /**
+         * Найти игрока по сокету
+         * @param socket Сокет (тип определяется игроком, см. getSocket)
+         * @return Индекс игрока, либо -1 если игрок не найден
+         */
+        template <typename Socket>
+        int indexOf(const Socket& socket){
+            // Отключенный игрок приостановленной сессии мог оставить тот же сокет (номера соединений используются
+            // повторно) - подключенный игрок находится первым
+            int found = -1;
+            for(size_t i = 0; i < players_.size(); i++){
+                if(players_[i].getSocket() == socket){
+                    if(players_[i].isConnected()) return static_cast<int>(i);
+                    if(found < 0) found = static_cast<int>(i);
+                }
+            }
+            return found;
+        }
+
+        /**
+         * Получить игрока по индексу
+         * @param index Индекс
+         * @return Ссылка на объект игрока
+         */
+        Peer& getPlayer(int index){
+            return players_[index];
+        }
+
+        /**
+         * Получить текущий этап
+         * @return Этап
+         */
+        Stage getStage() const{
+            return stage_;
+        }
+
+        /**
+         * Получить номер текущего хода
+         * @return Номер хода
+         */
+        uint64_t getMoves() const{
+            return moves_;
+        }
+
+        /**
+         * Завершена ли игра
+         * @return Да или нет
+         */
+        bool isFinished() const{
+            return stage_ == FINISHED;
+        }
+
+        /**
+         * Начать игру (вызывается после присоединения второго игрока)
+         */
+        void start(){
+            // Рандомизация игроков
+            this->randomizePlayers();
+
+            // Если оба игрока передали расстановки - итоги ходов определяет сессия
+            authoritative_ = fleets_[0].isValid() && fleets_[1].isValid();
+
+            // Отправить сообщение о статусе игры (и токены возобновления, если сессия возобновляемая)
+            if(players_.size() == 2 && this->allConnected()){
+                this->sendToConnected(MsgGameStatus(authoritative_ ? GAME_RUNNING_AUTHORITATIVE : GAME_RUNNING));
+                if(resumable_){
+                    this->issueResumeTokens();
+                }
+                this->announceTurn();
+            }else{
+                this->finish(MsgGameStatus(GAME_OVER_DISCONNECTED));
+            }
+        }
+
+        /**
+         * Обработать сообщение игрока (не блокирует, вызывается по готовности данных)
+         * @param playerIndex Индекс игрока-отправителя
+         * @param message Сообщение
+         */
+        void onMessage(int playerIndex, Msg& message){
+            // Ход активного игрока - итог определяется по расстановке ожидающего
+            if(authoritative_ && stage_ == AWAITING_SHOT && playerIndex == activePlayerIndex_ && message.getType() == MSG_SHOT_DETAILS)
+            {
+                this->resolveShot(message);
+            }
+            // Ход активного игрока - передается ожидающему
+            else if(stage_ == AWAITING_SHOT && playerIndex == activePlayerIndex_ && message.getType() == MSG_SHOT_DETAILS)
+            {
+                this->getWaitingPlayer().postMessage(message);
+                MsgShotDetails::ShotDetails details = message.toMsgShotDetails().getDetails();
+                pendingShot_ = details;
+                this->record(MsgSpectatorEvent::SPECTATOR_SHOT, activePlayerIndex_, MsgSpectatorEvent::SHOT_RESULT_UNKNOWN, details.x, details.y);
+                stage_ = AWAITING_RESULTS;
+                moves_++;
+            }
+            // Ответ ожидающего игрока (промазал, попал, уничтожил, победил) - передается ходившему
+            else if(stage_ == AWAITING_RESULTS && playerIndex != activePlayerIndex_ && message.getType() == MSG_SHOT_RESULTS)
+            {
+                this->getActivePlayer().postMessage(message);
+                this->record(MsgSpectatorEvent::SPECTATOR_RESULT, activePlayerIndex_, message.toMsgShotResults().getResults());
+                this->trackRelayResult(message.toMsgShotResults().getResults());
+
+                // Если ходивший игрок победил (уничтожил последний корабль) - отправить игрокам сообщения о завершении игры
+                if(message.toMsgShotResults().getResults() == SHOT_RESULT_WIN){
+                    this->getActivePlayer().postMessage(MsgGameStatus(GAME_OVER_WIN));
+                    this->getWaitingPlayer().postMessage(MsgGameStatus(GAME_OVER_LOOSE));
+                    this->record(MsgSpectatorEvent::SPECTATOR_GAME_OVER, activePlayerIndex_, GAME_OVER_WIN);
+                    stage_ = FINISHED;
+                    return;
+                }
+
+                // Если ходивший промазал - сменить игроков
+                if(message.toMsgShotResults().getResults() == SHOT_RESULT_MISS){
+                    this->swapPlayers();
+                }
+
+                this->announceTurn();
+            }
+        }
+
+        /**
+         * Обработать отключение одного из игроков
+         * @details Сообщение получит только оставшийся игрок (очередь отключенного не записывается).
+         * Возобновляемая сессия не завершается: игра ожидает возвращения игрока (см. resume, onResumeExpired)
+         */
+        void onDisconnected(){
+            if(stage_ != FINISHED && stage_ != LOBBY && !resumable_){
+                this->finish(MsgGameStatus(GAME_OVER_DISCONNECTED));
+            }
+        }
+
+        /**
+         * Обработать истечение срока ожидания отключенных игроков
+         * @details Если кто-то из игроков так и не вернулся, игра завершается как при отключении
+         */
+        void onResumeExpired(){
+            if(stage_ != FINISHED && stage_ != LOBBY && !this->allConnected()){
+                this->finish(MsgGameStatus(GAME_OVER_DISCONNECTED));
+            }
+        }
+
+        /**
+         * Обработать истечение срока хода
+         * @param move Номер хода, на который был взведен таймер (если ход уже сделан - событие игнорируется)
+         * @details Проигрывает игрок, от которого ожидалось сообщение
+         */
+        void onTurnTimeout(uint64_t move){
+            if(move != moves_ || (stage_ != AWAITING_SHOT && stage_ != AWAITING_RESULTS))
+                return;
+
+            bool activeIsIdle = stage_ == AWAITING_SHOT;
+            (activeIsIdle ? this->getActivePlayer() : this->getWaitingPlayer()).postMessage(MsgGameStatus(GAME_OVER_LOOSE));
+            (activeIsIdle ? this->getWaitingPlayer() : this->getActivePlayer()).postMessage(MsgGameStatus(GAME_OVER_WIN));
+            this->record(MsgSpectatorEvent::SPECTATOR_GAME_OVER, activeIsIdle ? 1 - activePlayerIndex_ : activePlayerIndex_, GAME_OVER_WIN);
+            stage_ = FINISHED;
+        }
+
+        /**
+         * Отправить игрокам сообщение проверки соединения
+         * @details Запись в разорванное соединение приводит к его закрытию, и сессия узнает об отключении
+         */
+        void heartbeat(){
+            if(stage_ != FINISHED){
+                this->sendToConnected(Msg(MSG_HEARTBEAT, 0));
+            }
+        }
+
+    private:
+        /**
+         * Выдать игрокам токены возобновления (случайные, отличные от нуля)
+         */
+        void issueResumeTokens(){
+            std::random_device device;
+            for(size_t i = 0; i < players_.size() && i < 2; i++){
+                do{
+                    resumeTokens_[i] = (static_cast<uint64_t>(device()) << 32) ^ device();
+                }while(resumeTokens_[i] == 0);
+                players_[i].postMessage(MsgResumeToken(resumeTokens_[i]));
+            }
+        }
+
+        /**
+         * Учесть итог выстрела, переданный ожидающим игроком (итоги ходов определяют клиенты)
+         * @param result Итог выстрела (SHOT_RESULT_*)
+         */
+        void trackRelayResult(uint8_t result){
+            int board = activePlayerIndex_ == 0 ? 1 : 0;
+            unsigned x = static_cast<unsigned>(pendingShot_.x);
+            unsigned y = static_cast<unsigned>(pendingShot_.y);
+            FleetBoard::setCell(relayShots_[board], x, y);
+            if(result != SHOT_RESULT_MISS){
+                FleetBoard::setCell(relayHits_[board], x, y);
+            }
+        }
+
+        /**
+         * Снимок игры для игрока
+         * @param playerIndex Индекс игрока
+         * @return Снимок (если итоги ходов определяют клиенты - поля по переданным ими итогам)
+         */
+        MsgResumeState::ResumeState resumeState(int playerIndex) const{
+            MsgResumeState::ResumeState state = {};
+            int enemyIndex = playerIndex == 0 ? 1 : 0;
+            const FleetBoard& own = fleets_[playerIndex];
+            const FleetBoard& enemy = fleets_[enemyIndex];
+            for(int i = 0; i < 2; i++){
+                if(authoritative_){
+                    state.ownShots[i] = own.shots()[i];
+                    state.enemyShots[i] = enemy.shots()[i];
+                    state.enemyHits[i] = enemy.shots()[i] & enemy.cells()[i];
+                }else{
+                    state.ownShots[i] = relayShots_[playerIndex][i];
+                    state.enemyShots[i] = relayShots_[enemyIndex][i];
+                    state.enemyHits[i] = relayHits_[enemyIndex][i];
+                }
+            }
+
+            state.resumed = 1;
+            state.status = authoritative_ ? GAME_RUNNING_AUTHORITATIVE : GAME_RUNNING;
+            state.turn = playerIndex == activePlayerIndex_ ? 1 : 0;
+            state.awaitingResults = stage_ == AWAITING_RESULTS ? 1 : 0;
+            if(stage_ == AWAITING_RESULTS){
+                state.shotX = static_cast<uint8_t>(pendingShot_.x);
+                state.shotY = static_cast<uint8_t>(pendingShot_.y);
+            }
+            return state;
+        }
+
+        /**
+         * Определить итог хода активного игрока по расстановке ожидающего и отправить его обоим игрокам
+         * @param message Сообщение с деталями хода
+         * @details Выстрел за пределы поля или в уже обстрелянную клетку отклоняется - игрок ходит повторно
+         * (номер хода не меняется, поэтому срок хода не продлевается)
+         */
+        void resolveShot(Msg& message){
+            MsgShotDetails::ShotDetails details = message.toMsgShotDetails().getDetails();
+            FleetBoard::ShotResult result = fleets_[activePlayerIndex_ == 0 ? 1 : 0].shoot(details.x, details.y);
+
+            if(result == FleetBoard::REJECTED){
+                this->getActivePlayer().postMessage(MsgShotAvailable(true));
+                return;
+            }
+
+            // Ходивший получает итог, ожидающий - координаты (для отображения на своем поле)
+            this->getActivePlayer().postMessage(MsgShotResults(static_cast<uint8_t>(result)));
+            this->getWaitingPlayer().postMessage(message);
+            this->record(MsgSpectatorEvent::SPECTATOR_SHOT, activePlayerIndex_, static_cast<uint8_t>(result), details.x, details.y);
+
+            if(result == FleetBoard::WIN){
+                this->getActivePlayer().postMessage(MsgGameStatus(GAME_OVER_WIN));
+                this->getWaitingPlayer().postMessage(MsgGameStatus(GAME_OVER_LOOSE));
+                this->record(MsgSpectatorEvent::SPECTATOR_GAME_OVER, activePlayerIndex_, GAME_OVER_WIN);
+                stage_ = FINISHED;
+                return;
+            }
+
+            if(result == FleetBoard::MISS){
+                this->swapPlayers();
+            }
+
+            this->announceTurn();
+        }
+
+        /**
+         * Отправить игрокам сообщение о том кто ходит а кто нет
+         * @details Отключение игрока поступает в сессию отдельным событием (onDisconnected)
+         */
+        void announceTurn(){
+            this->getActivePlayer().postMessage(MsgShotAvailable(true));
+            this->getWaitingPlayer().postMessage(MsgShotAvailable(false));
+            this->record(MsgSpectatorEvent::SPECTATOR_TURN, activePlayerIndex_, 0);
+            stage_ = AWAITING_SHOT;
+            moves_++;
+        }
+
+        /**
+         * Завершить игру, уведомив подключенных игроков
+         * @param status Сообщение о статусе игры
+         */
+        void finish(const Msg& status){
+            this->sendToConnected(status);
+            stage_ = FINISHED;
+
+            // Победитель - оставшийся игрок (если он один)
+            int winner = MsgSpectatorEvent::NO_PLAYER;
+            if(players_.size() == 2 && players_[0].isConnected() != players_[1].isConnected()){
+                winner = players_[0].isConnected() ? 0 : 1;
+            }
+            this->record(MsgSpectatorEvent::SPECTATOR_GAME_OVER, winner, GAME_OVER_DISCONNECTED);
+        }
+
+        /**
+         * Учесть событие для наблюдателей (если они есть)
+         * @param kind Вид события
+         * @param player Индекс игрока
+         * @param value Итог выстрела, либо состояние игры
+         * @param x Координата, либо разряды клеток
+         * @param y Координата, либо разряды клеток
+         */
+        void record(MsgSpectatorEvent::Kind kind, int player, uint8_t value, uint64_t x = 0, uint64_t y = 0){
+            if(spectated_){
+                spectatorEvents_.push_back(MsgSpectatorEvent::SpectatorEvent{x, y, kind, static_cast<uint8_t>(player), value});
+            }
+        }
+    };
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace net
+{
+    /**
+     * Расстановка кораблей игрока на стороне сервера
+     * Клетки поля хранятся битовой картой (бит y * FIELD_SIZE + x), для каждой клетки известен номер корабля,
+     * а для каждого корабля - кол-во целых частей, поэтому итог выстрела определяется за O(1).
+     * Не зависит от Qt (может использоваться любым сервером)
+     */
+    class FleetBoard
+    {
+    public:
+        /// Размер поля (клеток по ширине и высоте)
+        static constexpr unsigned FIELD_SIZE = 10;
+        /// Кол-во клеток поля
+        static constexpr unsigned CELLS = FIELD_SIZE * FIELD_SIZE;
+        /// Кол-во кораблей (4 однопалубных, 3 двухпалубных, 2 трехпалубных, 1 четырехпалубный)
+        static constexpr unsigned SHIPS = 10;
+        /// Наибольшая длина корабля
+        static constexpr unsigned MAX_SHIP_LENGTH = 4;
+
+        /// Итог выстрела (значения совпадают с SHOT_RESULT_*)
+        enum ShotResult {
+            MISS = 0,
+            HIT = 1,
+            DESTROYED = 2,
+            WIN = 3,
+            // Выстрел отклонен (клетка за пределами поля, либо по ней уже стреляли)
+            REJECTED = 0xFF
+        };
+
+    private:
+        /// Клетки, занятые кораблями
+        uint64_t ships_[2];
+        /// Клетки, по которым стреляли
+        uint64_t shots_[2];
+        /// Номер корабля клетки (0 - клетка пуста, иначе номер + 1)
+        uint8_t shipOf_[CELLS];
+        /// Кол-во целых частей кораблей
+        uint8_t shipHealth_[SHIPS];
+        /// Кол-во целых кораблей
+        unsigned shipsAlive_;
+        /// Расстановка загружена и соответствует правилам
+        bool valid_;
+
+    public:
+        /**
+         * Конструктор (пустая, не валидная расстановка)
+         */
+        FleetBoard():shipsAlive_(0),valid_(false){
+            this->clear();
+        }
+
+        /**
+         * Индекс клетки в битовой карте
+         * @param x Столбец
+         * @param y Строка
+         * @return Индекс бита
+         */
+        static unsigned cellIndex(unsigned x, unsigned y){
+            return y * FIELD_SIZE + x;
+        }
+
+        /**
+         * Отметить клетку в битовой карте
+         * @param cells Битовая карта (2 слова)
+         * @param x Столбец
+         * @param y Строка
+         */
+        static void setCell(uint64_t cells[2], unsigned x, unsigned y){
+            if(x < FIELD_SIZE && y < FIELD_SIZE){
+                unsigned index = cellIndex(x, y);
+                cells[index / 64] |= static_cast<uint64_t>(1) << (index % 64);
+            }
+        }
+
+        /**
+         * Отмечена ли клетка в битовой карте
+         * @param cells Битовая карта (2 слова)
+         * @param index Индекс клетки
+         * @return Да или нет
+         */
+        static bool testCell(const uint64_t cells[2], unsigned index){
+            return ((cells[index / 64] >> (index % 64)) & 1) != 0;
+        }
+
+        /**
+         * Загрузить расстановку и проверить ее по правилам
+         * @param cells Битовая карта клеток, занятых кораблями (2 слова)
+         * @return Соответствует ли расстановка правилам (корабли - прямые линии, не касаются друг друга
+         * даже углами, состав флота стандартный)
+         */
+        bool load(const uint64_t cells[2]){
+            this->clear();
+            ships_[0] = cells[0];
+            ships_[1] = cells[1];
+
+            // Биты за пределами поля не допускаются
+            if((ships_[1] >> (CELLS - 64)) != 0)
+                return false;
+
+            unsigned lengthsCount[MAX_SHIP_LENGTH + 1] = {};
+            unsigned shipsCount = 0;
+
+            for(unsigned y = 0; y < FIELD_SIZE; y++)
+            {
+                for(unsigned x = 0; x < FIELD_SIZE; x++)
+                {
+                    unsigned index = cellIndex(x, y);
+                    if(!testCell(ships_, index) || shipOf_[index] != 0)
+                        continue;
+
+                    // Новый корабль начинается в верхней левой клетке и продолжается вправо, либо вниз
+                    bool horizontal = x + 1 < FIELD_SIZE && testCell(ships_, index + 1);
+                    unsigned length = 0;
+                    while(length <= MAX_SHIP_LENGTH)
+                    {
+                        unsigned cx = horizontal ? x + length : x;
+                        unsigned cy = horizontal ? y : y + length;
+                        if(cx >= FIELD_SIZE || cy >= FIELD_SIZE || !testCell(ships_, cellIndex(cx, cy)))
+                            break;
+                        length++;
+                    }
+
+                    if(length > MAX_SHIP_LENGTH || shipsCount >= SHIPS)
+                        return false;
+
+                    // Все соседние клетки (кроме клеток самого корабля) должны быть пусты
+                    for(unsigned i = 0; i < length; i++)
+                    {
+                        unsigned cx = horizontal ? x + i : x;
+                        unsigned cy = horizontal ? y : y + i;
+                        if(!this->onlyOwnNeighbors(cx, cy, x, y, horizontal, length))
+                            return false;
+                        shipOf_[cellIndex(cx, cy)] = static_cast<uint8_t>(shipsCount + 1);
+                    }
+
+                    shipHealth_[shipsCount] = static_cast<uint8_t>(length);
+                    lengthsCount[length]++;
+                    shipsCount++;
+                }
+            }
+
+            // Кораблей длины N должно быть (MAX_SHIP_LENGTH + 1 - N)
+            for(unsigned length = 1; length <= MAX_SHIP_LENGTH; length++){
+                if(lengthsCount[length] != MAX_SHIP_LENGTH + 1 - length)
+                    return false;
+            }
+
+            shipsAlive_ = shipsCount;
+            valid_ = true;
+            return true;
+        }
+
+        /**
+         * Получить битовую карту клеток, занятых кораблями
+         * @return Указатель на 2 слова
+         */
+        const uint64_t* cells() const{
+            return ships_;
+        }
+
+        /**
+         * Получить битовую карту клеток, по которым стреляли
+         * @return Указатель на 2 слова
+         */
+        const uint64_t* shots() const{
+            return shots_;
+        }
+
+        /**
+         * Повторить выстрелы (восстановление состояния расстановки, переданного другим процессом)
+         * @param cells Битовая карта клеток, по которым стреляли (2 слова)
+         */
+        void replayShots(const uint64_t cells[2]){
+            for(unsigned index = 0; index < CELLS; index++){
+                if(testCell(cells, index)){
+                    this->shoot(index % FIELD_SIZE, index / FIELD_SIZE);
+                }
+            }
+        }
+
+        /**
+         * Загружена ли валидная расстановка
+         * @return Да или нет
+         */
+        bool isValid() const{
+            return valid_;
+        }
+
+        /**
+         * Выстрел по клетке
+         * @param x Столбец
+         * @param y Строка
+         * @return Итог выстрела
+         */
+        ShotResult shoot(size_t x, size_t y){
+            if(!valid_ || x >= FIELD_SIZE || y >= FIELD_SIZE)
+                return REJECTED;
+
+            unsigned index = cellIndex(static_cast<unsigned>(x), static_cast<unsigned>(y));
+            if(testCell(shots_, index))
+                return REJECTED;
+            shots_[index / 64] |= static_cast<uint64_t>(1) << (index % 64);
+
+            if(shipOf_[index] == 0)
+                return MISS;
+
+            if(--shipHealth_[shipOf_[index] - 1] > 0)
+                return HIT;
+
+            return --shipsAlive_ > 0 ? DESTROYED : WIN;
+        }
+
+    private:
+        /**
+         * Сбросить расстановку
+         */
+        void clear(){
+            ships_[0] = ships_[1] = 0;
+            shots_[0] = shots_[1] = 0;
+            memset(shipOf_, 0, sizeof(shipOf_));
+            memset(shipHealth_, 0, sizeof(shipHealth_));
+            shipsAlive_ = 0;
+            valid_ = false;
+        }
+
+        /**
+         * Принадлежат ли все занятые соседние клетки (включая диагональные) тому же кораблю
+         * @param cx Столбец клетки
+         * @param cy Строка клетки
+         * @param x Столбец начала корабля
+         * @param y Строка начала корабля
+         * @param horizontal Горизонтальный ли корабль
+         * @param length Длина корабля
+         * @return Да или нет
+         */
+        bool onlyOwnNeighbors(unsigned cx, unsigned cy, unsigned x, unsigned y, bool horizontal, unsigned length) const{
+            for(int dy = -1; dy <= 1; dy++)
+            {
+                for(int dx = -1; dx <= 1; dx++)
+                {
+                    int nx = static_cast<int>(cx) + dx;
+                    int ny = static_cast<int>(cy) + dy;
+                    if(nx < 0 || ny < 0 || nx >= static_cast<int>(FIELD_SIZE) || ny >= static_cast<int>(FIELD_SIZE))
+                        continue;
+                    if(!testCell(ships_, cellIndex(static_cast<unsigned>(nx), static_cast<unsigned>(ny))))
+                        continue;
+
+                    bool own = horizontal ?
+                            (ny == static_cast<int>(y) && nx >= static_cast<int>(x) && nx < static_cast<int>(x + length)) :
+                            (nx == static_cast<int>(x) && ny >= static_cast<int>(y) && ny < static_cast<int>(y + length));
+                    if(!own)
+                        return false;
+                }
+            }
+            return true;
+        }
+    };
+}
@@ -1,7 +1,9 @@
 #pragma once
 
-#include <QTcpServer>
-#include <QTcpSocket>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <utility>
 
 namespace net
 {
@@ -21,6 +23,37 @@ namespace net
     constexpr uint8_t MSG_SHOT_DETAILS = 5;
     // Тип сообщения - итоги хода (выстрела)
     constexpr uint8_t MSG_SHOT_RESULTS = 6;
+    // Тип сообщения - проверка соединения (без полезной нагрузки, клиентом игнорируется)
+    constexpr uint8_t MSG_HEARTBEAT = 7;
+    // Тип сообщения - расстановка кораблей игрока (отправляется до запроса на подключение к игре)
+    constexpr uint8_t MSG_FLEET_LAYOUT = 8;
+    // Тип сообщения - сервер перегружен, повторить попытку позже (вместо ответа на запрос игрока)
+    constexpr uint8_t MSG_SERVER_BUSY = 9;
+    // Тип сообщения - подписка на список сессий, ожидающих второго игрока (вместо запроса на подключение к игре)
+    constexpr uint8_t MSG_LOBBY_SUBSCRIBE = 10;
+    // Тип сообщения - снимок или изменения списка сессий, ожидающих второго игрока
+    constexpr uint8_t MSG_LOBBY_UPDATE = 11;
+    // Тип сообщения - наблюдение за игрой (вместо запроса на подключение к игре)
+    constexpr uint8_t MSG_SPECTATE = 12;
+    // Тип сообщения - событие игры для наблюдателей
+    constexpr uint8_t MSG_SPECTATOR_EVENT = 13;
+    // Тип сообщения - токен возобновления игры после разрыва соединения
+    constexpr uint8_t MSG_RESUME_TOKEN = 14;
+    // Тип сообщения - возобновление игры после разрыва соединения (вместо запроса на подключение к игре)
+    constexpr uint8_t MSG_RESUME = 15;
+    // Тип сообщения - снимок игры для вернувшегося игрока
+    constexpr uint8_t MSG_RESUME_STATE = 16;
+    // Тип сообщения - метка канала (следующие сообщения относятся к игре этого канала соединения)
+    constexpr uint8_t MSG_CHANNEL = 17;
+    // Тип сообщения - закрытие канала соединения
+    constexpr uint8_t MSG_CHANNEL_CLOSE = 18;
+
+    /// Особые ключи сессий (в запросе игрока на подключение к игре)
+
+    // Ключ сессии - создать новую сессию
+    constexpr uintptr_t SESSION_KEY_NEW = 0;
+    // Ключ сессии - присоединиться к любому игроку, ожидающему соперника
+    constexpr uintptr_t SESSION_KEY_ANY = ~static_cast<uintptr_t>(0);
 
     /// Состояние игры
 
@@ -32,6 +65,8 @@ namespace net
     constexpr uint8_t GAME_OVER_LOOSE = 2;
     // Состояние игры - игра закончилась отключением второго игрока
     constexpr uint8_t GAME_OVER_DISCONNECTED = 3;
+    // Состояние игры - игра в процессе, итоги ходов определяет сервер (по расстановкам кораблей игроков)
+    constexpr uint8_t GAME_RUNNING_AUTHORITATIVE = 4;
 
     /// Итоги хода
 
@@ -51,6 +86,15 @@ namespace net
     class MsgShotResults;
     class MsgPlayerQuery;
     class MsgPlayerResponse;
+    class MsgFleetLayout;
+    class MsgServerBusy;
+    class MsgLobbyUpdate;
+    class MsgSpectate;
+    class MsgSpectatorEvent;
+    class MsgResumeToken;
+    class MsgResume;
+    class MsgResumeState;
+    class MsgChannel;
 
     /**
      * Базовый класс игрового сообщения
@@ -60,6 +104,7 @@ namespace net
     {
     private:
         /// Классы PlayerPeer и ServerPeer имеет доступ к закрытым членам данного класса
+        friend class MsgCodec;
         friend class BasePeer;
         friend class PlayerPeer;
         friend class ServerPeer;
@@ -213,5 +258,77 @@ namespace net
         MsgPlayerResponse& toMsgPlayerResponse(){
             return *(reinterpret_cast<MsgPlayerResponse*>(this));
         }
+
+        /**
+         * Конвертировать в MsgFleetLayout
+         * @return Ссылка на текущий объект
+         */
+        MsgFleetLayout& toMsgFleetLayout(){
+            return *(reinterpret_cast<MsgFleetLayout*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgServerBusy
+         * @return Ссылка на текущий объект
+         */
+        MsgServerBusy& toMsgServerBusy(){
+            return *(reinterpret_cast<MsgServerBusy*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgLobbyUpdate
+         * @return Ссылка на текущий объект
+         */
+        MsgLobbyUpdate& toMsgLobbyUpdate(){
+            return *(reinterpret_cast<MsgLobbyUpdate*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgSpectate
+         * @return Ссылка на текущий объект
+         */
+        MsgSpectate& toMsgSpectate(){
+            return *(reinterpret_cast<MsgSpectate*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgSpectatorEvent
+         * @return Ссылка на текущий объект
+         */
+        MsgSpectatorEvent& toMsgSpectatorEvent(){
+            return *(reinterpret_cast<MsgSpectatorEvent*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgResumeToken
+         * @return Ссылка на текущий объект
+         */
+        MsgResumeToken& toMsgResumeToken(){
+            return *(reinterpret_cast<MsgResumeToken*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgResume
+         * @return Ссылка на текущий объект
+         */
+        MsgResume& toMsgResume(){
+            return *(reinterpret_cast<MsgResume*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgResumeState
+         * @return Ссылка на текущий объект
+         */
+        MsgResumeState& toMsgResumeState(){
+            return *(reinterpret_cast<MsgResumeState*>(this));
+        }
+
+        /**
+         * Конвертировать в MsgChannel
+         * @return Ссылка на текущий объект
+         */
+        MsgChannel& toMsgChannel(){
+            return *(reinterpret_cast<MsgChannel*>(this));
+        }
     };
 }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение канала (несколько игр на одном соединении)
+     * Метка канала (MSG_CHANNEL) относит к каналу все следующие за ней сообщения - до следующей метки. Канал ведет себя
+     * как отдельное соединение: открывается первой меткой с новым номером и проходит все этапы (расстановка, запрос на
+     * подключение к игре, игра). Закрытие канала (MSG_CHANNEL_CLOSE) от клиента - отключение игрока, от сервера - закрытие
+     * "соединения" канала (после закрытия канал нужно выбрать меткой заново). Соединение переходит на каналы целиком:
+     * метка должна быть первым сообщением клиента, сервер же предваряет меткой каждое свое сообщение
+     */
+    class MsgChannel final : public Msg
+    {
+    public:
+        explicit MsgChannel(uint32_t channel = 0, bool close = false): Msg(close ? MSG_CHANNEL_CLOSE : MSG_CHANNEL, sizeof(uint32_t)){
+            memcpy(this->payload_, &channel, sizeof(uint32_t));
+        }
+
+        uint32_t getChannel(){
+            return *(reinterpret_cast<uint32_t*>(payload_));
+        }
+    };
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Msg.hpp"
+#include "MsgShotDetails.hpp"
+#include "MsgPlayerResponse.hpp"
+#include "MsgFleetLayout.hpp"
+#include "MsgLobbyUpdate.hpp"
+#include "MsgSpectatorEvent.hpp"
+#include "MsgResume.hpp"
+#include "MsgResumeState.hpp"
+
+#include <string>
+
+namespace net
+{
+    /**
+     * Кодирование сообщений в поток байт и разбор потока на сообщения
+     * Сообщение передается как байт типа, за которым следует полезная нагрузка фиксированного (по типу) размера.
+     * Не зависит от Qt (используется как пирами на сокетах Qt, так и серверами на системных сокетах)
+     */
+    class MsgCodec
+    {
+    public:
+        /// Наибольший размер сообщения (тип и полезная нагрузка)
+        static constexpr size_t MAX_MESSAGE_SIZE = 64;
+        static_assert(sizeof(uint8_t) + sizeof(MsgLobbyUpdate::LobbyUpdate) <= MAX_MESSAGE_SIZE, "Lobby update must fit into message buffer");
+        static_assert(sizeof(uint8_t) + sizeof(MsgResumeState::ResumeState) <= MAX_MESSAGE_SIZE, "Resume state must fit into message buffer");
+
+    private:
+        /// Начало сообщения, полученное не целиком
+        char pending_[MAX_MESSAGE_SIZE];
+        /// Кол-во байт начала сообщения
+        size_t pendingSize_;
+
+    public:
+        /**
+         * Конструктор
+         */
+        MsgCodec():pendingSize_(0){}
+
+        /**
+         * Размер полезной нагрузки сообщения заданного типа
+         * @param msgType Тип сообщения
+         * @return Размер в байтах
+         */
+        static size_t payloadSizeOf(uint8_t msgType){
+            switch(msgType){
+                case MSG_SHOT_AVAILABLE:
+                    return sizeof(bool);
+                case MSG_GAME_STATUS:
+                case MSG_SHOT_RESULTS:
+                    return sizeof(uint8_t);
+                case MSG_SHOT_DETAILS:
+                    return sizeof(MsgShotDetails::ShotDetails);
+                case MSG_PLR_QUERY:
+                case MSG_SPECTATE:
+                    return sizeof(uintptr_t);
+                case MSG_PLR_RESPONSE:
+                    return sizeof(MsgPlayerResponse::PlayerResponse);
+                case MSG_FLEET_LAYOUT:
+                    return sizeof(MsgFleetLayout::FleetLayout);
+                case MSG_SERVER_BUSY:
+                case MSG_CHANNEL:
+                case MSG_CHANNEL_CLOSE:
+                    return sizeof(uint32_t);
+                case MSG_LOBBY_UPDATE:
+                    return sizeof(MsgLobbyUpdate::LobbyUpdate);
+                case MSG_SPECTATOR_EVENT:
+                    return sizeof(MsgSpectatorEvent::SpectatorEvent);
+                case MSG_RESUME_TOKEN:
+                    return sizeof(uint64_t);
+                case MSG_RESUME:
+                    return sizeof(MsgResume::ResumeQuery);
+                case MSG_RESUME_STATE:
+                    return sizeof(MsgResumeState::ResumeState);
+                default:
+                    return 0;
+            }
+        }
+
+        /**
+         * Дописать сообщение в буфер
+         * @param message Сообщение
+         * @param out Буфер
+         */
+        static void encode(const Msg& message, std::string& out){
+            out.append(reinterpret_cast<const char*>(&message.type_), sizeof(uint8_t));
+            if(message.payloadSize_ > 0){
+                out.append(message.payload_, message.payloadSize_);
+            }
+        }
+
+        /**
+         * Извлечь из потока очередное сообщение
+         * @param data Указатель на непрочитанные данные (сдвигается на прочитанное)
+         * @param size Кол-во непрочитанных байт (уменьшается на прочитанное)
+         * @param message Извлеченное сообщение
+         * @return Извлечено ли сообщение (если нет - данные исчерпаны, начало сообщения сохранено до следующего вызова)
+         */
+        bool decode(const char*& data, size_t& size, Msg& message){
+            // Тип сообщения - первый байт (из сохраненного начала, либо из новых данных)
+            if(pendingSize_ == 0 && size == 0)
+                return false;
+
+            uint8_t msgType = static_cast<uint8_t>(pendingSize_ > 0 ? pending_[0] : data[0]);
+            size_t total = sizeof(uint8_t) + payloadSizeOf(msgType);
+
+            // Сообщение целиком в новых данных - копируется без промежуточного буфера
+            if(pendingSize_ == 0 && size >= total){
+                message = Msg(msgType, total - sizeof(uint8_t));
+                if(message.payloadSize_ > 0){
+                    memcpy(message.payload_, data + sizeof(uint8_t), message.payloadSize_);
+                }
+                data += total;
+                size -= total;
+                return true;
+            }
+
+            // Иначе сообщение собирается из частей
+            size_t chunk = total - pendingSize_ < size ? total - pendingSize_ : size;
+            memcpy(pending_ + pendingSize_, data, chunk);
+            pendingSize_ += chunk;
+            data += chunk;
+            size -= chunk;
+            if(pendingSize_ < total)
+                return false;
+
+            message = Msg(msgType, total - sizeof(uint8_t));
+            if(message.payloadSize_ > 0){
+                memcpy(message.payload_, pending_ + sizeof(uint8_t), message.payloadSize_);
+            }
+            pendingSize_ = 0;
+            return true;
+        }
+
+        /**
+         * Получено ли начало сообщения (сообщение не дочитано)
+         * @return Да или нет
+         */
+        bool hasPending() const{
+            return pendingSize_ > 0;
+        }
+
+        /**
+         * Получить начало недочитанного сообщения (для передачи соединения другому процессу)
+         * @return Байты начала сообщения
+         */
+        std::string getPending() const{
+            return std::string(pending_, pendingSize_);
+        }
+
+        /**
+         * Восстановить начало недочитанного сообщения
+         * @param pending Байты начала сообщения
+         * @return Удалось ли (начало не может быть длиннее сообщения)
+         */
+        bool setPending(const std::string& pending){
+            if(pending.size() >= MAX_MESSAGE_SIZE)
+                return false;
+
+            memcpy(pending_, pending.data(), pending.size());
+            pendingSize_ = pending.size();
+            return true;
+        }
+    };
+}
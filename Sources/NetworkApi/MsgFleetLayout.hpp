@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение о расстановке кораблей игрока (битовая карта занятых клеток, см. FleetBoard)
+     */
+    class MsgFleetLayout final : public Msg
+    {
+    public:
+        struct FleetLayout{
+            uint64_t cells[2];
+        };
+
+        explicit MsgFleetLayout(const FleetLayout& layout):Msg(MSG_FLEET_LAYOUT, sizeof(FleetLayout)){
+            memcpy(this->payload_,&layout, sizeof(FleetLayout));
+        }
+
+        FleetLayout getLayout(){
+            return *(reinterpret_cast<FleetLayout*>(payload_));
+        }
+    };
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение о подписке на список сессий, ожидающих второго игрока (вместо запроса на подключение к игре)
+     * Сервер отвечает снимком списка и далее присылает его изменения (см. MsgLobbyUpdate). Подписка действует,
+     * пока клиент не отправит запрос на подключение к игре, либо не отключится
+     */
+    class MsgLobbySubscribe final : public Msg
+    {
+    public:
+        MsgLobbySubscribe():Msg(MSG_LOBBY_SUBSCRIBE, 0){}
+    };
+}
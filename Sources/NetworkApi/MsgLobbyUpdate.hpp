@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение об изменении списка сессий, ожидающих второго игрока (для подписчиков, см. MsgLobbySubscribe)
+     * Снимок списка - одно или несколько сообщений с добавленными сессиями (первое отмечено LOBBY_SNAPSHOT_BEGIN,
+     * последнее - LOBBY_SNAPSHOT_END; если сессий больше предела снимка сервера, последнее отмечено и
+     * LOBBY_SNAPSHOT_TRUNCATED), далее приходят только изменения. Изменения применяются как к множеству:
+     * добавление уже известной сессии и удаление отсутствующей ничего не меняют
+     */
+    class MsgLobbyUpdate final : public Msg
+    {
+    public:
+        /// Наибольшее кол-во ключей в одном сообщении
+        static constexpr size_t KEYS_PER_UPDATE = 6;
+
+        /// Признаки сообщения
+        enum Flags : uint8_t {
+            // Первое сообщение снимка (клиент очищает список)
+            LOBBY_SNAPSHOT_BEGIN = 1,
+            // Последнее сообщение снимка
+            LOBBY_SNAPSHOT_END = 2,
+            // Снимок неполный (сессий больше предела снимка, остальные не передаются, пока не изменятся)
+            LOBBY_SNAPSHOT_TRUNCATED = 4
+        };
+
+        struct LobbyUpdate{
+            // Ключи сессий: сначала добавленные, затем удаленные
+            uintptr_t keys[KEYS_PER_UPDATE];
+            // Кол-во добавленных и удаленных
+            uint8_t added;
+            uint8_t removed;
+            // Признаки (см. Flags)
+            uint8_t flags;
+        };
+
+        explicit MsgLobbyUpdate(const LobbyUpdate& update):Msg(MSG_LOBBY_UPDATE, sizeof(LobbyUpdate)){
+            memcpy(this->payload_,&update, sizeof(LobbyUpdate));
+        }
+
+        LobbyUpdate getUpdate(){
+            return *(reinterpret_cast<LobbyUpdate*>(payload_));
+        }
+    };
+}
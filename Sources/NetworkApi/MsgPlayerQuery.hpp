@@ -19,7 +19,11 @@ namespace net
         }
 
         bool newSession(){
-            return this->getSessionKey() == 0;
+            return this->getSessionKey() == SESSION_KEY_NEW;
+        }
+
+        bool anySession(){
+            return this->getSessionKey() == SESSION_KEY_ANY;
         }
     };
 }
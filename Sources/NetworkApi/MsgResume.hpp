@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение о возобновлении игры после разрыва соединения (вместо запроса на подключение к игре)
+     * Сервер отвечает снимком игры (MsgResumeState), далее игра продолжается обычными сообщениями
+     */
+    class MsgResume final : public Msg
+    {
+    public:
+        struct ResumeQuery{
+            // Ключ сессии
+            uintptr_t sessionKey;
+            // Токен возобновления (см. MsgResumeToken)
+            uint64_t token;
+        };
+
+        explicit MsgResume(uintptr_t sessionKey = 0, uint64_t token = 0): Msg(MSG_RESUME, sizeof(ResumeQuery)){
+            ResumeQuery query = {};
+            query.sessionKey = sessionKey;
+            query.token = token;
+            memcpy(this->payload_, &query, sizeof(ResumeQuery));
+        }
+
+        ResumeQuery getQuery(){
+            return *(reinterpret_cast<ResumeQuery*>(payload_));
+        }
+    };
+}
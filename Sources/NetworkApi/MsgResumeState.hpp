@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение со снимком игры для игрока, вернувшегося после разрыва соединения (ответ на MsgResume)
+     * Поля передаются битовыми картами (разряды клеток 0-63 и 64-99, см. FleetBoard), а не повтором ходов.
+     * Если итоги ходов определяют клиенты, попадания по полю соперника известны из переданных им итогов.
+     * Если игра не возобновлена, сервер закрывает соединение
+     */
+    class MsgResumeState final : public Msg
+    {
+    public:
+        struct ResumeState{
+            // Клетки поля игрока, по которым стрелял соперник
+            uint64_t ownShots[2];
+            // Клетки поля соперника, по которым стрелял игрок, и попадания среди них
+            uint64_t enemyShots[2];
+            uint64_t enemyHits[2];
+            // Выстрел соперника, ожидающий итога от игрока (итоги ходов определяют клиенты)
+            uint8_t shotX;
+            uint8_t shotY;
+            // Возобновлена ли игра
+            uint8_t resumed;
+            // Состояние игры (GAME_RUNNING, либо GAME_RUNNING_AUTHORITATIVE)
+            uint8_t status;
+            // Ход игрока (иначе - ход соперника)
+            uint8_t turn;
+            // Выстрел сделан, ожидается его итог
+            uint8_t awaitingResults;
+        };
+
+        explicit MsgResumeState(const ResumeState& state):Msg(MSG_RESUME_STATE, sizeof(ResumeState)){
+            memcpy(this->payload_,&state, sizeof(ResumeState));
+        }
+
+        explicit MsgResumeState(bool resumed):Msg(MSG_RESUME_STATE, sizeof(ResumeState)){
+            ResumeState state = {};
+            state.resumed = resumed ? 1 : 0;
+            memcpy(this->payload_,&state, sizeof(ResumeState));
+        }
+
+        ResumeState getState(){
+            return *(reinterpret_cast<ResumeState*>(payload_));
+        }
+    };
+}
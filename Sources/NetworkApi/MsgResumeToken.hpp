@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение с токеном возобновления игры (сервер отправляет его игроку вслед за состоянием начатой игры)
+     * Потеряв соединение, игрок может в течение срока ожидания подключиться заново и вернуться в игру (см. MsgResume)
+     */
+    class MsgResumeToken final : public Msg
+    {
+    public:
+        explicit MsgResumeToken(uint64_t token = 0): Msg(MSG_RESUME_TOKEN, sizeof(uint64_t)){
+            memcpy(this->payload_, &token, sizeof(uint64_t));
+        }
+
+        uint64_t getToken(){
+            return *(reinterpret_cast<uint64_t*>(payload_));
+        }
+    };
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение о перегрузке сервера (вместо ответа на запрос игрока, после него сервер закрывает соединение)
+     */
+    class MsgServerBusy final : public Msg
+    {
+    public:
+        explicit MsgServerBusy(uint32_t retryAfter):Msg(MSG_SERVER_BUSY, sizeof(uint32_t)){
+            memcpy(this->payload_, &retryAfter, sizeof(uint32_t));
+        }
+
+        uint32_t getRetryAfter(){
+            return *(reinterpret_cast<uint32_t*>(payload_));
+        }
+    };
+}
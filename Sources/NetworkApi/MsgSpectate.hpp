@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение о наблюдении за игрой (вместо запроса на подключение к игре)
+     * Сервер отвечает как на запрос игрока (MsgPlayerResponse), далее присылает события игры (см. MsgSpectatorEvent)
+     */
+    class MsgSpectate final : public Msg
+    {
+    public:
+        explicit MsgSpectate(uintptr_t sessionKey = 0): Msg(MSG_SPECTATE, sizeof(uintptr_t)){
+            memcpy(this->payload_, &sessionKey, sizeof(uintptr_t));
+        }
+
+        uintptr_t getSessionKey(){
+            return *(reinterpret_cast<uintptr_t*>(payload_));
+        }
+    };
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Сообщение о событии игры для наблюдателей (см. MsgSpectate)
+     * Наблюдатель, подключившийся к идущей игре, сначала получает поля игроков (обстрелянные клетки и попадания,
+     * если итоги ходов определяет сервер) и текущий ход, далее - события по мере игры
+     */
+    class MsgSpectatorEvent final : public Msg
+    {
+    public:
+        /// Вид события
+        enum Kind : uint8_t {
+            // Обстрелянные клетки поля игрока (x, y - разряды клеток 0-63 и 64-99)
+            SPECTATOR_BOARD = 0,
+            // Клетки поля игрока, в которых подбиты корабли (x, y - разряды клеток)
+            SPECTATOR_HITS = 1,
+            // Ход игрока
+            SPECTATOR_TURN = 2,
+            // Выстрел игрока по клетке (x, y) и его итог (SHOT_RESULT_UNKNOWN - итог сообщит соперник)
+            SPECTATOR_SHOT = 3,
+            // Итог последнего выстрела игрока, сообщенный соперником
+            SPECTATOR_RESULT = 4,
+            // Игра завершена (игрок - победитель, либо NO_PLAYER; значение - состояние игры для победителя)
+            SPECTATOR_GAME_OVER = 5
+        };
+
+        /// Итог выстрела еще не известен (итоги ходов определяют клиенты)
+        static constexpr uint8_t SHOT_RESULT_UNKNOWN = 0xFF;
+        /// Игрок не указан
+        static constexpr uint8_t NO_PLAYER = 0xFF;
+
+        struct SpectatorEvent{
+            // Координаты клетки, либо разряды клеток поля
+            uint64_t x;
+            uint64_t y;
+            // Вид события (см. Kind)
+            uint8_t kind;
+            // Индекс игрока
+            uint8_t player;
+            // Итог выстрела, либо состояние игры
+            uint8_t value;
+        };
+
+        explicit MsgSpectatorEvent(const SpectatorEvent& event):Msg(MSG_SPECTATOR_EVENT, sizeof(SpectatorEvent)){
+            memcpy(this->payload_,&event, sizeof(SpectatorEvent));
+        }
+
+        SpectatorEvent getEvent(){
+            return *(reinterpret_cast<SpectatorEvent*>(payload_));
+        }
+    };
+}
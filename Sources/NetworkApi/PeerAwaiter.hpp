@@ -0,0 +1,118 @@
+#pragma once
+
+#include <functional>
+#include <QObject>
+#include <QTimer>
+
+#include "BasePeer.hpp"
+
+namespace net
+{
+    /**
+     * Ожидание сообщения без блокировки потока (вместо блокирующих цепочек waitForMessage)
+     * Проект собирается по C++11, поэтому вместо co_await ожидание выражается продолжением: recv регистрирует
+     * обработчик, а цикл событий вызывает его, когда сообщение получено целиком, истек срок или соединение
+     * разорвано. Обработчик может сразу ожидать следующее сообщение, поэтому протокол записывается той же
+     * последовательностью шагов, что и с waitForMessage, но поток (например, поток интерфейса) не блокируется
+     * и стек на каждое ожидание не нужен
+     */
+    class PeerAwaiter final : public QObject
+    {
+    public:
+        /// Обработчик сообщения (MSG_UNDEFINED - срок истек, либо соединение разорвано)
+        typedef std::function<void(Msg&)> Handler;
+
+    private:
+        /// Соединение
+        BasePeer& peer_;
+        /// Обработчик ожидаемого сообщения (пусто - ничего не ожидается)
+        Handler handler_;
+        /// Срок ожидания
+        QTimer deadline_;
+
+    public:
+        /**
+         * Конструктор
+         * @param peer Соединение (должно существовать, пока существует объект)
+         * @param parent Родительский объект
+         */
+        explicit PeerAwaiter(BasePeer& peer, QObject* parent = nullptr):
+                QObject(parent),
+                peer_(peer),
+                deadline_(this)
+        {
+            deadline_.setSingleShot(true);
+            connect(&deadline_, &QTimer::timeout, this, [this]{ this->complete(Msg(MSG_UNDEFINED, 0)); });
+            if(peer_.getSocket() != nullptr){
+                connect(peer_.getSocket(), &QTcpSocket::readyRead, this, &PeerAwaiter::deliver);
+                connect(peer_.getSocket(), &QTcpSocket::disconnected, this, [this]{ this->complete(Msg(MSG_UNDEFINED, 0)); });
+            }
+        }
+
+        /**
+         * Ожидать следующее сообщение (проверочные сообщения сервера пропускаются)
+         * @param timeout Срок ожидания (мс, -1 - без срока)
+         * @param handler Обработчик (заменяет ранее зарегистрированный)
+         * @details Обработчик всегда вызывается из цикла событий, даже если сообщение уже в буфере сокета
+         */
+        void recv(int timeout, Handler handler){
+            handler_ = std::move(handler);
+            if(timeout >= 0) deadline_.start(timeout);
+            else deadline_.stop();
+
+            // Сообщения, пришедшие вместе с предыдущим, уже в буфере (события готовности к чтению для них не будет)
+            if(peer_.hasMessage() || !peer_.isConnected()){
+                QTimer::singleShot(0, this, [this]{ this->deliver(); });
+            }
+        }
+
+        /**
+         * Прекратить ожидание (обработчик не будет вызван)
+         */
+        void cancel(){
+            handler_ = nullptr;
+            deadline_.stop();
+        }
+
+        /**
+         * Ожидается ли сообщение
+         * @return Да или нет
+         */
+        bool isWaiting() const{
+            return static_cast<bool>(handler_);
+        }
+
+    private:
+        /**
+         * Передать обработчику полученное сообщение (если оно ожидается)
+         */
+        void deliver(){
+            while(handler_ && peer_.hasMessage()){
+                Msg message = peer_.readMessage();
+                if(message.getType() != MSG_HEARTBEAT){
+                    this->complete(std::move(message));
+                }
+            }
+
+            // Соединение разорвано до получения сообщения
+            if(handler_ && !peer_.isConnected()){
+                this->complete(Msg(MSG_UNDEFINED, 0));
+            }
+        }
+
+        /**
+         * Завершить ожидание
+         * @param message Сообщение (MSG_UNDEFINED - срок истек, либо соединение разорвано)
+         * @details Обработчик снимается до вызова, поэтому может зарегистрировать следующее ожидание
+         */
+        void complete(Msg message){
+            if(!handler_)
+                return;
+
+            Handler handler = std::move(handler_);
+            handler_ = nullptr;
+            deadline_.stop();
+            handler(message);
+        }
+    };
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+namespace net
+{
+    /**
+     * Транспорт соединения, выбираемый по схеме адреса
+     * @details Адрес вида "unix:<путь>" - локальный (Unix-domain) сокет для клиентов на той же машине, что и сервер
+     * (боты, маршрутизатор): данные не проходят стек TCP. Остальные адреса - хост TCP. Дескриптор локального сокета
+     * передается объекту QTcpSocket (его ввод-вывод от семейства сокета не зависит), поэтому BasePeer, сигналы сокета
+     * и передача соединений между реакторами работают с обоими транспортами одинаково. Локальный транспорт есть только
+     * в Unix-системах
+     */
+    class PeerTransport
+    {
+    public:
+        /**
+         * Указывает ли адрес на локальный сокет
+         * @param address Адрес
+         * @return Да или нет
+         */
+        static bool isLocal(const std::string& address){
+            return address.compare(0, strlen(localScheme()), localScheme()) == 0;
+        }
+
+        /**
+         * Подключен ли сокет через локальный сокет
+         * @param socket Подключенный сокет
+         * @return Да или нет
+         * @details Qt разбирает только адреса IP, поэтому у локального соединения адреса клиента нет
+         */
+        static bool isLocalConnection(const QTcpSocket* socket){
+            return socket->peerAddress().isNull();
+        }
+
+        /**
+         * Подключиться к серверу
+         * @param socket Сокет
+         * @param address Адрес (IP или имя хоста, либо "unix:<путь>")
+         * @param port Порт (для локального сокета не используется)
+         * @param timeout Время ожидания подключения
+         * @return Удалось ли
+         */
+        static bool connect(QTcpSocket* socket, const std::string& address, unsigned port, int timeout = -1){
+            if(isLocal(address))
+                return connectLocal(socket, address.substr(strlen(localScheme())));
+
+            socket->connectToHost(QString::fromStdString(address), static_cast<quint16>(port));
+            return socket->waitForConnected(timeout);
+        }
+
+        /**
+         * Начать подключение к серверу, не ожидая его завершения
+         * @param socket Сокет
+         * @param address Адрес (IP или имя хоста, либо "unix:<путь>")
+         * @param port Порт (для локального сокета не используется)
+         * @return Удалось ли начать
+         * @details Подключение к локальному сокету завершается сразу (сокет в состоянии ConnectedState),
+         * подключение TCP - в цикле событий сигналом connected либо error сокета
+         */
+        static bool beginConnect(QTcpSocket* socket, const std::string& address, unsigned port){
+            if(isLocal(address))
+                return connectLocal(socket, address.substr(strlen(localScheme())));
+
+            socket->connectToHost(QString::fromStdString(address), static_cast<quint16>(port));
+            return socket->state() != QAbstractSocket::UnconnectedState;
+        }
+
+        /**
+         * Начать прием подключений через локальный сокет
+         * @param server Сервер подключений (принимает их так же, как подключения TCP)
+         * @param path Путь сокета (сокет, оставшийся от завершившегося процесса, удаляется, см. removeStale)
+         * @param backlog Длина очереди ожидающих подключений
+         * @return Удалось ли
+         */
+        static bool listenLocal(QTcpServer& server, const std::string& path, int backlog){
+#ifdef Q_OS_UNIX
+            sockaddr_un address;
+            if(!makeAddress(path, address) || !removeStale(path, address))
+                return false;
+
+            int descriptor = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if(descriptor < 0)
+                return false;
+
+            if(::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+               ::listen(descriptor, backlog) != 0 ||
+               !server.setSocketDescriptor(descriptor))
+            {
+                ::close(descriptor);
+                return false;
+            }
+            return true;
+#else
+            Q_UNUSED(server)
+            Q_UNUSED(path)
+            Q_UNUSED(backlog)
+            return false;
+#endif
+        }
+
+    private:
+        /**
+         * Схема адреса локального сокета
+         * @return Строка
+         */
+        static const char* localScheme(){
+            return "unix:";
+        }
+
+        /**
+         * Подключиться к серверу через локальный сокет
+         * @param socket Сокет (получает дескриптор подключенного сокета)
+         * @param path Путь сокета
+         * @return Удалось ли
+         */
+        static bool connectLocal(QTcpSocket* socket, const std::string& path){
+#ifdef Q_OS_UNIX
+            sockaddr_un address;
+            if(!makeAddress(path, address))
+                return false;
+
+            int descriptor = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if(descriptor < 0)
+                return false;
+
+            // Подключение к локальному сокету не ожидает ответа по сети - блокирующий вызов завершается сразу
+            if(::connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+               !socket->setSocketDescriptor(descriptor))
+            {
+                ::close(descriptor);
+                return false;
+            }
+            return true;
+#else
+            Q_UNUSED(socket)
+            Q_UNUSED(path)
+            return false;
+#endif
+        }
+
+#ifdef Q_OS_UNIX
+        /**
+         * Адрес локального сокета
+         * @param path Путь сокета
+         * @param address Адрес
+         * @return Умещается ли путь в адрес
+         */
+        static bool makeAddress(const std::string& path, sockaddr_un& address){
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if(path.empty() || path.size() >= sizeof(address.sun_path))
+                return false;
+
+            memcpy(address.sun_path, path.data(), path.size());
+            return true;
+        }
+
+        /**
+         * Освободить путь локального сокета (файл сокета, оставшийся от завершившегося процесса, удаляется)
+         * @param path Путь сокета
+         * @param address Адрес сокета
+         * @return Свободен ли путь
+         * @details Удаляется только сокет, подключение к которому отклонено. Другой файл и сокет работающего
+         * процесса не трогаются - открытие сокета завершается ошибкой
+         */
+        static bool removeStale(const std::string& path, const sockaddr_un& address){
+            struct stat info;
+            if(::lstat(path.c_str(), &info) != 0)
+                return errno == ENOENT;
+            if(!S_ISSOCK(info.st_mode))
+                return false;
+
+            // Проверка не блокируется, даже если очередь работающего процесса заполнена
+            int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if(probe < 0)
+                return false;
+            ::fcntl(probe, F_SETFL, O_NONBLOCK);
+
+            bool stale = ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 && errno == ECONNREFUSED;
+            ::close(probe);
+            return stale && ::unlink(path.c_str()) == 0;
+        }
+#endif
+    };
+}
@@ -1,15 +1,55 @@
 #pragma once
 
+#include <atomic>
+
 #include "BasePeer.hpp"
 
 namespace net
 {
     /**
      * Класс для взаимодействия с игроком
+     * @details Сессия игрока может выполняться в потоке пула, а состояние сокета меняет поток реактора, поэтому
+     * игрок сессии считается подключенным до события отключения (см. markDisconnected), а не по состоянию сокета
      */
     class PlayerPeer final : public BasePeer{
+        /// Подключен ли игрок (сбрасывается потоком пула при обработке события отключения, читается и потоком сокетов)
+        std::atomic<bool> connected_{true};
+
+    public:
         // Наследовать все конструкторы
         using BasePeer::BasePeer;
+
+        /**
+         * Конструктор перемещения
+         * @param other R-value ссылка на другой объект
+         */
+        PlayerPeer(PlayerPeer&& other) noexcept : BasePeer(std::move(other)), connected_(other.connected_.load()){}
+
+        /**
+         * Перемещение через присваивание
+         * @param other R-value ссылка на другой объект
+         * @return Ссылка на текущий объект
+         */
+        PlayerPeer& operator=(PlayerPeer&& other) noexcept{
+            BasePeer::operator=(std::move(other));
+            connected_.store(other.connected_.load());
+            return *this;
+        }
+
+        /**
+         * Подключен ли игрок
+         * @return Да или нет
+         */
+        bool isConnected() const{
+            return connected_.load();
+        }
+
+        /**
+         * Отметить игрока отключенным (соединение разорвано или закрыто сервером)
+         */
+        void markDisconnected(){
+            connected_.store(false);
+        }
     };
 }
 
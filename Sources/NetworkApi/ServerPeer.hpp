@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BasePeer.hpp"
+#include "PeerTransport.hpp"
 
 namespace net
 {
@@ -12,12 +13,14 @@ namespace net
     public:
         /**
          * Конструктор
-         * @param ip IP
-         * @param port Порт
+         * @param ip IP, либо "unix:<путь>" - локальный сокет сервера на той же машине (см. PeerTransport)
+         * @param port Порт (для локального сокета не используется)
+         * @param wait Ожидать ли подключения (иначе подключение TCP завершается в цикле событий - сигналом connected
+         * либо error сокета, см. PeerTransport::beginConnect)
          */
-        explicit ServerPeer(const char* ip, unsigned port):BasePeer(new QTcpSocket){
-            connection_->connectToHost(QString::fromStdString(ip),port);
-            connection_->waitForConnected(-1);
+        explicit ServerPeer(const char* ip, unsigned port, bool wait = true):BasePeer(new QTcpSocket){
+            if(wait) PeerTransport::connect(connection_, ip, port);
+            else PeerTransport::beginConnect(connection_, ip, port);
         }
     };
 }
\ No newline at end of file
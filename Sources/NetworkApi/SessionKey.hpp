@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Msg.hpp"
+
+namespace net
+{
+    /**
+     * Ключ сессии при работе нескольких серверов (шардов) за маршрутизатором
+     * Номер шарда хранится в старших разрядах ключа, поэтому маршрутизатор определяет сервер сессии по одному
+     * только запросу игрока, не зная о сессиях. Одиночный сервер - шард 0 (ключи не меняются)
+     */
+    class SessionKey
+    {
+    public:
+        /// Кол-во старших разрядов ключа, отведенных под номер шарда
+        static constexpr unsigned SHARD_BITS = 8;
+        /// Наибольшее кол-во шардов
+        static constexpr unsigned MAX_SHARDS = 1u << SHARD_BITS;
+        /// Положение номера шарда в ключе
+        static constexpr unsigned SHARD_SHIFT = sizeof(uintptr_t) * 8 - SHARD_BITS;
+
+        /**
+         * Дополнить ключ сессии номером шарда
+         * @param localKey Ключ сессии в пределах сервера (старшие разряды отбрасываются)
+         * @param shard Номер шарда
+         * @return Ключ сессии
+         */
+        static uintptr_t make(uintptr_t localKey, unsigned shard){
+            const uintptr_t localMask = (static_cast<uintptr_t>(1) << SHARD_SHIFT) - 1;
+            return (static_cast<uintptr_t>(shard % MAX_SHARDS) << SHARD_SHIFT) | (localKey & localMask);
+        }
+
+        /**
+         * Получить номер шарда, владеющего сессией
+         * @param key Ключ сессии
+         * @return Номер шарда
+         */
+        static unsigned shardOf(uintptr_t key){
+            return static_cast<unsigned>(key >> SHARD_SHIFT);
+        }
+    };
+}
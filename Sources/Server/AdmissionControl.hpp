@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "ServerSettings.hpp"
+
+/**
+ * Контроль приема нагрузки
+ * Считает соединения, незавершенные рукопожатия и живые сессии и сравнивает их с пределами из настроек. Работа
+ * сверх предела не принимается: клиенту сразу отвечается "сервер занят" со сроком повтора, а не оставляется
+ * ждать, пока истекут сроки, поэтому задержки игроков в идущих играх при всплесках подключений не растут.
+ * Счетчики атомарные - реакторы Qt-сервера разделяют один объект
+ */
+class AdmissionControl
+{
+public:
+    /// Решение о приеме
+    enum Verdict {
+        // Принято
+        ADMITTED,
+        // Превышен предел соединений
+        TOO_MANY_CONNECTIONS,
+        // Превышен предел незавершенных рукопожатий
+        TOO_MANY_HANDSHAKES,
+        // Превышен предел живых сессий
+        TOO_MANY_SESSIONS
+    };
+
+private:
+    /// Пределы (0 - без предела)
+    unsigned connectionsLimit_;
+    unsigned handshakesLimit_;
+    unsigned sessionsLimit_;
+    /// Текущие соединения, незавершенные рукопожатия и живые сессии
+    std::atomic<unsigned> connections_;
+    std::atomic<unsigned> handshakes_;
+    std::atomic<unsigned> sessions_;
+    /// Кол-во отказов
+    std::atomic<uint64_t> rejected_;
+    /// Последнее решение и сменилось ли оно с прошлой проверки (см. takeStateChange)
+    std::atomic<int> lastVerdict_;
+    std::atomic<bool> stateChanged_;
+
+public:
+    /**
+     * Конструктор
+     * @param settings Настройки (пределы)
+     */
+    explicit AdmissionControl(const ServerSettings& settings):
+            connectionsLimit_(settings.connectionsLimit),
+            handshakesLimit_(settings.handshakesLimit),
+            sessionsLimit_(settings.sessionsLimit),
+            connections_(0),
+            handshakes_(0),
+            sessions_(0),
+            rejected_(0),
+            lastVerdict_(ADMITTED),
+            stateChanged_(false){}
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    AdmissionControl(const AdmissionControl& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    AdmissionControl& operator=(const AdmissionControl& other) = delete;
+
+    /**
+     * Принять новое соединение (при успехе учитываются соединение и его рукопожатие)
+     * @return Решение
+     */
+    Verdict admitConnection()
+    {
+        if(!reserve(connections_, connectionsLimit_))
+            return this->decide(TOO_MANY_CONNECTIONS);
+
+        if(!reserve(handshakes_, handshakesLimit_)){
+            connections_--;
+            return this->decide(TOO_MANY_HANDSHAKES);
+        }
+        return this->decide(ADMITTED);
+    }
+
+    /**
+     * Учесть соединение без проверки пределов (переданное другим реактором или процессом)
+     * @param handshaking Рукопожатие соединения еще не завершено
+     */
+    void adoptConnection(bool handshaking)
+    {
+        connections_++;
+        if(handshaking) handshakes_++;
+    }
+
+    /**
+     * Рукопожатие соединения завершено (либо прервано)
+     */
+    void handshakeFinished()
+    {
+        handshakes_--;
+    }
+
+    /**
+     * Соединение закрыто
+     */
+    void connectionClosed()
+    {
+        connections_--;
+    }
+
+    /**
+     * Принять новую сессию (при успехе она учитывается)
+     * @return Решение
+     */
+    Verdict admitSession()
+    {
+        return this->decide(reserve(sessions_, sessionsLimit_) ? ADMITTED : TOO_MANY_SESSIONS);
+    }
+
+    /**
+     * Учесть сессию без проверки предела (переданную другим процессом)
+     */
+    void adoptSession()
+    {
+        sessions_++;
+    }
+
+    /**
+     * Сессия закрыта
+     */
+    void sessionClosed()
+    {
+        sessions_--;
+    }
+
+    /**
+     * Сбросить счетчики (состояние сервера заменяется переданным)
+     */
+    void reset()
+    {
+        connections_ = 0;
+        handshakes_ = 0;
+        sessions_ = 0;
+    }
+
+    /**
+     * Сменилось ли состояние (прием, либо отказы) с прошлой проверки
+     * @return Да или нет (сбрасывается)
+     */
+    bool takeStateChange()
+    {
+        return stateChanged_.exchange(false);
+    }
+
+    /**
+     * Отказывает ли сервер новым клиентам (по последнему решению)
+     * @return Да или нет
+     */
+    bool isShedding() const
+    {
+        return lastVerdict_ != ADMITTED;
+    }
+
+    /**
+     * Описание текущего состояния (для журнала)
+     * @return Строка
+     */
+    std::string describe() const
+    {
+        static const char* reasons[] = {"accepting", "shedding (connections limit)", "shedding (handshakes limit)", "shedding (sessions limit)"};
+        return std::string("Admission: ") + reasons[lastVerdict_.load()]
+               + ", connections " + counter(connections_, connectionsLimit_)
+               + ", handshakes " + counter(handshakes_, handshakesLimit_)
+               + ", sessions " + counter(sessions_, sessionsLimit_)
+               + ", rejected " + std::to_string(rejected_.load()) + ".";
+    }
+
+private:
+    /**
+     * Занять единицу счетчика, если предел не превышен
+     * @param value Счетчик
+     * @param limit Предел (0 - без предела)
+     * @return Удалось ли
+     */
+    static bool reserve(std::atomic<unsigned>& value, unsigned limit)
+    {
+        if(value.fetch_add(1) < limit || limit == 0)
+            return true;
+
+        value--;
+        return false;
+    }
+
+    /**
+     * Запомнить решение
+     * @param verdict Решение
+     * @return Решение
+     */
+    Verdict decide(Verdict verdict)
+    {
+        if(verdict != ADMITTED) rejected_++;
+        if(lastVerdict_.exchange(verdict) != verdict) stateChanged_ = true;
+        return verdict;
+    }
+
+    /**
+     * Значение счетчика с пределом (для журнала)
+     * @param value Счетчик
+     * @param limit Предел
+     * @return Строка
+     */
+    static std::string counter(const std::atomic<unsigned>& value, unsigned limit)
+    {
+        return std::to_string(value.load()) + "/" + (limit > 0 ? std::to_string(limit) : std::string("-"));
+    }
+};
@@ -0,0 +1,1372 @@
+#include "GameServer.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "../NetworkApi/MsgPlayerQuery.hpp"
+#include "../NetworkApi/MsgPlayerResponse.hpp"
+#include "../NetworkApi/MsgServerBusy.hpp"
+#include "../NetworkApi/MsgLobbyUpdate.hpp"
+#include "../NetworkApi/MsgSpectate.hpp"
+#include "../NetworkApi/MsgResume.hpp"
+#include "../NetworkApi/MsgResumeState.hpp"
+#include "../NetworkApi/SessionKey.hpp"
+#include "../NetworkApi/PeerTransport.hpp"
+
+/**
+ * Ключ адреса клиента для ограничения частоты
+ * @param socket Сокет клиента
+ * @return Ключ (адреса IPv4 учитываются в виде IPv6; 0 - клиент локального сокета, частота не ограничивается)
+ */
+static uint64_t peerKeyOf(QTcpSocket* socket)
+{
+    if(net::PeerTransport::isLocalConnection(socket))
+        return 0;
+
+    Q_IPV6ADDR address = socket->peerAddress().toIPv6Address();
+    return RateLimiter::keyOf(address.c, sizeof(address.c));
+}
+
+/**
+ * Ключ ограничения частоты сообщений соединения (у каждого соединения свой запас, поэтому клиенты за одним
+ * адресом - например, за маршрутизатором - не делят его)
+ * @param socket Сокет клиента
+ * @return Ключ (0 - клиент локального сокета, частота не ограничивается)
+ */
+static uint64_t messageKeyOf(QTcpSocket* socket)
+{
+    uint64_t peerKey = peerKeyOf(socket);
+    if(peerKey == 0)
+        return 0;
+
+    uint64_t parts[2] = {peerKey, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(socket))};
+    return RateLimiter::keyOf(parts, sizeof(parts));
+}
+
+/**
+ * Конструктор
+ * @param context Общее состояние сервера
+ * @param index Номер реактора
+ * @param parent Родительский объект
+ */
+GameServer::GameServer(ServerContext& context, unsigned index, QObject* parent):
+        QObject(parent),
+        context_(context),
+        index_(index),
+        settings_(context.settings),
+        tcpServer_(this),
+        localServer_(this),
+        timers_(context.settings.timerTick, 0),
+        tickTimer_(this),
+        lobbyTimer_(this)
+{
+    clock_.start();
+
+    // При всплеске подключений (например, после перезапуска) принятые подключения не должны отбрасываться
+    tcpServer_.setMaxPendingConnections(settings_.maxPendingConnections);
+    localServer_.setMaxPendingConnections(settings_.maxPendingConnections);
+    connect(&tcpServer_,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+    connect(&localServer_,SIGNAL(newConnection()),this,SLOT(onNewConnection()));
+
+    // Колесо продвигается периодическим таймером (число активных сроков на него не влияет)
+    tickTimer_.setInterval(settings_.timerTick);
+    connect(&tickTimer_,SIGNAL(timeout()),this,SLOT(onTimerTick()));
+
+    // Изменения списка сессий рассылаются пачкой раз в период (частые изменения сливаются)
+    lobbyTimer_.setInterval(settings_.lobbyUpdateInterval);
+    connect(&lobbyTimer_,SIGNAL(timeout()),this,SLOT(onLobbyTick()));
+}
+
+/**
+ * Деструктор
+ */
+GameServer::~GameServer() = default;
+
+/**
+ * Наибольшее кол-во реакторов, которые могут слушать один порт на данной платформе
+ * @return Кол-во (1, если SO_REUSEPORT не поддерживается)
+ */
+unsigned GameServer::maxReactors()
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    return ServerContext::MAX_REACTORS;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Начать прослушивание порта (вызывается в потоке реактора)
+ * @param port Порт
+ * @return Удалось ли открыть прослушивающий сокет
+ * @details Если реакторов несколько, порт открывается с SO_REUSEPORT (подключения распределяет ядро)
+ */
+bool GameServer::listen(quint16 port)
+{
+    if(context_.reactors.size() <= 1){
+        return tcpServer_.listen(QHostAddress::Any, port);
+    }
+
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    // QTcpServer не позволяет задать опции сокета до bind, поэтому сокет открывается вручную
+    int descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(descriptor < 0)
+        return false;
+
+    int enable = 1;
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if(::setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0 ||
+       ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0 ||
+       ::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+       ::listen(descriptor, settings_.maxPendingConnections) != 0 ||
+       !tcpServer_.setSocketDescriptor(descriptor))
+    {
+        ::close(descriptor);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(port)
+    return false;
+#endif
+}
+
+/**
+ * Начать прием подключений через локальный сокет (клиенты на той же машине, вместе с портом)
+ * @param path Путь сокета
+ * @return Удалось ли открыть сокет
+ */
+bool GameServer::listenLocal(const std::string& path)
+{
+    return net::PeerTransport::listenLocal(localServer_, path, settings_.maxPendingConnections);
+}
+
+/**
+ * Продвинуть рукопожатие по мере поступления данных
+ * @param socket Сокет клиента
+ * @param handshake Рукопожатие
+ */
+void GameServer::advanceHandshake(QTcpSocket* socket, Handshake& handshake)
+{
+    // Запросу могут предшествовать расстановка кораблей (один раз) и подписка на список сессий
+    while(handshake.player.hasMessage())
+    {
+        uint8_t msgType = net::MSG_UNDEFINED;
+        socket->peek(reinterpret_cast<char*>(&msgType), sizeof(uint8_t));
+        if(msgType == net::MSG_FLEET_LAYOUT && !handshake.fleetReceived)
+        {
+            net::MsgFleetLayout::FleetLayout layout = handshake.player.readMessage().toMsgFleetLayout().getLayout();
+            handshake.fleetReceived = true;
+            if(!handshake.fleet.load(layout.cells)){
+                std::cout << "Client " << socket << " sent invalid fleet layout. Shots will be resolved by clients." << std::endl;
+            }
+        }
+        else if(msgType == net::MSG_LOBBY_SUBSCRIBE)
+        {
+            handshake.player.readMessage();
+            this->subscribeLobby(handshake);
+        }
+        else break;
+    }
+
+    // Запрос еще не получен целиком - ожидается продолжение (ограничено сроком рукопожатия, кроме подписчиков)
+    if(!handshake.player.hasMessage()){
+        if(handshake.stage == AWAITING_QUERY && (socket->bytesAvailable() > 0 || handshake.fleetReceived)){
+            handshake.stage = RECEIVING_QUERY;
+        }
+
+        // Запись может разорвать соединение медленного получателя (рукопожатие изымается), поэтому выполняется последней
+        if(handshake.stage == LOBBY_SUBSCRIBED){
+            handshake.player.flushOutbox();
+        }
+        return;
+    }
+
+    // Рукопожатие завершено - игрок изымается из таблицы рукопожатий
+    net::Msg playerQuery = handshake.player.readMessage();
+    net::PlayerPeer player(std::move(handshake.player));
+    net::FleetBoard fleet = handshake.fleet;
+    this->eraseHandshake(handshakes_.find(socket));
+
+    // Если это сообщение о подключении к игре
+    if(playerQuery.getType() == net::MSG_PLR_QUERY){
+        this->processPlayerQuery(std::move(player), playerQuery, fleet);
+    }
+    // Если клиент хочет наблюдать за игрой
+    else if(playerQuery.getType() == net::MSG_SPECTATE){
+        this->spectate(std::move(player), playerQuery.toMsgSpectate().getSessionKey());
+    }
+    // Если игрок возвращается в игру после разрыва соединения
+    else if(playerQuery.getType() == net::MSG_RESUME){
+        net::MsgResume::ResumeQuery query = playerQuery.toMsgResume().getQuery();
+        this->resumePlayer(std::move(player), query.sessionKey, query.token);
+    }
+    // Если вместо сообщения о подключении пришло что-то иное
+    else{
+        std::cout << "Wrong initial query provided from client " << socket << "(" << socket->peerAddress().toString().toStdString() << "). Ignored." << std::endl;
+        disconnect(socket, nullptr, this, nullptr);
+    }
+}
+
+/**
+ * Изъять подключение из таблицы рукопожатий (учитывает завершение рукопожатия, либо подписки на список сессий)
+ * @param handshake Рукопожатие
+ */
+void GameServer::eraseHandshake(std::unordered_map<QTcpSocket*,Handshake>::iterator handshake)
+{
+    this->cancelTimer(handshake->second.timer);
+
+    // Подписчик уже учтен как завершивший рукопожатие, последний подписчик останавливает рассылку
+    if(handshake->second.stage == LOBBY_SUBSCRIBED){
+        if(--lobbySubscribers_ == 0){
+            context_.lobby.unwatch(index_);
+            lobbyTimer_.stop();
+        }
+    }else if(handshake->second.stage != AWAITING_NEXT_GAME){
+        context_.admission.handshakeFinished();
+    }
+    handshakes_.erase(handshake);
+}
+
+/**
+ * Подписать клиента на список сессий, ожидающих второго игрока (отправляет снимок списка)
+ * @param handshake Рукопожатие
+ */
+void GameServer::subscribeLobby(Handshake& handshake)
+{
+    if(handshake.stage == LOBBY_SUBSCRIBED)
+        return;
+
+    // Подписчик может выбирать сессию сколько угодно долго, поэтому не занимает место среди рукопожатий
+    this->cancelTimer(handshake.timer);
+    if(handshake.stage != AWAITING_NEXT_GAME){
+        context_.admission.handshakeFinished();
+    }
+    handshake.stage = LOBBY_SUBSCRIBED;
+    if(lobbySubscribers_++ == 0){
+        lobbyTimer_.start();
+    }
+
+    // Снимок записывается в сокет по окончании разбора данных клиента (см. advanceHandshake)
+    std::vector<net::Msg> snapshot;
+    context_.lobby.snapshot(index_, settings_.lobbySnapshotLimit, snapshot);
+    for(const net::Msg& message : snapshot){
+        handshake.player.postMessage(message);
+    }
+    std::cout << "Client " << handshake.player.getSocket() << " subscribed to lobby (" << lobbySubscribers_ << " subscribers)." << std::endl;
+}
+
+/**
+ * Обработать запрос игрока на подключение к игре
+ * @param player Игрок (рукопожатие которого завершено)
+ * @param playerQuery Сообщение-запрос
+ * @param fleet Расстановка кораблей игрока (может быть не задана)
+ */
+void GameServer::processPlayerQuery(net::PlayerPeer&& player, net::Msg& playerQuery, const net::FleetBoard& fleet)
+{
+    QTcpSocket* socket = player.getSocket();
+
+    // Если игрок НЕ подключается к сессии, но создает НОВУЮ
+    if(playerQuery.toMsgPlayerQuery().newSession())
+    {
+        std::cout << "Client " << socket << " queries new session" << std::endl;
+        this->createSession(std::move(player), fleet, false);
+    }
+    // Если игрок ищет любого соперника
+    else if(playerQuery.toMsgPlayerQuery().anySession())
+    {
+        std::cout << "Client " << socket << " queries matchmaking" << std::endl;
+        this->matchPlayer(std::move(player), fleet);
+    }
+    // Если игрок подключается к СУЩЕСТВУЮЩЕЙ сессии
+    else
+    {
+        // Получить уникальный ключ сессии
+        auto sessionKey = playerQuery.toMsgPlayerQuery().getSessionKey();
+
+        std::cout << "Client " << socket << " joins to existing session (" << sessionKey << ")" << std::endl;
+        this->joinByKey(std::move(player), fleet, sessionKey, false);
+    }
+}
+
+/**
+ * Найти игроку любого соперника
+ * @param player Игрок
+ * @param fleet Расстановка кораблей игрока
+ */
+void GameServer::matchPlayer(net::PlayerPeer&& player, const net::FleetBoard& fleet)
+{
+    // Из очереди извлекаются сессии ожидающих игроков, пока не найдется актуальная
+    // (ожидавший мог отключиться, а его сессия - закрыться, не покидая очередь)
+    uintptr_t sessionKey = 0;
+    while(context_.matchQueue.pop(sessionKey))
+    {
+        // Сессию другого реактора проверяет он сам
+        if(ServerContext::ownerOf(sessionKey) != index_){
+            this->forwardPlayer(std::move(player), fleet, sessionKey, true);
+            return;
+        }
+
+        SessionRegistry::SessionPtr task = context_.sessions.find(sessionKey);
+        if(task && task->matchmaking && task->session.playersCount() == 1 && task->session.allConnected()){
+            std::cout << "Client " << player.getSocket() << " matched with session (" << sessionKey << ")" << std::endl;
+            this->joinSession(std::move(player), fleet, sessionKey, task, true);
+            return;
+        }
+    }
+
+    // Соперника нет - игрок сам ожидает в очереди
+    this->createSession(std::move(player), fleet, true);
+}
+
+/**
+ * Присоединить игрока к сессии по ключу (сессии другого реактора - передать игрока ему)
+ * @param player Игрок
+ * @param fleet Расстановка кораблей игрока
+ * @param sessionKey Ключ сессии
+ * @param matchmaking Сессия взята из очереди поиска соперника (если она уже не актуальна - поиск продолжается)
+ */
+void GameServer::joinByKey(net::PlayerPeer&& player, const net::FleetBoard& fleet, uintptr_t sessionKey, bool matchmaking)
+{
+    // Сессия другого реактора изменяется только его потоком
+    unsigned owner = ServerContext::ownerOf(sessionKey);
+    if(owner != index_ && owner < context_.reactors.size()){
+        this->forwardPlayer(std::move(player), fleet, sessionKey, matchmaking);
+        return;
+    }
+
+    // Найти сессию по ключу (сессия должна ожидать второго игрока, который не отключился)
+    // Сессия в ожидании второго игрока не ставится в пул, поэтому ее можно изменять в потоке реактора
+    SessionRegistry::SessionPtr task = owner == index_ ? context_.sessions.find(sessionKey) : SessionRegistry::SessionPtr();
+    if(task && task->matchmaking == matchmaking && task->session.playersCount() == 1 && task->session.allConnected())
+    {
+        this->joinSession(std::move(player), fleet, sessionKey, task, matchmaking);
+    }
+    // Сессия из очереди поиска уже не актуальна - продолжить поиск
+    else if(matchmaking){
+        this->matchPlayer(std::move(player), fleet);
+    }
+    // Если не удалось найти сессию
+    else{
+        std::cout << "Session with key " << sessionKey << " not found." << std::endl;
+        player.postMessage(net::MsgPlayerResponse(false));
+        player.flushOutbox();
+        this->retainPlayer(std::move(player));
+    }
+}
+
+/**
+ * Оставить соединение игрока открытым для следующего запроса на подключение к игре (после окончания игры или
+ * неудачного запроса; если повторное использование соединений отключено - соединение закрывается)
+ * @param player Игрок (сообщения уже переданы сокету)
+ */
+void GameServer::retainPlayer(net::PlayerPeer&& player)
+{
+    QTcpSocket* socket = player.getSocket();
+    if(settings_.reuseTimeout <= 0 || socket->state() != QAbstractSocket::ConnectedState){
+        disconnect(socket, nullptr, this, nullptr);
+        return;
+    }
+
+    // Соединение снова ожидает запроса (как после подключения, но рукопожатием не считается - клиент уже известен)
+    Timers::TimerId timer = this->addTimer(settings_.reuseTimeout, ServerTimer{HANDSHAKE_TIMEOUT, reinterpret_cast<uintptr_t>(socket), 0});
+    handshakes_.emplace(socket, Handshake{std::move(player), timer, AWAITING_NEXT_GAME, false, net::FleetBoard()});
+}
+
+/**
+ * Передать игрока реактору, владеющему сессией
+ * @param player Игрок
+ * @param fleet Расстановка кораблей игрока
+ * @param sessionKey Ключ сессии
+ * @param matchmaking Сессия взята из очереди поиска соперника
+ */
+void GameServer::forwardPlayer(net::PlayerPeer&& player, const net::FleetBoard& fleet, uintptr_t sessionKey, bool matchmaking)
+{
+    net::PlayerPeer released(std::move(player));
+    QTcpSocket* socket = released.getSocket();
+    disconnect(socket, nullptr, this, nullptr);
+
+#ifdef Q_OS_UNIX
+    // Соединение продолжает существовать, пока открыт хотя бы один дескриптор: копия передается владельцу,
+    // а сокет этого реактора закрывает свой (игрок ожидает ответа, поэтому непрочитанных данных нет)
+    int descriptor = ::dup(static_cast<int>(socket->socketDescriptor()));
+    socket->abort();
+
+    if(descriptor >= 0)
+    {
+        QByteArray fleetCells;
+        if(fleet.isValid()){
+            fleetCells = QByteArray(reinterpret_cast<const char*>(fleet.cells()), static_cast<int>(2 * sizeof(uint64_t)));
+        }
+
+        std::cout << "Client " << socket << " forwarded to reactor " << ServerContext::ownerOf(sessionKey) << std::endl;
+        QMetaObject::invokeMethod(context_.reactors[ServerContext::ownerOf(sessionKey)], "adoptPlayer", Qt::QueuedConnection,
+                Q_ARG(quint64, static_cast<quint64>(descriptor)),
+                Q_ARG(quint64, static_cast<quint64>(sessionKey)),
+                Q_ARG(bool, matchmaking),
+                Q_ARG(QByteArray, fleetCells));
+    }
+#else
+    // Передача соединений между реакторами поддерживается только на POSIX системах (там же, где SO_REUSEPORT)
+    Q_UNUSED(fleet)
+    Q_UNUSED(sessionKey)
+    Q_UNUSED(matchmaking)
+    socket->abort();
+#endif
+}
+
+/**
+ * Принять игрока, переданного другим реактором (вызывается в потоке реактора)
+ * @param descriptor Дескриптор соединения (копия, принадлежит теперь этому реактору)
+ * @param sessionKey Ключ сессии
+ * @param matchmaking Игрок ищет любого соперника (сессия найдена в очереди)
+ * @param fleetCells Расстановка кораблей игрока (битовая карта, пусто - не задана)
+ */
+void GameServer::adoptPlayer(quint64 descriptor, quint64 sessionKey, bool matchmaking, QByteArray fleetCells)
+{
+    auto socket = new QTcpSocket();
+    if(!socket->setSocketDescriptor(static_cast<qintptr>(descriptor))){
+        std::cout << "Can't adopt forwarded connection " << descriptor << "." << std::endl;
+        socket->deleteLater();
+        return;
+    }
+
+    net::FleetBoard fleet;
+    if(fleetCells.size() == static_cast<int>(2 * sizeof(uint64_t))){
+        uint64_t cells[2];
+        memcpy(cells, fleetCells.constData(), sizeof(cells));
+        fleet.load(cells);
+    }
+
+    // Соединение уже принято другим реактором - пределы не проверяются, но оно учитывается до закрытия
+    context_.admission.adoptConnection(false);
+    this->trackConnection(socket);
+    connect(socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+    connect(socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+    net::PlayerPeer player(socket);
+    player.setOutboxLimits(static_cast<qint64>(settings_.outboxHighWater), static_cast<qint64>(settings_.outboxLimit));
+    this->joinByKey(std::move(player), fleet, static_cast<uintptr_t>(sessionKey), matchmaking);
+}
+
+/**
+ * Принять наблюдателя, переданного другим реактором (вызывается в потоке реактора)
+ * @param descriptor Дескриптор соединения (копия, принадлежит теперь этому реактору)
+ * @param sessionKey Ключ сессии
+ */
+void GameServer::adoptSpectator(quint64 descriptor, quint64 sessionKey)
+{
+    auto socket = new QTcpSocket();
+    if(!socket->setSocketDescriptor(static_cast<qintptr>(descriptor))){
+        std::cout << "Can't adopt forwarded connection " << descriptor << "." << std::endl;
+        socket->deleteLater();
+        return;
+    }
+
+    // Соединение уже принято другим реактором - пределы не проверяются, но оно учитывается до закрытия
+    context_.admission.adoptConnection(false);
+    this->trackConnection(socket);
+    connect(socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+    connect(socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+    this->spectate(net::PlayerPeer(socket), static_cast<uintptr_t>(sessionKey));
+}
+
+/**
+ * Принять игрока, возвращающегося в игру, переданного другим реактором (вызывается в потоке реактора)
+ * @param descriptor Дескриптор соединения (копия, принадлежит теперь этому реактору)
+ * @param sessionKey Ключ сессии
+ * @param token Токен возобновления
+ */
+void GameServer::adoptResumed(quint64 descriptor, quint64 sessionKey, quint64 token)
+{
+    auto socket = new QTcpSocket();
+    if(!socket->setSocketDescriptor(static_cast<qintptr>(descriptor))){
+        std::cout << "Can't adopt forwarded connection " << descriptor << "." << std::endl;
+        socket->deleteLater();
+        return;
+    }
+
+    // Соединение уже принято другим реактором - пределы не проверяются, но оно учитывается до закрытия
+    context_.admission.adoptConnection(false);
+    this->trackConnection(socket);
+    connect(socket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+    connect(socket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+
+    net::PlayerPeer player(socket);
+    player.setOutboxLimits(static_cast<qint64>(settings_.outboxHighWater), static_cast<qint64>(settings_.outboxLimit));
+    this->resumePlayer(std::move(player), static_cast<uintptr_t>(sessionKey), static_cast<uint64_t>(token));
+}
+
+/**
+ * Вернуть игрока в игру после разрыва соединения (сессии другого реактора - передать игрока ему)
+ * @param player Игрок на новом соединении (рукопожатие которого завершено)
+ * @param sessionKey Ключ сессии
+ * @param token Токен возобновления
+ */
+void GameServer::resumePlayer(net::PlayerPeer&& player, uintptr_t sessionKey, uint64_t token)
+{
+    // Сессия другого реактора изменяется только его потоком
+    unsigned owner = ServerContext::ownerOf(sessionKey);
+    if(owner != index_ && owner < context_.reactors.size()){
+        this->forwardResumed(std::move(player), sessionKey, token);
+        return;
+    }
+
+    SessionRegistry::SessionPtr task = owner == index_ ? context_.sessions.find(sessionKey) : SessionRegistry::SessionPtr();
+    if(!task){
+        std::cout << "Client " << player.getSocket() << " can't resume session (" << sessionKey << "). Session not found." << std::endl;
+        player.postMessage(net::MsgResumeState(false));
+        player.flushOutbox();
+        return;
+    }
+
+    // Сессия, выполняемая в пуле, примет игрока по завершении задачи
+    if(task->scheduled){
+        task->resumes.emplace_back(token, std::move(player));
+        return;
+    }
+
+    this->applyResume(sessionKey, task.get(), token, std::move(player));
+}
+
+/**
+ * Передать возвращающегося игрока реактору, владеющему сессией
+ * @param player Игрок
+ * @param sessionKey Ключ сессии
+ * @param token Токен возобновления
+ */
+void GameServer::forwardResumed(net::PlayerPeer&& player, uintptr_t sessionKey, uint64_t token)
+{
+    net::PlayerPeer released(std::move(player));
+    QTcpSocket* socket = released.getSocket();
+    disconnect(socket, nullptr, this, nullptr);
+
+#ifdef Q_OS_UNIX
+    // Игрок ожидает снимка игры, поэтому непрочитанных данных нет (см. forwardPlayer)
+    int descriptor = ::dup(static_cast<int>(socket->socketDescriptor()));
+    socket->abort();
+
+    if(descriptor >= 0){
+        std::cout << "Resuming player " << socket << " forwarded to reactor " << ServerContext::ownerOf(sessionKey) << std::endl;
+        QMetaObject::invokeMethod(context_.reactors[ServerContext::ownerOf(sessionKey)], "adoptResumed", Qt::QueuedConnection,
+                Q_ARG(quint64, static_cast<quint64>(descriptor)),
+                Q_ARG(quint64, static_cast<quint64>(sessionKey)),
+                Q_ARG(quint64, static_cast<quint64>(token)));
+    }
+#else
+    Q_UNUSED(sessionKey)
+    Q_UNUSED(token)
+    socket->abort();
+#endif
+}
+
+/**
+ * Заменить соединение отключившегося игрока новым (вызывается, только пока сессия не выполняется в пуле)
+ * @param sessionKey Ключ сессии
+ * @param task Сессия
+ * @param token Токен возобновления
+ * @param player Игрок на новом соединении (получает снимок игры, либо отказ)
+ */
+void GameServer::applyResume(uintptr_t sessionKey, SessionTask* task, uint64_t token, net::PlayerPeer&& player)
+{
+    QTcpSocket* socket = player.getSocket();
+    net::GameSession& s = task->session;
+
+    // Вернуться можно только на место отключившегося игрока идущей игры, предъявив его токен
+    int playerIndex = s.findResumable(token);
+    if(playerIndex < 0){
+        std::cout << "Client " << socket << " can't resume session (" << sessionKey << "). Wrong token or game is over." << std::endl;
+        player.postMessage(net::MsgResumeState(false));
+        player.flushOutbox();
+        return;
+    }
+
+    // Старый сокет больше не относится к сессии (он будет уничтожен вместе с прежним соединением)
+    QTcpSocket* previous = s.getPlayer(playerIndex).getSocket();
+    socketSessions_.erase(previous);
+    disconnect(previous, nullptr, this, nullptr);
+
+    s.resume(playerIndex, std::move(player));
+    socketSessions_[socket] = sessionKey;
+    s.flushOutboxes();
+    std::cout << "Client " << socket << " resumed session (" << sessionKey << ") as player " << playerIndex << "." << std::endl;
+
+    this->armResumeTimer(sessionKey, task);
+}
+
+/**
+ * Начать наблюдение за игрой (сессии другого реактора - передать наблюдателя ему)
+ * @param player Соединение наблюдателя (рукопожатие которого завершено)
+ * @param sessionKey Ключ сессии
+ */
+void GameServer::spectate(net::PlayerPeer&& player, uintptr_t sessionKey)
+{
+    // Сессия другого реактора изменяется только его потоком
+    unsigned owner = ServerContext::ownerOf(sessionKey);
+    if(owner != index_ && owner < context_.reactors.size()){
+        this->forwardSpectator(std::move(player), sessionKey);
+        return;
+    }
+
+    SessionRegistry::SessionPtr task = owner == index_ ? context_.sessions.find(sessionKey) : SessionRegistry::SessionPtr();
+    if(!task || task->spectators.size() >= settings_.maxSpectators){
+        std::cout << "Session with key " << sessionKey << " can't be spectated." << std::endl;
+        player.postMessage(net::MsgPlayerResponse(false));
+        player.flushOutbox();
+        return;
+    }
+
+    QTcpSocket* socket = player.getSocket();
+    player.postMessage(net::MsgPlayerResponse(true, sessionKey));
+    connect(socket,SIGNAL(bytesWritten(qint64)),this,SLOT(onSpectatorWritten()));
+    spectators_.emplace(socket, Spectator{std::move(player), sessionKey, SpectatorQueue<QByteArray>(), false});
+    task->spectators.push_back(socket);
+    std::cout << "Client " << socket << " spectates session (" << sessionKey << "), " << task->spectators.size() << " spectators." << std::endl;
+
+    // Состояние сессии, выполняемой в пуле, будет прочитано по завершении задачи
+    if(!task->scheduled){
+        this->publishSpectators(task.get());
+    }
+}
+
+/**
+ * Передать наблюдателя реактору, владеющему сессией
+ * @param player Соединение наблюдателя
+ * @param sessionKey Ключ сессии
+ */
+void GameServer::forwardSpectator(net::PlayerPeer&& player, uintptr_t sessionKey)
+{
+    net::PlayerPeer released(std::move(player));
+    QTcpSocket* socket = released.getSocket();
+    disconnect(socket, nullptr, this, nullptr);
+
+#ifdef Q_OS_UNIX
+    // Как и игрок, наблюдатель ожидает ответа, поэтому непрочитанных данных нет (см. forwardPlayer)
+    int descriptor = ::dup(static_cast<int>(socket->socketDescriptor()));
+    socket->abort();
+
+    if(descriptor >= 0){
+        std::cout << "Spectator " << socket << " forwarded to reactor " << ServerContext::ownerOf(sessionKey) << std::endl;
+        QMetaObject::invokeMethod(context_.reactors[ServerContext::ownerOf(sessionKey)], "adoptSpectator", Qt::QueuedConnection,
+                Q_ARG(quint64, static_cast<quint64>(descriptor)),
+                Q_ARG(quint64, static_cast<quint64>(sessionKey)));
+    }
+#else
+    Q_UNUSED(sessionKey)
+    socket->abort();
+#endif
+}
+
+/**
+ * Разослать наблюдателям сессии накопленные события (кодируются один раз) и отправить текущее состояние игры
+ * новым наблюдателям (вызывается, только пока сессия не выполняется в пуле)
+ * @param task Сессия
+ */
+void GameServer::publishSpectators(SessionTask* task)
+{
+    net::GameSession& s = task->session;
+    std::vector<net::MsgSpectatorEvent::SpectatorEvent> events;
+    if(task->spectators.empty() || !s.takeSpectatorEvents(events)){
+        events.clear();
+    }
+
+    // События кодируются один раз, буфер разделяется очередями всех наблюдателей
+    QByteArray chunk;
+    if(!events.empty()){
+        std::string encoded;
+        for(const net::MsgSpectatorEvent::SpectatorEvent& event : events){
+            net::MsgCodec::encode(net::MsgSpectatorEvent(event), encoded);
+        }
+        chunk = QByteArray(encoded.data(), static_cast<int>(encoded.size()));
+    }
+
+    // Отстающий наблюдатель отключается вне рассылки (отключение меняет список наблюдателей)
+    for(QTcpSocket* socket : task->spectators)
+    {
+        Spectator& spectator = spectators_.at(socket);
+
+        // Новый наблюдатель получает текущее состояние игры вместо событий, накопленных до его подключения
+        if(!spectator.synced){
+            std::vector<net::MsgSpectatorEvent::SpectatorEvent> snapshot;
+            s.spectatorSnapshot(snapshot);
+            for(const net::MsgSpectatorEvent::SpectatorEvent& event : snapshot){
+                spectator.peer.postMessage(net::MsgSpectatorEvent(event));
+            }
+            spectator.peer.flushOutbox();
+            spectator.synced = true;
+            continue;
+        }
+
+        if(chunk.isEmpty())
+            continue;
+
+        if(!spectator.queue.push(chunk, static_cast<size_t>(chunk.size()), settings_.spectatorQueueLimit)){
+            std::cout << "Spectator " << socket << " can't keep up with session. Disconnected." << std::endl;
+            QTimer::singleShot(0, socket, [socket]{ socket->abort(); });
+            continue;
+        }
+        this->drainSpectator(spectator);
+    }
+
+    // Сессия накапливает события, пока у нее есть наблюдатели
+    s.setSpectated(!task->spectators.empty());
+}
+
+/**
+ * Передать очередь наблюдателя сокету, пока очередь сокета невелика
+ * @param spectator Наблюдатель
+ * @param all Передать очередь целиком (перед закрытием соединения)
+ */
+void GameServer::drainSpectator(Spectator& spectator, bool all)
+{
+    QTcpSocket* socket = spectator.peer.getSocket();
+    auto queued = static_cast<size_t>(socket->bytesToWrite());
+    size_t highWater = settings_.outboxHighWater > 0 && !all ? settings_.outboxHighWater : SIZE_MAX;
+    if(queued < highWater){
+        spectator.queue.drain(highWater - queued, [socket](const QByteArray& chunk){ socket->write(chunk); });
+    }
+}
+
+/**
+ * Создать сессию, в которой игрок ожидает второго
+ * @param player Игрок
+ * @param fleet Расстановка кораблей игрока
+ * @param matchmaking Сессия создана для поиска соперника (ключ помещается в очередь)
+ */
+void GameServer::createSession(net::PlayerPeer&& player, const net::FleetBoard& fleet, bool matchmaking)
+{
+    QTcpSocket* socket = player.getSocket();
+
+    // Новая сессия создается только в пределах допустимой нагрузки
+    AdmissionControl::Verdict verdict = context_.admission.admitSession();
+    if(verdict != AdmissionControl::ADMITTED){
+        this->rejectBusy(std::move(player), verdict);
+        return;
+    }
+
+    // Получить уникальный ключ сессии (младшие разряды - номер реактора-владельца, старшие - номер шарда)
+    auto sessionKey = net::SessionKey::make(static_cast<uintptr_t>((++sessionsCounter_ << ServerContext::REACTOR_BITS) | index_), settings_.shardIndex);
+
+    // Зарегистрировать сессию (ключ не должен быть занят)
+    auto entry = context_.sessions.findOrInsert(sessionKey);
+    if(!entry.second){
+        std::cout << "Session not created. Key " << sessionKey << " is already in use." << std::endl;
+        context_.admission.sessionClosed();
+        player.postMessage(net::MsgPlayerResponse(false));
+        player.flushOutbox();
+        return;
+    }
+
+    // Поставить сессию в очередь поиска соперника
+    if(matchmaking && !context_.matchQueue.push(sessionKey)){
+        context_.sessions.erase(sessionKey);
+        context_.admission.sessionClosed();
+        std::cout << "Session not created. Matchmaking queue is full." << std::endl;
+        this->rejectBusy(std::move(player), AdmissionControl::TOO_MANY_SESSIONS);
+        return;
+    }
+
+    // Если удалось отправить игроку ответ
+    if(player.postMessage(net::MsgPlayerResponse(true,sessionKey)) && player.flushOutbox())
+    {
+        // Добавить в сессию игрока
+        entry.first->session.addPlayer(std::move(player));
+        entry.first->session.setFleet(0, fleet);
+        entry.first->session.setResumable(settings_.resumeGrace > 0);
+        entry.first->matchmaking = matchmaking;
+        socketSessions_[socket] = sessionKey;
+        std::cout << "New session (" << sessionKey << ") created. Key sent to client." << std::endl;
+
+        // Сессию, ожидающую второго игрока по ключу, видят подписчики списка
+        if(!matchmaking){
+            context_.lobby.sessionOpened(sessionKey);
+        }
+
+        // Ожидание второго игрока ограничено по времени, соединение ожидающего периодически проверяется
+        if(settings_.lobbyTimeout > 0){
+            entry.first->lobbyTimer = this->addTimer(settings_.lobbyTimeout, ServerTimer{LOBBY_TIMEOUT, sessionKey, 0});
+        }
+        if(settings_.heartbeatInterval > 0){
+            entry.first->heartbeatTimer = this->addTimer(settings_.heartbeatInterval, ServerTimer{HEARTBEAT, sessionKey, 0});
+        }
+    }
+    // Если не удалось (ключ, оставшийся в очереди поиска, будет пропущен)
+    else{
+        context_.sessions.erase(sessionKey);
+        context_.admission.sessionClosed();
+        std::cout << "Session not created. Can't send response to client." << std::endl;
+    }
+}
+
+/**
+ * Присоединить игрока к ожидающей сессии и начать игру
+ * @param player Игрок
+ * @param fleet Расстановка кораблей игрока
+ * @param sessionKey Ключ сессии
+ * @param task Сессия (ожидает второго игрока)
+ * @param sendKey Сообщить игроку ключ сессии (при поиске соперника игрок его не знает)
+ */
+void GameServer::joinSession(net::PlayerPeer&& player, const net::FleetBoard& fleet, uintptr_t sessionKey, const SessionRegistry::SessionPtr& task, bool sendKey)
+{
+    QTcpSocket* socket = player.getSocket();
+
+    // Сессия в ожидании второго игрока не ставится в пул, поэтому ее можно изменять в потоке сервера
+    // Если удалось отправить игроку ответ
+    if(player.postMessage(net::MsgPlayerResponse(true, sendKey ? sessionKey : 0)))
+    {
+        // Добавить в сессию игрока и начать игру
+        net::GameSession& s = task->session;
+        s.addPlayer(std::move(player));
+        s.setFleet(1, fleet);
+        socketSessions_[socket] = sessionKey;
+        std::cout << "Player added to session. Response sent to client" << std::endl;
+
+        context_.lobby.sessionClosed(sessionKey);
+        this->cancelTimer(task->lobbyTimer);
+        s.start();
+        s.flushOutboxes();
+        this->publishSpectators(task.get());
+        if(s.isFinished()){
+            this->closeSession(sessionKey, task.get());
+        }else{
+            this->armTurnTimer(sessionKey, task.get());
+            this->armResumeTimer(sessionKey, task.get());
+        }
+    }
+    // Если не удалось
+    else{
+        std::cout << "Player not added. Can't send response to client." << std::endl;
+    }
+}
+
+/**
+ * Добавить таймер в колесо
+ * @param delay Задержка (мс)
+ * @param timer Данные таймера
+ * @return Идентификатор таймера
+ */
+GameServer::Timers::TimerId GameServer::addTimer(int delay, const ServerTimer& timer)
+{
+    // Колесо могло простаивать - перед добавлением оно догоняет текущее время (истекших таймеров в нем нет)
+    if(!tickTimer_.isActive()){
+        timers_.advance(clock_.elapsed(), expiredTimers_);
+        tickTimer_.start();
+    }
+    return timers_.schedule(delay, timer);
+}
+
+/**
+ * Отменить таймер
+ * @param id Идентификатор таймера (обнуляется)
+ */
+void GameServer::cancelTimer(Timers::TimerId& id)
+{
+    timers_.cancel(id);
+    id = 0;
+}
+
+/**
+ * Взвести таймер хода, если ход сменился
+ * @param sessionKey Ключ сессии
+ * @param task Сессия
+ */
+void GameServer::armTurnTimer(uintptr_t sessionKey, SessionTask* task)
+{
+    quint64 move = task->session.getMoves();
+    if(settings_.turnTimeout <= 0 || task->session.isFinished() || task->turnTimerMove == move)
+        return;
+
+    this->cancelTimer(task->turnTimer);
+    task->turnTimer = this->addTimer(settings_.turnTimeout, ServerTimer{TURN_TIMEOUT, sessionKey, move});
+    task->turnTimerMove = move;
+}
+
+/**
+ * Взвести срок возвращения, если в сессии есть отключившиеся игроки (иначе снять)
+ * @param sessionKey Ключ сессии
+ * @param task Сессия
+ */
+void GameServer::armResumeTimer(uintptr_t sessionKey, SessionTask* task)
+{
+    // Срок отсчитывается от первого отключения и не продлевается последующими
+    if(task->session.isFinished() || task->session.allConnected()){
+        this->cancelTimer(task->resumeTimer);
+        return;
+    }
+
+    if(settings_.resumeGrace > 0 && task->resumeTimer == 0){
+        task->resumeTimer = this->addTimer(settings_.resumeGrace, ServerTimer{RESUME_TIMEOUT, sessionKey, 0});
+        std::cout << "Session (" << sessionKey << ") suspended until disconnected players return." << std::endl;
+    }
+}
+
+/**
+ * Обработать истекший таймер
+ * @param timer Данные таймера
+ */
+void GameServer::onTimerExpired(const ServerTimer& timer)
+{
+    // Рукопожатие не завершилось вовремя (завершенные рукопожатия снимают свой таймер)
+    if(timer.type == HANDSHAKE_TIMEOUT)
+    {
+        auto socket = reinterpret_cast<QTcpSocket*>(timer.target);
+        auto handshake = handshakes_.find(socket);
+        if(handshake == handshakes_.end())
+            return;
+
+        if(handshake->second.stage == AWAITING_NEXT_GAME){
+            std::cout << "Client " << socket << " didn't query next game in time. Dropped." << std::endl;
+        }else{
+            std::cout << "Client " << socket << " didn't send initial query in time ("
+                      << (handshake->second.stage == AWAITING_QUERY ? "no data" : "incomplete query") << "). Dropped." << std::endl;
+        }
+
+        disconnect(socket, nullptr, this, nullptr);
+        this->eraseHandshake(handshake);
+        return;
+    }
+
+    // Таймеры сессий снимаются при их закрытии
+    SessionRegistry::SessionPtr task = context_.sessions.find(timer.target);
+    if(!task)
+        return;
+
+    switch(timer.type)
+    {
+        // Второй игрок так и не присоединился - сессия закрывается
+        case LOBBY_TIMEOUT:
+            task->lobbyTimer = 0;
+            if(task->session.getStage() == net::GameSession::LOBBY){
+                std::cout << "Session (" << timer.target << ") expired waiting for second player." << std::endl;
+                task->session.sendToConnected(net::MsgGameStatus(net::GAME_OVER_DISCONNECTED));
+                task->session.flushOutboxes();
+                this->closeSession(timer.target, task.get());
+            }
+            break;
+
+        // Игрок не сделал ход вовремя - решение принимает сессия (ход мог быть сделан, пока событие в очереди)
+        case TURN_TIMEOUT:
+            task->turnTimer = 0;
+            task->postTurnTimeout(timer.move);
+            if(!task->scheduled){
+                this->schedule(timer.target, task.get());
+            }
+            break;
+
+        // Проверка соединений (сессию в ожидании второго игрока можно изменять в потоке сервера)
+        case HEARTBEAT:
+            task->heartbeatTimer = this->addTimer(settings_.heartbeatInterval, ServerTimer{HEARTBEAT, timer.target, 0});
+            if(task->session.playersCount() < 2){
+                task->session.heartbeat();
+                task->session.flushOutboxes();
+            }else{
+                task->postHeartbeat();
+                if(!task->scheduled){
+                    this->schedule(timer.target, task.get());
+                }
+            }
+            break;
+
+        // Отключившиеся игроки не вернулись вовремя - решение принимает сессия (игрок мог вернуться, пока событие в очереди)
+        case RESUME_TIMEOUT:
+            task->resumeTimer = 0;
+            task->postResumeExpired();
+            if(!task->scheduled){
+                this->schedule(timer.target, task.get());
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Поставить сессию в пул потоков
+ * @param sessionKey Ключ сессии
+ * @param task Сессия
+ */
+void GameServer::schedule(uintptr_t sessionKey, SessionTask* task)
+{
+    // Сессия не будет уничтожена, пока задача не завершится (см. onSessionProcessed)
+    task->scheduled = true;
+    context_.pool.submit([this, sessionKey, task]{
+        task->run();
+        QMetaObject::invokeMethod(this, "onSessionProcessed", Qt::QueuedConnection, Q_ARG(quint64, static_cast<quint64>(sessionKey)));
+    });
+}
+
+/**
+ * Завершить сессию (отключает игроков)
+ * @param sessionKey Ключ сессии
+ * @param task Сессия
+ */
+void GameServer::closeSession(uintptr_t sessionKey, SessionTask* task)
+{
+    // Сессия, выполняемая в пуле, будет завершена по окончании задачи
+    if(task->scheduled)
+        return;
+
+    // Сроки сессии больше не отслеживаются, в списке ожидающих второго игрока ее больше нет
+    this->cancelTimer(task->lobbyTimer);
+    this->cancelTimer(task->turnTimer);
+    this->cancelTimer(task->heartbeatTimer);
+    this->cancelTimer(task->resumeTimer);
+    context_.lobby.sessionClosed(sessionKey);
+
+    // Наблюдатели получают последние события и отключаются (после записи очереди, см. BasePeer)
+    this->publishSpectators(task);
+    for(QTcpSocket* socket : task->spectators){
+        auto spectator = spectators_.find(socket);
+        if(spectator == spectators_.end())
+            continue;
+
+        disconnect(socket, nullptr, this, nullptr);
+        this->drainSpectator(spectator->second, true);
+        spectators_.erase(spectator);
+    }
+    task->spectators.clear();
+
+    // Сокеты игроков больше не относятся к сессии (соединения ожидают следующей игры)
+    net::GameSession& s = task->session;
+    for(size_t i = 0; i < s.playersCount(); i++){
+        net::PlayerPeer& player = s.getPlayer(static_cast<int>(i));
+        socketSessions_.erase(player.getSocket());
+        this->retainPlayer(std::move(player));
+    }
+
+    // Уничтожение сессии (соединения, не оставленные для следующей игры, закрываются после отправки последних сообщений)
+    context_.sessions.erase(sessionKey);
+    context_.admission.sessionClosed();
+    std::cout << "Session (" << sessionKey << ") closed." << std::endl;
+}
+
+/**
+ * Отказать игроку: сервер перегружен (отправляет срок повтора и закрывает соединение)
+ * @param player Игрок
+ * @param verdict Решение контроля приема
+ */
+void GameServer::rejectBusy(net::PlayerPeer&& player, AdmissionControl::Verdict verdict)
+{
+    static const char* reasons[] = {"", "too many connections", "too many handshakes", "too many sessions"};
+    std::cout << "Client " << player.getSocket() << " rejected (" << reasons[verdict] << ")." << std::endl;
+
+    // Ответ отправляется сразу, соединение закрывается при уничтожении игрока (после отправки)
+    net::PlayerPeer rejected(std::move(player));
+    disconnect(rejected.getSocket(), nullptr, this, nullptr);
+    rejected.postMessage(net::MsgServerBusy(settings_.busyRetryAfter));
+    rejected.flushOutbox();
+    this->reportAdmission();
+}
+
+/**
+ * Записать в журнал состояние контроля приема, если оно сменилось (прием, либо отказы)
+ */
+void GameServer::reportAdmission()
+{
+    if(context_.admission.takeStateChange()){
+        std::cout << context_.admission.describe() << std::endl;
+    }
+}
+
+/**
+ * Учитывать соединение контролем приема до уничтожения его сокета
+ * @param socket Сокет
+ */
+void GameServer::trackConnection(QTcpSocket* socket)
+{
+    // Соединение не связано с объектом сервера, поэтому не снимается при отключении сокета от его слотов
+    AdmissionControl* admission = &context_.admission;
+    connect(socket, &QObject::destroyed, [admission]{ admission->connectionClosed(); });
+}
+
+/// S L O T S
+
+/**
+ * Обработка события появления новых подключений
+ */
+void GameServer::onNewConnection()
+{
+    // Подключения через порт и через локальный сокет принимаются одинаково
+    auto server = qobject_cast<QTcpServer*>(sender());
+    if(server == nullptr)
+        return;
+
+    // Принять все ожидающие подключения
+    while(server->hasPendingConnections())
+    {
+        // Получить сокет подключившегося клиента
+        QTcpSocket* clientSocket = server->nextPendingConnection();
+
+        // Если соединение не установлено
+        if(clientSocket->state() != QAbstractSocket::ConnectedState){
+            clientSocket->deleteLater();
+            continue;
+        }
+
+        // Адрес, подключающийся чаще допустимого, отключается сразу (без ответа и записи в журнал)
+        uint64_t peerKey = peerKeyOf(clientSocket);
+        if(peerKey != 0 && !context_.connectionRate.consume(peerKey)){
+            clientSocket->abort();
+            clientSocket->deleteLater();
+            continue;
+        }
+
+        // Сверх пределов нагрузки клиент сразу получает отказ со сроком повтора (соединение не учитывается)
+        AdmissionControl::Verdict verdict = context_.admission.admitConnection();
+        if(verdict != AdmissionControl::ADMITTED){
+            this->rejectBusy(net::PlayerPeer(clientSocket), verdict);
+            continue;
+        }
+        this->reportAdmission();
+
+        // Информация о клиенте
+        std::cout << "Client " << clientSocket << " connected (" << (peerKey != 0 ? clientSocket->peerAddress().toString().toStdString() : "local") << ")" << std::endl;
+
+        // Далее игрок, сразу же после подключения, отправляет запрос (сообщение) на присоединение к игре
+        // Запрос обрабатывается по готовности данных, не блокируя прием других подключений, срок ограничен таймером
+        Timers::TimerId timer = this->addTimer(settings_.handshakeTimeout, ServerTimer{HANDSHAKE_TIMEOUT, reinterpret_cast<uintptr_t>(clientSocket), 0});
+        auto handshake = handshakes_.emplace(clientSocket, Handshake{net::PlayerPeer(clientSocket), timer, AWAITING_QUERY, false, net::FleetBoard()});
+        handshake.first->second.player.setOutboxLimits(static_cast<qint64>(settings_.outboxHighWater), static_cast<qint64>(settings_.outboxLimit));
+        this->trackConnection(clientSocket);
+        connect(clientSocket,SIGNAL(readyRead()),this,SLOT(onReadyRead()));
+        connect(clientSocket,SIGNAL(disconnected()),this,SLOT(onDisconnected()));
+    }
+}
+
+/**
+ * Обработка события готовности сокета к чтению
+ */
+void GameServer::onReadyRead()
+{
+    auto socket = qobject_cast<QTcpSocket*>(sender());
+    if(socket == nullptr)
+        return;
+
+    // Если игрок еще не присоединен к сессии - ожидается запрос на подключение к игре
+    auto handshake = handshakes_.find(socket);
+    if(handshake != handshakes_.end())
+    {
+        this->advanceHandshake(socket, handshake->second);
+        return;
+    }
+
+    // Наблюдатель ничего не присылает (данные отбрасываются)
+    if(spectators_.count(socket) > 0){
+        socket->readAll();
+        return;
+    }
+
+    // Если игрок присоединен к сессии - передать сессии все полученные сообщения
+    auto owner = socketSessions_.find(socket);
+    if(owner == socketSessions_.end())
+        return;
+
+    uintptr_t sessionKey = owner->second;
+    SessionRegistry::SessionPtr task = context_.sessions.find(sessionKey);
+    if(!task)
+        return;
+
+    int playerIndex = task->session.indexOf(socket);
+    if(playerIndex < 0)
+        return;
+
+    net::PlayerPeer& player = task->session.getPlayer(playerIndex);
+    uint64_t messageKey = player.hasMessage() ? messageKeyOf(socket) : 0;
+    bool received = false;
+    while(player.hasMessage())
+    {
+        net::Msg message = player.readMessage();
+
+        // Клиент, присылающий сообщения чаще допустимого, отключается до того, как они попадут в сессию
+        if(messageKey != 0 && !context_.messageRate.consume(messageKey)){
+            std::cout << "Client " << socket << " exceeded message rate. Disconnected." << std::endl;
+            socket->abort();
+            return;
+        }
+
+        // Пока второй игрок не присоединился, сообщения игнорируются
+        if(task->session.playersCount() < 2)
+            continue;
+
+        task->postMessage(playerIndex, std::move(message));
+        received = true;
+    }
+
+    if(received && !task->scheduled){
+        this->schedule(sessionKey, task.get());
+    }
+}
+
+/**
+ * Обработка события отключения клиента
+ */
+void GameServer::onDisconnected()
+{
+    auto socket = qobject_cast<QTcpSocket*>(sender());
+    if(socket == nullptr)
+        return;
+
+    // Отключился игрок, не успевший присоединиться к игре
+    auto handshake = handshakes_.find(socket);
+    if(handshake != handshakes_.end()){
+        this->eraseHandshake(handshake);
+        std::cout << "Client " << socket << " disconnected before joining." << std::endl;
+        return;
+    }
+
+    // Отключился наблюдатель (сессия могла быть уже закрыта)
+    auto spectator = spectators_.find(socket);
+    if(spectator != spectators_.end()){
+        std::cout << "Spectator " << socket << " disconnected from session (" << spectator->second.sessionKey << ")." << std::endl;
+        SessionRegistry::SessionPtr task = context_.sessions.find(spectator->second.sessionKey);
+        if(task){
+            task->spectators.erase(std::find(task->spectators.begin(), task->spectators.end(), socket));
+            if(!task->scheduled) task->session.setSpectated(!task->spectators.empty());
+        }
+        spectators_.erase(spectator);
+        return;
+    }
+
+    // Отключился игрок игровой сессии
+    auto owner = socketSessions_.find(socket);
+    if(owner == socketSessions_.end())
+        return;
+
+    uintptr_t sessionKey = owner->second;
+    SessionRegistry::SessionPtr task = context_.sessions.find(sessionKey);
+    if(!task){
+        std::cout << "Client " << socket << " disconnected from session (" << sessionKey << ")." << std::endl;
+        return;
+    }
+
+    // Медленный получатель отключается сервером (флаг выставляется потоком реактора, поэтому читается без гонки)
+    int playerIndex = task->session.indexOf(socket);
+    if(playerIndex >= 0 && task->session.getPlayer(playerIndex).isSlowConsumer()){
+        std::cout << "Client " << socket << " disconnected from session (" << sessionKey << ") as slow consumer." << std::endl;
+    }else{
+        std::cout << "Client " << socket << " disconnected from session (" << sessionKey << ")." << std::endl;
+    }
+
+    // Если второй игрок еще не присоединился - сессию можно завершить сразу
+    if(task->session.playersCount() < 2){
+        this->closeSession(sessionKey, task.get());
+        return;
+    }
+
+    // Иначе отключение обрабатывается сессией в пуле
+    task->postDisconnected(playerIndex);
+    if(!task->scheduled){
+        this->schedule(sessionKey, task.get());
+    }
+}
+
+/**
+ * Обработка завершения задачи сессии в пуле потоков (вызывается в потоке сервера)
+ * @param sessionKey Ключ сессии
+ */
+void GameServer::onSessionProcessed(quint64 sessionKey)
+{
+    auto key = static_cast<uintptr_t>(sessionKey);
+    SessionRegistry::SessionPtr task = context_.sessions.find(key);
+    if(!task)
+        return;
+
+    // Вернуть игроков, пришедших за время выполнения (их снимки игры уходят вместе с остальными сообщениями)
+    for(auto& resume : task->resumes){
+        this->applyResume(key, task.get(), resume.first, std::move(resume.second));
+    }
+    task->resumes.clear();
+
+    // Записать в сокеты сообщения, подготовленные сессией, наблюдатели получают события
+    task->session.flushOutboxes();
+    this->publishSpectators(task.get());
+
+    // Если за время выполнения поступили новые события - обработать их следующей задачей
+    if(task->hasEvents()){
+        this->schedule(key, task.get());
+        return;
+    }
+
+    task->scheduled = false;
+    if(task->session.isFinished()){
+        this->closeSession(key, task.get());
+    }else{
+        this->armTurnTimer(key, task.get());
+        this->armResumeTimer(key, task.get());
+    }
+}
+
+/**
+ * Обработка такта колеса таймеров
+ */
+void GameServer::onTimerTick()
+{
+    // Истекшие таймеры извлекаются из колеса пачкой и обрабатываются после (обработка может добавлять новые)
+    timers_.advance(clock_.elapsed(), expiredTimers_);
+    for(const ServerTimer& timer : expiredTimers_){
+        this->onTimerExpired(timer);
+    }
+    expiredTimers_.clear();
+
+    // Давно не использованные корзины ограничения частоты обнуляются понемногу каждый такт
+    context_.connectionRate.age(settings_.timerTick);
+    context_.messageRate.age(settings_.timerTick);
+
+    if(timers_.size() == 0){
+        tickTimer_.stop();
+    }
+}
+
+/**
+ * Разослать подписчикам изменения списка сессий, накопленные за период
+ */
+void GameServer::onLobbyTick()
+{
+    std::vector<net::Msg> changes;
+    if(!context_.lobby.takeChanges(index_, changes))
+        return;
+
+    // Запись может разорвать соединение медленного получателя (рукопожатие изымается), поэтому подписчики
+    // выбираются заранее
+    std::vector<QTcpSocket*> subscribers;
+    subscribers.reserve(lobbySubscribers_);
+    for(const auto& handshake : handshakes_){
+        if(handshake.second.stage == LOBBY_SUBSCRIBED) subscribers.push_back(handshake.first);
+    }
+
+    for(QTcpSocket* socket : subscribers){
+        auto handshake = handshakes_.find(socket);
+        if(handshake == handshakes_.end())
+            continue;
+
+        net::PlayerPeer& subscriber = handshake->second.player;
+        for(const net::Msg& message : changes){
+            subscriber.postMessage(message);
+        }
+        subscriber.flushOutbox();
+    }
+}
+
+/**
+ * Обработка записи данных наблюдателя (очередь наблюдателя передается сокету по мере записи)
+ */
+void GameServer::onSpectatorWritten()
+{
+    auto socket = qobject_cast<QTcpSocket*>(sender());
+    auto spectator = spectators_.find(socket);
+    if(spectator != spectators_.end() && !spectator->second.queue.empty()){
+        this->drainSpectator(spectator->second);
+    }
+}
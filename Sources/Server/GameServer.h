@@ -0,0 +1,421 @@
+#pragma once
+
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QByteArray>
+
+#include "../NetworkApi/PlayerPeer.hpp"
+#include "../NetworkApi/FleetBoard.hpp"
+#include "ServerContext.hpp"
+#include "TimerWheel.hpp"
+#include "SpectatorQueue.hpp"
+
+/**
+ * Игровой сервер (реактор)
+ * Все подключения реактора обслуживаются одним циклом событий (без блокирующих ожиданий и потоков на сессию).
+ * Логика сессий выполняется короткими задачами в пуле потоков, сокеты используются только потоком реактора.
+ * Все сроки (рукопожатия, ожидание второго игрока, ходы, проверка соединений) отслеживает одно колесо таймеров.
+ * Несколько реакторов в разных потоках могут слушать один порт (SO_REUSEPORT), игрок, присоединяющийся
+ * к сессии другого реактора, передается ему вместе с соединением
+ */
+class GameServer final : public QObject
+{
+Q_OBJECT
+
+public:
+    /**
+     * Конструктор
+     * @param context Общее состояние сервера
+     * @param index Номер реактора
+     * @param parent Родительский объект
+     */
+    explicit GameServer(ServerContext& context, unsigned index = 0, QObject* parent = nullptr);
+
+    /**
+     * Деструктор
+     */
+    ~GameServer() override;
+
+    /**
+     * Наибольшее кол-во реакторов, которые могут слушать один порт на данной платформе
+     * @return Кол-во (1, если SO_REUSEPORT не поддерживается)
+     */
+    static unsigned maxReactors();
+
+    /**
+     * Начать прослушивание порта (вызывается в потоке реактора)
+     * @param port Порт
+     * @return Удалось ли открыть прослушивающий сокет
+     * @details Если реакторов несколько, порт открывается с SO_REUSEPORT (подключения распределяет ядро)
+     */
+    Q_INVOKABLE bool listen(quint16 port);
+
+    /**
+     * Начать прием подключений через локальный сокет (клиенты на той же машине, вместе с портом)
+     * @param path Путь сокета
+     * @return Удалось ли открыть сокет
+     */
+    bool listenLocal(const std::string& path);
+
+    /**
+     * Принять игрока, переданного другим реактором (вызывается в потоке реактора)
+     * @param descriptor Дескриптор соединения (копия, принадлежит теперь этому реактору)
+     * @param sessionKey Ключ сессии
+     * @param matchmaking Игрок ищет любого соперника (сессия найдена в очереди)
+     * @param fleetCells Расстановка кораблей игрока (битовая карта, пусто - не задана)
+     */
+    Q_INVOKABLE void adoptPlayer(quint64 descriptor, quint64 sessionKey, bool matchmaking, QByteArray fleetCells);
+
+    /**
+     * Принять наблюдателя, переданного другим реактором (вызывается в потоке реактора)
+     * @param descriptor Дескриптор соединения (копия, принадлежит теперь этому реактору)
+     * @param sessionKey Ключ сессии
+     */
+    Q_INVOKABLE void adoptSpectator(quint64 descriptor, quint64 sessionKey);
+
+    /**
+     * Принять игрока, возвращающегося в игру, переданного другим реактором (вызывается в потоке реактора)
+     * @param descriptor Дескриптор соединения (копия, принадлежит теперь этому реактору)
+     * @param sessionKey Ключ сессии
+     * @param token Токен возобновления
+     */
+    Q_INVOKABLE void adoptResumed(quint64 descriptor, quint64 sessionKey, quint64 token);
+
+private slots:
+    /**
+     * Обработка события появления новых подключений
+     */
+    void onNewConnection();
+
+    /**
+     * Обработка события готовности сокета к чтению
+     */
+    void onReadyRead();
+
+    /**
+     * Обработка события отключения клиента
+     */
+    void onDisconnected();
+
+    /**
+     * Обработка завершения задачи сессии в пуле потоков (вызывается в потоке сервера)
+     * @param sessionKey Ключ сессии
+     */
+    void onSessionProcessed(quint64 sessionKey);
+
+    /**
+     * Обработка такта колеса таймеров
+     */
+    void onTimerTick();
+
+    /**
+     * Разослать подписчикам изменения списка сессий, накопленные за период
+     */
+    void onLobbyTick();
+
+    /**
+     * Обработка записи данных наблюдателя (очередь наблюдателя передается сокету по мере записи)
+     */
+    void onSpectatorWritten();
+
+private:
+    /// Этап рукопожатия
+    enum HandshakeStage {
+        // Данные от клиента еще не поступали
+        AWAITING_QUERY,
+        // Запрос получен частично (клиент дописывает его)
+        RECEIVING_QUERY,
+        // Клиент подписан на список сессий и выбирает сессию (срок рукопожатия не отслеживается)
+        LOBBY_SUBSCRIBED,
+        // Соединение игрока ожидает следующей игры (после окончания игры или неудачного запроса, не рукопожатие)
+        AWAITING_NEXT_GAME
+    };
+
+    /// Тип таймера сервера
+    enum TimerType {
+        // Срок рукопожатия
+        HANDSHAKE_TIMEOUT,
+        // Срок ожидания второго игрока
+        LOBBY_TIMEOUT,
+        // Срок хода
+        TURN_TIMEOUT,
+        // Проверка соединений игроков сессии
+        HEARTBEAT,
+        // Срок возвращения отключившихся игроков
+        RESUME_TIMEOUT
+    };
+
+    /// Таймер сервера (данные таймера в колесе)
+    struct ServerTimer
+    {
+        // Тип
+        TimerType type;
+        // Сокет (для рукопожатия) или ключ сессии
+        uintptr_t target;
+        // Номер хода (для срока хода)
+        quint64 move;
+    };
+
+    /// Колесо таймеров сервера
+    typedef TimerWheel<ServerTimer> Timers;
+
+    /// Наблюдатель игры
+    struct Spectator
+    {
+        // Соединение (ответы на запрос и текущее состояние игры отправляются через его очередь)
+        net::PlayerPeer peer;
+        // Ключ сессии
+        uintptr_t sessionKey;
+        // События, еще не переданные сокету (буферы разделяются всеми наблюдателями сессии)
+        SpectatorQueue<QByteArray> queue;
+        // Получено ли текущее состояние игры (сессия в пуле отправит его по завершении задачи)
+        bool synced;
+    };
+
+    /// Подключение в процессе рукопожатия (ожидается запрос на подключение к игре)
+    struct Handshake
+    {
+        // Игрок
+        net::PlayerPeer player;
+        // Таймер срока рукопожатия
+        Timers::TimerId timer;
+        // Этап
+        HandshakeStage stage;
+        // Расстановка кораблей получена (валидная расстановка включает режим, в котором ходы обрабатывает сервер)
+        bool fleetReceived;
+        // Расстановка кораблей
+        net::FleetBoard fleet;
+    };
+
+    /// Общее состояние сервера
+    ServerContext& context_;
+    /// Номер реактора
+    unsigned index_;
+    /// Настройки
+    ServerSettings settings_;
+    /// TCP сервер (дочерний объект - переносится в поток реактора вместе с ним)
+    QTcpServer tcpServer_;
+    /// Сервер подключений через локальный сокет (сокеты его клиентов - те же QTcpSocket, см. net::PeerTransport)
+    QTcpServer localServer_;
+    /// Часы сервера (монотонные)
+    QElapsedTimer clock_;
+    /// Колесо таймеров
+    Timers timers_;
+    /// Истекшие таймеры (обрабатываются пачкой за такт, память используется повторно)
+    std::vector<ServerTimer> expiredTimers_;
+    /// Таймер тактов колеса (работает, пока в колесе есть таймеры, дочерний объект)
+    QTimer tickTimer_;
+    /// Подключения в процессе рукопожатия
+    std::unordered_map<QTcpSocket*,Handshake> handshakes_;
+    /// Принадлежность сокетов игровым сессиям
+    std::unordered_map<QTcpSocket*,uintptr_t> socketSessions_;
+    /// Кол-во подписчиков списка сессий среди рукопожатий
+    size_t lobbySubscribers_ = 0;
+    /// Таймер рассылки изменений списка сессий (работает, пока есть подписчики, дочерний объект)
+    QTimer lobbyTimer_;
+    /// Наблюдатели игр сессий реактора
+    std::unordered_map<QTcpSocket*,Spectator> spectators_;
+    /// Счетчик сессий реактора (для ключей)
+    quint64 sessionsCounter_ = 0;
+
+    /**
+     * Продвинуть рукопожатие по мере поступления данных
+     * @param socket Сокет клиента
+     * @param handshake Рукопожатие
+     */
+    void advanceHandshake(QTcpSocket* socket, Handshake& handshake);
+
+    /**
+     * Изъять подключение из таблицы рукопожатий (учитывает завершение рукопожатия, либо подписки на список сессий)
+     * @param handshake Рукопожатие
+     */
+    void eraseHandshake(std::unordered_map<QTcpSocket*,Handshake>::iterator handshake);
+
+    /**
+     * Оставить соединение игрока открытым для следующего запроса на подключение к игре (после окончания игры или
+     * неудачного запроса; если повторное использование соединений отключено - соединение закрывается)
+     * @param player Игрок (сообщения уже переданы сокету)
+     */
+    void retainPlayer(net::PlayerPeer&& player);
+
+    /**
+     * Подписать клиента на список сессий, ожидающих второго игрока (отправляет снимок списка)
+     * @param handshake Рукопожатие
+     */
+    void subscribeLobby(Handshake& handshake);
+
+    /**
+     * Обработать запрос игрока на подключение к игре
+     * @param player Игрок (рукопожатие которого завершено)
+     * @param playerQuery Сообщение-запрос
+     * @param fleet Расстановка кораблей игрока (может быть не задана)
+     */
+    void processPlayerQuery(net::PlayerPeer&& player, net::Msg& playerQuery, const net::FleetBoard& fleet);
+
+    /**
+     * Создать сессию, в которой игрок ожидает второго
+     * @param player Игрок
+     * @param fleet Расстановка кораблей игрока
+     * @param matchmaking Сессия создана для поиска соперника (ключ помещается в очередь)
+     */
+    void createSession(net::PlayerPeer&& player, const net::FleetBoard& fleet, bool matchmaking);
+
+    /**
+     * Присоединить игрока к ожидающей сессии и начать игру
+     * @param player Игрок
+     * @param fleet Расстановка кораблей игрока
+     * @param sessionKey Ключ сессии
+     * @param task Сессия (ожидает второго игрока)
+     * @param sendKey Сообщить игроку ключ сессии (при поиске соперника игрок его не знает)
+     */
+    void joinSession(net::PlayerPeer&& player, const net::FleetBoard& fleet, uintptr_t sessionKey, const SessionRegistry::SessionPtr& task, bool sendKey);
+
+    /**
+     * Найти игроку любого соперника
+     * @param player Игрок
+     * @param fleet Расстановка кораблей игрока
+     */
+    void matchPlayer(net::PlayerPeer&& player, const net::FleetBoard& fleet);
+
+    /**
+     * Присоединить игрока к сессии по ключу (сессии другого реактора - передать игрока ему)
+     * @param player Игрок
+     * @param fleet Расстановка кораблей игрока
+     * @param sessionKey Ключ сессии
+     * @param matchmaking Сессия взята из очереди поиска соперника (если она уже не актуальна - поиск продолжается)
+     */
+    void joinByKey(net::PlayerPeer&& player, const net::FleetBoard& fleet, uintptr_t sessionKey, bool matchmaking);
+
+    /**
+     * Передать игрока реактору, владеющему сессией
+     * @param player Игрок
+     * @param fleet Расстановка кораблей игрока
+     * @param sessionKey Ключ сессии
+     * @param matchmaking Сессия взята из очереди поиска соперника
+     */
+    void forwardPlayer(net::PlayerPeer&& player, const net::FleetBoard& fleet, uintptr_t sessionKey, bool matchmaking);
+
+    /**
+     * Вернуть игрока в игру после разрыва соединения (сессии другого реактора - передать игрока ему)
+     * @param player Игрок на новом соединении (рукопожатие которого завершено)
+     * @param sessionKey Ключ сессии
+     * @param token Токен возобновления
+     */
+    void resumePlayer(net::PlayerPeer&& player, uintptr_t sessionKey, uint64_t token);
+
+    /**
+     * Передать возвращающегося игрока реактору, владеющему сессией
+     * @param player Игрок
+     * @param sessionKey Ключ сессии
+     * @param token Токен возобновления
+     */
+    void forwardResumed(net::PlayerPeer&& player, uintptr_t sessionKey, uint64_t token);
+
+    /**
+     * Заменить соединение отключившегося игрока новым (вызывается, только пока сессия не выполняется в пуле)
+     * @param sessionKey Ключ сессии
+     * @param task Сессия
+     * @param token Токен возобновления
+     * @param player Игрок на новом соединении (получает снимок игры, либо отказ)
+     */
+    void applyResume(uintptr_t sessionKey, SessionTask* task, uint64_t token, net::PlayerPeer&& player);
+
+    /**
+     * Начать наблюдение за игрой (сессии другого реактора - передать наблюдателя ему)
+     * @param player Соединение наблюдателя (рукопожатие которого завершено)
+     * @param sessionKey Ключ сессии
+     */
+    void spectate(net::PlayerPeer&& player, uintptr_t sessionKey);
+
+    /**
+     * Передать наблюдателя реактору, владеющему сессией
+     * @param player Соединение наблюдателя
+     * @param sessionKey Ключ сессии
+     */
+    void forwardSpectator(net::PlayerPeer&& player, uintptr_t sessionKey);
+
+    /**
+     * Разослать наблюдателям сессии накопленные события (кодируются один раз) и отправить текущее состояние игры
+     * новым наблюдателям (вызывается, только пока сессия не выполняется в пуле)
+     * @param task Сессия
+     */
+    void publishSpectators(SessionTask* task);
+
+    /**
+     * Передать очередь наблюдателя сокету, пока очередь сокета невелика
+     * @param spectator Наблюдатель
+     * @param all Передать очередь целиком (перед закрытием соединения)
+     */
+    void drainSpectator(Spectator& spectator, bool all = false);
+
+    /**
+     * Добавить таймер в колесо
+     * @param delay Задержка (мс)
+     * @param timer Данные таймера
+     * @return Идентификатор таймера
+     */
+    Timers::TimerId addTimer(int delay, const ServerTimer& timer);
+
+    /**
+     * Отменить таймер
+     * @param id Идентификатор таймера (обнуляется)
+     */
+    void cancelTimer(Timers::TimerId& id);
+
+    /**
+     * Взвести таймер хода, если ход сменился
+     * @param sessionKey Ключ сессии
+     * @param task Сессия
+     */
+    void armTurnTimer(uintptr_t sessionKey, SessionTask* task);
+
+    /**
+     * Взвести срок возвращения, если в сессии есть отключившиеся игроки (иначе снять)
+     * @param sessionKey Ключ сессии
+     * @param task Сессия
+     */
+    void armResumeTimer(uintptr_t sessionKey, SessionTask* task);
+
+    /**
+     * Обработать истекший таймер
+     * @param timer Данные таймера
+     */
+    void onTimerExpired(const ServerTimer& timer);
+
+    /**
+     * Поставить сессию в пул потоков
+     * @param sessionKey Ключ сессии
+     * @param task Сессия
+     */
+    void schedule(uintptr_t sessionKey, SessionTask* task);
+
+    /**
+     * Завершить сессию (отключает игроков)
+     * @param sessionKey Ключ сессии
+     * @param task Сессия
+     */
+    void closeSession(uintptr_t sessionKey, SessionTask* task);
+
+    /**
+     * Отказать игроку: сервер перегружен (отправляет срок повтора и закрывает соединение)
+     * @param player Игрок
+     * @param verdict Решение контроля приема
+     */
+    void rejectBusy(net::PlayerPeer&& player, AdmissionControl::Verdict verdict);
+
+    /**
+     * Записать в журнал состояние контроля приема, если оно сменилось (прием, либо отказы)
+     */
+    void reportAdmission();
+
+    /**
+     * Учитывать соединение контролем приема до уничтожения его сокета
+     * @param socket Сокет
+     */
+    void trackConnection(QTcpSocket* socket);
+};
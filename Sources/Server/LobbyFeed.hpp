@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../NetworkApi/MsgLobbyUpdate.hpp"
+
+/**
+ * Список сессий, ожидающих второго игрока по ключу (лобби), и его изменения для подписчиков
+ * Подписчик получает снимок один раз, далее - только изменения, накопленные за период рассылки. Изменения
+ * накапливаются отдельно для каждого потребителя (реактора), у которого есть подписчики, и сливаются: сессия,
+ * добавленная и заполненная за один период, в рассылку не попадает. Поэтому объем рассылки зависит от числа
+ * изменений, а не от размера списка. Список разделяется потоками (доступ под блокировкой)
+ */
+class LobbyFeed
+{
+private:
+    /// Потребитель изменений
+    struct Consumer
+    {
+        // Есть ли у потребителя подписчики (изменения накапливаются только для них)
+        bool watching = false;
+        // Изменения с прошлой рассылки (true - сессия добавлена, false - удалена)
+        std::unordered_map<uintptr_t, bool> changes;
+    };
+
+    /// Ключи сессий списка и их позиции в нем (удаление - перестановкой последнего)
+    std::vector<uintptr_t> open_;
+    std::unordered_map<uintptr_t, size_t> positions_;
+    /// Потребители изменений
+    std::vector<Consumer> consumers_;
+    /// Блокировка
+    mutable std::mutex mutex_;
+
+public:
+    /**
+     * Конструктор
+     * @param consumers Кол-во потребителей изменений
+     */
+    explicit LobbyFeed(unsigned consumers = 1):
+            consumers_(consumers > 0 ? consumers : 1){}
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    LobbyFeed(const LobbyFeed& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    LobbyFeed& operator=(const LobbyFeed& other) = delete;
+
+    /**
+     * Добавить сессию в список (сессия ожидает второго игрока по ключу)
+     * @param sessionKey Ключ сессии
+     */
+    void sessionOpened(uintptr_t sessionKey)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(positions_.count(sessionKey) > 0)
+            return;
+
+        positions_[sessionKey] = open_.size();
+        open_.push_back(sessionKey);
+        this->record(sessionKey, true);
+    }
+
+    /**
+     * Удалить сессию из списка (второй игрок присоединился, либо сессия закрыта)
+     * @param sessionKey Ключ сессии (отсутствующие в списке пропускаются)
+     */
+    void sessionClosed(uintptr_t sessionKey)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto position = positions_.find(sessionKey);
+        if(position == positions_.end())
+            return;
+
+        uintptr_t last = open_.back();
+        open_[position->second] = last;
+        positions_[last] = position->second;
+        open_.pop_back();
+        positions_.erase(sessionKey);
+        this->record(sessionKey, false);
+    }
+
+    /**
+     * Получить снимок списка для нового подписчика (далее изменения накапливаются для потребителя)
+     * @param consumer Номер потребителя
+     * @param limit Наибольшее кол-во сессий в снимке (очередь подписчика не должна превысить предел; неполный снимок
+     * отмечается LOBBY_SNAPSHOT_TRUNCATED)
+     * @param out Сообщения снимка (дописываются)
+     */
+    void snapshot(unsigned consumer, size_t limit, std::vector<net::Msg>& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        consumers_[consumer].watching = true;
+        if(open_.size() <= limit){
+            makeUpdates(open_, std::vector<uintptr_t>(), true, out);
+        }else{
+            makeUpdates(std::vector<uintptr_t>(open_.begin(), open_.begin() + static_cast<std::ptrdiff_t>(limit)), std::vector<uintptr_t>(), true, out, true);
+        }
+    }
+
+    /**
+     * Извлечь изменения, накопленные для потребителя с прошлой рассылки
+     * @param consumer Номер потребителя
+     * @param out Сообщения изменений (дописываются)
+     * @return Были ли изменения
+     */
+    bool takeChanges(unsigned consumer, std::vector<net::Msg>& out)
+    {
+        std::vector<uintptr_t> added, removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Consumer& c = consumers_[consumer];
+            if(c.changes.empty())
+                return false;
+
+            for(const auto& change : c.changes){
+                (change.second ? added : removed).push_back(change.first);
+            }
+            c.changes.clear();
+        }
+
+        makeUpdates(added, removed, false, out);
+        return true;
+    }
+
+    /**
+     * Прекратить накопление изменений для потребителя (подписчиков у него не осталось)
+     * @param consumer Номер потребителя
+     */
+    void unwatch(unsigned consumer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        consumers_[consumer].watching = false;
+        consumers_[consumer].changes.clear();
+    }
+
+    /**
+     * Очистить список (подписки потребителей сохраняются)
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(uintptr_t sessionKey : open_){
+            this->record(sessionKey, false);
+        }
+        open_.clear();
+        positions_.clear();
+    }
+
+    /**
+     * Кол-во сессий в списке
+     * @return Кол-во
+     */
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return open_.size();
+    }
+
+private:
+    /**
+     * Учесть изменение для потребителей с подписчиками (встречные изменения взаимно исключаются)
+     * @param sessionKey Ключ сессии
+     * @param added Добавлена ли сессия
+     */
+    void record(uintptr_t sessionKey, bool added)
+    {
+        for(Consumer& c : consumers_){
+            if(!c.watching)
+                continue;
+
+            auto change = c.changes.find(sessionKey);
+            if(change != c.changes.end() && change->second != added) c.changes.erase(change);
+            else c.changes[sessionKey] = added;
+        }
+    }
+
+    /**
+     * Разложить изменения по сообщениям
+     * @param added Добавленные сессии
+     * @param removed Удаленные сессии
+     * @param snapshot Снимок ли это (первое и последнее сообщения отмечаются, пустой снимок - одно сообщение)
+     * @param out Сообщения (дописываются)
+     * @param truncated Неполный ли снимок (отмечается последнее сообщение)
+     */
+    static void makeUpdates(const std::vector<uintptr_t>& added, const std::vector<uintptr_t>& removed, bool snapshot, std::vector<net::Msg>& out, bool truncated = false)
+    {
+        size_t total = added.size() + removed.size();
+        size_t next = 0;
+        do
+        {
+            net::MsgLobbyUpdate::LobbyUpdate update = {};
+            if(snapshot && next == 0) update.flags |= net::MsgLobbyUpdate::LOBBY_SNAPSHOT_BEGIN;
+
+            for(size_t i = 0; i < net::MsgLobbyUpdate::KEYS_PER_UPDATE && next < total; i++, next++){
+                if(next < added.size()){
+                    update.keys[i] = added[next];
+                    update.added++;
+                }else{
+                    update.keys[i] = removed[next - added.size()];
+                    update.removed++;
+                }
+            }
+
+            if(snapshot && next == total) update.flags |= net::MsgLobbyUpdate::LOBBY_SNAPSHOT_END;
+            if(truncated && next == total) update.flags |= net::MsgLobbyUpdate::LOBBY_SNAPSHOT_TRUNCATED;
+            out.push_back(net::MsgLobbyUpdate(update));
+        }
+        while(next < total);
+    }
+};
@@ -1,28 +1,33 @@
 #include <iostream>
-#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <initializer_list>
 #include <QtPlugin>
+#include <QCoreApplication>
+#include <QThread>
 
-#include "../NetworkApi/Msg.hpp"
-#include "../NetworkApi/MsgGameStatus.hpp"
-#include "../NetworkApi/MsgShotAvailable.hpp"
-#include "../NetworkApi/MsgPlayerQuery.hpp"
-#include "../NetworkApi/MsgPlayerResponse.hpp"
-#include "../NetworkApi/MsgShotResults.hpp"
-#include "../NetworkApi/PlayerPeer.hpp"
-#include "../NetworkApi/GameSession.hpp"
+#include "GameServer.h"
 
 /// Прослушиваемый порт
 unsigned _port;
-/// Состояние сервера
-bool _serverOn = true;
-/// Ассоциативный игровых массив сессий
-std::unordered_map<uintptr_t,net::GameSession> _sessions;
 
 /**
- * Процедура игровой сессии (работает в отдельном потоке)
- * @param sessionKey Ключ сессии
+ * Разобрать список чисел через запятую (пропущенные значения не меняются)
+ * @param list Список
+ * @param values Получатели значений по порядку
  */
-void sessionProcedure(uintptr_t sessionKey);
+static void parseList(const std::string& list, std::initializer_list<unsigned*> values)
+{
+    size_t begin = 0;
+    for(unsigned* value : values){
+        if(begin > list.size()) break;
+        size_t end = std::min(list.find(',', begin), list.size());
+        if(end > begin) *value = static_cast<unsigned>(std::stoul(list.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+}
 
 /**
  * Точка входа
@@ -39,187 +44,100 @@ int main(int argc, char* argv[])
 
     try
     {
+        // Цикл событий (обслуживает подключения первого реактора)
+        QCoreApplication app(argc, argv);
+
         // Ввод прослушиваемого порта
         std::cout << "Please enter port: ";
         std::cin >> _port;
 
-        // Инициализация TCP сервера
-        QTcpServer tcpServer;
-        if(!tcpServer.listen(QHostAddress::Any, static_cast<quint16>(_port))){
-            throw std::runtime_error("Error: can't open listening socket.");
+        // Параметры: "--rate <подключений>,<сообщений>" - допустимая частота в секунду: подключений с одного адреса,
+        // сообщений по одному соединению (0 - без ограничения; за маршрутизатором частоту подключений следует
+        // отключить - все клиенты приходят с его адреса). Остальные аргументы - позиционные (см. ниже)
+        ServerSettings settings;
+        std::vector<std::string> arguments;
+        for(int i = 1; i < argc; i++){
+            std::string argument(argv[i]);
+            if(argument == "--rate" && i + 1 < argc){
+                parseList(argv[++i], {&settings.connectionRate, &settings.messageRate});
+            }else{
+                arguments.push_back(argument);
+            }
         }
 
-        std::cout << "Listening port (" << _port << ")." << std::endl;
-
-        // Основной цикл сервера
-        while(_serverOn)
-        {
-            // Ожидать новых подключений
-            tcpServer.waitForNewConnection(-1);
-
-            // Получить сокет подключившегося клиента
-            QTcpSocket* clientSocket = tcpServer.nextPendingConnection();
-
-            // Если соединение установлено
-            if(clientSocket->state() == QAbstractSocket::ConnectedState)
-            {
-                // Информация о клиенте
-                std::cout << "Client " << clientSocket << " connected (" << clientSocket->peerAddress().toString().toStdString() << ")" << std::endl;
-
-                // Создать объект для взаимодействия с игроком
-                net::PlayerPeer player(clientSocket);
-
-                // Далее игрок игрок, сразу же после подключения, отправляет запрос (сообщение) на присоединение к игре
-                // Ожидаем его с небольшим тайм-аутом
-                net::Msg playerQuery = player.waitForMessage(100);
-
-                // Если это сообщение о подключении к игре
-                if(playerQuery.getType() == net::MSG_PLR_QUERY){
-
-                    // Если игрок НЕ подключается к сессии, но создает НОВУЮ
-                    if(playerQuery.toMsgPlayerQuery().newSession())
-                    {
-                        // Получить уникальный ключ сессии
-                        auto sessionKey = reinterpret_cast<uintptr_t>(clientSocket);
-
-                        std::cout << "Client " << clientSocket << " queries new session (" << sessionKey << ") " << std::endl;
-
-                        // Если удалось отправить игроку ответ
-                        if(player.sendMessage(net::MsgPlayerResponse(true,sessionKey)))
-                        {
-                            // Добавить в сессию игрока
-                            _sessions[sessionKey].addPlayer(std::move(player));
-                            std::cout << "New session created. Key sent to client." << std::endl;
-                        }
-                        // Если не удалось
-                        else{
-                            std::cout << "Session not created. Can't send response to client." << std::endl;
-                        }
-                    }
-                    // Если игрок подключается к СУЩЕСТВУЮЩЕЙ сессии
-                    else
-                    {
-                        // Получить уникальный ключ сессии
-                        auto sessionKey = playerQuery.toMsgPlayerQuery().getSessionKey();
-
-                        std::cout << "Client " << clientSocket << "joins to existing session (" << sessionKey << ")" << std::endl;
-
-                        // Если удалось найти сессию по ключу и второй игрок не отключился
-                        if(_sessions.find(sessionKey) != _sessions.end() && _sessions[sessionKey].allConnected()){
-                            // Если удалось отправить игроку ответ
-                            if(player.sendMessage(net::MsgPlayerResponse(true)))
-                            {
-                                // Добавить в сессию игрока
-                                _sessions[sessionKey].addPlayer(std::move(player));
-                                std::cout << "Player added to session. Response sent to client" << std::endl;
-
-                                // Запустить поток сессии
-                                std::thread sessionThread(sessionProcedure,sessionKey);
-                                sessionThread.detach();
-                            }
-                            // Если не удалось
-                            else{
-                                std::cout << "Player not added. Can't send response to client." << std::endl;
-                            }
-                        }
-                        // Если не удалось найти сессию
-                        else{
-                            std::cout << "Session with key " << sessionKey << " not found." << std::endl;
-                            player.sendMessage(net::MsgPlayerResponse(false));
-                        }
-                    }
-                }
-                // Если вместо сообщения о подключении пришло что-то иное
-                else {
-                    std::cout << "Wrong initial query provided from client " << clientSocket << "(" << clientSocket->peerAddress().toString().toStdString() << "). Ignored." << std::endl;
-                }
-            }
+        // Кол-во реакторов можно задать первым аргументом командной строки
+        if(arguments.size() > 0){
+            settings.reactorsCount = static_cast<unsigned>(std::stoul(arguments[0]));
         }
-    }
-    catch(std::exception& ex)
-    {
-        std::cout << ex.what() << std::endl;
-        system("pause");
-    }
-    return 0;
-}
+        if(settings.reactorsCount == 0){
+            settings.reactorsCount = static_cast<unsigned>(std::max(1, QThread::idealThreadCount()));
+        }
+        settings.reactorsCount = std::min(settings.reactorsCount, GameServer::maxReactors());
 
-/**
- * Процедура игровой сессии (работает в отдельном потоке)
- * @param sessionKey Ключ сессии
- */
-void sessionProcedure(uintptr_t sessionKey)
-{
-    // Если вдруг такой сессии нет
-    if(_sessions.find(sessionKey) == _sessions.end())
-        return;
+        // Номер сервера в группе за маршрутизатором (BattleShipRouter) можно задать вторым аргументом
+        if(arguments.size() > 1){
+            settings.shardIndex = static_cast<unsigned>(std::stoul(arguments[1]));
+        }
 
-    // Ссылка на текущую сессию
-    net::GameSession& s = _sessions[sessionKey];
+        // Общее состояние и реакторы (первый работает в главном потоке, остальные - каждый в своем)
+        ServerContext context(settings);
+        std::vector<std::unique_ptr<GameServer>> reactors;
+        std::vector<std::unique_ptr<QThread>> threads;
+        for(unsigned i = 0; i < settings.reactorsCount; i++){
+            reactors.emplace_back(new GameServer(context, i));
+            context.reactors.push_back(reactors.back().get());
+        }
 
-    // Рандомизация игроков
-    s.randomizePlayers();
+        // Остановка (также при ошибке запуска, когда часть потоков реакторов уже работает): задачи пула обращаются
+        // к реакторам, поэтому пул останавливается первым, реакторы уничтожаются после завершения своих потоков
+        auto shutdown = [&]{
+            context.pool.stop();
+            for(auto& thread : threads){
+                thread->quit();
+                thread->wait();
+            }
+            reactors.clear();
+        };
 
-    // Отправить сообщение о статусе игры
-    if(s.allConnected()){
-        s.sendToConnected(net::MsgGameStatus(net::GAME_RUNNING));
-    }else{
-        s.sendToConnected(net::MsgGameStatus(net::GAME_OVER_DISCONNECTED));
-    }
+        // Инициализация игрового сервера (каждый реактор открывает порт в своем потоке)
+        bool listening = reactors[0]->listen(static_cast<quint16>(_port));
+        for(unsigned i = 1; i < settings.reactorsCount && listening; i++)
+        {
+            threads.emplace_back(new QThread());
+            reactors[i]->moveToThread(threads.back().get());
+            threads.back()->start();
 
-    // Основной цикл процедуры
-    while(true)
-    {
-        // Если кто-то отключен - отправляем сообщение об остановке игры
-        if(!s.allConnected()){
-            s.sendToConnected(net::MsgGameStatus(net::GAME_OVER_DISCONNECTED));
-            break;
-        }
-        // Иначе отправить игрокам сообщение о том кто ходит а кто нет
-        else{
-            s.getActivePlayer().sendMessage(net::MsgShotAvailable(true));
-            s.getWaitingPlayer().sendMessage(net::MsgShotAvailable(false));
+            QMetaObject::invokeMethod(reactors[i].get(), "listen", Qt::BlockingQueuedConnection,
+                    Q_RETURN_ARG(bool, listening), Q_ARG(quint16, static_cast<quint16>(_port)));
         }
 
-        // Ожидаем хода активного игрока, получаем сообщение с информацией о ходе
-        auto shotMsg = s.getActivePlayer().waitForMessage();
-
-        // Если получено сообщение MSG_UNDEFINED и какие-то игроки отключены
-        if(shotMsg.getType() == net::MSG_UNDEFINED && !s.allConnected()){
-            s.sendToConnected(net::MsgGameStatus(net::GAME_OVER_DISCONNECTED));
-            break;
-        }
-        // Иначе отправляем информацию о ходе ожидающему игроку
-        else{
-            s.getWaitingPlayer().sendMessage(shotMsg);
+        if(!listening){
+            shutdown();
+            throw std::runtime_error("Error: can't open listening socket.");
         }
 
-        // Ответ от ожидающего игрока (промазал, попал, уничтожил, победил)
-        auto shotResults = s.getWaitingPlayer().waitForMessage();
+        std::cout << "Listening port (" << _port << "), reactors: " << settings.reactorsCount << "." << std::endl;
 
-        // Если получено сообщение MSG_UNDEFINED и какие-то игроки отключены
-        if(shotResults.getType() == net::MSG_UNDEFINED && !s.allConnected()){
-            s.sendToConnected(net::MsgGameStatus(net::GAME_OVER_DISCONNECTED));
-            break;
-        }
-        // Иначе отправляем ответ ходившему игроку
-        else{
-            s.getActivePlayer().sendMessage(shotResults);
+        // Путь локального сокета для клиентов на той же машине (боты, маршрутизатор) можно задать третьим аргументом.
+        // Локальные подключения принимает первый реактор (SO_REUSEPORT к локальным сокетам не применяется)
+        if(arguments.size() > 2){
+            if(!reactors[0]->listenLocal(arguments[2])){
+                shutdown();
+                throw std::runtime_error("Error: can't open local socket.");
+            }
+            std::cout << "Listening local socket (" << arguments[2] << ")." << std::endl;
         }
 
-        // Если ходивший игрок победил (уничтожил последний корабль) - отправить игрокам сообщения о завершении игры
-        if(shotResults.toMsgShotResults().getResults() == net::SHOT_RESULT_WIN){
-            s.getActivePlayer().sendMessage(net::MsgGameStatus(net::GAME_OVER_WIN));
-            s.getWaitingPlayer().sendMessage(net::MsgGameStatus(net::GAME_OVER_LOOSE));
-            break;
-        }
-        // Если ходивший промазал - сменить игроков (итерация начинается заново)
-        else if (shotResults.toMsgShotResults().getResults() == net::SHOT_RESULT_MISS){
-            s.swapPlayers();
-        }
-    }
+        // Основной цикл сервера
+        int result = QCoreApplication::exec();
 
-    // Завершение сессии
-    _sessions.erase(sessionKey);
-    std::cout << "Session (" << sessionKey << ") closed." << std::endl;
-}
\ No newline at end of file
+        shutdown();
+        return result;
+    }
+    catch(std::exception& ex)
+    {
+        std::cout << ex.what() << std::endl;
+        system("pause");
+    }
+    return 0;
+}
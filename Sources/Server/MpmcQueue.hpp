@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/**
+ * Ограниченная неблокирующая очередь для многих производителей и многих потребителей
+ * Кольцевой буфер, каждая ячейка которого хранит номер последовательности: по нему производитель и потребитель
+ * определяют, свободна ли ячейка, и занимают ее одной операцией CAS над своей позицией (без блокировок)
+ * @tparam T Тип элемента
+ */
+template <typename T>
+class MpmcQueue
+{
+private:
+    /// Ячейка буфера
+    struct Cell
+    {
+        // Номер последовательности (равен позиции - ячейка свободна, позиции + 1 - занята)
+        std::atomic<size_t> sequence;
+        // Данные
+        T data;
+    };
+
+    /// Буфер
+    std::unique_ptr<Cell[]> buffer_;
+    /// Маска индекса (размер буфера - степень двойки)
+    size_t mask_;
+    /// Выравнивание (позиции производителей и потребителей не должны делить линию кэша)
+    char padding0_[64];
+    /// Позиция записи
+    std::atomic<size_t> enqueuePos_;
+    char padding1_[64];
+    /// Позиция чтения
+    std::atomic<size_t> dequeuePos_;
+    char padding2_[64];
+
+public:
+    /**
+     * Конструктор
+     * @param capacity Вместимость (округляется вверх до степени двойки)
+     */
+    explicit MpmcQueue(size_t capacity = 4096):
+            enqueuePos_(0),
+            dequeuePos_(0)
+    {
+        size_t size = 2;
+        while(size < capacity){
+            size <<= 1;
+        }
+
+        buffer_.reset(new Cell[size]);
+        mask_ = size - 1;
+        for(size_t i = 0; i < size; i++){
+            buffer_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    MpmcQueue(const MpmcQueue& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    MpmcQueue& operator=(const MpmcQueue& other) = delete;
+
+    /**
+     * Добавить элемент
+     * @param value Элемент
+     * @return Удалось ли добавить (очередь может быть заполнена)
+     */
+    bool push(const T& value)
+    {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell& cell = buffer_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+
+            // Ячейка свободна - занять позицию
+            if(diff == 0){
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    cell.data = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            // Ячейка еще не прочитана - очередь заполнена
+            else if(diff < 0){
+                return false;
+            }
+            // Позицию занял другой производитель
+            else{
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Извлечь элемент
+     * @param value Ссылка, по которой записывается элемент
+     * @return Удалось ли извлечь (очередь может быть пуста)
+     */
+    bool pop(T& value)
+    {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell& cell = buffer_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+
+            // Ячейка заполнена - занять позицию
+            if(diff == 0){
+                if(dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    value = cell.data;
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            // Ячейка еще не записана - очередь пуста
+            else if(diff < 0){
+                return false;
+            }
+            // Позицию занял другой потребитель
+            else{
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
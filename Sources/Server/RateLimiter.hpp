@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Ограничение частоты событий по адресу источника (корзина токенов)
+ * Корзины хранятся таблицей фиксированного размера и выбираются хешем адреса, без поиска и выделения памяти,
+ * поэтому проверка - O(1) при любом кол-ве клиентов. Адреса с одинаковым хешем делят корзину. Состояние корзины
+ * (токены и время пополнения) - одно 64-разрядное слово, изменяемое атомарно, поэтому таблицу могут разделять
+ * несколько потоков. Токены пополняются по времени при обращении, давно не использованные корзины периодически
+ * обнуляются (age), чтобы отсчет времени в них не переполнялся
+ */
+class RateLimiter
+{
+private:
+    /// Кол-во дробных разрядов токенов (токены хранятся с фиксированной точкой)
+    static constexpr unsigned TOKEN_FRACTION_BITS = 8;
+    /// Один токен
+    static constexpr uint64_t ONE_TOKEN = static_cast<uint64_t>(1) << TOKEN_FRACTION_BITS;
+    /// Через сколько простоя корзина считается полной и может быть обнулена (мс)
+    static constexpr uint32_t IDLE_RESET = 60000;
+
+    /// Корзины (0 - корзина полна; иначе токены в старших 32 разрядах, время пополнения - в младших)
+    std::vector<std::atomic<uint64_t>> buckets_;
+    /// Маска номера корзины
+    size_t mask_;
+    /// Пополнение за секунду (в долях токена) и вместимость корзины (в долях токена)
+    uint64_t rate_;
+    uint64_t burst_;
+    /// Время создания (отсчет времени пополнения)
+    std::chrono::steady_clock::time_point started_;
+    /// Следующая корзина, проверяемая обнулением простаивающих
+    std::atomic<size_t> agingCursor_;
+
+public:
+    /**
+     * Конструктор
+     * @param tableSize Кол-во корзин (округляется вверх до степени двойки)
+     * @param ratePerSecond Кол-во событий в секунду, допустимое на адрес (0 - без ограничения)
+     * @param burst Кол-во событий, допустимое подряд (вместимость корзины)
+     */
+    RateLimiter(size_t tableSize, unsigned ratePerSecond, unsigned burst):
+            buckets_(roundUp(tableSize)),
+            mask_(buckets_.size() - 1),
+            rate_(static_cast<uint64_t>(ratePerSecond) * ONE_TOKEN),
+            burst_(static_cast<uint64_t>(burst > 0 ? burst : 1) * ONE_TOKEN),
+            started_(std::chrono::steady_clock::now()),
+            agingCursor_(0)
+    {
+        for(auto& bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    RateLimiter(const RateLimiter& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    RateLimiter& operator=(const RateLimiter& other) = delete;
+
+    /**
+     * Ключ адреса (хеш FNV-1a байтов адреса)
+     * @param bytes Байты адреса
+     * @param size Кол-во байт
+     * @return Ключ
+     */
+    static uint64_t keyOf(const void* bytes, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for(size_t i = 0; i < size; i++){
+            hash ^= static_cast<const uint8_t*>(bytes)[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * Взять токен из корзины адреса
+     * @param key Ключ адреса (см. keyOf)
+     * @return Допустимо ли событие (false - адрес превысил частоту)
+     */
+    bool consume(uint64_t key)
+    {
+        if(rate_ == 0)
+            return true;
+
+        std::atomic<uint64_t>& bucket = buckets_[(key ^ (key >> 32)) & mask_];
+        uint32_t now = this->now();
+        uint64_t state = bucket.load(std::memory_order_relaxed);
+        while(true)
+        {
+            uint64_t tokens = this->refill(state, now);
+            if(tokens < ONE_TOKEN)
+                return false;
+
+            uint64_t next = ((tokens - ONE_TOKEN) << 32) | now;
+            if(bucket.compare_exchange_weak(state, next, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    /**
+     * Обнулить часть давно не использованных корзин (вызывается периодически, за время простоя IDLE_RESET
+     * проверяется вся таблица)
+     * @param interval Период вызова (мс)
+     */
+    void age(int interval)
+    {
+        if(rate_ == 0 || interval <= 0)
+            return;
+
+        size_t count = buckets_.size() * static_cast<size_t>(interval) / IDLE_RESET + 1;
+        uint32_t now = this->now();
+        size_t first = agingCursor_.fetch_add(count, std::memory_order_relaxed);
+        for(size_t i = 0; i < count && i <= mask_; i++){
+            std::atomic<uint64_t>& bucket = buckets_[(first + i) & mask_];
+            uint64_t state = bucket.load(std::memory_order_relaxed);
+            if(state != 0 && now - static_cast<uint32_t>(state) >= IDLE_RESET){
+                bucket.compare_exchange_strong(state, 0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Кол-во корзин
+     * @return Кол-во
+     */
+    size_t size() const
+    {
+        return buckets_.size();
+    }
+
+private:
+    /**
+     * Текущее время от создания (значение 0 не используется - им отмечены полные корзины)
+     * @return Время (мс, по модулю 2^32)
+     */
+    uint32_t now() const
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_).count();
+        uint32_t value = static_cast<uint32_t>(elapsed);
+        return value != 0 ? value : 1;
+    }
+
+    /**
+     * Токены корзины с учетом пополнения
+     * @param state Состояние корзины
+     * @param now Текущее время
+     * @return Токены (в долях токена)
+     */
+    uint64_t refill(uint64_t state, uint32_t now) const
+    {
+        uint32_t elapsed = now - static_cast<uint32_t>(state);
+        if(state == 0 || elapsed >= IDLE_RESET)
+            return burst_;
+
+        uint64_t tokens = (state >> 32) + rate_ * elapsed / 1000;
+        return tokens < burst_ ? tokens : burst_;
+    }
+
+    /**
+     * Округлить вверх до степени двойки
+     * @param value Значение
+     * @return Степень двойки (не менее 1)
+     */
+    static size_t roundUp(size_t value)
+    {
+        size_t result = 1;
+        while(result < value) result <<= 1;
+        return result;
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ServerSettings.hpp"
+#include "SessionRegistry.hpp"
+#include "MpmcQueue.hpp"
+#include "WorkerPool.hpp"
+#include "AdmissionControl.hpp"
+#include "RateLimiter.hpp"
+#include "LobbyFeed.hpp"
+
+class GameServer;
+
+/**
+ * Общее состояние сервера, разделяемое всеми потоками приема подключений (реакторами)
+ * Каждый реактор владеет своими сокетами и сессиями, но реестр, очередь поиска соперника и пул потоков у них общие.
+ * Номер реактора-владельца хранится в младших разрядах ключа сессии
+ */
+struct ServerContext
+{
+    /// Кол-во разрядов ключа сессии, отведенных под номер реактора
+    static constexpr unsigned REACTOR_BITS = 6;
+    /// Наибольшее кол-во реакторов
+    static constexpr unsigned MAX_REACTORS = 1u << REACTOR_BITS;
+
+    /// Настройки
+    ServerSettings settings;
+    /// Реестр игровых сессий
+    SessionRegistry sessions;
+    /// Очередь сессий игроков, ожидающих любого соперника
+    MpmcQueue<uintptr_t> matchQueue;
+    /// Реакторы (заполняется до начала приема подключений, далее не меняется)
+    std::vector<GameServer*> reactors;
+    /// Контроль приема нагрузки (общие для всех реакторов счетчики соединений, рукопожатий и сессий)
+    AdmissionControl admission;
+    /// Ограничение частоты подключений по адресу клиента и сообщений по соединению
+    RateLimiter connectionRate;
+    RateLimiter messageRate;
+    /// Список сессий, ожидающих второго игрока по ключу (изменения накапливаются для каждого реактора)
+    LobbyFeed lobby;
+    /// Пул потоков для выполнения сессий (уничтожается раньше сессий)
+    WorkerPool pool;
+
+    /**
+     * Конструктор
+     * @param serverSettings Настройки сервера
+     */
+    explicit ServerContext(const ServerSettings& serverSettings):
+            settings(serverSettings),
+            matchQueue(serverSettings.matchQueueCapacity),
+            admission(serverSettings),
+            connectionRate(serverSettings.rateTableSize, serverSettings.connectionRate, serverSettings.connectionBurst),
+            messageRate(serverSettings.rateTableSize, serverSettings.messageRate, serverSettings.messageBurst),
+            lobby(serverSettings.reactorsCount),
+            pool(serverSettings.workersCount){}
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    ServerContext(const ServerContext& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    ServerContext& operator=(const ServerContext& other) = delete;
+
+    /**
+     * Получить номер реактора, владеющего сессией
+     * @param sessionKey Ключ сессии
+     * @return Номер реактора
+     */
+    static unsigned ownerOf(uintptr_t sessionKey)
+    {
+        return static_cast<unsigned>(sessionKey & (MAX_REACTORS - 1));
+    }
+};
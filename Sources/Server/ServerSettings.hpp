@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Настройки игрового сервера
+ */
+struct ServerSettings
+{
+    // Кол-во потоков пула для выполнения сессий (0 - по числу ядер)
+    size_t workersCount = 0;
+    // Кол-во потоков приема подключений (реакторов), слушающих один порт с SO_REUSEPORT (0 - по числу ядер)
+    unsigned reactorsCount = 1;
+    // Время, за которое подключившийся клиент должен прислать запрос на подключение к игре (мс)
+    int handshakeTimeout = 5000;
+    // Время, в течение которого соединение игрока после окончания игры (либо неудачного запроса) ожидает следующего
+    // запроса на подключение к игре (мс, 0 - соединение закрывается сразу). Ожидающие не учитываются среди рукопожатий
+    int reuseTimeout = 60000;
+    // Максимальное кол-во принятых, но еще не обработанных сервером подключений
+    int maxPendingConnections = 1024;
+    // Время ожидания второго игрока, после которого сессия закрывается (мс, 0 - без ограничения)
+    int lobbyTimeout = 300000;
+    // Время на один ход (выстрел или ответ на него), по истечении которого игрок проигрывает (мс, 0 - без ограничения)
+    int turnTimeout = 120000;
+    // Срок, в течение которого отключившийся игрок может вернуться в игру по токену (мс, 0 - игра завершается сразу).
+    // Отсчитывается от первого отключения в сессии, срок хода при этом не останавливается
+    int resumeGrace = 20000;
+    // Период отправки проверочных сообщений игрокам сессий (мс, 0 - не отправлять)
+    int heartbeatInterval = 15000;
+    // Длительность такта колеса таймеров (мс)
+    int timerTick = 100;
+    // Номер сервера (шарда) в группе серверов за маршрутизатором - хранится в старших разрядах ключей сессий
+    unsigned shardIndex = 0;
+    // Пределы приема нагрузки: соединений, незавершенных рукопожатий и живых сессий (0 - без предела).
+    // Сверх предела клиенту сразу отвечается "сервер занят" (MSG_SERVER_BUSY) и соединение закрывается
+    unsigned connectionsLimit = 0;
+    unsigned handshakesLimit = 0;
+    unsigned sessionsLimit = 0;
+    // Через сколько перегруженный сервер предлагает клиенту повторить попытку (мс)
+    unsigned busyRetryAfter = 2000;
+    // Ограничение частоты: подключений с одного адреса и сообщений по одному соединению, в секунду и подряд
+    // (частота 0 - без ограничения). Лишние подключения закрываются сразу, клиент, превысивший частоту сообщений,
+    // отключается
+    unsigned connectionRate = 20;
+    unsigned connectionBurst = 50;
+    unsigned messageRate = 50;
+    unsigned messageBurst = 100;
+    // Кол-во корзин таблиц ограничения частоты (адреса с одинаковым хешем делят корзину)
+    size_t rateTableSize = 65536;
+    // Пределы очереди исходящих данных игрока (байт, 0 - без предела): начиная с первого проверочные сообщения
+    // не ставятся в очередь, при превышении второго игрок отключается как медленный получатель
+    size_t outboxHighWater = 4096;
+    size_t outboxLimit = 65536;
+    // Период рассылки изменений списка сессий, ожидающих второго игрока, подписчикам (мс; изменения за период сливаются)
+    int lobbyUpdateInterval = 250;
+    // Наибольшее кол-во сессий в снимке списка для нового подписчика (снимок не должен превышать пределы очереди)
+    size_t lobbySnapshotLimit = 1024;
+    // Наибольшее кол-во наблюдателей одной сессии и предел очереди событий наблюдателя (байт, 0 - без предела;
+    // при превышении наблюдатель отключается - игроки его не ожидают)
+    size_t maxSpectators = 1024;
+    size_t spectatorQueueLimit = 262144;
+    // Вместимость очереди игроков, ожидающих любого соперника
+    size_t matchQueueCapacity = 4096;
+    // Наибольшее кол-во одновременных подключений (сервер на системных сокетах, таблица соединений и их буферы)
+    unsigned maxConnections = 16384;
+    // Наибольшее кол-во одновременных сессий (сервер на системных сокетах, таблица сессий размещается при запуске)
+    unsigned maxSessions = 8192;
+    // Наибольшее кол-во каналов (игр на одном соединении, см. MsgChannel) - всего и на одно соединение (сервер на
+    // системных сокетах, каналы занимают ячейки таблицы соединений сверх maxConnections; 0 - каналы не поддерживаются)
+    unsigned maxChannels = 16384;
+    unsigned maxChannelsPerConnection = 512;
+    // Период вывода сведений о памяти соединений и сессий (мс, 0 - не выводить)
+    int memoryReportInterval = 60000;
+    // Период сброса файла контрольных точек сессий на диск (мс, сервер на системных сокетах; 0 - только при остановке).
+    // Запись контрольной точки на смене хода системных вызовов не делает - после аварийного завершения процесса
+    // записи сохраняются страничным кешем, период ограничивает потери только при сбое самой машины
+    int checkpointSyncInterval = 1000;
+    // Глубина очереди ввода-вывода (событий epoll за один вызов, элементов кольца io_uring)
+    unsigned ioQueueDepth = 1024;
+};
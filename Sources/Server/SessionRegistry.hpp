@@ -0,0 +1,153 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include "SessionTask.hpp"
+
+/**
+ * Потокобезопасный реестр игровых сессий
+ * Реестр разделен на сегменты по хешу ключа, у каждого сегмента своя блокировка. Поиск, вставка и удаление
+ * затрагивают только один сегмент, поэтому потоки, работающие с разными сессиями, практически не конкурируют
+ */
+class SessionRegistry
+{
+public:
+    /// Указатель на сессию
+    typedef std::shared_ptr<SessionTask> SessionPtr;
+
+private:
+    /// Сегмент реестра
+    struct Shard
+    {
+        // Блокировка сегмента
+        std::mutex mutex;
+        // Сессии сегмента
+        std::unordered_map<uintptr_t,SessionPtr> sessions;
+        // Выравнивание (соседние сегменты не должны делить линию кэша)
+        char padding[64];
+    };
+
+    /// Сегменты
+    std::unique_ptr<Shard[]> shards_;
+    /// Кол-во разрядов индекса сегмента
+    unsigned shardBits_;
+    /// Общее кол-во сессий
+    std::atomic<size_t> size_;
+
+public:
+    /**
+     * Конструктор
+     * @param shardBits Кол-во разрядов индекса сегмента (сегментов будет 2^shardBits)
+     */
+    explicit SessionRegistry(unsigned shardBits = 6):
+            shards_(new Shard[static_cast<size_t>(1) << shardBits]),
+            shardBits_(shardBits),
+            size_(0){}
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    SessionRegistry(const SessionRegistry& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    SessionRegistry& operator=(const SessionRegistry& other) = delete;
+
+    /**
+     * Найти сессию
+     * @param key Ключ сессии
+     * @return Указатель на сессию (пустой, если сессии нет)
+     */
+    SessionPtr find(uintptr_t key)
+    {
+        Shard& shard = this->shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(key);
+        return it != shard.sessions.end() ? it->second : SessionPtr();
+    }
+
+    /**
+     * Найти сессию, либо создать новую, если ее нет (за один поиск)
+     * @param key Ключ сессии
+     * @return Пара из указателя на сессию и признака того, что она была создана
+     */
+    std::pair<SessionPtr,bool> findOrInsert(uintptr_t key)
+    {
+        Shard& shard = this->shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto result = shard.sessions.emplace(key, SessionPtr());
+        if(result.second){
+            result.first->second = std::make_shared<SessionTask>();
+            size_++;
+        }
+        return std::make_pair(result.first->second, result.second);
+    }
+
+    /**
+     * Удалить сессию
+     * @param key Ключ сессии
+     * @return Указатель на удаленную сессию (пустой, если сессии не было)
+     * @details Сессия уничтожается вместе с последним указателем, поэтому вызывающий решает, в каком потоке это произойдет
+     */
+    SessionPtr erase(uintptr_t key)
+    {
+        Shard& shard = this->shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        SessionPtr session;
+        auto it = shard.sessions.find(key);
+        if(it != shard.sessions.end()){
+            session.swap(it->second);
+            shard.sessions.erase(it);
+            size_--;
+        }
+        return session;
+    }
+
+    /**
+     * Кол-во сессий
+     * @return Кол-во
+     */
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /**
+     * Выполнить действие для каждой сессии (сегменты блокируются по очереди)
+     * @param action Действие (ключ, указатель на сессию)
+     */
+    template <typename Action>
+    void forEach(Action action)
+    {
+        for(size_t i = 0; i < (static_cast<size_t>(1) << shardBits_); i++)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            for(auto& entry : shards_[i].sessions){
+                action(entry.first, entry.second);
+            }
+        }
+    }
+
+private:
+    /**
+     * Получить сегмент, которому принадлежит ключ
+     * @param key Ключ сессии
+     * @return Ссылка на сегмент
+     * @details Ключи могут быть адресами (младшие разряды одинаковы), поэтому используется мультипликативное хеширование
+     */
+    Shard& shardOf(uintptr_t key)
+    {
+        uint64_t hash = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+        return shards_[shardBits_ > 0 ? static_cast<size_t>(hash >> (64 - shardBits_)) : 0];
+    }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "../NetworkApi/GameSession.hpp"
+
+/**
+ * Игровая сессия как единица планирования пула потоков
+ * События сессии (сообщения и отключения игроков, истечение сроков) накапливает поток сокетов, а обрабатывает
+ * короткая задача в пуле. Одновременно сессию обрабатывает не более одной задачи (см. флаг scheduled)
+ */
+class SessionTask
+{
+public:
+    /// Тип события сессии
+    enum EventType {
+        // Сообщение игрока
+        MESSAGE,
+        // Игрок отключился
+        DISCONNECTED,
+        // Истек срок хода
+        TURN_TIMEOUT,
+        // Пора проверить соединения игроков
+        HEARTBEAT,
+        // Истек срок возвращения отключившихся игроков
+        RESUME_EXPIRED
+    };
+
+    /// Событие сессии
+    struct Event
+    {
+        // Тип
+        EventType type;
+        // Индекс игрока (для истечения срока хода - номер хода)
+        uint64_t argument;
+        // Сообщение игрока
+        net::Msg message;
+    };
+
+    /// Игровая сессия
+    net::GameSession session;
+    /// Сессия поставлена в пул (изменяется только потоком сокетов)
+    bool scheduled = false;
+    /// Сессия создана для поиска соперника (к ней нельзя присоединиться по ключу)
+    bool matchmaking = false;
+
+    /// Таймеры сессии (идентификаторы колеса таймеров сервера, изменяются только потоком сокетов)
+    uint64_t lobbyTimer = 0;
+    uint64_t turnTimer = 0;
+    uint64_t heartbeatTimer = 0;
+    uint64_t resumeTimer = 0;
+    /// Номер хода, на который взведен таймер хода
+    uint64_t turnTimerMove = 0;
+    /// Сокеты наблюдателей (изменяются только потоком сокетов)
+    std::vector<QTcpSocket*> spectators;
+    /// Игроки, вернувшиеся в игру, пока сессия выполнялась в пуле (токен и соединение, изменяются только потоком сокетов)
+    std::vector<std::pair<uint64_t, net::PlayerPeer>> resumes;
+
+private:
+    /// Блокировка очереди событий
+    std::mutex mutex_;
+    /// Очередь событий
+    std::deque<Event> events_;
+
+public:
+    /**
+     * Добавить сообщение игрока (вызывается потоком сокетов)
+     * @param playerIndex Индекс игрока
+     * @param message Сообщение
+     */
+    void postMessage(int playerIndex, net::Msg&& message)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(Event{MESSAGE, static_cast<uint64_t>(playerIndex), std::move(message)});
+    }
+
+    /**
+     * Добавить событие отключения игрока (вызывается потоком сокетов)
+     * @param playerIndex Индекс игрока (игрок отмечается отключенным при обработке события)
+     */
+    void postDisconnected(int playerIndex)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(Event{DISCONNECTED, static_cast<uint64_t>(playerIndex), net::Msg(net::MSG_UNDEFINED, 0)});
+    }
+
+    /**
+     * Добавить событие истечения срока хода (вызывается потоком сокетов)
+     * @param move Номер хода, на который был взведен таймер
+     */
+    void postTurnTimeout(uint64_t move)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(Event{TURN_TIMEOUT, move, net::Msg(net::MSG_UNDEFINED, 0)});
+    }
+
+    /**
+     * Добавить событие проверки соединений (вызывается потоком сокетов)
+     */
+    void postHeartbeat()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(Event{HEARTBEAT, 0, net::Msg(net::MSG_UNDEFINED, 0)});
+    }
+
+    /**
+     * Добавить событие истечения срока возвращения игроков (вызывается потоком сокетов)
+     */
+    void postResumeExpired()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(Event{RESUME_EXPIRED, 0, net::Msg(net::MSG_UNDEFINED, 0)});
+    }
+
+    /**
+     * Есть ли необработанные события
+     * @return Да или нет
+     */
+    bool hasEvents()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !events_.empty();
+    }
+
+    /**
+     * Обработать накопленные события (выполняется в потоке пула)
+     */
+    void run()
+    {
+        std::deque<Event> events;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events.swap(events_);
+        }
+
+        for(Event& event : events)
+        {
+            if(session.isFinished())
+                break;
+
+            switch(event.type)
+            {
+                case MESSAGE:
+                    session.onMessage(static_cast<int>(event.argument), event.message);
+                    break;
+                case DISCONNECTED:
+                    if(event.argument < session.playersCount()){
+                        session.getPlayer(static_cast<int>(event.argument)).markDisconnected();
+                    }
+                    session.onDisconnected();
+                    break;
+                case TURN_TIMEOUT:
+                    session.onTurnTimeout(event.argument);
+                    break;
+                case HEARTBEAT:
+                    session.heartbeat();
+                    break;
+                case RESUME_EXPIRED:
+                    session.onResumeExpired();
+                    break;
+            }
+        }
+    }
+};
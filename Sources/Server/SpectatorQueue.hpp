@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+/**
+ * Очередь событий игры для одного наблюдателя
+ * События сессии кодируются один раз в неизменяемый буфер с подсчетом ссылок (QByteArray, std::shared_ptr), который
+ * ставится в очереди всех наблюдателей без копирования. В сокет наблюдателя буферы передаются, только пока его
+ * собственная очередь невелика, поэтому медленный наблюдатель копит ссылки, а не данные. Очереди наблюдателей
+ * отделены от очередей игроков: игроки наблюдателей не ожидают, а наблюдатель, очередь которого превысила
+ * предел, отключается
+ * @tparam Buffer Тип разделяемого буфера
+ */
+template <typename Buffer>
+class SpectatorQueue
+{
+private:
+    /// Буферы и их размеры
+    std::deque<std::pair<Buffer, size_t>> chunks_;
+    /// Объем очереди (байт)
+    size_t bytes_;
+
+public:
+    /**
+     * Конструктор
+     */
+    SpectatorQueue():bytes_(0){}
+
+    /**
+     * Поставить буфер в очередь
+     * @param chunk Буфер
+     * @param size Размер данных буфера
+     * @param limit Предел объема очереди (0 - без предела)
+     * @return Остался ли объем в пределе (иначе наблюдатель отключается)
+     */
+    bool push(const Buffer& chunk, size_t size, size_t limit)
+    {
+        chunks_.emplace_back(chunk, size);
+        bytes_ += size;
+        return limit == 0 || bytes_ <= limit;
+    }
+
+    /**
+     * Передать буферы в сокет, пока в его очереди есть место
+     * @param room Место в очереди сокета (байт; буфер передается целиком, даже если превышает остаток)
+     * @param write Запись буфера (вызывается для каждого буфера)
+     */
+    template <typename Write>
+    void drain(size_t room, Write write)
+    {
+        while(room > 0 && !chunks_.empty())
+        {
+            std::pair<Buffer, size_t>& chunk = chunks_.front();
+            write(chunk.first);
+            room = chunk.second < room ? room - chunk.second : 0;
+            bytes_ -= chunk.second;
+            chunks_.pop_front();
+        }
+    }
+
+    /**
+     * Пуста ли очередь
+     * @return Да или нет
+     */
+    bool empty() const
+    {
+        return chunks_.empty();
+    }
+
+    /**
+     * Объем очереди
+     * @return Кол-во байт
+     */
+    size_t size() const
+    {
+        return bytes_;
+    }
+};
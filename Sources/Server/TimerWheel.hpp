@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Иерархическое колесо таймеров
+ * Таймер попадает в ячейку одного из уровней в зависимости от оставшегося времени. Ячейки первого уровня
+ * соответствуют одному такту, ячейки каждого следующего уровня - полному обороту предыдущего. При обороте уровня
+ * таймеры ячейки следующего уровня перераспределяются вниз. Добавление и отмена - O(1), истекшие таймеры
+ * выдаются пачкой при продвижении колеса
+ * @tparam Payload Данные таймера (возвращаются при истечении)
+ */
+template <typename Payload>
+class TimerWheel
+{
+public:
+    /// Идентификатор таймера (0 - нет таймера)
+    typedef uint64_t TimerId;
+
+private:
+    /// Кол-во разрядов индекса ячейки
+    static constexpr unsigned SLOT_BITS = 6;
+    /// Кол-во ячеек уровня
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    /// Кол-во уровней
+    static constexpr unsigned LEVELS = 4;
+    /// Пустая ссылка
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+
+    /// Узел (таймер)
+    struct Node
+    {
+        // Такт истечения
+        uint64_t expiresAt;
+        // Соседи по ячейке
+        uint32_t prev;
+        uint32_t next;
+        // Ячейка (уровень * SLOTS + индекс), NIL - узел свободен
+        uint32_t slot;
+        // Поколение узла (меняется при каждом освобождении)
+        uint32_t generation;
+        // Данные
+        Payload payload;
+    };
+
+    /// Длительность такта (мс)
+    int64_t tickMs_;
+    /// Текущий такт
+    uint64_t currentTick_;
+    /// Узлы
+    std::vector<Node> nodes_;
+    /// Первый свободный узел
+    uint32_t freeList_;
+    /// Первые узлы ячеек
+    uint32_t heads_[LEVELS * SLOTS];
+    /// Кол-во активных таймеров
+    size_t size_;
+
+public:
+    /**
+     * Конструктор
+     * @param tickMs Длительность такта (мс)
+     * @param nowMs Текущее время (мс)
+     */
+    explicit TimerWheel(int64_t tickMs = 100, int64_t nowMs = 0):
+            tickMs_(tickMs > 0 ? tickMs : 1),
+            currentTick_(static_cast<uint64_t>(nowMs / tickMs_)),
+            freeList_(NIL),
+            size_(0)
+    {
+        for(uint32_t& head : heads_){
+            head = NIL;
+        }
+    }
+
+    /**
+     * Добавить таймер
+     * @param delayMs Задержка относительно текущего положения колеса (мс)
+     * @param payload Данные таймера
+     * @return Идентификатор таймера
+     */
+    TimerId schedule(int64_t delayMs, const Payload& payload)
+    {
+        // Положение колеса отстает от текущего времени не более чем на такт, поэтому такт добавляется сверху
+        // (таймер истекает не раньше заданной задержки и не позже, чем через два такта после нее)
+        uint64_t ticks = (delayMs > 0 ? static_cast<uint64_t>((delayMs + tickMs_ - 1) / tickMs_) : 0) + 1;
+
+        uint32_t index = this->allocate();
+        Node& node = nodes_[index];
+        node.expiresAt = currentTick_ + ticks;
+        node.payload = payload;
+        this->link(index);
+        size_++;
+
+        return (static_cast<uint64_t>(node.generation) << 32) | index;
+    }
+
+    /**
+     * Отменить таймер
+     * @param id Идентификатор таймера
+     * @return Был ли таймер активен
+     */
+    bool cancel(TimerId id)
+    {
+        uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFFu);
+        if(id == 0 || index >= nodes_.size())
+            return false;
+
+        Node& node = nodes_[index];
+        if(node.slot == NIL || node.generation != static_cast<uint32_t>(id >> 32))
+            return false;
+
+        this->unlink(index);
+        this->release(index);
+        size_--;
+        return true;
+    }
+
+    /**
+     * Продвинуть колесо до текущего времени
+     * @param nowMs Текущее время (мс)
+     * @param expired Массив, в который добавляются данные истекших таймеров
+     */
+    void advance(int64_t nowMs, std::vector<Payload>& expired)
+    {
+        uint64_t targetTick = static_cast<uint64_t>(nowMs / tickMs_);
+
+        while(currentTick_ < targetTick)
+        {
+            currentTick_++;
+
+            // При обороте уровня перераспределить ячейку следующего уровня
+            for(unsigned level = 1; level < LEVELS; level++)
+            {
+                if((currentTick_ & ((static_cast<uint64_t>(1) << (SLOT_BITS * level)) - 1)) != 0)
+                    break;
+                this->cascade(level, static_cast<unsigned>((currentTick_ >> (SLOT_BITS * level)) & (SLOTS - 1)));
+            }
+
+            // Все таймеры ячейки текущего такта истекли
+            uint32_t& head = heads_[currentTick_ & (SLOTS - 1)];
+            while(head != NIL)
+            {
+                uint32_t index = head;
+                head = nodes_[index].next;
+                expired.push_back(nodes_[index].payload);
+                this->release(index);
+                size_--;
+            }
+            if(size_ == 0){
+                currentTick_ = targetTick;
+            }
+        }
+    }
+
+    /**
+     * Кол-во активных таймеров
+     * @return Кол-во
+     */
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    /**
+     * Получить свободный узел
+     * @return Индекс узла
+     */
+    uint32_t allocate()
+    {
+        if(freeList_ != NIL){
+            uint32_t index = freeList_;
+            freeList_ = nodes_[index].next;
+            return index;
+        }
+
+        Node node = {};
+        node.slot = NIL;
+        node.generation = 1;
+        nodes_.push_back(node);
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    /**
+     * Освободить узел (отвязанный от ячейки)
+     * @param index Индекс узла
+     */
+    void release(uint32_t index)
+    {
+        Node& node = nodes_[index];
+        node.slot = NIL;
+        node.generation++;
+        node.payload = Payload();
+        node.next = freeList_;
+        freeList_ = index;
+    }
+
+    /**
+     * Поместить узел в ячейку, соответствующую оставшемуся времени
+     * @param index Индекс узла
+     */
+    void link(uint32_t index)
+    {
+        Node& node = nodes_[index];
+        uint64_t delta = node.expiresAt > currentTick_ ? node.expiresAt - currentTick_ : 0;
+
+        // Слишком далекие таймеры ставятся в последнюю ячейку (будут перераспределены позже)
+        const uint64_t maxDelta = (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)) - 1;
+        if(delta > maxDelta){
+            node.expiresAt = currentTick_ + maxDelta;
+            delta = maxDelta;
+        }
+
+        unsigned level = 0;
+        while(level + 1 < LEVELS && delta >= (static_cast<uint64_t>(1) << (SLOT_BITS * (level + 1)))){
+            level++;
+        }
+
+        uint32_t slot = level * SLOTS + static_cast<uint32_t>((node.expiresAt >> (SLOT_BITS * level)) & (SLOTS - 1));
+        node.slot = slot;
+        node.prev = NIL;
+        node.next = heads_[slot];
+        if(heads_[slot] != NIL){
+            nodes_[heads_[slot]].prev = index;
+        }
+        heads_[slot] = index;
+    }
+
+    /**
+     * Отвязать узел от ячейки
+     * @param index Индекс узла
+     */
+    void unlink(uint32_t index)
+    {
+        Node& node = nodes_[index];
+        if(node.prev != NIL){
+            nodes_[node.prev].next = node.next;
+        }else{
+            heads_[node.slot] = node.next;
+        }
+        if(node.next != NIL){
+            nodes_[node.next].prev = node.prev;
+        }
+    }
+
+    /**
+     * Перераспределить таймеры ячейки верхнего уровня по нижним уровням
+     * @param level Уровень
+     * @param slotIndex Индекс ячейки
+     */
+    void cascade(unsigned level, unsigned slotIndex)
+    {
+        uint32_t index = heads_[level * SLOTS + slotIndex];
+        heads_[level * SLOTS + slotIndex] = NIL;
+
+        while(index != NIL)
+        {
+            uint32_t next = nodes_[index].next;
+            this->link(index);
+            index = next;
+        }
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+/**
+ * Пул рабочих потоков с перехватом задач (work stealing)
+ * У каждого потока своя очередь (дек): свои задачи берутся с конца, чужие перехватываются с начала
+ */
+class WorkerPool
+{
+public:
+    /// Задача
+    typedef std::function<void()> Task;
+
+private:
+    /// Рабочий поток и его очередь задач
+    struct Worker
+    {
+        // Блокировка очереди
+        std::mutex mutex;
+        // Очередь задач
+        std::deque<Task> tasks;
+        // Поток
+        std::thread thread;
+    };
+
+    /// Рабочие потоки
+    std::vector<std::unique_ptr<Worker>> workers_;
+    /// Кол-во задач во всех очередях
+    std::atomic<size_t> pending_;
+    /// Индекс очереди для следующей задачи, добавляемой извне пула
+    std::atomic<size_t> nextWorker_;
+    /// Блокировка для ожидания задач
+    std::mutex idleMutex_;
+    /// Условная переменная для пробуждения простаивающих потоков
+    std::condition_variable idle_;
+    /// Пул останавливается
+    bool stop_;
+
+public:
+    /**
+     * Конструктор
+     * @param threadsCount Кол-во потоков (0 - по числу ядер)
+     */
+    explicit WorkerPool(size_t threadsCount = 0):pending_(0),nextWorker_(0),stop_(false)
+    {
+        if(threadsCount == 0){
+            threadsCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for(size_t i = 0; i < threadsCount; i++){
+            workers_.emplace_back(new Worker());
+        }
+
+        for(size_t i = 0; i < threadsCount; i++){
+            workers_[i]->thread = std::thread(&WorkerPool::workerProcedure, this, i);
+        }
+    }
+
+    /**
+     * Деструктор (оставшиеся задачи выполняются до остановки потоков)
+     */
+    ~WorkerPool()
+    {
+        this->stop();
+    }
+
+    /**
+     * Остановить потоки (оставшиеся задачи выполняются до остановки, повторный вызов ничего не делает)
+     * @details Позволяет остановить пул раньше уничтожения объектов, к которым обращаются задачи
+     */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex_);
+            stop_ = true;
+        }
+        idle_.notify_all();
+
+        for(auto& worker : workers_){
+            if(worker->thread.joinable()){
+                worker->thread.join();
+            }
+        }
+    }
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    WorkerPool(const WorkerPool& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    WorkerPool& operator=(const WorkerPool& other) = delete;
+
+    /**
+     * Добавить задачу
+     * @param task Задача
+     * @details Задача, добавленная из рабочего потока, попадает в его собственную очередь, иначе очереди выбираются по кругу.
+     * Счетчик задач увеличивается до того, как задача станет доступна для перехвата (иначе взявший ее поток
+     * уменьшил бы счетчик раньше)
+     */
+    void submit(Task task)
+    {
+        int current = currentWorker(this);
+        size_t index = current >= 0 ? static_cast<size_t>(current) : nextWorker_++ % workers_.size();
+
+        {
+            std::lock_guard<std::mutex> lock(idleMutex_);
+            pending_++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+            workers_[index]->tasks.push_back(std::move(task));
+        }
+        idle_.notify_one();
+    }
+
+    /**
+     * Кол-во потоков
+     * @return Кол-во
+     */
+    size_t size() const
+    {
+        return workers_.size();
+    }
+
+private:
+    /**
+     * Индекс рабочего потока пула, в котором выполняется вызов
+     * @param pool Пул
+     * @param index Индекс для запоминания (если >= 0)
+     * @return Индекс потока либо -1, если вызов выполняется вне потоков пула
+     */
+    static int currentWorker(const WorkerPool* pool, int index = -1)
+    {
+        static thread_local const WorkerPool* ownerPool = nullptr;
+        static thread_local int ownerIndex = -1;
+
+        if(index >= 0){
+            ownerPool = pool;
+            ownerIndex = index;
+        }
+
+        return ownerPool == pool ? ownerIndex : -1;
+    }
+
+    /**
+     * Взять задачу из своей очереди (с конца)
+     * @param index Индекс потока
+     * @param task Задача
+     * @return Удалось ли взять
+     */
+    bool popLocal(size_t index, Task& task)
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        if(workers_[index]->tasks.empty())
+            return false;
+
+        task = std::move(workers_[index]->tasks.back());
+        workers_[index]->tasks.pop_back();
+        return true;
+    }
+
+    /**
+     * Перехватить задачу из очереди другого потока (с начала)
+     * @param index Индекс потока-перехватчика
+     * @param task Задача
+     * @return Удалось ли перехватить
+     * @details Очереди обходятся, только пока есть задачи, и блокируются с ожиданием (очередь, занятая владельцем,
+     * не пропускается - иначе поток крутился бы вхолостую, не находя задачу)
+     */
+    bool steal(size_t index, Task& task)
+    {
+        for(size_t i = 1; i < workers_.size() && pending_ > 0; i++)
+        {
+            Worker& victim = *workers_[(index + i) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(victim.tasks.empty())
+                continue;
+
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Процедура рабочего потока
+     * @param index Индекс потока
+     */
+    void workerProcedure(size_t index)
+    {
+        currentWorker(this, static_cast<int>(index));
+
+        while(true)
+        {
+            Task task;
+
+            // Своя задача, либо перехваченная у занятого потока
+            if(this->popLocal(index, task) || this->steal(index, task)){
+                pending_--;
+                task();
+                continue;
+            }
+
+            // Ожидание новых задач
+            std::unique_lock<std::mutex> lock(idleMutex_);
+            idle_.wait(lock, [this]{ return stop_ || pending_ > 0; });
+            if(stop_ && pending_ == 0)
+                return;
+        }
+    }
+};
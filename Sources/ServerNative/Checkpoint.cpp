@@ -0,0 +1,248 @@
+#include "Checkpoint.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// Признак и версия формата файла
+static constexpr uint32_t CHECKPOINT_MAGIC = 0x42534350;
+static constexpr uint32_t CHECKPOINT_VERSION = 2;
+/// Выравнивание записей (строка кеша - запись одной сессии не делит строку с соседней). Запись может занимать
+/// две страницы, которые после сбоя машины окажутся на диске в разных версиях, - такую запись отвергает контрольная сумма
+static constexpr size_t RECORD_ALIGNMENT = 64;
+
+/// Заголовок файла (занимает первую запись)
+struct CheckpointHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t recordSize;
+    uint64_t payloadSize;
+    uint64_t capacity;
+};
+
+/**
+ * Конструктор
+ */
+CheckpointFile::CheckpointFile():
+        map_(nullptr),
+        mapSize_(0),
+        recordSize_(0),
+        payloadSize_(0),
+        capacity_(0),
+        sequence_(0),
+        syncStopping_(false)
+{}
+
+/**
+ * Деструктор (останавливает поток сброса, сбрасывает страницы и закрывает файл)
+ */
+CheckpointFile::~CheckpointFile()
+{
+    this->close();
+}
+
+/**
+ * Открыть (либо создать) файл
+ * @param path Путь
+ * @param capacity Кол-во записей (по размеру таблицы сессий)
+ * @param payloadSize Размер данных записи (байт)
+ * @return Удалось ли (файл другого формата или размера начинается заново)
+ */
+bool CheckpointFile::open(const std::string& path, size_t capacity, size_t payloadSize)
+{
+    this->close();
+
+    size_t recordSize = (sizeof(RecordHeader) + payloadSize + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+    size_t mapSize = recordSize * (capacity + 1);
+    static_assert(sizeof(CheckpointHeader) <= RECORD_ALIGNMENT, "File header must fit the first record");
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fd < 0)
+        return false;
+
+    // Файл другого размера (либо новый) размечается заново - записи прежнего формата не читаются
+    struct stat info = {};
+    bool fresh = ::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != mapSize;
+    if(fresh && (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, static_cast<off_t>(mapSize)) != 0)){
+        ::close(fd);
+        return false;
+    }
+
+    // Отображение остается действительным после закрытия дескриптора
+    void* map = ::mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    map_ = static_cast<char*>(map);
+    mapSize_ = mapSize;
+    recordSize_ = recordSize;
+    payloadSize_ = payloadSize;
+    capacity_ = capacity;
+
+    CheckpointHeader* header = reinterpret_cast<CheckpointHeader*>(map_);
+    if(fresh || header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION
+       || header->recordSize != recordSize || header->payloadSize != payloadSize || header->capacity != capacity)
+    {
+        memset(map_, 0, mapSize_);
+        *header = CheckpointHeader{CHECKPOINT_MAGIC, CHECKPOINT_VERSION, recordSize, payloadSize, capacity};
+    }
+
+    // Номера новых записей продолжают номера прежнего процесса
+    for(size_t slot = 0; slot < capacity_; slot++){
+        uint32_t closed = this->headerOf(slot)->closed;
+        if(closed > sequence_) sequence_ = closed;
+    }
+    return true;
+}
+
+/**
+ * Начать периодический сброс страниц на диск в отдельном потоке
+ * @param interval Период (мс, 0 - сбрасываются только при закрытии)
+ */
+void CheckpointFile::startSync(int interval)
+{
+    this->stopSync();
+    if(map_ == nullptr || interval <= 0)
+        return;
+
+    // Поток только сообщает ядру о страницах отображения - сами записи он не читает и не блокирует
+    syncStopping_ = false;
+    syncThread_ = std::thread([this, interval]{
+        std::unique_lock<std::mutex> lock(syncMutex_);
+        while(!syncWake_.wait_for(lock, std::chrono::milliseconds(interval), [this]{ return syncStopping_; })){
+            ::msync(map_, mapSize_, MS_SYNC);
+        }
+    });
+}
+
+/**
+ * Открыт ли файл
+ * @return Да или нет
+ */
+bool CheckpointFile::isOpen() const
+{
+    return map_ != nullptr;
+}
+
+/**
+ * Записать состояние сессии
+ * @param slot Номер записи
+ * @param sessionKey Ключ сессии
+ * @param payload Данные (payloadSize байт)
+ */
+void CheckpointFile::write(size_t slot, uint64_t sessionKey, const void* payload)
+{
+    if(map_ == nullptr || slot >= capacity_)
+        return;
+
+    // Номера до и после копирования расходятся, если процесс завершился посреди записи
+    RecordHeader* header = this->headerOf(slot);
+    uint32_t sequence = ++sequence_;
+    header->opened = sequence;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->sessionKey = sessionKey;
+    memcpy(reinterpret_cast<char*>(header) + sizeof(RecordHeader), payload, payloadSize_);
+    header->checksum = this->checksumOf(header);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->closed = sequence;
+}
+
+/**
+ * Освободить запись
+ * @param slot Номер записи
+ */
+void CheckpointFile::erase(size_t slot)
+{
+    if(map_ == nullptr || slot >= capacity_)
+        return;
+
+    this->headerOf(slot)->sessionKey = 0;
+}
+
+/**
+ * Освободить все записи
+ */
+void CheckpointFile::clear()
+{
+    for(size_t slot = 0; slot < capacity_; slot++){
+        this->erase(slot);
+    }
+}
+
+/**
+ * Заголовок записи
+ * @param slot Номер записи
+ * @return Указатель на заголовок
+ */
+CheckpointFile::RecordHeader* CheckpointFile::headerOf(size_t slot) const
+{
+    // Первая запись занята заголовком файла
+    return reinterpret_cast<RecordHeader*>(map_ + recordSize_ * (slot + 1));
+}
+
+/**
+ * Контрольная сумма записи (FNV-1a ключа сессии и данных)
+ * @param header Заголовок записи
+ * @return Сумма
+ */
+uint64_t CheckpointFile::checksumOf(const RecordHeader* header) const
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* bytes, size_t size){
+        for(size_t i = 0; i < size; i++){
+            hash ^= static_cast<const uint8_t*>(bytes)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    mix(&header->sessionKey, sizeof(header->sessionKey));
+    mix(reinterpret_cast<const char*>(header) + sizeof(RecordHeader), payloadSize_);
+    return hash;
+}
+
+/**
+ * Цела ли запись (копирование завершено, данные совпадают с контрольной суммой)
+ * @param header Заголовок записи
+ * @return Да или нет
+ */
+bool CheckpointFile::isIntact(const RecordHeader* header) const
+{
+    return header->opened == header->closed && header->checksum == this->checksumOf(header);
+}
+
+/**
+ * Остановить поток сброса
+ */
+void CheckpointFile::stopSync()
+{
+    if(!syncThread_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        syncStopping_ = true;
+    }
+    syncWake_.notify_one();
+    syncThread_.join();
+}
+
+/**
+ * Закрыть файл (страницы сбрасываются на диск)
+ */
+void CheckpointFile::close()
+{
+    this->stopSync();
+    if(map_ == nullptr)
+        return;
+
+    ::msync(map_, mapSize_, MS_SYNC);
+    ::munmap(map_, mapSize_);
+    map_ = nullptr;
+    mapSize_ = 0;
+    capacity_ = 0;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Контрольные точки живых сессий в отображаемом в память файле (восстановление после аварийного завершения)
+ * Файл - заголовок и массив записей фиксированного размера, запись сессии определяется номером ее ячейки в таблице
+ * сессий. Запись - копирование состояния в страницы файла без системных вызовов: после аварийного завершения
+ * процесса данные остаются в страничном кеше. На диск страницы сбрасываются отдельным потоком раз в период
+ * (защита от сбоя самой машины - с точностью до периода)
+ */
+class CheckpointFile
+{
+private:
+    /// Заголовок записи (номера до и после копирования совпадают у целой записи, контрольная сумма - у записи,
+    /// страницы которой сброшены на диск полностью)
+    struct RecordHeader
+    {
+        // Номер записи на момент начала копирования
+        uint32_t opened;
+        // Номер записи на момент завершения копирования
+        uint32_t closed;
+        // Ключ сессии (0 - запись свободна)
+        uint64_t sessionKey;
+        // Контрольная сумма ключа и данных
+        uint64_t checksum;
+    };
+
+    /// Отображенный файл (nullptr - не открыт)
+    char* map_;
+    /// Размер отображения (байт)
+    size_t mapSize_;
+    /// Размер записи вместе с заголовком (байт, кратен строке кеша)
+    size_t recordSize_;
+    /// Размер данных записи (байт)
+    size_t payloadSize_;
+    /// Кол-во записей
+    size_t capacity_;
+    /// Номер следующей записи
+    uint32_t sequence_;
+    /// Поток сброса страниц на диск
+    std::thread syncThread_;
+    /// Блокировка и условие остановки потока сброса
+    std::mutex syncMutex_;
+    std::condition_variable syncWake_;
+    bool syncStopping_;
+
+public:
+    /**
+     * Конструктор
+     */
+    CheckpointFile();
+
+    /**
+     * Деструктор (останавливает поток сброса, сбрасывает страницы и закрывает файл)
+     */
+    ~CheckpointFile();
+
+    CheckpointFile(const CheckpointFile&) = delete;
+    CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+    /**
+     * Открыть (либо создать) файл
+     * @param path Путь
+     * @param capacity Кол-во записей (по размеру таблицы сессий)
+     * @param payloadSize Размер данных записи (байт)
+     * @return Удалось ли (файл другого формата или размера начинается заново)
+     */
+    bool open(const std::string& path, size_t capacity, size_t payloadSize);
+
+    /**
+     * Начать периодический сброс страниц на диск в отдельном потоке
+     * @param interval Период (мс, 0 - сбрасываются только при закрытии)
+     */
+    void startSync(int interval);
+
+    /**
+     * Открыт ли файл
+     * @return Да или нет
+     */
+    bool isOpen() const;
+
+    /**
+     * Записать состояние сессии
+     * @param slot Номер записи
+     * @param sessionKey Ключ сессии
+     * @param payload Данные (payloadSize байт)
+     */
+    void write(size_t slot, uint64_t sessionKey, const void* payload);
+
+    /**
+     * Освободить запись
+     * @param slot Номер записи
+     */
+    void erase(size_t slot);
+
+    /**
+     * Освободить все записи
+     */
+    void clear();
+
+    /**
+     * Обойти целые занятые записи (записи, копирование которых прервано либо страницы которых сброшены на диск
+     * не полностью, пропускаются)
+     * @param visit Функция, принимающая ключ сессии и указатель на данные
+     */
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        for(size_t slot = 0; slot < capacity_; slot++){
+            const RecordHeader* header = this->headerOf(slot);
+            if(header->sessionKey != 0 && this->isIntact(header)){
+                visit(header->sessionKey, reinterpret_cast<const char*>(header) + sizeof(RecordHeader));
+            }
+        }
+    }
+
+private:
+    /**
+     * Заголовок записи
+     * @param slot Номер записи
+     * @return Указатель на заголовок
+     */
+    RecordHeader* headerOf(size_t slot) const;
+
+    /**
+     * Контрольная сумма записи (FNV-1a ключа сессии и данных)
+     * @param header Заголовок записи
+     * @return Сумма
+     */
+    uint64_t checksumOf(const RecordHeader* header) const;
+
+    /**
+     * Цела ли запись (копирование завершено, данные совпадают с контрольной суммой)
+     * @param header Заголовок записи
+     * @return Да или нет
+     */
+    bool isIntact(const RecordHeader* header) const;
+
+    /**
+     * Остановить поток сброса
+     */
+    void stopSync();
+
+    /**
+     * Закрыть файл (страницы сбрасываются на диск)
+     */
+    void close();
+};
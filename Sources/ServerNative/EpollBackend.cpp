@@ -0,0 +1,397 @@
+#include "EpollBackend.h"
+#include "ListenSocket.hpp"
+
+#include <cerrno>
+#include <netinet/tcp.h>
+
+/// Метка первого прослушивающего сокета в событиях epoll (метки следующих - на единицу меньше, соединения их не достигают)
+static constexpr uint64_t LISTENER_TAG = ~static_cast<uint64_t>(0);
+/// Размер общего буфера чтения
+static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * Данные события epoll для соединения (поколение в старших разрядах, номер ячейки - в младших)
+ * @param connection Номер соединения
+ * @param generation Поколение ячейки
+ * @return Данные события
+ */
+static uint64_t eventTag(uint32_t connection, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | connection;
+}
+
+/**
+ * Конструктор
+ * @param maxConnections Наибольшее кол-во соединений
+ * @param queueDepth Наибольшее кол-во событий за один вызов epoll_wait
+ */
+EpollBackend::EpollBackend(uint32_t maxConnections, unsigned queueDepth):
+        handler_(nullptr),
+        epoll_(::epoll_create1(EPOLL_CLOEXEC)),
+        slots_(maxConnections),
+        events_(queueDepth > 0 ? queueDepth : 1),
+        readBuffer_(READ_BUFFER_SIZE)
+{
+    // Свободные ячейки выдаются с начала таблицы
+    free_.reserve(maxConnections);
+    for(uint32_t i = maxConnections; i > 0; i--){
+        slots_[i - 1].fd = -1;
+        slots_[i - 1].generation = 0;
+        free_.push_back(i - 1);
+    }
+}
+
+/**
+ * Деструктор (закрывает все сокеты)
+ */
+EpollBackend::~EpollBackend()
+{
+    for(Slot& slot : slots_){
+        if(slot.fd >= 0) ::close(slot.fd);
+    }
+    for(int listener : listeners_){
+        ::close(listener);
+    }
+    if(epoll_ >= 0) ::close(epoll_);
+}
+
+const char* EpollBackend::name() const
+{
+    return "epoll";
+}
+
+bool EpollBackend::listen(uint16_t port, IoHandler& handler)
+{
+    int fd = openListenSocket(port, SOMAXCONN, true);
+    if(fd < 0)
+        return false;
+
+    if(!this->adoptListener(fd, handler)){
+        ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+bool EpollBackend::listenLocal(const std::string& path, IoHandler& handler)
+{
+    int fd = openLocalListenSocket(path, SOMAXCONN, true);
+    if(fd < 0)
+        return false;
+
+    if(!this->adoptListener(fd, handler)){
+        ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+void EpollBackend::poll(int timeoutMs)
+{
+    int count = ::epoll_wait(epoll_, events_.data(), static_cast<int>(events_.size()), timeoutMs);
+
+    for(int i = 0; i < count; i++)
+    {
+        const epoll_event& event = events_[i];
+        if(event.data.u64 > LISTENER_TAG - listeners_.size()){
+            this->acceptAll(listeners_[LISTENER_TAG - event.data.u64]);
+            continue;
+        }
+
+        // Событие соединения, закрытого ранее в этой же пачке, пропускается
+        auto connection = static_cast<uint32_t>(event.data.u64 & 0xFFFFFFFFu);
+        Slot& slot = slots_[connection];
+        if(slot.fd < 0 || slot.generation != static_cast<uint32_t>(event.data.u64 >> 32))
+            continue;
+
+        // Сокет снова принимает данные - очередь будет дописана при записи пачки
+        if(event.events & EPOLLOUT){
+            slot.writable = true;
+            if(!slot.outbox.empty()) this->markDirty(connection);
+        }
+
+        if(event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+            if(!this->readAll(connection)){
+                this->release(connection, !slot.closing);
+            }
+        }
+    }
+}
+
+std::string* EpollBackend::outbox(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0 || slot.closing)
+        return nullptr;
+
+    this->markDirty(connection);
+    return &slot.outbox;
+}
+
+void EpollBackend::flush()
+{
+    // Список может пополняться получателем событий при закрытии соединений
+    for(size_t i = 0; i < dirty_.size(); i++)
+    {
+        uint32_t connection = dirty_[i];
+        Slot& slot = slots_[connection];
+        slot.dirty = false;
+        if(slot.fd < 0)
+            continue;
+
+        // Получатель не успевает принимать данные - соединение разрывается, чтобы его очередь не росла без предела
+        if(!this->writeAll(connection) || this->exceedsOutboxLimit(slot.outbox.size() - slot.written)){
+            this->release(connection, !slot.closing);
+        }
+        else if(slot.closing && slot.outbox.empty()){
+            this->release(connection, false);
+        }
+    }
+    dirty_.clear();
+}
+
+void EpollBackend::close(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0 || slot.closing)
+        return;
+
+    slot.closing = true;
+    this->markDirty(connection);
+}
+
+bool EpollBackend::adoptListener(int fd, IoHandler& handler)
+{
+    if(epoll_ < 0 || ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+        return false;
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = LISTENER_TAG - listeners_.size();
+    if(::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0)
+        return false;
+
+    listeners_.push_back(fd);
+    handler_ = &handler;
+    return true;
+}
+
+uint32_t EpollBackend::adopt(int fd)
+{
+    // Сокет мог быть блокирующим у передавшего процесса
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return this->attach(fd);
+}
+
+std::vector<int> EpollBackend::detach(std::vector<DetachedConnection>& connections)
+{
+    // Ожидающих операций у epoll нет - сокеты просто исключаются из него
+    for(uint32_t connection = 0; connection < slots_.size(); connection++)
+    {
+        Slot& slot = slots_[connection];
+        slot.dirty = false;
+        if(slot.fd < 0)
+            continue;
+
+        ::epoll_ctl(epoll_, EPOLL_CTL_DEL, slot.fd, nullptr);
+        connections.push_back(DetachedConnection{connection, slot.fd, slot.outbox.substr(slot.written), slot.closing});
+
+        slot.fd = -1;
+        slot.generation++;
+        releaseBuffer(slot.outbox);
+        slot.written = 0;
+        slot.closing = false;
+        free_.push_back(connection);
+    }
+    dirty_.clear();
+
+    std::vector<int> listeners;
+    listeners.swap(listeners_);
+    for(int listener : listeners){
+        ::epoll_ctl(epoll_, EPOLL_CTL_DEL, listener, nullptr);
+    }
+    return listeners;
+}
+
+uint32_t EpollBackend::capacity() const
+{
+    return static_cast<uint32_t>(slots_.size());
+}
+
+size_t EpollBackend::slotFootprint() const
+{
+    // Буфер чтения общий для всех соединений
+    return sizeof(Slot);
+}
+
+size_t EpollBackend::bufferFootprint(uint32_t connection) const
+{
+    return heapBytes(slots_[connection].outbox);
+}
+
+int EpollBackend::descriptor(uint32_t connection) const
+{
+    return connection < slots_.size() ? slots_[connection].fd : -1;
+}
+
+size_t EpollBackend::queuedBytes(uint32_t connection) const
+{
+    const Slot& slot = slots_[connection];
+    return slot.outbox.size() - slot.written;
+}
+
+/**
+ * Принять все ожидающие подключения
+ * @param listener Прослушивающий сокет
+ */
+void EpollBackend::acceptAll(int listener)
+{
+    while(true)
+    {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            // Очередь исчерпана (EAGAIN), либо клиент отключился до приема
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+
+        uint32_t connection = this->attach(fd);
+        if(connection != NO_CONNECTION){
+            handler_->onAccepted(connection);
+        }
+    }
+}
+
+/**
+ * Занять ячейку под сокет и добавить его в epoll
+ * @param fd Неблокирующий сокет (закрывается, если ячейку занять не удалось)
+ * @return Номер соединения, либо NO_CONNECTION
+ */
+uint32_t EpollBackend::attach(int fd)
+{
+    // Таблица соединений заполнена - подключение отклоняется
+    if(free_.empty()){
+        ::close(fd);
+        return NO_CONNECTION;
+    }
+
+    uint32_t connection = free_.back();
+    free_.pop_back();
+
+    Slot& slot = slots_[connection];
+    slot.fd = fd;
+    slot.outbox.clear();
+    slot.written = 0;
+    slot.writable = true;
+    slot.closing = false;
+    slot.dirty = false;
+
+    // Сообщения короткие - отправляются без задержки
+    int enable = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = eventTag(connection, slot.generation);
+    if(::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0){
+        this->release(connection, false);
+        return NO_CONNECTION;
+    }
+
+    return connection;
+}
+
+/**
+ * Прочесть все доступные данные соединения
+ * @param connection Номер соединения
+ * @return Открыто ли соединение (false - клиент отключился, либо произошла ошибка)
+ */
+bool EpollBackend::readAll(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    while(true)
+    {
+        ssize_t received = ::recv(slot.fd, readBuffer_.data(), readBuffer_.size(), 0);
+        if(received > 0){
+            // Данные закрываемого сервером соединения не нужны (но читаются, чтобы узнать об отключении)
+            if(!slot.closing) handler_->onReceived(connection, readBuffer_.data(), static_cast<size_t>(received));
+            continue;
+        }
+        if(received == 0)
+            return false;
+        if(errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+/**
+ * Записать очередь соединения (пока сокет принимает данные)
+ * @param connection Номер соединения
+ * @return Открыто ли соединение
+ */
+bool EpollBackend::writeAll(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    while(slot.writable && slot.written < slot.outbox.size())
+    {
+        ssize_t sent = ::send(slot.fd, slot.outbox.data() + slot.written, slot.outbox.size() - slot.written, MSG_NOSIGNAL);
+        if(sent > 0){
+            slot.written += static_cast<size_t>(sent);
+            continue;
+        }
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            // Продолжение - по событию EPOLLOUT
+            slot.writable = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Простаивающее соединение не держит память очереди до следующей записи
+    if(slot.written == slot.outbox.size()){
+        releaseBuffer(slot.outbox);
+        slot.written = 0;
+    }
+    return true;
+}
+
+/**
+ * Поставить соединение в список ожидающих записи
+ * @param connection Номер соединения
+ */
+void EpollBackend::markDirty(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(!slot.dirty){
+        slot.dirty = true;
+        dirty_.push_back(connection);
+    }
+}
+
+/**
+ * Закрыть сокет и освободить ячейку
+ * @param connection Номер соединения
+ * @param notify Сообщить ли получателю (если соединение не закрыто сервером)
+ */
+void EpollBackend::release(uint32_t connection, bool notify)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0)
+        return;
+
+    // Закрытие сокета исключает его из epoll
+    ::close(slot.fd);
+    slot.fd = -1;
+    slot.generation++;
+    releaseBuffer(slot.outbox);
+    slot.written = 0;
+    slot.closing = false;
+    free_.push_back(connection);
+
+    if(notify){
+        handler_->onClosed(connection);
+    }
+}
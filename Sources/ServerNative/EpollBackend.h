@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <sys/epoll.h>
+
+#include "IoBackend.hpp"
+
+/**
+ * Ввод-вывод на epoll в режиме edge-triggered
+ * Готовность сокета сообщается один раз, поэтому чтение и запись выполняются до EAGAIN. Данные всех соединений
+ * читаются в общий буфер (получатель обрабатывает их сразу), запись выполняется один раз за итерацию цикла
+ */
+class EpollBackend final : public IoBackend
+{
+private:
+    /// Соединение
+    struct Slot
+    {
+        // Сокет (-1 - ячейка свободна)
+        int fd;
+        // Поколение ячейки (отличает события закрытого соединения от событий нового в той же ячейке)
+        uint32_t generation;
+        // Исходящие данные и кол-во уже записанных из них байт (записанная очередь освобождается)
+        std::string outbox;
+        size_t written;
+        // Сокет готов к записи
+        bool writable;
+        // Закрыто сервером (закрывается после записи очереди)
+        bool closing;
+        // Ячейка в списке ожидающих записи
+        bool dirty;
+    };
+
+    /// Получатель событий
+    IoHandler* handler_;
+    /// Дескриптор epoll
+    int epoll_;
+    /// Прослушивающие сокеты (порт и, если открыт, локальный сокет)
+    std::vector<int> listeners_;
+    /// Соединения
+    std::vector<Slot> slots_;
+    /// Свободные ячейки
+    std::vector<uint32_t> free_;
+    /// Ячейки с исходящими данными (или ожидающие закрытия)
+    std::vector<uint32_t> dirty_;
+    /// События, получаемые за один вызов
+    std::vector<epoll_event> events_;
+    /// Общий буфер чтения
+    std::vector<char> readBuffer_;
+
+public:
+    /**
+     * Конструктор
+     * @param maxConnections Наибольшее кол-во соединений
+     * @param queueDepth Наибольшее кол-во событий за один вызов epoll_wait
+     */
+    EpollBackend(uint32_t maxConnections, unsigned queueDepth);
+
+    /**
+     * Деструктор (закрывает все сокеты)
+     */
+    ~EpollBackend() override;
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    EpollBackend(const EpollBackend& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    EpollBackend& operator=(const EpollBackend& other) = delete;
+
+    const char* name() const override;
+    bool listen(uint16_t port, IoHandler& handler) override;
+    bool listenLocal(const std::string& path, IoHandler& handler) override;
+    void poll(int timeoutMs) override;
+    std::string* outbox(uint32_t connection) override;
+    void flush() override;
+    void close(uint32_t connection) override;
+    bool adoptListener(int fd, IoHandler& handler) override;
+    uint32_t adopt(int fd) override;
+    std::vector<int> detach(std::vector<DetachedConnection>& connections) override;
+    uint32_t capacity() const override;
+    size_t slotFootprint() const override;
+    size_t bufferFootprint(uint32_t connection) const override;
+    int descriptor(uint32_t connection) const override;
+    size_t queuedBytes(uint32_t connection) const override;
+
+private:
+    /**
+     * Принять все ожидающие подключения
+     * @param listener Прослушивающий сокет
+     */
+    void acceptAll(int listener);
+
+    /**
+     * Занять ячейку под сокет и добавить его в epoll
+     * @param fd Неблокирующий сокет (закрывается, если ячейку занять не удалось)
+     * @return Номер соединения, либо NO_CONNECTION
+     */
+    uint32_t attach(int fd);
+
+    /**
+     * Прочесть все доступные данные соединения
+     * @param connection Номер соединения
+     * @return Открыто ли соединение (false - клиент отключился, либо произошла ошибка)
+     */
+    bool readAll(uint32_t connection);
+
+    /**
+     * Записать очередь соединения (пока сокет принимает данные)
+     * @param connection Номер соединения
+     * @return Открыто ли соединение
+     */
+    bool writeAll(uint32_t connection);
+
+    /**
+     * Поставить соединение в список ожидающих записи
+     * @param connection Номер соединения
+     */
+    void markDirty(uint32_t connection);
+
+    /**
+     * Закрыть сокет и освободить ячейку
+     * @param connection Номер соединения
+     * @param notify Сообщить ли получателю (если соединение не закрыто сервером)
+     */
+    void release(uint32_t connection, bool notify);
+};
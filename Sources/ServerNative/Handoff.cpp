@@ -0,0 +1,240 @@
+#include "Handoff.h"
+#include "ListenSocket.hpp"
+
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/// Наибольшее кол-во сокетов в одном сообщении (ядро ограничивает SCM_MAX_FD = 253)
+static constexpr size_t FDS_PER_MESSAGE = 250;
+/// Наибольшее время ожидания операций канала (с)
+static constexpr int CHANNEL_TIMEOUT = 5;
+/// Наибольший размер состояния (байт)
+static constexpr uint64_t MAX_STATE_SIZE = 1ull << 30;
+/// Байт подтверждения
+static constexpr char ACK = 'K';
+
+/**
+ * Заполнить адрес локального сокета
+ * @param path Путь сокета
+ * @param address Адрес
+ * @return Удалось ли (путь не длиннее допустимого)
+ */
+static bool makeAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, path.data(), path.size());
+    return true;
+}
+
+/**
+ * Ограничить время ожидания операций канала (зависший процесс не должен останавливать другой)
+ * @param channel Канал передачи
+ */
+static void setChannelTimeout(int channel)
+{
+    timeval timeout = {CHANNEL_TIMEOUT, 0};
+    ::setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(channel, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * Записать данные полностью
+ * @param channel Канал передачи
+ * @param data Данные
+ * @param size Кол-во байт
+ * @return Удалось ли
+ */
+static bool sendAll(int channel, const char* data, size_t size)
+{
+    while(size > 0){
+        ssize_t sent = ::send(channel, data, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+/**
+ * Прочесть данные полностью
+ * @param channel Канал передачи
+ * @param data Буфер
+ * @param size Кол-во байт
+ * @return Удалось ли
+ */
+static bool receiveAll(int channel, char* data, size_t size)
+{
+    while(size > 0){
+        ssize_t received = ::recv(channel, data, size, 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+        if(received <= 0)
+            return false;
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+int openHandoffListener(const std::string& path)
+{
+    sockaddr_un address;
+    if(!makeAddress(path, address))
+        return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    // Файл сокета мог остаться от предыдущего процесса (сокет работающего процесса и другие файлы не трогаются)
+    if(!removeStaleLocalSocket(path, address) ||
+       ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 1) != 0){
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectHandoff(const std::string& path)
+{
+    sockaddr_un address;
+    if(!makeAddress(path, address))
+        return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+        ::close(fd);
+        return -1;
+    }
+
+    setChannelTimeout(fd);
+    return fd;
+}
+
+int acceptHandoff(int listener)
+{
+    int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if(fd < 0)
+        return -1;
+
+    setChannelTimeout(fd);
+    return fd;
+}
+
+bool sendHandoff(int channel, const std::string& state, const std::vector<int>& fds)
+{
+    // Заголовок: размер состояния и кол-во сокетов
+    uint64_t header[2] = {state.size(), fds.size()};
+    if(!sendAll(channel, reinterpret_cast<const char*>(header), sizeof(header)) || !sendAll(channel, state.data(), state.size()))
+        return false;
+
+    // Сокеты передаются пачками, каждая - с одним байтом данных (к нему ядро и привязывает пачку)
+    std::vector<char> control(CMSG_SPACE(FDS_PER_MESSAGE * sizeof(int)));
+    for(size_t offset = 0; offset < fds.size(); offset += FDS_PER_MESSAGE)
+    {
+        size_t count = std::min(FDS_PER_MESSAGE, fds.size() - offset);
+        char byte = 0;
+        iovec data = {&byte, 1};
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+        cmsghdr* rights = CMSG_FIRSTHDR(&message);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(rights), fds.data() + offset, count * sizeof(int));
+
+        ssize_t sent;
+        do{
+            sent = ::sendmsg(channel, &message, MSG_NOSIGNAL);
+        }while(sent < 0 && errno == EINTR);
+        if(sent != 1)
+            return false;
+    }
+    return true;
+}
+
+bool receiveHandoff(int channel, std::string& state, std::vector<int>& fds)
+{
+    fds.clear();
+    uint64_t header[2] = {};
+    if(!receiveAll(channel, reinterpret_cast<char*>(header), sizeof(header)) || header[0] > MAX_STATE_SIZE)
+        return false;
+
+    state.resize(static_cast<size_t>(header[0]));
+    if(!receiveAll(channel, &state[0], state.size()))
+        return false;
+
+    std::vector<char> control(CMSG_SPACE(FDS_PER_MESSAGE * sizeof(int)));
+    bool ok = true;
+    while(ok && fds.size() < header[1])
+    {
+        char byte = 0;
+        iovec data = {&byte, 1};
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        ssize_t received;
+        do{
+            received = ::recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+        }while(received < 0 && errno == EINTR);
+
+        // Пачка без сокетов, либо усеченная (не хватило дескрипторов) - передача не удалась
+        ok = received == 1 && !(message.msg_flags & MSG_CTRUNC);
+        for(cmsghdr* rights = CMSG_FIRSTHDR(&message); rights != nullptr; rights = CMSG_NXTHDR(&message, rights)){
+            if(rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const char* begin = reinterpret_cast<const char*>(CMSG_DATA(rights));
+            for(size_t i = 0; i < count; i++){
+                int fd;
+                memcpy(&fd, begin + i * sizeof(int), sizeof(int));
+                fds.push_back(fd);
+            }
+        }
+    }
+
+    if(ok && fds.size() == header[1])
+        return true;
+
+    for(int fd : fds){
+        ::close(fd);
+    }
+    fds.clear();
+    return false;
+}
+
+bool sendHandoffAck(int channel)
+{
+    return sendAll(channel, &ACK, 1);
+}
+
+bool waitHandoffAck(int channel)
+{
+    char byte = 0;
+    return receiveAll(channel, &byte, 1) && byte == ACK;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+/**
+ * Передача прослушивающего сокета и соединений новому процессу сервера (перезапуск без простоя)
+ * Новый процесс подключается к локальному сокету старого, старый изымает сокеты из механизма ввода-вывода
+ * и передает их (SCM_RIGHTS) вместе с сериализованным состоянием сессий. Старый процесс завершается только
+ * после подтверждения нового, иначе возобновляет работу сам. Подключения, пришедшие во время передачи,
+ * ожидают в очереди прослушивающего сокета
+ */
+
+/**
+ * Запись состояния для передачи (значения - в представлении процесса, передача только на той же машине)
+ */
+class HandoffWriter
+{
+private:
+    /// Данные
+    std::string data_;
+
+public:
+    /**
+     * Дописать значение
+     * @param value Значение (тривиально копируемый тип)
+     */
+    template<typename T>
+    void put(const T& value){
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written");
+        data_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /**
+     * Дописать строку (с длиной)
+     * @param value Строка
+     */
+    void putString(const std::string& value){
+        this->put(static_cast<uint64_t>(value.size()));
+        data_ += value;
+    }
+
+    /**
+     * Получить записанные данные
+     * @return Ссылка на данные
+     */
+    const std::string& data() const{
+        return data_;
+    }
+};
+
+/**
+ * Чтение переданного состояния (после первой ошибки все чтения неудачны)
+ */
+class HandoffReader
+{
+private:
+    /// Данные
+    const std::string& data_;
+    /// Текущее положение
+    size_t offset_;
+    /// Не было ли ошибок
+    bool ok_;
+
+public:
+    /**
+     * Конструктор
+     * @param data Данные (должны существовать, пока существует объект)
+     */
+    explicit HandoffReader(const std::string& data):data_(data),offset_(0),ok_(true){}
+
+    /**
+     * Прочесть значение
+     * @param value Значение (тривиально копируемый тип)
+     * @return Удалось ли
+     */
+    template<typename T>
+    bool get(T& value){
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read");
+        if(!ok_ || data_.size() - offset_ < sizeof(T))
+            return ok_ = false;
+
+        memcpy(&value, data_.data() + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return true;
+    }
+
+    /**
+     * Прочесть строку (с длиной)
+     * @param value Строка
+     * @return Удалось ли
+     */
+    bool getString(std::string& value){
+        uint64_t size = 0;
+        if(!this->get(size) || data_.size() - offset_ < size)
+            return ok_ = false;
+
+        value.assign(data_.data() + offset_, static_cast<size_t>(size));
+        offset_ += static_cast<size_t>(size);
+        return true;
+    }
+
+    /**
+     * Прочитаны ли все данные без ошибок
+     * @return Да или нет
+     */
+    bool complete() const{
+        return ok_ && offset_ == data_.size();
+    }
+};
+
+/**
+ * Открыть локальный сокет, ожидающий подключения нового процесса
+ * @param path Путь сокета (сокет, оставшийся от завершившегося процесса, удаляется, см. removeStaleLocalSocket)
+ * @return Дескриптор неблокирующего сокета, либо -1 при ошибке
+ */
+int openHandoffListener(const std::string& path);
+
+/**
+ * Подключиться к локальному сокету работающего процесса
+ * @param path Путь сокета
+ * @return Дескриптор канала передачи, либо -1 (процесса нет)
+ */
+int connectHandoff(const std::string& path);
+
+/**
+ * Принять подключение нового процесса (без ожидания)
+ * @param listener Локальный сокет
+ * @return Дескриптор канала передачи, либо -1 (подключений нет)
+ */
+int acceptHandoff(int listener);
+
+/**
+ * Передать состояние и сокеты
+ * @param channel Канал передачи
+ * @param state Состояние
+ * @param fds Сокеты (остаются открытыми у передающего)
+ * @return Удалось ли
+ */
+bool sendHandoff(int channel, const std::string& state, const std::vector<int>& fds);
+
+/**
+ * Получить состояние и сокеты
+ * @param channel Канал передачи
+ * @param state Состояние
+ * @param fds Сокеты (в порядке передачи)
+ * @return Удалось ли (при неудаче полученные сокеты закрываются)
+ */
+bool receiveHandoff(int channel, std::string& state, std::vector<int>& fds);
+
+/**
+ * Подтвердить, что новый процесс принял сокеты и работает
+ * @param channel Канал передачи
+ * @return Удалось ли
+ */
+bool sendHandoffAck(int channel);
+
+/**
+ * Дождаться подтверждения нового процесса
+ * @param channel Канал передачи
+ * @return Получено ли подтверждение
+ */
+bool waitHandoffAck(int channel);
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Получатель событий ввода-вывода
+ * Соединение идентифицируется номером ячейки таблицы соединений (номер переиспользуется после закрытия)
+ */
+class IoHandler
+{
+public:
+    /**
+     * Деструктор
+     */
+    virtual ~IoHandler() = default;
+
+    /**
+     * Принято новое соединение
+     * @param connection Номер соединения
+     */
+    virtual void onAccepted(uint32_t connection) = 0;
+
+    /**
+     * Получены данные
+     * @param connection Номер соединения
+     * @param data Данные (действительны только на время вызова)
+     * @param size Кол-во байт
+     */
+    virtual void onReceived(uint32_t connection, const char* data, size_t size) = 0;
+
+    /**
+     * Соединение разорвано клиентом, либо из-за ошибки (о закрытых сервером соединениях не сообщается)
+     * @param connection Номер соединения
+     */
+    virtual void onClosed(uint32_t connection) = 0;
+};
+
+/**
+ * Соединение, изъятое из механизма ввода-вывода (для передачи другому процессу)
+ */
+struct DetachedConnection
+{
+    // Номер соединения
+    uint32_t connection;
+    // Сокет (владение переходит к получателю)
+    int fd;
+    // Исходящие данные, которые не успели записать
+    std::string output;
+    // Закрыто сервером (после записи исходящих данных)
+    bool closing;
+};
+
+/**
+ * Механизм ввода-вывода на системных сокетах
+ * Исходящие данные накапливаются в очередях соединений и записываются пачкой (flush), события готовности
+ * и завершения операций также обрабатываются пачкой (poll)
+ */
+class IoBackend
+{
+public:
+    /// Номер несуществующего соединения
+    static constexpr uint32_t NO_CONNECTION = 0xFFFFFFFFu;
+
+    /**
+     * Деструктор
+     */
+    virtual ~IoBackend() = default;
+
+    /**
+     * Название механизма
+     * @return Строка
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * Открыть порт и начать прием подключений
+     * @param port Порт
+     * @param handler Получатель событий
+     * @return Удалось ли
+     */
+    virtual bool listen(uint16_t port, IoHandler& handler) = 0;
+
+    /**
+     * Открыть локальный (Unix-domain) сокет и начать прием подключений на нем (вместе с портом)
+     * @param path Путь сокета
+     * @param handler Получатель событий
+     * @return Удалось ли
+     */
+    virtual bool listenLocal(const std::string& path, IoHandler& handler) = 0;
+
+    /**
+     * Ожидать событий и передать их получателю
+     * @param timeoutMs Наибольшее время ожидания (мс)
+     */
+    virtual void poll(int timeoutMs) = 0;
+
+    /**
+     * Получить очередь исходящих данных соединения (дописанное будет записано при следующем flush)
+     * @param connection Номер соединения
+     * @return Указатель на очередь, либо nullptr если соединение закрывается
+     */
+    virtual std::string* outbox(uint32_t connection) = 0;
+
+    /**
+     * Записать накопленные очереди исходящих данных
+     */
+    virtual void flush() = 0;
+
+    /**
+     * Закрыть соединение после записи его очереди исходящих данных
+     * @param connection Номер соединения
+     */
+    virtual void close(uint32_t connection) = 0;
+
+    /**
+     * Начать прием подключений на уже открытом прослушивающем сокете (переданном другим процессом)
+     * @param fd Прослушивающий сокет (при успехе механизм им владеет, прием на открытых ранее продолжается)
+     * @param handler Получатель событий
+     * @return Удалось ли
+     */
+    virtual bool adoptListener(int fd, IoHandler& handler) = 0;
+
+    /**
+     * Принять уже установленное соединение (переданное другим процессом)
+     * @param fd Сокет (механизм им владеет, даже если соединение не принято)
+     * @return Номер соединения, либо NO_CONNECTION если таблица соединений заполнена
+     * @details Получатель не уведомляется (onAccepted), состояние соединения восстанавливает вызывающий
+     */
+    virtual uint32_t adopt(int fd) = 0;
+
+    /**
+     * Прекратить ввод-вывод и изъять все сокеты
+     * @param connections Изъятые соединения
+     * @return Прослушивающие сокеты в порядке открытия (владение переходит к вызывающему)
+     * @details Незавершенные операции отменяются или дожидаются, поэтому получатель еще может получить
+     * последние события. Соединения не разрываются - после изъятия сокеты можно передать другому процессу
+     */
+    virtual std::vector<int> detach(std::vector<DetachedConnection>& connections) = 0;
+
+    /**
+     * Наибольшее кол-во соединений
+     * @return Кол-во
+     */
+    virtual uint32_t capacity() const = 0;
+
+    /**
+     * Память ячейки соединения, занимаемая независимо от нагрузки (таблица соединений размещается целиком)
+     * @return Кол-во байт
+     */
+    virtual size_t slotFootprint() const = 0;
+
+    /**
+     * Память буферов соединения (очереди исходящих данных)
+     * @param connection Номер соединения
+     * @return Кол-во байт (0 - буферы освобождены, соединение простаивает и хранится в компактном виде)
+     */
+    virtual size_t bufferFootprint(uint32_t connection) const = 0;
+
+    /**
+     * Сокет соединения (для сведений о нем, например адреса клиента; ввод-вывод выполняет только механизм)
+     * @param connection Номер соединения
+     * @return Дескриптор сокета, либо -1
+     */
+    virtual int descriptor(uint32_t connection) const = 0;
+
+    /**
+     * Объем исходящих данных соединения, еще не записанных в сокет
+     * @param connection Номер соединения
+     * @return Кол-во байт
+     */
+    virtual size_t queuedBytes(uint32_t connection) const = 0;
+
+    /**
+     * Задать пределы очереди исходящих данных соединения (0 - без предела)
+     * @param highWater Объем, начиная с которого проверочные сообщения не ставятся в очередь (см. NativePeer)
+     * @param limit Объем, при превышении которого соединение разрывается как медленный получатель (получатель
+     * событий уведомляется как об обычном отключении)
+     */
+    void setOutboxLimits(size_t highWater, size_t limit){
+        outboxHighWater_ = highWater;
+        outboxLimit_ = limit;
+    }
+
+    /**
+     * Объем очереди, начиная с которого проверочные сообщения не ставятся в очередь
+     * @return Кол-во байт (0 - без предела)
+     */
+    size_t outboxHighWater() const{
+        return outboxHighWater_;
+    }
+
+    /**
+     * Кол-во соединений, разорванных как медленные получатели
+     * @return Кол-во
+     */
+    uint64_t evictedCount() const{
+        return evicted_;
+    }
+
+protected:
+    /// Пределы очереди исходящих данных (0 - без предела)
+    size_t outboxHighWater_ = 0;
+    size_t outboxLimit_ = 0;
+    /// Кол-во соединений, разорванных как медленные получатели
+    uint64_t evicted_ = 0;
+
+    /**
+     * Проверить, превышает ли очередь соединения предел (превысившие учитываются)
+     * @param queued Объем очереди
+     * @return Да или нет
+     */
+    bool exceedsOutboxLimit(size_t queued){
+        if(outboxLimit_ == 0 || queued <= outboxLimit_)
+            return false;
+
+        evicted_++;
+        return true;
+    }
+
+    /**
+     * Память, выделенная строкой в куче
+     * @param buffer Строка
+     * @return Кол-во байт (короткие строки хранятся в самом объекте - 0)
+     */
+    static size_t heapBytes(const std::string& buffer){
+        const char* data = buffer.data();
+        const char* object = reinterpret_cast<const char*>(&buffer);
+        return (data >= object && data < object + sizeof(buffer)) ? 0 : buffer.capacity() + 1;
+    }
+
+    /**
+     * Освободить память строки (clear сохраняет выделенную память)
+     * @param buffer Строка
+     */
+    static void releaseBuffer(std::string& buffer){
+        std::string().swap(buffer);
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+/**
+ * Открыть прослушивающий TCP сокет на всех интерфейсах
+ * @param port Порт
+ * @param backlog Длина очереди ожидающих подключений
+ * @param nonBlocking Открыть ли в неблокирующем режиме
+ * @return Дескриптор сокета, либо -1 при ошибке
+ */
+inline int openListenSocket(uint16_t port, int backlog, bool nonBlocking)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+    if(fd < 0)
+        return -1;
+
+    int enable = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, backlog) != 0){
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Освободить путь локального сокета (файл сокета, оставшийся от завершившегося процесса, удаляется)
+ * @param path Путь сокета
+ * @param address Адрес сокета
+ * @return Свободен ли путь
+ * @details Удаляется только сокет, подключение к которому отклонено. Другой файл и сокет работающего процесса
+ * не трогаются - открытие сокета завершается ошибкой
+ */
+inline bool removeStaleLocalSocket(const std::string& path, const sockaddr_un& address)
+{
+    struct stat info;
+    if(::lstat(path.c_str(), &info) != 0)
+        return errno == ENOENT;
+    if(!S_ISSOCK(info.st_mode))
+        return false;
+
+    // Проверка не блокируется, даже если очередь работающего процесса заполнена
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if(probe < 0)
+        return false;
+
+    bool stale = ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 && errno == ECONNREFUSED;
+    ::close(probe);
+    return stale && ::unlink(path.c_str()) == 0;
+}
+
+/**
+ * Открыть прослушивающий локальный (Unix-domain) сокет для клиентов на той же машине
+ * @param path Путь сокета (сокет, оставшийся от завершившегося процесса, удаляется, см. removeStaleLocalSocket)
+ * @param backlog Длина очереди ожидающих подключений
+ * @param nonBlocking Открыть ли в неблокирующем режиме
+ * @return Дескриптор сокета, либо -1 при ошибке
+ */
+inline int openLocalListenSocket(const std::string& path, int backlog, bool nonBlocking)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(address.sun_path))
+        return -1;
+    memcpy(address.sun_path, path.data(), path.size());
+
+    if(!removeStaleLocalSocket(path, address))
+        return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+    if(fd < 0)
+        return -1;
+
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, backlog) != 0){
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
@@ -0,0 +1,188 @@
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <csignal>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "NativeServer.h"
+#include "Handoff.h"
+#include "UringBackend.h"
+#include "EpollBackend.h"
+
+/// Прослушиваемый порт
+unsigned _port;
+/// Сервер (для остановки по сигналу)
+NativeServer* _server = nullptr;
+
+/**
+ * Обработчик сигналов остановки
+ * @param signal Номер сигнала
+ */
+static void onStopSignal(int signal)
+{
+    (void)signal;
+    if(_server != nullptr) _server->stop();
+}
+
+/**
+ * Разобрать список чисел через запятую (пропущенные значения не меняются)
+ * @param list Список
+ * @param values Получатели значений по порядку
+ */
+static void parseList(const std::string& list, std::initializer_list<unsigned*> values)
+{
+    size_t begin = 0;
+    for(unsigned* value : values){
+        if(begin > list.size()) break;
+        size_t end = std::min(list.find(',', begin), list.size());
+        if(end > begin) *value = static_cast<unsigned>(std::stoul(list.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+}
+
+/**
+ * Точка входа
+ * @param argc Кол-во аргументов
+ * @param argv Аргументы
+ * @return Код выполнения (выхода)
+ */
+int main(int argc, char* argv[])
+{
+    try
+    {
+        // Аргументы: "epoll" - не использовать io_uring, "--handoff <путь>" - перезапуск без разрыва соединений,
+        // "--checkpoint <путь>" - файл контрольных точек идущих игр (после аварийного завершения игроки возвращаются по токенам),
+        // "--shard <номер>" - номер сервера в группе за маршрутизатором (BattleShipRouter),
+        // "--connections <кол-во>" - наибольшее кол-во соединений (и сессий - каждый ожидающий игрок держит сессию)
+        // "--admission <соединения>,<рукопожатия>,<сессии>" - пределы нагрузки, сверх которых клиентам отвечается "сервер занят",
+        // "--rate <подключений>,<сообщений>" - допустимая частота в секунду: подключений с одного адреса, сообщений
+        // по одному соединению (0 - без ограничения),
+        // "--channels <всего>,<на соединение>" - наибольшее кол-во каналов (игр на одном соединении, 0 - каналы не поддерживаются),
+        // "--local <путь>" - также принимать подключения через локальный сокет (клиенты на той же машине, без стека TCP)
+        ServerSettings settings;
+        bool forceEpoll = false;
+        std::string handoffPath;
+        std::string checkpointPath;
+        std::string localPath;
+        for(int i = 1; i < argc; i++){
+            std::string argument(argv[i]);
+            if(argument == "epoll") forceEpoll = true;
+            else if(argument == "--handoff" && i + 1 < argc) handoffPath = argv[++i];
+            else if(argument == "--checkpoint" && i + 1 < argc) checkpointPath = argv[++i];
+            else if(argument == "--local" && i + 1 < argc) localPath = argv[++i];
+            else if(argument == "--shard" && i + 1 < argc) settings.shardIndex = static_cast<unsigned>(std::stoul(argv[++i]));
+            else if(argument == "--connections" && i + 1 < argc){
+                settings.maxConnections = static_cast<unsigned>(std::stoul(argv[++i]));
+                settings.maxSessions = settings.maxConnections;
+            }
+            else if(argument == "--admission" && i + 1 < argc){
+                parseList(argv[++i], {&settings.connectionsLimit, &settings.handshakesLimit, &settings.sessionsLimit});
+            }
+            else if(argument == "--rate" && i + 1 < argc){
+                parseList(argv[++i], {&settings.connectionRate, &settings.messageRate});
+            }
+            else if(argument == "--channels" && i + 1 < argc){
+                parseList(argv[++i], {&settings.maxChannels, &settings.maxChannelsPerConnection});
+            }
+        }
+
+        // Каждое соединение - дескриптор, поэтому мягкий предел их кол-ва поднимается (насколько позволяет жесткий)
+        rlimit files;
+        if(::getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < settings.maxConnections + 64){
+            files.rlim_cur = std::min<rlim_t>(files.rlim_max, settings.maxConnections + 64);
+            ::setrlimit(RLIMIT_NOFILE, &files);
+            if(files.rlim_cur < settings.maxConnections + 64){
+                std::cout << "Warning: open files limit (" << files.rlim_cur << ") is below connections limit." << std::endl;
+            }
+        }
+
+        // Если по пути уже ожидает работающий процесс - работа принимается у него (порт не запрашивается)
+        std::string handoffState;
+        std::vector<int> handoffFds;
+        int channel = handoffPath.empty() ? -1 : connectHandoff(handoffPath);
+        if(channel >= 0 && !receiveHandoff(channel, handoffState, handoffFds)){
+            ::close(channel);
+            throw std::runtime_error("Error: can't receive state from running server.");
+        }
+        bool takeover = channel >= 0;
+
+        // Ввод прослушиваемого порта
+        if(!takeover){
+            std::cout << "Please enter port: ";
+            std::cin >> _port;
+        }
+
+        // Запись в разорванное соединение не должна завершать процесс
+        std::signal(SIGPIPE, SIG_IGN);
+
+        // Механизм ввода-вывода: io_uring, если ядро его поддерживает (иначе, либо по аргументу "epoll" - epoll)
+        std::unique_ptr<IoBackend> backend;
+        std::unique_ptr<NativeServer> server;
+        // При передаче работы локальный сокет (если был открыт) передается вместе с портом
+        auto start = [&]() -> bool {
+            server.reset(new NativeServer(settings, *backend));
+            if(takeover)
+                return server->restore(handoffState, handoffFds);
+            return server->listen(static_cast<uint16_t>(_port)) && (localPath.empty() || server->listenLocal(localPath));
+        };
+
+        if(!forceEpoll){
+            backend.reset(new UringBackend(settings.maxConnections, settings.ioQueueDepth));
+            if(!start()){
+                std::cout << "io_uring is not available. Falling back to epoll." << std::endl;
+                server.reset();
+                backend.reset();
+            }
+        }
+
+        if(!backend){
+            backend.reset(new EpollBackend(settings.maxConnections, settings.ioQueueDepth));
+            if(!start()){
+                // Закрытие канала сообщает работающему процессу, что ему следует продолжить работу
+                if(takeover){
+                    for(int fd : handoffFds) ::close(fd);
+                    ::close(channel);
+                    throw std::runtime_error("Error: can't restore state of running server.");
+                }
+                throw std::runtime_error("Error: can't open listening socket.");
+            }
+        }
+
+        if(takeover){
+            if(!sendHandoffAck(channel)){
+                std::cout << "Warning: running server didn't receive confirmation." << std::endl;
+            }
+            ::close(channel);
+            std::cout << "Took over running server, I/O: " << backend->name() << "." << std::endl;
+        }else{
+            std::cout << "Listening port (" << _port << ", TCP and WebSocket), I/O: " << backend->name() << "." << std::endl;
+            if(!localPath.empty()) std::cout << "Listening local socket (" << localPath << ")." << std::endl;
+        }
+
+        // Следующий перезапуск - через тот же путь
+        if(!handoffPath.empty() && !server->enableHandoff(handoffPath)){
+            std::cout << "Warning: can't open handoff socket (" << handoffPath << ")." << std::endl;
+        }
+
+        // Сессии из контрольных точек восстанавливаются при обычном запуске (при передаче работы они уже переданы)
+        if(!checkpointPath.empty() && !server->enableCheckpoints(checkpointPath, !takeover)){
+            std::cout << "Warning: can't open checkpoint file (" << checkpointPath << ")." << std::endl;
+        }
+
+        // Основной цикл сервера (до SIGINT или SIGTERM)
+        _server = server.get();
+        std::signal(SIGINT, onStopSignal);
+        std::signal(SIGTERM, onStopSignal);
+        server->run();
+        _server = nullptr;
+    }
+    catch(std::exception& ex)
+    {
+        std::cout << ex.what() << std::endl;
+    }
+    return 0;
+}
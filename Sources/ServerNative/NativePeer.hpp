@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../NetworkApi/MsgCodec.hpp"
+#include "../NetworkApi/MsgChannel.hpp"
+#include "IoBackend.hpp"
+#include "WebSocketStream.h"
+
+/**
+ * Игрок на системном сокете (см. BasicGameSession)
+ * Сообщения кодируются сразу в очередь исходящих данных соединения, запись выполняет механизм ввода-вывода
+ * (клиенту WebSocket - в двоичном кадре, заголовок которого пишется в очередь перед сообщением). Игрок канала
+ * пишет в очередь соединения-носителя, предваряя каждое сообщение меткой своего канала
+ */
+class NativePeer
+{
+private:
+    /// Механизм ввода-вывода
+    IoBackend* backend_;
+    /// Номер соединения (для игрока канала - номер соединения канала у сервера)
+    uint32_t connection_;
+    /// Соединение, в очередь которого пишутся сообщения, и номер канала у клиента
+    uint32_t carrier_;
+    uint32_t channel_;
+    /// Играет ли игрок по каналу соединения
+    bool multiplexed_;
+    /// Подключен ли игрок (сбрасывается сервером при разрыве соединения)
+    bool connected_;
+    /// Подключен ли игрок через WebSocket
+    bool websocket_;
+
+public:
+    /**
+     * Конструктор
+     * @param backend Механизм ввода-вывода
+     * @param connection Номер соединения
+     * @param websocket Подключен ли игрок через WebSocket
+     */
+    NativePeer(IoBackend& backend, uint32_t connection, bool websocket = false):
+            backend_(&backend),
+            connection_(connection),
+            carrier_(connection),
+            channel_(0),
+            multiplexed_(false),
+            connected_(true),
+            websocket_(websocket){}
+
+    /**
+     * Конструктор игрока канала
+     * @param backend Механизм ввода-вывода
+     * @param connection Номер соединения канала
+     * @param websocket Подключен ли игрок через WebSocket
+     * @param carrier Соединение-носитель канала
+     * @param channel Номер канала у клиента
+     */
+    NativePeer(IoBackend& backend, uint32_t connection, bool websocket, uint32_t carrier, uint32_t channel):
+            backend_(&backend),
+            connection_(connection),
+            carrier_(carrier),
+            channel_(channel),
+            multiplexed_(true),
+            connected_(true),
+            websocket_(websocket){}
+
+    /**
+     * Дописать в очередь метку канала
+     * @param channel Номер канала у клиента
+     * @param websocket Соединение WebSocket
+     * @param outbox Очередь исходящих данных
+     */
+    static void writeChannel(uint32_t channel, bool websocket, std::string& outbox){
+        if(websocket){
+            WebSocketStream::writeFrameHeader(sizeof(uint8_t) + sizeof(uint32_t), outbox);
+        }
+        net::MsgCodec::encode(net::MsgChannel(channel), outbox);
+    }
+
+    /**
+     * Получить номер соединения
+     * @return Номер
+     */
+    uint32_t getSocket() const{
+        return connection_;
+    }
+
+    /**
+     * Отправка сообщения без ожидания (запись выполняется механизмом ввода-вывода пачкой)
+     * @param message Сообщение
+     * @return Удалось ли поместить сообщение в очередь отправки
+     */
+    bool postMessage(const net::Msg& message){
+        std::string* outbox = connected_ ? backend_->outbox(carrier_) : nullptr;
+        if(outbox == nullptr)
+            return false;
+
+        // Получателю с большой очередью проверочные сообщения не нужны (о разрыве сообщит сама очередь)
+        size_t highWater = backend_->outboxHighWater();
+        if(message.getType() == net::MSG_HEARTBEAT && highWater > 0 && backend_->queuedBytes(carrier_) >= highWater)
+            return true;
+
+        if(multiplexed_){
+            writeChannel(channel_, websocket_, *outbox);
+        }
+        if(websocket_){
+            WebSocketStream::writeFrameHeader(sizeof(uint8_t) + net::MsgCodec::payloadSizeOf(message.getType()), *outbox);
+        }
+        net::MsgCodec::encode(message, *outbox);
+        return true;
+    }
+
+    /**
+     * Подключен ли игрок
+     * @return Да или нет
+     */
+    bool isConnected() const{
+        return connected_;
+    }
+
+    /**
+     * Отметить игрока отключенным (соединение разорвано или закрыто сервером)
+     */
+    void markDisconnected(){
+        connected_ = false;
+    }
+};
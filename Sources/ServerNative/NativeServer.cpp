@@ -0,0 +1,1937 @@
+#include "NativeServer.h"
+
+#include <iostream>
+#include <cstring>
+#include <type_traits>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../NetworkApi/MsgPlayerQuery.hpp"
+#include "../NetworkApi/MsgPlayerResponse.hpp"
+#include "../NetworkApi/MsgServerBusy.hpp"
+#include "../NetworkApi/MsgFleetLayout.hpp"
+#include "../NetworkApi/MsgLobbyUpdate.hpp"
+#include "../NetworkApi/MsgSpectate.hpp"
+#include "../NetworkApi/MsgResume.hpp"
+#include "../NetworkApi/MsgResumeState.hpp"
+#include "../NetworkApi/MsgChannel.hpp"
+#include "../NetworkApi/SessionKey.hpp"
+#include "Handoff.h"
+
+/// Признак и версия формата состояния, передаваемого новому процессу
+static constexpr uint32_t HANDOFF_MAGIC = 0x42534831;
+static constexpr uint32_t HANDOFF_VERSION = 9;
+
+/**
+ * Цель таймера соединения (поколение в старших разрядах, номер в младших)
+ * @param connection Номер соединения
+ * @param generation Поколение
+ * @return Цель таймера
+ */
+static uint64_t connectionTarget(uint32_t connection, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | connection;
+}
+
+/**
+ * Номер записи контрольной точки сессии (номер ячейки таблицы сессий)
+ * @param sessionKey Ключ сессии
+ * @return Номер записи
+ */
+static size_t checkpointSlot(uintptr_t sessionKey)
+{
+    return static_cast<size_t>(sessionKey & ((static_cast<uintptr_t>(1) << SessionSlab<int>::INDEX_BITS) - 1));
+}
+
+/**
+ * Ключ адреса клиента для ограничения частоты
+ * @param fd Сокет клиента
+ * @return Ключ (0 - клиент локального сокета, либо адрес не получен: частота не ограничивается)
+ */
+static uint64_t peerKeyOf(int fd)
+{
+    sockaddr_storage address = {};
+    socklen_t size = sizeof(address);
+    if(fd < 0 || ::getpeername(fd, reinterpret_cast<sockaddr*>(&address), &size) != 0 || address.ss_family == AF_UNIX)
+        return 0;
+
+    if(address.ss_family == AF_INET6){
+        const in6_addr& ip = reinterpret_cast<const sockaddr_in6&>(address).sin6_addr;
+        return RateLimiter::keyOf(&ip, sizeof(ip));
+    }
+    const in_addr& ip = reinterpret_cast<const sockaddr_in&>(address).sin_addr;
+    return RateLimiter::keyOf(&ip, sizeof(ip));
+}
+
+/**
+ * Ключ ограничения частоты сообщений соединения (у каждого соединения и канала свой запас, поэтому клиенты за одним
+ * адресом - например, за маршрутизатором - не делят его)
+ * @param peerKey Ключ адреса клиента (0 - частота не ограничивается)
+ * @param connection Номер соединения (канала)
+ * @param generation Поколение ячейки соединения
+ * @return Ключ (0 - частота не ограничивается)
+ */
+static uint64_t messageKeyOf(uint64_t peerKey, uint32_t connection, uint32_t generation)
+{
+    if(peerKey == 0)
+        return 0;
+
+    uint64_t parts[2] = {peerKey, connectionTarget(connection, generation)};
+    return RateLimiter::keyOf(parts, sizeof(parts));
+}
+
+/**
+ * Конструктор
+ * @param settings Настройки
+ * @param backend Механизм ввода-вывода
+ */
+NativeServer::NativeServer(const ServerSettings& settings, IoBackend& backend):
+        settings_(settings),
+        backend_(backend),
+        connections_(backend.capacity() + settings.maxChannels),
+        sessions_(settings.maxSessions),
+        admission_(settings),
+        connectionRate_(settings.rateTableSize, settings.connectionRate, settings.connectionBurst),
+        messageRate_(settings.rateTableSize, settings.messageRate, settings.messageBurst),
+        started_(std::chrono::steady_clock::now()),
+        timers_(settings.timerTick, 0),
+        stopRequested_(0),
+        handoffListener_(-1),
+        handoffCheckedAt_(0),
+        memoryReportedAt_(0),
+        rateAgedAt_(0),
+        lobbyPublishedAt_(0)
+{
+    for(uint32_t i = 0; i < connections_.size(); i++){
+        Connection& connection = connections_[i];
+        connection.generation = 0;
+        connection.open = false;
+        connection.handshaking = false;
+        connection.peerKey = 0;
+        connection.messageKey = 0;
+        connection.transport = UNKNOWN_TRANSPORT;
+        connection.lobbyIndex = NOT_SUBSCRIBED;
+        connection.carrier = i;
+        connection.channel = 0;
+        connection.inbound = IoBackend::NO_CONNECTION;
+    }
+
+    // Ячейки каналов выдаются с меньших номеров
+    for(uint32_t i = static_cast<uint32_t>(connections_.size()); i > backend.capacity(); i--){
+        freeChannels_.push_back(i - 1);
+    }
+
+    // Очередь медленного получателя не растет без предела (один зависший игрок не держит память сервера)
+    backend_.setOutboxLimits(settings.outboxHighWater, settings.outboxLimit);
+}
+
+/**
+ * Деструктор
+ */
+NativeServer::~NativeServer()
+{
+    if(handoffListener_ >= 0) ::close(handoffListener_);
+}
+
+/**
+ * Открыть порт
+ * @param port Порт
+ * @return Удалось ли
+ */
+bool NativeServer::listen(uint16_t port)
+{
+    return backend_.listen(port, *this);
+}
+
+/**
+ * Открыть локальный (Unix-domain) сокет для клиентов на той же машине (вместе с портом)
+ * @param path Путь сокета
+ * @return Удалось ли
+ */
+bool NativeServer::listenLocal(const std::string& path)
+{
+    return backend_.listenLocal(path, *this);
+}
+
+/**
+ * Ожидать подключения нового процесса, которому работа будет передана без разрыва соединений
+ * @param path Путь локального сокета
+ * @return Удалось ли открыть сокет
+ */
+bool NativeServer::enableHandoff(const std::string& path)
+{
+    if(handoffListener_ >= 0) ::close(handoffListener_);
+    handoffPath_ = path;
+    handoffListener_ = openHandoffListener(path);
+    return handoffListener_ >= 0;
+}
+
+/**
+ * Восстановить работу из состояния, переданного прежним процессом
+ * @param state Состояние (см. handoff)
+ * @param fds Прослушивающий сокет, затем сокеты соединений (при успехе ими владеет сервер)
+ * @return Удалось ли (при неудаче сокеты соединений не тронуты - можно попробовать с другим механизмом)
+ */
+bool NativeServer::restore(const std::string& state, const std::vector<int>& fds)
+{
+    // Сохраненное соединение
+    struct SavedConnection
+    {
+        uint32_t connection;
+        uint8_t open;
+        uint64_t sessionKey;
+        uint8_t fleetReceived;
+        uint64_t fleet[2];
+        std::string pending;
+        std::string output;
+        uint8_t transport;
+        uint8_t websocketOpen;
+        std::string websocketPending;
+        uint8_t lobbySubscribed;
+        uint64_t spectating;
+        uint8_t multiplexed;
+        uint64_t inbound;
+    };
+
+    // Сохраненный канал (соединение-носитель - по номеру у прежнего процесса)
+    struct SavedChannel
+    {
+        uint32_t connection;
+        uint32_t carrier;
+        uint32_t channel;
+        uint64_t sessionKey;
+        uint8_t fleetReceived;
+        uint64_t fleet[2];
+        uint8_t lobbySubscribed;
+        uint64_t spectating;
+    };
+
+    // Сохраненная сессия (игроки - по номерам соединений у прежнего процесса)
+    struct SavedSession
+    {
+        uint64_t key;
+        uint8_t matchmaking;
+        Session::State state;
+        uint8_t playersCount;
+        uint32_t players[2];
+    };
+
+    // Состояние разбирается целиком до того, как механизм ввода-вывода получит сокеты
+    HandoffReader reader(state);
+    uint32_t magic = 0, version = 0;
+    uint64_t listenersCount = 0, connectionsCount = 0;
+    reader.get(magic);
+    reader.get(version);
+    reader.get(listenersCount);
+    reader.get(connectionsCount);
+    if(magic != HANDOFF_MAGIC || version != HANDOFF_VERSION || listenersCount == 0 || listenersCount + connectionsCount != fds.size())
+        return false;
+
+    std::vector<SavedConnection> savedConnections(static_cast<size_t>(connectionsCount));
+    for(SavedConnection& saved : savedConnections){
+        reader.get(saved.connection);
+        reader.get(saved.open);
+        reader.get(saved.sessionKey);
+        reader.get(saved.fleetReceived);
+        reader.get(saved.fleet);
+        reader.getString(saved.pending);
+        reader.getString(saved.output);
+        reader.get(saved.transport);
+        reader.get(saved.websocketOpen);
+        reader.getString(saved.websocketPending);
+        reader.get(saved.lobbySubscribed);
+        reader.get(saved.spectating);
+        reader.get(saved.multiplexed);
+        reader.get(saved.inbound);
+    }
+
+    uint64_t channelsCount = 0;
+    std::vector<SavedChannel> savedChannels;
+    reader.get(channelsCount);
+    for(uint64_t i = 0; i < channelsCount; i++){
+        SavedChannel saved = {};
+        if(!reader.get(saved.connection) || !reader.get(saved.carrier) || !reader.get(saved.channel) || !reader.get(saved.sessionKey)
+           || !reader.get(saved.fleetReceived) || !reader.get(saved.fleet) || !reader.get(saved.lobbySubscribed) || !reader.get(saved.spectating))
+            return false;
+        savedChannels.push_back(saved);
+    }
+
+    uint64_t sessionsCount = 0;
+    std::vector<SavedSession> savedSessions;
+    reader.get(sessionsCount);
+    for(uint64_t i = 0; i < sessionsCount; i++){
+        SavedSession saved = {};
+        if(!reader.get(saved.key) || !reader.get(saved.matchmaking) || !reader.get(saved.state) || !reader.get(saved.playersCount) || saved.playersCount > 2)
+            return false;
+        for(uint8_t player = 0; player < saved.playersCount; player++){
+            reader.get(saved.players[player]);
+        }
+        savedSessions.push_back(saved);
+    }
+
+    uint64_t queueSize = 0;
+    std::vector<uint64_t> savedQueue;
+    reader.get(queueSize);
+    for(uint64_t i = 0; i < queueSize; i++){
+        uint64_t key = 0;
+        if(!reader.get(key))
+            return false;
+        savedQueue.push_back(key);
+    }
+
+    if(!reader.complete())
+        return false;
+
+    // Прием продолжается на всех сокетах прежнего процесса (порт и локальный сокет)
+    for(size_t i = 0; i < listenersCount; i++){
+        if(!backend_.adoptListener(fds[i], *this))
+            return false;
+    }
+
+    // Прежнее состояние сервера (при неудачной передаче - то же самое) заменяется переданным
+    sessions_.clear();
+    matchQueue_.clear();
+    timers_ = Timers(settings_.timerTick, this->elapsed());
+    admission_.reset();
+    lobby_.clear();
+    lobby_.unwatch(0);
+    lobbySubscribers_.clear();
+    for(Connection& c : connections_){
+        c.open = false;
+        c.handshakeTimer = 0;
+        c.handshaking = false;
+        c.lobbyIndex = NOT_SUBSCRIBED;
+        c.spectator.reset();
+        c.channels.reset();
+        c.inbound = IoBackend::NO_CONNECTION;
+    }
+    backloggedSpectators_.clear();
+    freeChannels_.clear();
+    for(uint32_t i = static_cast<uint32_t>(connections_.size()); i > backend_.capacity(); i--){
+        freeChannels_.push_back(i - 1);
+    }
+
+    // Соединения получают новые номера, незаписанные данные ставятся в очередь
+    std::unordered_map<uint32_t, uint32_t> connectionIds;
+    std::vector<uint32_t> subscribers;
+    std::vector<std::pair<uint32_t, uintptr_t>> spectators;
+    for(size_t i = 0; i < savedConnections.size(); i++)
+    {
+        const SavedConnection& saved = savedConnections[i];
+        uint32_t connection = backend_.adopt(fds[listenersCount + i]);
+        if(connection == IoBackend::NO_CONNECTION)
+            continue;
+
+        Connection& c = connections_[connection];
+        c.generation++;
+        c.open = saved.open != 0;
+        c.codec = net::MsgCodec();
+        c.codec.setPending(saved.pending);
+        c.sessionKey = static_cast<uintptr_t>(saved.sessionKey);
+        c.peerKey = peerKeyOf(backend_.descriptor(connection));
+        c.messageKey = messageKeyOf(c.peerKey, connection, c.generation);
+        c.fleet.reset(saved.fleetReceived != 0 ? new net::FleetBoard() : nullptr);
+        if(c.fleet) c.fleet->load(saved.fleet);
+        c.transport = static_cast<Transport>(saved.transport);
+        c.websocket.reset(c.transport == WEBSOCKET ? new WebSocketStream() : nullptr);
+        if(c.websocket) c.websocket->restore(saved.websocketOpen != 0, saved.websocketPending);
+        c.channels.reset(saved.multiplexed != 0 ? new std::unordered_map<uint32_t, uint32_t>() : nullptr);
+
+        std::string* outbox = backend_.outbox(connection);
+        if(outbox != nullptr) *outbox += saved.output;
+
+        // Соединение закрывалось прежним процессом - закрывается после записи
+        if(!c.open){
+            backend_.close(connection);
+            continue;
+        }
+
+        // Переданные соединения учитываются без проверки пределов
+        connectionIds[saved.connection] = connection;
+        if(saved.lobbySubscribed != 0){
+            subscribers.push_back(connection);
+        }
+        if(saved.spectating != 0){
+            spectators.emplace_back(connection, static_cast<uintptr_t>(saved.spectating));
+        }
+        c.handshaking = c.sessionKey == 0 && saved.lobbySubscribed == 0 && saved.spectating == 0 && !c.channels;
+        admission_.adoptConnection(c.handshaking);
+        if(c.handshaking){
+            c.handshakeTimer = this->addTimer(settings_.handshakeTimeout, ServerTimer{HANDSHAKE_TIMEOUT, connectionTarget(connection, c.generation), 0});
+        }
+    }
+
+    // Каналы открываются заново на тех же соединениях-носителях (каналы закрытых носителей не восстанавливаются)
+    for(const SavedChannel& saved : savedChannels)
+    {
+        auto carrier = connectionIds.find(saved.carrier);
+        if(carrier == connectionIds.end() || !connections_[carrier->second].channels)
+            continue;
+
+        uint32_t connection = this->openChannel(carrier->second, saved.channel);
+        if(connection == IoBackend::NO_CONNECTION)
+            continue;
+
+        Connection& c = connections_[connection];
+        c.sessionKey = static_cast<uintptr_t>(saved.sessionKey);
+        c.fleet.reset(saved.fleetReceived != 0 ? new net::FleetBoard() : nullptr);
+        if(c.fleet) c.fleet->load(saved.fleet);
+        if(c.sessionKey != 0 || saved.lobbySubscribed != 0 || saved.spectating != 0){
+            this->cancelTimer(c.handshakeTimer);
+        }
+
+        connectionIds[saved.connection] = connection;
+        if(saved.lobbySubscribed != 0){
+            subscribers.push_back(connection);
+        }
+        if(saved.spectating != 0){
+            spectators.emplace_back(connection, static_cast<uintptr_t>(saved.spectating));
+        }
+    }
+
+    // Следующие сообщения клиентов относятся к тем же каналам, что и у прежнего процесса
+    for(const SavedConnection& saved : savedConnections)
+    {
+        auto id = connectionIds.find(saved.connection);
+        if(saved.inbound == 0 || id == connectionIds.end() || !connections_[id->second].channels)
+            continue;
+
+        Connection& c = connections_[id->second];
+        auto inbound = c.channels->find(static_cast<uint32_t>(saved.inbound - 1));
+        if(inbound != c.channels->end()) c.inbound = inbound->second;
+    }
+
+    // Сессии восстанавливаются с игроками на новых номерах соединений, сроки отсчитываются заново
+    for(const SavedSession& saved : savedSessions)
+    {
+        auto sessionKey = static_cast<uintptr_t>(saved.key);
+        SessionEntry* restored = sessions_.emplaceAt(sessionKey);
+
+        // Таблица сессий нового процесса может быть меньше - игроки не поместившихся сессий отключаются
+        if(restored == nullptr){
+            for(uint8_t i = 0; i < saved.playersCount; i++){
+                auto id = connectionIds.find(saved.players[i]);
+                if(id != connectionIds.end()) this->dropConnection(id->second);
+            }
+            std::cout << "Session (" << sessionKey << ") not restored. Sessions table is full." << std::endl;
+            continue;
+        }
+
+        SessionEntry& entry = *restored;
+        admission_.adoptSession();
+        entry.matchmaking = saved.matchmaking != 0;
+
+        Session& s = entry.session;
+        for(uint8_t i = 0; i < saved.playersCount; i++){
+            auto id = connectionIds.find(saved.players[i]);
+            NativePeer player = id != connectionIds.end() ? this->peerOf(id->second) : NativePeer(backend_, 0);
+            if(id == connectionIds.end()) player.markDisconnected();
+            s.addPlayer(std::move(player));
+        }
+        s.setState(saved.state);
+
+        if(settings_.heartbeatInterval > 0){
+            entry.heartbeatTimer = this->addTimer(settings_.heartbeatInterval, ServerTimer{HEARTBEAT, sessionKey, 0});
+        }
+
+        // Ожидающий второго игрока мог не попасть в таблицу соединений
+        if(s.getStage() == Session::LOBBY){
+            if(!s.allConnected()){
+                this->closeSession(sessionKey);
+                continue;
+            }
+            if(settings_.lobbyTimeout > 0){
+                entry.lobbyTimer = this->addTimer(settings_.lobbyTimeout, ServerTimer{LOBBY_TIMEOUT, sessionKey, 0});
+            }
+            if(!entry.matchmaking){
+                lobby_.sessionOpened(sessionKey);
+            }
+            continue;
+        }
+
+        if(!s.allConnected()){
+            s.onDisconnected();
+        }
+        this->afterSessionEvent(sessionKey, entry);
+    }
+
+    for(uint64_t key : savedQueue){
+        matchQueue_.push_back(static_cast<uintptr_t>(key));
+    }
+
+    // Изменения, не разосланные прежним процессом, утеряны - подписчики получают новый снимок списка
+    for(uint32_t connection : subscribers){
+        this->subscribeLobby(connection);
+    }
+
+    // Наблюдатели получают текущее состояние игры заново (неразосланные события утеряны)
+    for(const auto& spectator : spectators){
+        if(!this->spectate(spectator.first, spectator.second, false)) this->dropConnection(spectator.first);
+    }
+
+    // Прежние записи контрольных точек (при неудачной передаче - свои же) заменяются восстановленными сессиями
+    this->rewriteCheckpoints();
+
+    std::cout << "Restored " << connectionIds.size() << " connections and " << sessions_.size() << " sessions." << std::endl;
+    return true;
+}
+
+/**
+ * Сохранять состояние идущих игр в файл контрольных точек
+ * @param path Путь файла
+ * @param recover Восстановить сессии, сохраненные прежним процессом (игроки возвращаются по токенам)
+ * @return Удалось ли открыть файл
+ */
+bool NativeServer::enableCheckpoints(const std::string& path, bool recover)
+{
+    static_assert(std::is_trivially_copyable<Session::State>::value, "Session state must be trivially copyable");
+    if(!checkpoints_.open(path, sessions_.capacity(), sizeof(Session::State)))
+        return false;
+
+    // Записи прежнего процесса читаются до того, как файл займут сессии этого
+    std::vector<std::pair<uintptr_t, Session::State>> saved;
+    if(recover){
+        checkpoints_.forEach([&saved](uint64_t sessionKey, const char* payload){
+            Session::State state;
+            memcpy(&state, payload, sizeof(state));
+            saved.emplace_back(static_cast<uintptr_t>(sessionKey), state);
+        });
+    }
+    checkpoints_.clear();
+
+    size_t recovered = 0;
+    for(const auto& record : saved){
+        if(this->recoverSession(record.first, record.second)) recovered++;
+    }
+    if(!saved.empty()){
+        std::cout << "Recovered " << recovered << " of " << saved.size() << " sessions from checkpoints." << std::endl;
+    }
+
+    this->rewriteCheckpoints();
+    checkpoints_.startSync(settings_.checkpointSyncInterval);
+    return true;
+}
+
+/**
+ * Восстановить сессию из контрольной точки (игроки отключены и могут вернуться по токенам)
+ * @param sessionKey Ключ сессии
+ * @param state Состояние сессии
+ * @return Удалось ли (игра шла, и ячейка таблицы сессий свободна)
+ */
+bool NativeServer::recoverSession(uintptr_t sessionKey, const Session::State& state)
+{
+    // Сохраняются только идущие игры (ожидающему второго игрока возвращаться некуда)
+    if(state.stage == Session::LOBBY || state.stage == Session::FINISHED)
+        return false;
+
+    // Ключ другого шарда, либо таблица сессий меньше, чем у прежнего процесса
+    SessionEntry* recovered = net::SessionKey::shardOf(sessionKey) == settings_.shardIndex % net::SessionKey::MAX_SHARDS
+            ? sessions_.emplaceAt(sessionKey) : nullptr;
+    if(recovered == nullptr){
+        std::cout << "Session (" << sessionKey << ") not recovered. Key doesn't fit sessions table." << std::endl;
+        return false;
+    }
+
+    SessionEntry& entry = *recovered;
+    admission_.adoptSession();
+
+    // Соединений прежнего процесса нет - оба игрока отключены до возвращения
+    Session& s = entry.session;
+    for(int i = 0; i < 2; i++){
+        NativePeer player(backend_, 0);
+        player.markDisconnected();
+        s.addPlayer(std::move(player));
+    }
+    s.setState(state);
+
+    if(settings_.heartbeatInterval > 0){
+        entry.heartbeatTimer = this->addTimer(settings_.heartbeatInterval, ServerTimer{HEARTBEAT, sessionKey, 0});
+    }
+
+    // Невозобновляемая сессия завершается сразу, иначе ожидает игроков в пределах срока возвращения
+    s.onDisconnected();
+    this->afterSessionEvent(sessionKey, entry);
+    return this->findSession(sessionKey) != nullptr;
+}
+
+/**
+ * Записать все живые сессии в файл контрольных точек заново (прочие записи освобождаются)
+ */
+void NativeServer::rewriteCheckpoints()
+{
+    if(!checkpoints_.isOpen())
+        return;
+
+    checkpoints_.clear();
+    sessions_.forEach([this](SessionSlab<SessionEntry>::Handle handle, SessionEntry& entry){
+        entry.checkpointMove = 0;
+        this->saveCheckpoint(net::SessionKey::make(handle, settings_.shardIndex), entry);
+    });
+}
+
+/**
+ * Записать состояние сессии в контрольную точку, если начался новый ход
+ * @param sessionKey Ключ сессии
+ * @param entry Сессия
+ */
+void NativeServer::saveCheckpoint(uintptr_t sessionKey, SessionEntry& entry)
+{
+    // Ожидающая второго игрока сессия не сохраняется, прочие события хода состояние не меняют
+    const Session& s = entry.session;
+    if(!checkpoints_.isOpen() || s.getStage() == Session::LOBBY || s.getMoves() == entry.checkpointMove)
+        return;
+
+    Session::State state = s.getState();
+    checkpoints_.write(checkpointSlot(sessionKey), sessionKey, &state);
+    entry.checkpointMove = s.getMoves();
+}
+
+/**
+ * Цикл сервера (до запроса остановки)
+ */
+void NativeServer::run()
+{
+    while(!stopRequested_)
+    {
+        // События ввода-вывода ожидаются не дольше такта колеса таймеров
+        backend_.poll(settings_.timerTick);
+
+        // Истекшие таймеры
+        expiredTimers_.clear();
+        timers_.advance(this->elapsed(), expiredTimers_);
+        for(const ServerTimer& timer : expiredTimers_){
+            this->onTimerExpired(timer);
+        }
+
+        // Изменения списка сессий рассылаются пачкой раз в период (частые изменения сливаются)
+        if(!lobbySubscribers_.empty() && this->elapsed() - lobbyPublishedAt_ >= settings_.lobbyUpdateInterval){
+            lobbyPublishedAt_ = this->elapsed();
+            this->publishLobby();
+        }
+
+        // Очереди наблюдателей передаются соединениям по мере записи (раньше игроков они не пишутся)
+        if(!backloggedSpectators_.empty()){
+            this->drainSpectators();
+        }
+
+        // Сообщения, подготовленные за итерацию, записываются пачкой
+        backend_.flush();
+
+        // Подключение нового процесса проверяется раз в такт
+        if(handoffListener_ >= 0 && this->elapsed() - handoffCheckedAt_ >= settings_.timerTick){
+            handoffCheckedAt_ = this->elapsed();
+            int channel = acceptHandoff(handoffListener_);
+            if(channel >= 0) this->handoff(channel);
+        }
+
+        // Давно не использованные корзины ограничения частоты обнуляются понемногу каждый такт
+        if(this->elapsed() - rateAgedAt_ >= settings_.timerTick){
+            int interval = static_cast<int>(this->elapsed() - rateAgedAt_);
+            rateAgedAt_ = this->elapsed();
+            connectionRate_.age(interval);
+            messageRate_.age(interval);
+        }
+
+        if(settings_.memoryReportInterval > 0 && this->elapsed() - memoryReportedAt_ >= settings_.memoryReportInterval){
+            memoryReportedAt_ = this->elapsed();
+            this->reportMemory();
+        }
+    }
+}
+
+/**
+ * Запросить остановку (допускается из обработчика сигнала)
+ */
+void NativeServer::stop()
+{
+    stopRequested_ = 1;
+}
+
+void NativeServer::onAccepted(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    c.generation++;
+    c.codec = net::MsgCodec();
+    c.sessionKey = 0;
+    c.fleet.reset();
+    c.peerKey = peerKeyOf(backend_.descriptor(connection));
+    c.messageKey = messageKeyOf(c.peerKey, connection, c.generation);
+    c.transport = UNKNOWN_TRANSPORT;
+    c.websocket.reset();
+    c.lobbyIndex = NOT_SUBSCRIBED;
+    c.spectator.reset();
+    c.channels.reset();
+    c.inbound = IoBackend::NO_CONNECTION;
+
+    // Адрес, подключающийся чаще допустимого, отключается сразу (без ответа и записи в журнал)
+    if(c.peerKey != 0 && !connectionRate_.consume(c.peerKey)){
+        c.open = false;
+        c.handshaking = false;
+        backend_.close(connection);
+        return;
+    }
+
+    // Сверх пределов нагрузки клиент сразу получает отказ со сроком повтора (соединение не учитывается)
+    AdmissionControl::Verdict verdict = admission_.admitConnection();
+    if(verdict != AdmissionControl::ADMITTED){
+        c.open = false;
+        c.handshaking = false;
+        this->rejectBusy(connection, verdict);
+        return;
+    }
+    c.open = true;
+    c.handshaking = true;
+    this->reportAdmission();
+
+    // Далее игрок, сразу же после подключения, отправляет запрос (сообщение) на присоединение к игре
+    c.handshakeTimer = this->addTimer(settings_.handshakeTimeout, ServerTimer{HANDSHAKE_TIMEOUT, connectionTarget(connection, c.generation), 0});
+    std::cout << "Client " << connection << " connected" << std::endl;
+}
+
+void NativeServer::onReceived(uint32_t connection, const char* data, size_t size)
+{
+    Connection& c = connections_[connection];
+    if(!c.open)
+        return;
+
+    // Вид соединения определяется по первым данным клиента (запрос установки WebSocket начинается с GET)
+    if(c.transport == UNKNOWN_TRANSPORT){
+        c.transport = WebSocketStream::isUpgradeRequest(data, size) ? WEBSOCKET : RAW_TCP;
+        if(c.transport == WEBSOCKET) c.websocket.reset(new WebSocketStream());
+    }
+
+    if(!c.websocket){
+        this->receiveMessages(connection, data, size);
+        return;
+    }
+
+    // Полезная нагрузка кадров - тот же поток сообщений, ответы на запрос установки и кадры управления - сразу в очередь
+    std::string* outbox = backend_.outbox(connection);
+    std::string discarded;
+    websocketPayload_.clear();
+    bool proceed = c.websocket->receive(data, size, websocketPayload_, outbox != nullptr ? *outbox : discarded);
+    this->receiveMessages(connection, websocketPayload_.data(), websocketPayload_.size());
+
+    // Клиент закрыл соединение, либо нарушил протокол
+    if(!proceed && c.open){
+        std::cout << "Client " << connection << " closed WebSocket." << std::endl;
+        backend_.close(connection);
+        this->onClosed(connection);
+    }
+}
+
+void NativeServer::onClosed(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    if(!c.open)
+        return;
+    c.open = false;
+    this->finishHandshake(c);
+    this->unsubscribeLobby(connection);
+
+    // Канал контролем приема не учитывается, каналы соединения отключаются вместе с ним
+    if(this->isChannel(connection)){
+        this->releaseChannel(connection);
+    }else{
+        admission_.connectionClosed();
+        this->closeChannels(connection);
+    }
+
+    // Отключился наблюдатель
+    if(c.spectator){
+        std::cout << "Spectator " << connection << " disconnected from session (" << c.spectator->sessionKey << ")." << std::endl;
+        this->stopSpectating(connection);
+        return;
+    }
+
+    // Отключился игрок, не успевший присоединиться к игре
+    if(c.sessionKey == 0){
+        this->cancelTimer(c.handshakeTimer);
+        std::cout << "Client " << connection << " disconnected before joining." << std::endl;
+        return;
+    }
+
+    uintptr_t sessionKey = c.sessionKey;
+    std::cout << "Client " << connection << " disconnected from session (" << sessionKey << ")." << std::endl;
+
+    SessionEntry* entry = this->findSession(sessionKey);
+    if(entry == nullptr)
+        return;
+
+    Session& s = entry->session;
+    int playerIndex = s.indexOf(connection);
+    if(playerIndex >= 0){
+        s.getPlayer(playerIndex).markDisconnected();
+    }
+
+    // Если второй игрок еще не присоединился - сессию можно завершить сразу
+    if(s.playersCount() < 2){
+        this->closeSession(sessionKey);
+        return;
+    }
+
+    s.onDisconnected();
+    this->afterSessionEvent(sessionKey, *entry);
+}
+
+/**
+ * Передать прослушивающие сокеты, соединения и сессии новому процессу
+ * @param channel Канал передачи (закрывается)
+ * @details При успехе сервер останавливается, иначе возобновляет работу с теми же соединениями
+ */
+void NativeServer::handoff(int channel)
+{
+    std::cout << "New server process connected. Handing off connections." << std::endl;
+
+    // Сокет закрывается до передачи, чтобы новый процесс застал его файл устаревшим и открыл по тому же пути
+    ::close(handoffListener_);
+    handoffListener_ = -1;
+
+    // Изъятие может доставить последние события ввода-вывода - они обрабатываются как обычно
+    backend_.flush();
+    std::vector<DetachedConnection> detached;
+    std::vector<int> fds = backend_.detach(detached);
+    size_t listeners = fds.size();
+
+    std::string state = this->saveState(listeners, detached);
+    fds.reserve(listeners + detached.size());
+    for(const DetachedConnection& connection : detached){
+        fds.push_back(connection.fd);
+    }
+
+    bool handedOff = listeners > 0 && sendHandoff(channel, state, fds) && waitHandoffAck(channel);
+    ::close(channel);
+
+    // У нового процесса свои дескрипторы тех же сокетов - закрытие здесь соединений не разрывает
+    if(handedOff){
+        for(int fd : fds){
+            ::close(fd);
+        }
+        std::cout << "Handed off " << detached.size() << " connections and " << sessions_.size() << " sessions. Stopping." << std::endl;
+        this->stop();
+        return;
+    }
+
+    std::cout << "Handoff failed. Resuming." << std::endl;
+    if(!this->restore(state, fds)){
+        for(int fd : fds){
+            if(fd >= 0) ::close(fd);
+        }
+        std::cout << "Can't resume after failed handoff. Stopping." << std::endl;
+        this->stop();
+        return;
+    }
+    if(!this->enableHandoff(handoffPath_)){
+        std::cout << "Warning: can't reopen handoff socket (" << handoffPath_ << ")." << std::endl;
+    }
+}
+
+/**
+ * Сохранить состояние соединений и сессий
+ * @param listeners Кол-во прослушивающих сокетов (передаются перед сокетами соединений)
+ * @param detached Соединения, изъятые из механизма ввода-вывода
+ * @return Состояние
+ */
+std::string NativeServer::saveState(size_t listeners, const std::vector<DetachedConnection>& detached)
+{
+    HandoffWriter writer;
+    writer.put(HANDOFF_MAGIC);
+    writer.put(HANDOFF_VERSION);
+    writer.put(static_cast<uint64_t>(listeners));
+
+    // Соединения - в порядке передачи сокетов
+    writer.put(static_cast<uint64_t>(detached.size()));
+    for(const DetachedConnection& connection : detached){
+        const Connection& c = connections_[connection.connection];
+        writer.put(connection.connection);
+        writer.put(static_cast<uint8_t>(c.open && !connection.closing));
+        writer.put(static_cast<uint64_t>(c.sessionKey));
+        net::FleetBoard fleet = c.fleet ? *c.fleet : net::FleetBoard();
+        writer.put(static_cast<uint8_t>(c.fleet != nullptr));
+        writer.put(fleet.cells()[0]);
+        writer.put(fleet.cells()[1]);
+        writer.putString(c.codec.getPending());
+        writer.putString(connection.output);
+        writer.put(static_cast<uint8_t>(c.transport));
+        writer.put(static_cast<uint8_t>(c.websocket && c.websocket->isOpen()));
+        writer.putString(c.websocket ? c.websocket->getPending() : std::string());
+        writer.put(static_cast<uint8_t>(c.lobbyIndex != NOT_SUBSCRIBED));
+        writer.put(static_cast<uint64_t>(c.spectator ? c.spectator->sessionKey : 0));
+        writer.put(static_cast<uint8_t>(c.channels != nullptr));
+        writer.put(static_cast<uint64_t>(c.inbound != IoBackend::NO_CONNECTION ? connections_[c.inbound].channel + 1ull : 0));
+    }
+
+    // Каналы - с номерами соединений-носителей (номер соединения канала - как у игрока в сессии)
+    std::vector<uint32_t> channels;
+    for(uint32_t connection = backend_.capacity(); connection < connections_.size(); connection++){
+        if(connections_[connection].open) channels.push_back(connection);
+    }
+    writer.put(static_cast<uint64_t>(channels.size()));
+    for(uint32_t connection : channels){
+        const Connection& c = connections_[connection];
+        writer.put(connection);
+        writer.put(c.carrier);
+        writer.put(c.channel);
+        writer.put(static_cast<uint64_t>(c.sessionKey));
+        net::FleetBoard fleet = c.fleet ? *c.fleet : net::FleetBoard();
+        writer.put(static_cast<uint8_t>(c.fleet != nullptr));
+        writer.put(fleet.cells()[0]);
+        writer.put(fleet.cells()[1]);
+        writer.put(static_cast<uint8_t>(c.lobbyIndex != NOT_SUBSCRIBED));
+        writer.put(static_cast<uint64_t>(c.spectator ? c.spectator->sessionKey : 0));
+    }
+
+    // Сессии - с номерами соединений игроков (отключенные игроки без номера)
+    writer.put(static_cast<uint64_t>(sessions_.size()));
+    sessions_.forEach([&](uintptr_t handle, SessionEntry& entry){
+        Session& s = entry.session;
+        writer.put(static_cast<uint64_t>(net::SessionKey::make(handle, settings_.shardIndex)));
+        writer.put(static_cast<uint8_t>(entry.matchmaking));
+        writer.put(s.getState());
+        writer.put(static_cast<uint8_t>(s.playersCount()));
+        for(size_t i = 0; i < s.playersCount(); i++){
+            NativePeer& player = s.getPlayer(static_cast<int>(i));
+            writer.put(player.isConnected() ? player.getSocket() : IoBackend::NO_CONNECTION);
+        }
+    });
+
+    writer.put(static_cast<uint64_t>(matchQueue_.size()));
+    for(uintptr_t key : matchQueue_){
+        writer.put(static_cast<uint64_t>(key));
+    }
+
+    return writer.data();
+}
+
+/**
+ * Текущее время от запуска сервера
+ * @return Время (мс)
+ */
+int64_t NativeServer::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_).count();
+}
+
+/**
+ * Вывести сведения о памяти соединений и сессий
+ */
+void NativeServer::reportMemory() const
+{
+    // Соединение без буферов, начала сообщения и расстановки кораблей хранится в компактном виде (ячейки таблиц)
+    size_t open = 0, parked = 0, buffers = 0, queued = 0, channels = 0;
+    for(uint32_t connection = 0; connection < connections_.size(); connection++){
+        const Connection& c = connections_[connection];
+        if(!c.open)
+            continue;
+
+        // У канала нет буферов механизма ввода-вывода (его данные идут через соединение-носитель)
+        if(this->isChannel(connection)){
+            buffers += (c.fleet ? sizeof(net::FleetBoard) : 0) + (c.spectator ? sizeof(Spectator) : 0);
+            channels++;
+            continue;
+        }
+
+        size_t heap = backend_.bufferFootprint(connection) + (c.fleet ? sizeof(net::FleetBoard) : 0) + (c.websocket ? c.websocket->footprint() : 0)
+                    + (c.spectator ? sizeof(Spectator) : 0);
+        buffers += heap;
+        queued += backend_.queuedBytes(connection);
+        open++;
+        if(heap == 0 && !c.codec.hasPending()) parked++;
+    }
+
+    size_t slot = backend_.slotFootprint() + sizeof(Connection);
+    size_t tables = backend_.slotFootprint() * backend_.capacity() + sizeof(Connection) * connections_.size() + sessions_.footprint();
+    std::cout << "Memory: " << open << " connections (" << parked << " parked), " << channels << " channels, " << sessions_.size() << " sessions. "
+              << "Per connection " << slot + (open > 0 ? buffers / open : 0) << " bytes (buffers " << buffers << " bytes total), "
+              << "per session " << sessions_.recordFootprint() << " bytes, tables " << tables / 1024 << " KB." << std::endl;
+    std::cout << "Outbound: " << queued << " bytes queued, " << backend_.evictedCount() << " slow consumers disconnected." << std::endl;
+    std::cout << admission_.describe() << std::endl;
+}
+
+/**
+ * Игрок на соединении (кодирует сообщения с учетом вида соединения)
+ * @param connection Номер соединения
+ * @return Игрок
+ */
+NativePeer NativeServer::peerOf(uint32_t connection)
+{
+    const Connection& c = connections_[connection];
+    if(this->isChannel(connection))
+        return NativePeer(backend_, connection, c.transport == WEBSOCKET, c.carrier, c.channel);
+    return NativePeer(backend_, connection, c.transport == WEBSOCKET);
+}
+
+/**
+ * Очередь исходящих данных соединения (для канала - очередь соединения-носителя, в которую уже записана метка канала)
+ * @param connection Номер соединения
+ * @return Указатель на очередь, либо nullptr (соединение закрыто)
+ */
+std::string* NativeServer::outboxOf(uint32_t connection)
+{
+    const Connection& c = connections_[connection];
+    std::string* outbox = backend_.outbox(c.carrier);
+    if(outbox != nullptr && this->isChannel(connection)){
+        NativePeer::writeChannel(c.channel, c.transport == WEBSOCKET, *outbox);
+    }
+    return outbox;
+}
+
+/**
+ * Является ли соединение каналом
+ * @param connection Номер соединения
+ * @return Да или нет
+ */
+bool NativeServer::isChannel(uint32_t connection) const
+{
+    return connection >= backend_.capacity();
+}
+
+/**
+ * Обработать сообщение соединения с каналами (метку или закрытие канала, либо сообщение выбранного канала)
+ * @param connection Номер соединения
+ * @param message Сообщение
+ */
+void NativeServer::onChannelMessage(uint32_t connection, net::Msg& message)
+{
+    Connection& c = connections_[connection];
+
+    // Соединение переходит на каналы целиком - первым сообщением, пока само не начало игру
+    if(!c.channels){
+        if(settings_.maxChannels == 0 || c.sessionKey != 0 || c.fleet || c.lobbyIndex != NOT_SUBSCRIBED || c.spectator){
+            std::cout << "Client " << connection << " can't multiplex games over this connection. Dropped." << std::endl;
+            this->dropConnection(connection);
+            return;
+        }
+        this->cancelTimer(c.handshakeTimer);
+        this->finishHandshake(c);
+        c.channels.reset(new std::unordered_map<uint32_t, uint32_t>());
+        c.inbound = IoBackend::NO_CONNECTION;
+        std::cout << "Client " << connection << " multiplexes games over channels." << std::endl;
+    }
+
+    // Метка выбирает канал следующих сообщений (новый номер открывает канал)
+    if(message.getType() == net::MSG_CHANNEL){
+        uint32_t channel = message.toMsgChannel().getChannel();
+        auto found = c.channels->find(channel);
+        c.inbound = found != c.channels->end() ? found->second : this->openChannel(connection, channel);
+        return;
+    }
+
+    // Клиент закрыл канал - игрок канала отключился
+    if(message.getType() == net::MSG_CHANNEL_CLOSE){
+        auto found = c.channels->find(message.toMsgChannel().getChannel());
+        if(found != c.channels->end()) this->onClosed(found->second);
+        return;
+    }
+
+    // Сообщения без выбранного канала (либо канала, закрытого сервером) пропускаются
+    if(c.inbound == IoBackend::NO_CONNECTION)
+        return;
+
+    // Метки каналов не учитываются, сообщения игр - каждое своим каналом: канал, превысивший частоту, отключается
+    // (клиенту сообщается о закрытии канала), остальные игры соединения продолжаются
+    uint32_t inbound = c.inbound;
+    const Connection& ch = connections_[inbound];
+    if(ch.messageKey != 0 && !messageRate_.consume(ch.messageKey)){
+        std::cout << "Channel " << ch.channel << " of client " << connection << " exceeded message rate. Closed." << std::endl;
+        NativePeer(backend_, connection, c.transport == WEBSOCKET).postMessage(net::MsgChannel(ch.channel, true));
+        this->onClosed(inbound);
+        return;
+    }
+    this->onMessage(inbound, message);
+}
+
+/**
+ * Открыть канал соединения (канал ожидает запроса на подключение к игре, как новое соединение)
+ * @param carrier Номер соединения-носителя
+ * @param channel Номер канала у клиента
+ * @return Номер соединения канала, либо NO_CONNECTION (слишком много каналов - клиенту отвечается "сервер занят")
+ */
+uint32_t NativeServer::openChannel(uint32_t carrier, uint32_t channel)
+{
+    Connection& c = connections_[carrier];
+    bool websocket = c.transport == WEBSOCKET;
+    if(freeChannels_.empty() || c.channels->size() >= settings_.maxChannelsPerConnection){
+        std::cout << "Client " << carrier << " can't open channel " << channel << " (too many channels)." << std::endl;
+        NativePeer(backend_, IoBackend::NO_CONNECTION, websocket, carrier, channel).postMessage(net::MsgServerBusy(settings_.busyRetryAfter));
+        NativePeer(backend_, carrier, websocket).postMessage(net::MsgChannel(channel, true));
+        return IoBackend::NO_CONNECTION;
+    }
+
+    uint32_t connection = freeChannels_.back();
+    freeChannels_.pop_back();
+    (*c.channels)[channel] = connection;
+
+    // Канал наследует адрес и вид соединения-носителя, рукопожатие носителя уже учтено
+    Connection& ch = connections_[connection];
+    ch.generation++;
+    ch.open = true;
+    ch.sessionKey = 0;
+    ch.fleet.reset();
+    ch.handshaking = false;
+    ch.peerKey = c.peerKey;
+    ch.messageKey = messageKeyOf(c.peerKey, connection, ch.generation);
+    ch.transport = c.transport;
+    ch.lobbyIndex = NOT_SUBSCRIBED;
+    ch.spectator.reset();
+    ch.carrier = carrier;
+    ch.channel = channel;
+    ch.handshakeTimer = this->addTimer(settings_.handshakeTimeout, ServerTimer{HANDSHAKE_TIMEOUT, connectionTarget(connection, ch.generation), 0});
+    return connection;
+}
+
+/**
+ * Освободить ячейку закрытого канала
+ * @param connection Номер соединения канала
+ */
+void NativeServer::releaseChannel(uint32_t connection)
+{
+    Connection& ch = connections_[connection];
+    Connection& c = connections_[ch.carrier];
+    if(c.channels) c.channels->erase(ch.channel);
+    if(c.inbound == connection) c.inbound = IoBackend::NO_CONNECTION;
+    freeChannels_.push_back(connection);
+}
+
+/**
+ * Отключить все каналы соединения (соединение-носитель закрыто)
+ * @param carrier Номер соединения-носителя
+ */
+void NativeServer::closeChannels(uint32_t carrier)
+{
+    // Отключение игрока канала может закрыть его сессию, а с ней - оставить открытыми другие каналы того же соединения,
+    // поэтому обходится изъятый список (каналы, еще не обойденные, закрываются в свою очередь)
+    std::unique_ptr<std::unordered_map<uint32_t, uint32_t>> channels(std::move(connections_[carrier].channels));
+    connections_[carrier].inbound = IoBackend::NO_CONNECTION;
+    if(!channels)
+        return;
+
+    for(const auto& channel : *channels){
+        this->onClosed(channel.second);
+    }
+}
+
+/**
+ * Разобрать поток сообщений клиента и обработать сообщения
+ * @param connection Номер соединения
+ * @param data Данные
+ * @param size Кол-во байт
+ */
+void NativeServer::receiveMessages(uint32_t connection, const char* data, size_t size)
+{
+    // Соединение может быть закрыто обработкой одного из сообщений
+    Connection& c = connections_[connection];
+    net::Msg message(net::MSG_UNDEFINED, 0);
+    while(c.open && c.codec.decode(data, size, message))
+    {
+        // Сообщения соединения с каналами относятся к выбранному каналу
+        if(c.channels || message.getType() == net::MSG_CHANNEL){
+            this->onChannelMessage(connection, message);
+            continue;
+        }
+
+        // Клиент, присылающий сообщения чаще допустимого, отключается до того, как они попадут в сессию
+        if(c.messageKey != 0 && !messageRate_.consume(c.messageKey)){
+            std::cout << "Client " << connection << " exceeded message rate. Disconnected." << std::endl;
+            backend_.close(connection);
+            this->onClosed(connection);
+            break;
+        }
+        this->onMessage(connection, message);
+    }
+}
+
+/**
+ * Передать расстановку кораблей соединения в сессию
+ * @param connection Номер соединения
+ * @param session Сессия
+ * @param playerIndex Индекс игрока
+ */
+void NativeServer::handOverFleet(uint32_t connection, Session& session, int playerIndex)
+{
+    // Без расстановки сессия остается с пустой (не валидной) - итоги ходов определяют клиенты
+    Connection& c = connections_[connection];
+    if(c.fleet){
+        session.setFleet(playerIndex, *c.fleet);
+        c.fleet.reset();
+    }
+}
+
+/**
+ * Обработать сообщение клиента
+ * @param connection Номер соединения
+ * @param message Сообщение
+ */
+void NativeServer::onMessage(uint32_t connection, net::Msg& message)
+{
+    Connection& c = connections_[connection];
+
+    // Наблюдатель ничего не присылает (сообщения игнорируются)
+    if(c.spectator)
+        return;
+
+    // Если игрок еще не присоединен к сессии - ожидается запрос на подключение к игре
+    if(c.sessionKey == 0){
+        this->advanceHandshake(connection, message);
+        return;
+    }
+
+    SessionEntry* entry = this->findSession(c.sessionKey);
+    if(entry == nullptr)
+        return;
+
+    // Пока второй игрок не присоединился, сообщения игнорируются
+    Session& s = entry->session;
+    int playerIndex = s.indexOf(connection);
+    if(s.playersCount() < 2 || playerIndex < 0)
+        return;
+
+    s.onMessage(playerIndex, message);
+    this->afterSessionEvent(c.sessionKey, *entry);
+}
+
+/**
+ * Обработать сообщение клиента, еще не присоединившегося к игре
+ * @param connection Номер соединения
+ * @param message Сообщение (расстановка кораблей, затем запрос на подключение к игре)
+ */
+void NativeServer::advanceHandshake(uint32_t connection, net::Msg& message)
+{
+    Connection& c = connections_[connection];
+
+    // Запросу может предшествовать расстановка кораблей (один раз)
+    if(message.getType() == net::MSG_FLEET_LAYOUT && !c.fleet)
+    {
+        net::MsgFleetLayout::FleetLayout layout = message.toMsgFleetLayout().getLayout();
+        c.fleet.reset(new net::FleetBoard());
+        if(!c.fleet->load(layout.cells)){
+            std::cout << "Client " << connection << " sent invalid fleet layout. Shots will be resolved by clients." << std::endl;
+        }
+        return;
+    }
+
+    // Рукопожатие завершено
+    this->cancelTimer(c.handshakeTimer);
+    this->finishHandshake(c);
+
+    // Подписка на список сессий (запрос на подключение к игре может последовать позже)
+    if(message.getType() == net::MSG_LOBBY_SUBSCRIBE){
+        this->subscribeLobby(connection);
+        return;
+    }
+    this->unsubscribeLobby(connection);
+
+    // Если это сообщение о подключении к игре
+    if(message.getType() == net::MSG_PLR_QUERY){
+        this->processPlayerQuery(connection, message);
+    }
+    // Если игрок возвращается в игру после разрыва соединения
+    else if(message.getType() == net::MSG_RESUME){
+        this->resumePlayer(connection, message);
+    }
+    // Если клиент хочет наблюдать за игрой
+    else if(message.getType() == net::MSG_SPECTATE){
+        uintptr_t sessionKey = message.toMsgSpectate().getSessionKey();
+        if(!this->spectate(connection, sessionKey, true)){
+            std::cout << "Session with key " << sessionKey << " can't be spectated." << std::endl;
+            this->peerOf(connection).postMessage(net::MsgPlayerResponse(false));
+            this->dropConnection(connection);
+        }
+    }
+    // Если вместо сообщения о подключении пришло что-то иное
+    else{
+        std::cout << "Wrong initial query provided from client " << connection << ". Ignored." << std::endl;
+        this->dropConnection(connection);
+    }
+}
+
+/**
+ * Обработать запрос на подключение к игре
+ * @param connection Номер соединения
+ * @param playerQuery Сообщение с запросом
+ */
+void NativeServer::processPlayerQuery(uint32_t connection, net::Msg& playerQuery)
+{
+    // Если игрок НЕ подключается к сессии, но создает НОВУЮ
+    if(playerQuery.toMsgPlayerQuery().newSession())
+    {
+        std::cout << "Client " << connection << " queries new session" << std::endl;
+        this->createSession(connection, false);
+    }
+    // Если игрок ищет любого соперника
+    else if(playerQuery.toMsgPlayerQuery().anySession())
+    {
+        std::cout << "Client " << connection << " queries matchmaking" << std::endl;
+        this->matchPlayer(connection);
+    }
+    // Если игрок подключается к СУЩЕСТВУЮЩЕЙ сессии
+    else
+    {
+        auto sessionKey = playerQuery.toMsgPlayerQuery().getSessionKey();
+        std::cout << "Client " << connection << " joins to existing session (" << sessionKey << ")" << std::endl;
+        this->joinByKey(connection, sessionKey);
+    }
+}
+
+/**
+ * Найти игрока, ожидающего любого соперника, и присоединиться к нему (либо ожидать самому)
+ * @param connection Номер соединения
+ */
+void NativeServer::matchPlayer(uint32_t connection)
+{
+    // Из очереди извлекаются сессии ожидающих игроков, пока не найдется актуальная
+    // (ожидавший мог отключиться, а его сессия - закрыться, не покидая очередь)
+    while(!matchQueue_.empty())
+    {
+        uintptr_t sessionKey = matchQueue_.front();
+        matchQueue_.pop_front();
+
+        SessionEntry* entry = this->findSession(sessionKey);
+        if(entry != nullptr && entry->matchmaking && entry->session.playersCount() == 1 && entry->session.allConnected()){
+            std::cout << "Client " << connection << " matched with session (" << sessionKey << ")" << std::endl;
+            this->joinSession(connection, sessionKey, *entry, true);
+            return;
+        }
+    }
+
+    // Соперника нет - игрок сам ожидает в очереди
+    this->createSession(connection, true);
+}
+
+/**
+ * Присоединиться к сессии по ключу
+ * @param connection Номер соединения
+ * @param sessionKey Ключ сессии
+ */
+void NativeServer::joinByKey(uint32_t connection, uintptr_t sessionKey)
+{
+    // Найти сессию по ключу (сессия должна ожидать второго игрока, который не отключился)
+    SessionEntry* entry = this->findSession(sessionKey);
+    if(entry != nullptr && !entry->matchmaking && entry->session.playersCount() == 1 && entry->session.allConnected())
+    {
+        this->joinSession(connection, sessionKey, *entry, false);
+    }
+    // Если не удалось найти сессию
+    else{
+        std::cout << "Session with key " << sessionKey << " not found." << std::endl;
+        this->peerOf(connection).postMessage(net::MsgPlayerResponse(false));
+        this->retainConnection(connection);
+    }
+}
+
+/**
+ * Создать сессию и добавить в нее игрока
+ * @param connection Номер соединения
+ * @param matchmaking Поставить ли сессию в очередь поиска соперника
+ */
+void NativeServer::createSession(uint32_t connection, bool matchmaking)
+{
+    // Новая сессия создается только в пределах допустимой нагрузки
+    AdmissionControl::Verdict verdict = admission_.admitSession();
+    if(verdict != AdmissionControl::ADMITTED){
+        this->rejectBusy(connection, verdict);
+        return;
+    }
+
+    // Заполненные очередь поиска соперника и таблица сессий - тоже перегрузка (повтор может быть успешным)
+    if(matchmaking && matchQueue_.size() >= settings_.matchQueueCapacity){
+        std::cout << "Session not created. Matchmaking queue is full." << std::endl;
+        admission_.sessionClosed();
+        this->rejectBusy(connection, AdmissionControl::TOO_MANY_SESSIONS);
+        return;
+    }
+
+    // Занять запись таблицы сессий
+    uintptr_t handle = sessions_.insert();
+    if(handle == 0){
+        std::cout << "Session not created. Sessions table is full." << std::endl;
+        admission_.sessionClosed();
+        this->rejectBusy(connection, AdmissionControl::TOO_MANY_SESSIONS);
+        return;
+    }
+
+    // Ключ сессии - дескриптор записи (не бывает 0 или всеми единицами), старшие разряды - номер шарда
+    uintptr_t sessionKey = net::SessionKey::make(handle, settings_.shardIndex);
+    NativePeer player = this->peerOf(connection);
+    if(!player.postMessage(net::MsgPlayerResponse(true, sessionKey))){
+        std::cout << "Session not created. Can't send response to client." << std::endl;
+        sessions_.erase(handle);
+        admission_.sessionClosed();
+        return;
+    }
+
+    // Добавить в сессию игрока
+    Connection& c = connections_[connection];
+    SessionEntry& entry = *sessions_.find(handle);
+    entry.session.addPlayer(std::move(player));
+    entry.session.setResumable(settings_.resumeGrace > 0);
+    this->handOverFleet(connection, entry.session, 0);
+    entry.matchmaking = matchmaking;
+    c.sessionKey = sessionKey;
+    if(matchmaking){
+        matchQueue_.push_back(sessionKey);
+    }else{
+        // Сессию, ожидающую второго игрока по ключу, видят подписчики списка
+        lobby_.sessionOpened(sessionKey);
+    }
+    std::cout << "New session (" << sessionKey << ") created. Key sent to client." << std::endl;
+
+    // Ожидание второго игрока ограничено по времени, соединение ожидающего периодически проверяется
+    if(settings_.lobbyTimeout > 0){
+        entry.lobbyTimer = this->addTimer(settings_.lobbyTimeout, ServerTimer{LOBBY_TIMEOUT, sessionKey, 0});
+    }
+    if(settings_.heartbeatInterval > 0){
+        entry.heartbeatTimer = this->addTimer(settings_.heartbeatInterval, ServerTimer{HEARTBEAT, sessionKey, 0});
+    }
+}
+
+/**
+ * Добавить второго игрока в сессию и начать игру
+ * @param connection Номер соединения
+ * @param sessionKey Ключ сессии
+ * @param entry Сессия
+ * @param sendKey Сообщить ли игроку ключ сессии
+ */
+void NativeServer::joinSession(uint32_t connection, uintptr_t sessionKey, SessionEntry& entry, bool sendKey)
+{
+    NativePeer player = this->peerOf(connection);
+    if(!player.postMessage(net::MsgPlayerResponse(true, sendKey ? sessionKey : 0))){
+        std::cout << "Player not added. Can't send response to client." << std::endl;
+        return;
+    }
+
+    // Добавить в сессию игрока и начать игру
+    Connection& c = connections_[connection];
+    Session& s = entry.session;
+    s.addPlayer(std::move(player));
+    this->handOverFleet(connection, s, 1);
+    c.sessionKey = sessionKey;
+    std::cout << "Player added to session. Response sent to client" << std::endl;
+
+    lobby_.sessionClosed(sessionKey);
+    this->cancelTimer(entry.lobbyTimer);
+    s.start();
+    this->afterSessionEvent(sessionKey, entry);
+}
+
+/**
+ * Вернуть отключившегося игрока в игру (отправляет снимок игры)
+ * @param connection Номер соединения
+ * @param resume Сообщение с ключом сессии и токеном возобновления
+ */
+void NativeServer::resumePlayer(uint32_t connection, net::Msg& resume)
+{
+    net::MsgResume::ResumeQuery query = resume.toMsgResume().getQuery();
+    uintptr_t sessionKey = query.sessionKey;
+    SessionEntry* entry = this->findSession(sessionKey);
+    int playerIndex = entry != nullptr ? entry->session.findResumable(query.token) : -1;
+    if(playerIndex < 0){
+        std::cout << "Client " << connection << " can't resume session (" << sessionKey << ")." << std::endl;
+        this->peerOf(connection).postMessage(net::MsgResumeState(false));
+        this->dropConnection(connection);
+        return;
+    }
+
+    // Расстановка, присланная перед возобновлением, не нужна (сессия хранит прежнюю)
+    Connection& c = connections_[connection];
+    c.fleet.reset();
+    c.sessionKey = sessionKey;
+    entry->session.resume(playerIndex, this->peerOf(connection));
+    std::cout << "Client " << connection << " resumed session (" << sessionKey << ") as player " << playerIndex << "." << std::endl;
+    this->afterSessionEvent(sessionKey, *entry);
+}
+
+/**
+ * Закрыть сессию, если игра завершена, иначе взвести срок хода и записать контрольную точку
+ * @param sessionKey Ключ сессии
+ * @param entry Сессия
+ */
+void NativeServer::afterSessionEvent(uintptr_t sessionKey, SessionEntry& entry)
+{
+    this->publishSpectators(entry);
+    if(entry.session.isFinished()){
+        this->closeSession(sessionKey);
+    }else{
+        this->armTurnTimer(sessionKey, entry);
+        this->armResumeTimer(sessionKey, entry);
+        this->saveCheckpoint(sessionKey, entry);
+    }
+}
+
+/**
+ * Найти сессию
+ * @param sessionKey Ключ сессии
+ * @return Указатель на сессию, либо nullptr (сессия закрыта, либо ключ другого шарда)
+ */
+NativeServer::SessionEntry* NativeServer::findSession(uintptr_t sessionKey)
+{
+    // Устаревший ключ (запись освобождена или занята другой сессией) отвергается по поколению записи
+    if(net::SessionKey::shardOf(sessionKey) != settings_.shardIndex % net::SessionKey::MAX_SHARDS)
+        return nullptr;
+    return sessions_.find(sessionKey);
+}
+
+/**
+ * Закрыть сессию (соединения закрываются после записи последних сообщений)
+ * @param sessionKey Ключ сессии
+ */
+void NativeServer::closeSession(uintptr_t sessionKey)
+{
+    SessionEntry* entry = this->findSession(sessionKey);
+    if(entry == nullptr)
+        return;
+
+    // Сроки сессии больше не отслеживаются, в списке ожидающих второго игрока ее больше нет
+    this->cancelTimer(entry->lobbyTimer);
+    this->cancelTimer(entry->turnTimer);
+    this->cancelTimer(entry->heartbeatTimer);
+    this->cancelTimer(entry->resumeTimer);
+    lobby_.sessionClosed(sessionKey);
+
+    // Наблюдатели получают последние события и отключаются
+    this->publishSpectators(*entry);
+    std::vector<uint32_t> spectators;
+    spectators.swap(entry->spectators);
+    for(uint32_t connection : spectators){
+        Connection& c = connections_[connection];
+        std::string* outbox = this->outboxOf(connection);
+        c.spectator->queue.drain(SIZE_MAX, [outbox](const SharedBuffer& chunk){ if(outbox != nullptr) *outbox += *chunk; });
+        c.spectator.reset();
+        this->dropConnection(connection);
+    }
+
+    // Соединения игроков больше не относятся к сессии (и ожидают следующей игры)
+    Session& s = entry->session;
+    for(size_t i = 0; i < s.playersCount(); i++){
+        NativePeer& player = s.getPlayer(static_cast<int>(i));
+        if(player.isConnected()){
+            player.markDisconnected();
+            this->retainConnection(player.getSocket());
+        }
+    }
+
+    checkpoints_.erase(checkpointSlot(sessionKey));
+    sessions_.erase(sessionKey);
+    admission_.sessionClosed();
+    std::cout << "Session (" << sessionKey << ") closed." << std::endl;
+}
+
+/**
+ * Оставить соединение открытым для следующего запроса на подключение к игре (после окончания игры или
+ * неудачного запроса; если повторное использование соединений отключено - закрыть)
+ * @param connection Номер соединения
+ */
+void NativeServer::retainConnection(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    if(!c.open)
+        return;
+
+    if(settings_.reuseTimeout <= 0){
+        this->dropConnection(connection);
+        return;
+    }
+
+    // Соединение снова ожидает запроса (как после подключения, но рукопожатием не считается - клиент уже известен)
+    this->cancelTimer(c.handshakeTimer);
+    this->finishHandshake(c);
+    c.sessionKey = 0;
+    c.fleet.reset();
+    c.handshakeTimer = this->addTimer(settings_.reuseTimeout, ServerTimer{HANDSHAKE_TIMEOUT, connectionTarget(connection, c.generation), 0});
+}
+
+/**
+ * Закрыть соединение клиента (после записи его очереди; канал закрывается сообщением клиенту)
+ * @param connection Номер соединения
+ */
+void NativeServer::dropConnection(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    if(!c.open)
+        return;
+
+    this->cancelTimer(c.handshakeTimer);
+    this->finishHandshake(c);
+    this->unsubscribeLobby(connection);
+    this->stopSpectating(connection);
+    c.open = false;
+
+    // Канал закрывается сообщением клиенту, соединение-носитель остается открытым
+    if(this->isChannel(connection)){
+        NativePeer(backend_, c.carrier, c.transport == WEBSOCKET).postMessage(net::MsgChannel(c.channel, true));
+        this->releaseChannel(connection);
+        return;
+    }
+    admission_.connectionClosed();
+    this->closeChannels(connection);
+
+    // Клиент WebSocket получает кадр закрытия после последних сообщений
+    std::string* outbox = c.websocket && c.websocket->isOpen() ? backend_.outbox(connection) : nullptr;
+    if(outbox != nullptr) WebSocketStream::writeClose(WebSocketStream::CLOSE_NORMAL, *outbox);
+    backend_.close(connection);
+}
+
+/**
+ * Подписать соединение на список сессий, ожидающих второго игрока (отправляет снимок списка)
+ * @param connection Номер соединения
+ */
+void NativeServer::subscribeLobby(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    if(c.lobbyIndex != NOT_SUBSCRIBED)
+        return;
+
+    c.lobbyIndex = static_cast<uint32_t>(lobbySubscribers_.size());
+    lobbySubscribers_.push_back(connection);
+
+    // Снимок не превышает пределов очереди, далее подписчик получает только изменения
+    std::vector<net::Msg> snapshot;
+    lobby_.snapshot(0, settings_.lobbySnapshotLimit, snapshot);
+    NativePeer subscriber = this->peerOf(connection);
+    for(const net::Msg& message : snapshot){
+        subscriber.postMessage(message);
+    }
+    std::cout << "Client " << connection << " subscribed to lobby (" << lobbySubscribers_.size() << " subscribers)." << std::endl;
+}
+
+/**
+ * Отменить подписку соединения на список сессий (если оно подписано)
+ * @param connection Номер соединения
+ */
+void NativeServer::unsubscribeLobby(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    if(c.lobbyIndex == NOT_SUBSCRIBED)
+        return;
+
+    // Место подписчика занимает последний
+    uint32_t last = lobbySubscribers_.back();
+    lobbySubscribers_[c.lobbyIndex] = last;
+    connections_[last].lobbyIndex = c.lobbyIndex;
+    lobbySubscribers_.pop_back();
+    c.lobbyIndex = NOT_SUBSCRIBED;
+
+    // Без подписчиков изменения не накапливаются
+    if(lobbySubscribers_.empty()){
+        lobby_.unwatch(0);
+    }
+}
+
+/**
+ * Разослать подписчикам изменения списка сессий, накопленные за период
+ */
+void NativeServer::publishLobby()
+{
+    std::vector<net::Msg> changes;
+    if(!lobby_.takeChanges(0, changes))
+        return;
+
+    // Изменения кодируются один раз для каждого вида соединения, подписчикам дописывается готовый буфер
+    lobbyRaw_.clear();
+    lobbyFramed_.clear();
+    for(const net::Msg& message : changes){
+        size_t offset = lobbyRaw_.size();
+        net::MsgCodec::encode(message, lobbyRaw_);
+        WebSocketStream::writeFrameHeader(lobbyRaw_.size() - offset, lobbyFramed_);
+        lobbyFramed_.append(lobbyRaw_, offset, std::string::npos);
+    }
+
+    for(uint32_t connection : lobbySubscribers_){
+        std::string* outbox = this->outboxOf(connection);
+        if(outbox != nullptr) *outbox += connections_[connection].transport == WEBSOCKET ? lobbyFramed_ : lobbyRaw_;
+    }
+}
+
+/**
+ * Начать наблюдение за игрой (отправляет ответ и текущее состояние игры)
+ * @param connection Номер соединения
+ * @param sessionKey Ключ сессии
+ * @param respond Отправить ли ответ на запрос (при восстановлении после передачи - нет)
+ * @return Удалось ли (сессия существует, и у нее не слишком много наблюдателей)
+ */
+bool NativeServer::spectate(uint32_t connection, uintptr_t sessionKey, bool respond)
+{
+    SessionEntry* entry = this->findSession(sessionKey);
+    if(entry == nullptr || entry->spectators.size() >= settings_.maxSpectators)
+        return false;
+
+    Connection& c = connections_[connection];
+    c.spectator.reset(new Spectator{sessionKey, entry->spectators.size(), SpectatorQueue<SharedBuffer>(), false});
+    entry->spectators.push_back(connection);
+
+    // Сессия накапливает события, пока у нее есть наблюдатели
+    Session& s = entry->session;
+    s.setSpectated(true);
+
+    // Текущее состояние игры отправляется только новому наблюдателю, далее - общие события
+    NativePeer spectator = this->peerOf(connection);
+    if(respond) spectator.postMessage(net::MsgPlayerResponse(true, sessionKey));
+    spectatorEvents_.clear();
+    s.spectatorSnapshot(spectatorEvents_);
+    for(const net::MsgSpectatorEvent::SpectatorEvent& event : spectatorEvents_){
+        spectator.postMessage(net::MsgSpectatorEvent(event));
+    }
+
+    std::cout << "Client " << connection << " spectates session (" << sessionKey << "), " << entry->spectators.size() << " spectators." << std::endl;
+    return true;
+}
+
+/**
+ * Прекратить наблюдение соединения за игрой (если оно наблюдает)
+ * @param connection Номер соединения
+ */
+void NativeServer::stopSpectating(uint32_t connection)
+{
+    Connection& c = connections_[connection];
+    if(!c.spectator)
+        return;
+
+    // Место наблюдателя занимает последний
+    SessionEntry* entry = this->findSession(c.spectator->sessionKey);
+    if(entry != nullptr && c.spectator->index < entry->spectators.size()){
+        uint32_t last = entry->spectators.back();
+        entry->spectators[c.spectator->index] = last;
+        connections_[last].spectator->index = c.spectator->index;
+        entry->spectators.pop_back();
+        if(entry->spectators.empty()) entry->session.setSpectated(false);
+    }
+    c.spectator.reset();
+}
+
+/**
+ * Разослать наблюдателям сессии накопленные события (кодируются один раз для всех наблюдателей)
+ * @param entry Сессия
+ */
+void NativeServer::publishSpectators(SessionEntry& entry)
+{
+    spectatorEvents_.clear();
+    if(entry.spectators.empty() || !entry.session.takeSpectatorEvents(spectatorEvents_))
+        return;
+
+    // Кадры WebSocket кодируются, только если среди наблюдателей есть такие соединения
+    auto raw = std::make_shared<std::string>();
+    std::shared_ptr<std::string> framed;
+    for(const net::MsgSpectatorEvent::SpectatorEvent& event : spectatorEvents_){
+        net::MsgCodec::encode(net::MsgSpectatorEvent(event), *raw);
+    }
+
+    // Отстающий наблюдатель отключается после рассылки (отключение меняет список наблюдателей)
+    std::vector<uint32_t> lagging;
+    for(uint32_t connection : entry.spectators)
+    {
+        Connection& c = connections_[connection];
+        if(c.transport == WEBSOCKET && !framed){
+            framed = std::make_shared<std::string>();
+            size_t messageSize = sizeof(uint8_t) + net::MsgCodec::payloadSizeOf(net::MSG_SPECTATOR_EVENT);
+            for(size_t offset = 0; offset < raw->size(); offset += messageSize){
+                WebSocketStream::writeFrameHeader(messageSize, *framed);
+                framed->append(*raw, offset, messageSize);
+            }
+        }
+
+        const std::shared_ptr<std::string>& chunk = c.transport == WEBSOCKET ? framed : raw;
+        if(!c.spectator->queue.push(chunk, chunk->size(), settings_.spectatorQueueLimit)){
+            lagging.push_back(connection);
+        }else if(!c.spectator->backlogged){
+            c.spectator->backlogged = true;
+            backloggedSpectators_.push_back(connection);
+        }
+    }
+
+    for(uint32_t connection : lagging){
+        std::cout << "Spectator " << connection << " can't keep up with session. Disconnected." << std::endl;
+        this->dropConnection(connection);
+    }
+}
+
+/**
+ * Передать очереди наблюдателей соединениям, пока очереди соединений невелики
+ */
+void NativeServer::drainSpectators()
+{
+    // Соединение могло закрыться, а его ячейку - занять новое (запись без наблюдателя в очереди пропускается)
+    size_t kept = 0;
+    for(uint32_t connection : backloggedSpectators_)
+    {
+        Connection& c = connections_[connection];
+        if(!c.spectator || !c.spectator->backlogged)
+            continue;
+
+        size_t queued = backend_.queuedBytes(c.carrier);
+        size_t highWater = settings_.outboxHighWater > 0 ? settings_.outboxHighWater : SIZE_MAX;
+        std::string* outbox = queued < highWater ? this->outboxOf(connection) : nullptr;
+        if(outbox != nullptr){
+            c.spectator->queue.drain(highWater - queued, [outbox](const SharedBuffer& chunk){ *outbox += *chunk; });
+        }
+
+        if(c.spectator->queue.empty()) c.spectator->backlogged = false;
+        else backloggedSpectators_[kept++] = connection;
+    }
+    backloggedSpectators_.resize(kept);
+}
+
+/**
+ * Учесть завершение рукопожатия соединения (если оно еще не учтено)
+ * @param c Соединение
+ */
+void NativeServer::finishHandshake(Connection& c)
+{
+    if(c.handshaking){
+        c.handshaking = false;
+        admission_.handshakeFinished();
+    }
+}
+
+/**
+ * Отказать клиенту: сервер перегружен (отправляет срок повтора и закрывает соединение)
+ * @param connection Номер соединения
+ * @param verdict Решение контроля приема
+ */
+void NativeServer::rejectBusy(uint32_t connection, AdmissionControl::Verdict verdict)
+{
+    static const char* reasons[] = {"", "too many connections", "too many handshakes", "too many sessions"};
+    std::cout << "Client " << connection << " rejected (" << reasons[verdict] << ")." << std::endl;
+
+    // Соединение, не принятое контролем приема, закрывается без учета
+    this->peerOf(connection).postMessage(net::MsgServerBusy(settings_.busyRetryAfter));
+    if(connections_[connection].open) this->dropConnection(connection);
+    else backend_.close(connection);
+    this->reportAdmission();
+}
+
+/**
+ * Вывести состояние контроля приема, если оно сменилось (прием, либо отказы)
+ */
+void NativeServer::reportAdmission()
+{
+    if(admission_.takeStateChange()){
+        std::cout << admission_.describe() << std::endl;
+    }
+}
+
+/**
+ * Добавить таймер
+ * @param delay Задержка (мс)
+ * @param timer Таймер
+ * @return Идентификатор
+ */
+NativeServer::Timers::TimerId NativeServer::addTimer(int delay, const ServerTimer& timer)
+{
+    // Колесо продвигается каждую итерацию цикла, поэтому отстает от текущего времени не более чем на такт
+    return timers_.schedule(delay, timer);
+}
+
+/**
+ * Отменить таймер
+ * @param id Идентификатор (обнуляется)
+ */
+void NativeServer::cancelTimer(Timers::TimerId& id)
+{
+    timers_.cancel(id);
+    id = 0;
+}
+
+/**
+ * Взвести срок хода, если начался новый ход
+ * @param sessionKey Ключ сессии
+ * @param entry Сессия
+ */
+void NativeServer::armTurnTimer(uintptr_t sessionKey, SessionEntry& entry)
+{
+    uint64_t move = entry.session.getMoves();
+    if(settings_.turnTimeout <= 0 || entry.session.isFinished() || entry.turnTimerMove == move)
+        return;
+
+    this->cancelTimer(entry.turnTimer);
+    entry.turnTimer = this->addTimer(settings_.turnTimeout, ServerTimer{TURN_TIMEOUT, sessionKey, move});
+    entry.turnTimerMove = move;
+}
+
+/**
+ * Взвести срок возвращения, если в сессии есть отключившиеся игроки (иначе снять)
+ * @param sessionKey Ключ сессии
+ * @param entry Сессия
+ */
+void NativeServer::armResumeTimer(uintptr_t sessionKey, SessionEntry& entry)
+{
+    Session& s = entry.session;
+    if(s.allConnected()){
+        this->cancelTimer(entry.resumeTimer);
+    }else if(entry.resumeTimer == 0){
+        entry.resumeTimer = this->addTimer(settings_.resumeGrace, ServerTimer{RESUME_TIMEOUT, sessionKey, 0});
+        std::cout << "Session (" << sessionKey << ") suspended until disconnected players return." << std::endl;
+    }
+}
+
+/**
+ * Обработать истекший таймер
+ * @param timer Таймер
+ */
+void NativeServer::onTimerExpired(const ServerTimer& timer)
+{
+    // Рукопожатие не завершилось вовремя (завершенные рукопожатия снимают свой таймер)
+    if(timer.type == HANDSHAKE_TIMEOUT)
+    {
+        auto connection = static_cast<uint32_t>(timer.target & 0xFFFFFFFFu);
+        Connection& c = connections_[connection];
+        if(!c.open || c.sessionKey != 0 || c.generation != static_cast<uint32_t>(timer.target >> 32))
+            return;
+
+        // Соединение, оставленное после игры, рукопожатием не считается
+        if(c.handshaking){
+            std::cout << "Client " << connection << " didn't send initial query in time ("
+                      << (c.codec.hasPending() || c.fleet ? "incomplete query" : "no data") << "). Dropped." << std::endl;
+        }else if(this->isChannel(connection)){
+            std::cout << "Channel " << c.channel << " of client " << c.carrier << " didn't query a game in time. Closed." << std::endl;
+        }else{
+            std::cout << "Client " << connection << " didn't query next game in time. Dropped." << std::endl;
+        }
+        c.handshakeTimer = 0;
+        this->dropConnection(connection);
+        return;
+    }
+
+    // Таймеры сессий снимаются при их закрытии
+    auto sessionKey = static_cast<uintptr_t>(timer.target);
+    SessionEntry* entry = this->findSession(sessionKey);
+    if(entry == nullptr)
+        return;
+
+    Session& s = entry->session;
+    switch(timer.type)
+    {
+        // Второй игрок так и не присоединился - сессия закрывается
+        case LOBBY_TIMEOUT:
+            entry->lobbyTimer = 0;
+            if(s.getStage() == Session::LOBBY){
+                std::cout << "Session (" << timer.target << ") expired waiting for second player." << std::endl;
+                s.sendToConnected(net::MsgGameStatus(net::GAME_OVER_DISCONNECTED));
+                this->closeSession(sessionKey);
+            }
+            break;
+
+        // Игрок не сделал ход вовремя (сессия сама проверяет, не сделан ли уже следующий ход)
+        case TURN_TIMEOUT:
+            entry->turnTimer = 0;
+            s.onTurnTimeout(timer.move);
+            this->afterSessionEvent(sessionKey, *entry);
+            break;
+
+        // Проверка соединений
+        case HEARTBEAT:
+            entry->heartbeatTimer = this->addTimer(settings_.heartbeatInterval, ServerTimer{HEARTBEAT, timer.target, 0});
+            s.heartbeat();
+            break;
+
+        // Отключившиеся игроки не вернулись вовремя - игра завершается как при отключении
+        case RESUME_TIMEOUT:
+            entry->resumeTimer = 0;
+            s.onResumeExpired();
+            this->afterSessionEvent(sessionKey, *entry);
+            break;
+
+        default:
+            break;
+    }
+}
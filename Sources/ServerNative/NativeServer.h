@@ -0,0 +1,571 @@
+#pragma once
+
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <csignal>
+
+#include "../NetworkApi/BasicGameSession.hpp"
+#include "../NetworkApi/MsgCodec.hpp"
+#include "../NetworkApi/FleetBoard.hpp"
+#include "../Server/ServerSettings.hpp"
+#include "../Server/TimerWheel.hpp"
+#include "../Server/AdmissionControl.hpp"
+#include "../Server/RateLimiter.hpp"
+#include "../Server/LobbyFeed.hpp"
+#include "../Server/SpectatorQueue.hpp"
+#include "SessionSlab.hpp"
+#include "IoBackend.hpp"
+#include "NativePeer.hpp"
+#include "WebSocketStream.h"
+#include "Checkpoint.h"
+
+/**
+ * Игровой сервер на системных сокетах (без Qt)
+ * Реализует тот же протокол, что и GameServer, в одном потоке: события ввода-вывода, таймеры и игровые сессии
+ * обрабатываются циклом run, исходящие данные всех соединений записываются механизмом ввода-вывода пачкой.
+ * На том же порту принимаются клиенты WebSocket (браузер): вид соединения определяется по первым данным клиента.
+ * Клиенты на той же машине (боты, маршрутизатор) могут подключаться через локальный сокет, минуя стек TCP - такие
+ * соединения обрабатываются так же, как соединения TCP, но частота их подключений и сообщений не ограничивается.
+ * За игрой могут следить наблюдатели: события сессии кодируются один раз и разделяются их очередями.
+ * Состояние идущих игр может сохраняться в файл контрольных точек на каждой смене хода: после аварийного
+ * завершения сервер восстанавливает из него сессии, ожидающие возвращения игроков по токенам.
+ * Клиент может вести много игр на одном соединении (см. MsgChannel): каждый канал занимает собственную ячейку таблицы
+ * соединений сверх ячеек механизма ввода-вывода и обрабатывается как отдельное соединение, данные же всех каналов
+ * идут через очередь соединения-носителя
+ */
+class NativeServer final : public IoHandler
+{
+private:
+    /// Игровая сессия
+    typedef net::BasicGameSession<NativePeer> Session;
+
+    /// Вид таймера сервера
+    enum TimerType {
+        // Срок рукопожатия подключившегося клиента
+        HANDSHAKE_TIMEOUT,
+        // Срок ожидания второго игрока
+        LOBBY_TIMEOUT,
+        // Срок хода
+        TURN_TIMEOUT,
+        // Период проверки соединений игроков сессии
+        HEARTBEAT,
+        // Срок возвращения отключившихся игроков
+        RESUME_TIMEOUT
+    };
+
+    /// Таймер сервера
+    struct ServerTimer
+    {
+        // Вид
+        TimerType type;
+        // Соединение (поколение и номер) или ключ сессии
+        uint64_t target;
+        // Номер хода (для срока хода)
+        uint64_t move;
+    };
+
+    /// Колесо таймеров сервера
+    typedef TimerWheel<ServerTimer> Timers;
+
+    /// Закодированные события сессии (разделяются очередями наблюдателей)
+    typedef std::shared_ptr<const std::string> SharedBuffer;
+
+    /// Наблюдатель игры
+    struct Spectator
+    {
+        // Ключ сессии
+        uintptr_t sessionKey;
+        // Позиция среди наблюдателей сессии
+        size_t index;
+        // События, еще не переданные в очередь соединения
+        SpectatorQueue<SharedBuffer> queue;
+        // Соединение в списке наблюдателей с непустой очередью
+        bool backlogged;
+    };
+
+    /// Вид соединения
+    enum Transport : uint8_t {
+        // Данные еще не получены
+        UNKNOWN_TRANSPORT,
+        // Поток сообщений протокола по TCP
+        RAW_TCP,
+        // Поток сообщений протокола в двоичных кадрах WebSocket
+        WEBSOCKET
+    };
+
+    /// Состояние соединения (таблица размещается целиком, поэтому в ней только то, что нужно каждому соединению)
+    struct Connection
+    {
+        // Поколение (меняется при каждом новом подключении в этой ячейке)
+        uint32_t generation;
+        // Открыто ли соединение
+        bool open;
+        // Разбор входящего потока на сообщения
+        net::MsgCodec codec;
+        // Ключ сессии игрока (0 - запрос на подключение к игре еще не получен)
+        uintptr_t sessionKey;
+        // Расстановка кораблей (nullptr - не получена, либо уже передана в сессию)
+        std::unique_ptr<net::FleetBoard> fleet;
+        // Срок рукопожатия
+        Timers::TimerId handshakeTimer;
+        // Рукопожатие еще не завершено (учитывается контролем приема)
+        bool handshaking;
+        // Ключ адреса клиента (частота подключений) и ключ частоты сообщений (свой у каждого соединения и канала;
+        // 0 - без ограничения)
+        uint64_t peerKey;
+        uint64_t messageKey;
+        // Вид соединения
+        Transport transport;
+        // Состояние WebSocket (nullptr - соединение TCP)
+        std::unique_ptr<WebSocketStream> websocket;
+        // Позиция среди подписчиков списка сессий (NOT_SUBSCRIBED - не подписан)
+        uint32_t lobbyIndex;
+        // Наблюдатель игры (nullptr - соединение не наблюдает за игрой)
+        std::unique_ptr<Spectator> spectator;
+        // Соединение-носитель (для соединения механизма ввода-вывода - оно само) и номер канала у клиента
+        uint32_t carrier;
+        uint32_t channel;
+        // Каналы соединения-носителя: номер канала у клиента -> ячейка канала (nullptr - соединение без каналов)
+        std::unique_ptr<std::unordered_map<uint32_t, uint32_t>> channels;
+        // Ячейка канала, к которому относятся следующие сообщения клиента (NO_CONNECTION - канал не выбран)
+        uint32_t inbound;
+    };
+
+    /// Позиция соединения, не подписанного на список сессий
+    static constexpr uint32_t NOT_SUBSCRIBED = 0xFFFFFFFFu;
+
+    /// Сессия и ее сроки
+    struct SessionEntry
+    {
+        // Сессия
+        Session session;
+        // Создана для поиска любого соперника
+        bool matchmaking = false;
+        // Сроки ожидания второго игрока, хода, проверки соединений и возвращения отключившихся игроков
+        Timers::TimerId lobbyTimer = 0;
+        Timers::TimerId turnTimer = 0;
+        Timers::TimerId heartbeatTimer = 0;
+        Timers::TimerId resumeTimer = 0;
+        // Ход, на который взведен срок хода
+        uint64_t turnTimerMove = 0;
+        // Ход, состояние на котором записано в контрольную точку
+        uint64_t checkpointMove = 0;
+        // Соединения наблюдателей
+        std::vector<uint32_t> spectators;
+    };
+
+    /// Настройки
+    ServerSettings settings_;
+    /// Механизм ввода-вывода
+    IoBackend& backend_;
+    /// Состояния соединений (по номерам соединений, за ними - ячейки каналов)
+    std::vector<Connection> connections_;
+    /// Свободные ячейки каналов
+    std::vector<uint32_t> freeChannels_;
+    /// Игровые сессии (ключ сессии - дескриптор записи с номером шарда в старших разрядах)
+    SessionSlab<SessionEntry> sessions_;
+    /// Сессии игроков, ожидающих любого соперника (закрытые сессии пропускаются при извлечении)
+    std::deque<uintptr_t> matchQueue_;
+    /// Контроль приема нагрузки
+    AdmissionControl admission_;
+    /// Ограничение частоты подключений по адресу клиента и сообщений по соединению
+    RateLimiter connectionRate_;
+    RateLimiter messageRate_;
+    /// Время запуска (отсчет времени колеса таймеров)
+    std::chrono::steady_clock::time_point started_;
+    /// Колесо таймеров и истекшие за такт таймеры
+    Timers timers_;
+    std::vector<ServerTimer> expiredTimers_;
+    /// Запрошена остановка (выставляется обработчиком сигнала)
+    volatile std::sig_atomic_t stopRequested_;
+    /// Локальный сокет для передачи работы новому процессу (-1 - передача не включена)
+    int handoffListener_;
+    /// Путь сокета передачи работы
+    std::string handoffPath_;
+    /// Время последней проверки подключения нового процесса (мс)
+    int64_t handoffCheckedAt_;
+    /// Время последнего вывода сведений о памяти (мс)
+    int64_t memoryReportedAt_;
+    /// Время последнего обнуления простаивающих корзин ограничения частоты (мс)
+    int64_t rateAgedAt_;
+    /// Полезная нагрузка кадров WebSocket, полученных за вызов onReceived (буфер переиспользуется)
+    std::string websocketPayload_;
+    /// Список сессий, ожидающих второго игрока, и соединения его подписчиков
+    LobbyFeed lobby_;
+    std::vector<uint32_t> lobbySubscribers_;
+    /// Время последней рассылки изменений списка сессий (мс)
+    int64_t lobbyPublishedAt_;
+    /// Изменения списка, закодированные для соединений TCP и WebSocket (буферы переиспользуются)
+    std::string lobbyRaw_;
+    std::string lobbyFramed_;
+    /// Наблюдатели, очереди которых еще не переданы соединениям целиком
+    std::vector<uint32_t> backloggedSpectators_;
+    /// События сессии, извлекаемые для наблюдателей (буфер переиспользуется)
+    std::vector<net::MsgSpectatorEvent::SpectatorEvent> spectatorEvents_;
+    /// Контрольные точки идущих игр (запись на сессию, по номеру ее ячейки в таблице сессий)
+    CheckpointFile checkpoints_;
+
+public:
+    /**
+     * Конструктор
+     * @param settings Настройки
+     * @param backend Механизм ввода-вывода
+     */
+    NativeServer(const ServerSettings& settings, IoBackend& backend);
+
+    /**
+     * Деструктор
+     */
+    ~NativeServer() override;
+
+    /**
+     * Открыть порт
+     * @param port Порт
+     * @return Удалось ли
+     */
+    bool listen(uint16_t port);
+
+    /**
+     * Открыть локальный (Unix-domain) сокет для клиентов на той же машине (вместе с портом)
+     * @param path Путь сокета
+     * @return Удалось ли
+     */
+    bool listenLocal(const std::string& path);
+
+    /**
+     * Ожидать подключения нового процесса, которому работа будет передана без разрыва соединений
+     * @param path Путь локального сокета
+     * @return Удалось ли открыть сокет
+     */
+    bool enableHandoff(const std::string& path);
+
+    /**
+     * Восстановить работу из состояния, переданного прежним процессом
+     * @param state Состояние (см. handoff)
+     * @param fds Прослушивающие сокеты, затем сокеты соединений (при успехе ими владеет сервер)
+     * @return Удалось ли (при неудаче сокеты соединений не тронуты - можно попробовать с другим механизмом)
+     */
+    bool restore(const std::string& state, const std::vector<int>& fds);
+
+    /**
+     * Сохранять состояние идущих игр в файл контрольных точек
+     * @param path Путь файла
+     * @param recover Восстановить сессии, сохраненные прежним процессом (игроки возвращаются по токенам)
+     * @return Удалось ли открыть файл
+     */
+    bool enableCheckpoints(const std::string& path, bool recover);
+
+    /**
+     * Цикл сервера (до запроса остановки)
+     */
+    void run();
+
+    /**
+     * Запросить остановку (допускается из обработчика сигнала)
+     */
+    void stop();
+
+    void onAccepted(uint32_t connection) override;
+    void onReceived(uint32_t connection, const char* data, size_t size) override;
+    void onClosed(uint32_t connection) override;
+
+private:
+    /**
+     * Передать прослушивающий сокет, соединения и сессии новому процессу
+     * @param channel Канал передачи (закрывается)
+     * @details При успехе сервер останавливается, иначе возобновляет работу с теми же соединениями
+     */
+    void handoff(int channel);
+
+    /**
+     * Сохранить состояние соединений и сессий
+     * @param listeners Кол-во прослушивающих сокетов (передаются перед сокетами соединений)
+     * @param detached Соединения, изъятые из механизма ввода-вывода
+     * @return Состояние
+     */
+    std::string saveState(size_t listeners, const std::vector<DetachedConnection>& detached);
+
+    /**
+     * Восстановить сессию из контрольной точки (игроки отключены и могут вернуться по токенам)
+     * @param sessionKey Ключ сессии
+     * @param state Состояние сессии
+     * @return Удалось ли (игра шла, и ячейка таблицы сессий свободна)
+     */
+    bool recoverSession(uintptr_t sessionKey, const Session::State& state);
+
+    /**
+     * Записать все живые сессии в файл контрольных точек заново (прочие записи освобождаются)
+     */
+    void rewriteCheckpoints();
+
+    /**
+     * Записать состояние сессии в контрольную точку, если начался новый ход
+     * @param sessionKey Ключ сессии
+     * @param entry Сессия
+     */
+    void saveCheckpoint(uintptr_t sessionKey, SessionEntry& entry);
+
+    /**
+     * Текущее время от запуска сервера
+     * @return Время (мс)
+     */
+    int64_t elapsed() const;
+
+    /**
+     * Вывести сведения о памяти соединений и сессий
+     */
+    void reportMemory() const;
+
+    /**
+     * Игрок на соединении (кодирует сообщения с учетом вида соединения)
+     * @param connection Номер соединения
+     * @return Игрок
+     */
+    NativePeer peerOf(uint32_t connection);
+
+    /**
+     * Очередь исходящих данных соединения (для канала - очередь соединения-носителя, в которую уже записана метка канала)
+     * @param connection Номер соединения
+     * @return Указатель на очередь, либо nullptr (соединение закрыто)
+     */
+    std::string* outboxOf(uint32_t connection);
+
+    /**
+     * Является ли соединение каналом
+     * @param connection Номер соединения
+     * @return Да или нет
+     */
+    bool isChannel(uint32_t connection) const;
+
+    /**
+     * Обработать сообщение соединения с каналами (метку или закрытие канала, либо сообщение выбранного канала)
+     * @param connection Номер соединения
+     * @param message Сообщение
+     */
+    void onChannelMessage(uint32_t connection, net::Msg& message);
+
+    /**
+     * Открыть канал соединения (канал ожидает запроса на подключение к игре, как новое соединение)
+     * @param carrier Номер соединения-носителя
+     * @param channel Номер канала у клиента
+     * @return Номер соединения канала, либо NO_CONNECTION (слишком много каналов - клиенту отвечается "сервер занят")
+     */
+    uint32_t openChannel(uint32_t carrier, uint32_t channel);
+
+    /**
+     * Освободить ячейку закрытого канала
+     * @param connection Номер соединения канала
+     */
+    void releaseChannel(uint32_t connection);
+
+    /**
+     * Отключить все каналы соединения (соединение-носитель закрыто)
+     * @param carrier Номер соединения-носителя
+     */
+    void closeChannels(uint32_t carrier);
+
+    /**
+     * Разобрать поток сообщений клиента и обработать сообщения
+     * @param connection Номер соединения
+     * @param data Данные
+     * @param size Кол-во байт
+     */
+    void receiveMessages(uint32_t connection, const char* data, size_t size);
+
+    /**
+     * Передать расстановку кораблей соединения в сессию
+     * @param connection Номер соединения
+     * @param session Сессия
+     * @param playerIndex Индекс игрока
+     */
+    void handOverFleet(uint32_t connection, Session& session, int playerIndex);
+
+    /**
+     * Обработать сообщение клиента
+     * @param connection Номер соединения
+     * @param message Сообщение
+     */
+    void onMessage(uint32_t connection, net::Msg& message);
+
+    /**
+     * Обработать сообщение клиента, еще не присоединившегося к игре
+     * @param connection Номер соединения
+     * @param message Сообщение (расстановка кораблей, затем запрос на подключение к игре)
+     */
+    void advanceHandshake(uint32_t connection, net::Msg& message);
+
+    /**
+     * Обработать запрос на подключение к игре
+     * @param connection Номер соединения
+     * @param playerQuery Сообщение с запросом
+     */
+    void processPlayerQuery(uint32_t connection, net::Msg& playerQuery);
+
+    /**
+     * Найти игрока, ожидающего любого соперника, и присоединиться к нему (либо ожидать самому)
+     * @param connection Номер соединения
+     */
+    void matchPlayer(uint32_t connection);
+
+    /**
+     * Присоединиться к сессии по ключу
+     * @param connection Номер соединения
+     * @param sessionKey Ключ сессии
+     */
+    void joinByKey(uint32_t connection, uintptr_t sessionKey);
+
+    /**
+     * Создать сессию и добавить в нее игрока
+     * @param connection Номер соединения
+     * @param matchmaking Поставить ли сессию в очередь поиска соперника
+     */
+    void createSession(uint32_t connection, bool matchmaking);
+
+    /**
+     * Добавить второго игрока в сессию и начать игру
+     * @param connection Номер соединения
+     * @param sessionKey Ключ сессии
+     * @param entry Сессия
+     * @param sendKey Сообщить ли игроку ключ сессии
+     */
+    void joinSession(uint32_t connection, uintptr_t sessionKey, SessionEntry& entry, bool sendKey);
+
+    /**
+     * Вернуть отключившегося игрока в игру (отправляет снимок игры)
+     * @param connection Номер соединения
+     * @param resume Сообщение с ключом сессии и токеном возобновления
+     */
+    void resumePlayer(uint32_t connection, net::Msg& resume);
+
+    /**
+     * Закрыть сессию, если игра завершена, иначе взвести срок хода и записать контрольную точку
+     * @param sessionKey Ключ сессии
+     * @param entry Сессия
+     */
+    void afterSessionEvent(uintptr_t sessionKey, SessionEntry& entry);
+
+    /**
+     * Найти сессию
+     * @param sessionKey Ключ сессии
+     * @return Указатель на сессию, либо nullptr (сессия закрыта, либо ключ другого шарда)
+     */
+    SessionEntry* findSession(uintptr_t sessionKey);
+
+    /**
+     * Закрыть сессию (соединения закрываются после записи последних сообщений)
+     * @param sessionKey Ключ сессии
+     */
+    void closeSession(uintptr_t sessionKey);
+
+    /**
+     * Оставить соединение открытым для следующего запроса на подключение к игре (после окончания игры или
+     * неудачного запроса; если повторное использование соединений отключено - закрыть)
+     * @param connection Номер соединения
+     */
+    void retainConnection(uint32_t connection);
+
+    /**
+     * Закрыть соединение клиента (после записи его очереди; канал закрывается сообщением клиенту)
+     * @param connection Номер соединения
+     */
+    void dropConnection(uint32_t connection);
+
+    /**
+     * Подписать соединение на список сессий, ожидающих второго игрока (отправляет снимок списка)
+     * @param connection Номер соединения
+     */
+    void subscribeLobby(uint32_t connection);
+
+    /**
+     * Отменить подписку соединения на список сессий (если оно подписано)
+     * @param connection Номер соединения
+     */
+    void unsubscribeLobby(uint32_t connection);
+
+    /**
+     * Разослать подписчикам изменения списка сессий, накопленные за период
+     */
+    void publishLobby();
+
+    /**
+     * Начать наблюдение за игрой (отправляет ответ и текущее состояние игры)
+     * @param connection Номер соединения
+     * @param sessionKey Ключ сессии
+     * @param respond Отправить ли ответ на запрос (при восстановлении после передачи - нет)
+     * @return Удалось ли (сессия существует, и у нее не слишком много наблюдателей)
+     */
+    bool spectate(uint32_t connection, uintptr_t sessionKey, bool respond);
+
+    /**
+     * Прекратить наблюдение соединения за игрой (если оно наблюдает)
+     * @param connection Номер соединения
+     */
+    void stopSpectating(uint32_t connection);
+
+    /**
+     * Разослать наблюдателям сессии накопленные события (кодируются один раз для всех наблюдателей)
+     * @param entry Сессия
+     */
+    void publishSpectators(SessionEntry& entry);
+
+    /**
+     * Передать очереди наблюдателей соединениям, пока очереди соединений невелики
+     */
+    void drainSpectators();
+
+    /**
+     * Учесть завершение рукопожатия соединения (если оно еще не учтено)
+     * @param c Соединение
+     */
+    void finishHandshake(Connection& c);
+
+    /**
+     * Отказать клиенту: сервер перегружен (отправляет срок повтора и закрывает соединение)
+     * @param connection Номер соединения
+     * @param verdict Решение контроля приема
+     */
+    void rejectBusy(uint32_t connection, AdmissionControl::Verdict verdict);
+
+    /**
+     * Вывести состояние контроля приема, если оно сменилось (прием, либо отказы)
+     */
+    void reportAdmission();
+
+    /**
+     * Добавить таймер
+     * @param delay Задержка (мс)
+     * @param timer Таймер
+     * @return Идентификатор
+     */
+    Timers::TimerId addTimer(int delay, const ServerTimer& timer);
+
+    /**
+     * Отменить таймер
+     * @param id Идентификатор (обнуляется)
+     */
+    void cancelTimer(Timers::TimerId& id);
+
+    /**
+     * Взвести срок хода, если начался новый ход
+     * @param sessionKey Ключ сессии
+     * @param entry Сессия
+     */
+    void armTurnTimer(uintptr_t sessionKey, SessionEntry& entry);
+
+    /**
+     * Взвести срок возвращения, если в сессии есть отключившиеся игроки (иначе снять)
+     * @param sessionKey Ключ сессии
+     * @param entry Сессия
+     */
+    void armResumeTimer(uintptr_t sessionKey, SessionEntry& entry);
+
+    /**
+     * Обработать истекший таймер
+     * @param timer Таймер
+     */
+    void onTimerExpired(const ServerTimer& timer);
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "../NetworkApi/SessionKey.hpp"
+
+/**
+ * Таблица записей фиксированного размера с поколенческими дескрипторами (для сессий)
+ * Все записи размещаются одним массивом при создании, поэтому обход (сроки, статистика) - линейный проход по
+ * непрерывной памяти. Дескриптор - номер записи в младших разрядах и поколение записи над ним; поколение меняется
+ * при каждом освобождении, поэтому устаревший дескриптор отвергается за O(1), даже если запись уже занята снова.
+ * Дескриптор умещается в разряды ключа сессии ниже номера шарда и никогда не равен 0 (поколение начинается с 1)
+ * @tparam T Запись (конструктор по умолчанию и перемещающее присваивание)
+ */
+template <typename T>
+class SessionSlab
+{
+public:
+    /// Дескриптор записи (0 - нет записи)
+    typedef uintptr_t Handle;
+
+    /// Кол-во разрядов номера записи (в 32-разрядной сборке ключ короче - разрядов поколения должно хватать)
+    static constexpr unsigned INDEX_BITS = sizeof(uintptr_t) >= 8 ? 20 : 14;
+    /// Наибольшее кол-во записей
+    static constexpr size_t MAX_CAPACITY = (static_cast<size_t>(1) << INDEX_BITS) - 1;
+
+private:
+    /// Кол-во разрядов поколения (остальные разряды ключа сессии ниже номера шарда)
+    static constexpr unsigned GENERATION_BITS = net::SessionKey::SHARD_SHIFT - INDEX_BITS;
+    static_assert(GENERATION_BITS >= 10, "Session key is too short for slab generation bits");
+    /// Маска номера записи
+    static constexpr uintptr_t INDEX_MASK = (static_cast<uintptr_t>(1) << INDEX_BITS) - 1;
+    /// Маска поколения (после сдвига)
+    static constexpr uintptr_t GENERATION_MASK = (static_cast<uintptr_t>(1) << GENERATION_BITS) - 1;
+
+    /// Запись
+    struct Record
+    {
+        // Значение
+        T value;
+        // Поколение
+        uintptr_t generation;
+        // Занята ли
+        bool used;
+    };
+
+    /// Записи
+    std::vector<Record> records_;
+    /// Свободные записи (стек; занятые через emplaceAt могут оставаться в нем и пропускаются)
+    std::vector<uint32_t> free_;
+    /// Кол-во занятых записей
+    size_t size_;
+
+public:
+    /**
+     * Конструктор
+     * @param capacity Кол-во записей (не более MAX_CAPACITY)
+     */
+    explicit SessionSlab(size_t capacity):
+            records_(capacity < MAX_CAPACITY ? capacity : MAX_CAPACITY),
+            size_(0)
+    {
+        // Свободные записи выдаются с начала массива
+        free_.reserve(records_.size());
+        for(size_t i = records_.size(); i > 0; i--){
+            records_[i - 1].generation = 1;
+            records_[i - 1].used = false;
+            free_.push_back(static_cast<uint32_t>(i - 1));
+        }
+    }
+
+    /**
+     * Занять запись
+     * @return Дескриптор (0 - свободных записей нет)
+     */
+    Handle insert()
+    {
+        while(!free_.empty())
+        {
+            uint32_t index = free_.back();
+            free_.pop_back();
+            if(records_[index].used)
+                continue;
+
+            records_[index].used = true;
+            size_++;
+            return this->handleOf(index);
+        }
+        return 0;
+    }
+
+    /**
+     * Занять запись с заданным дескриптором (восстановление записей, переданных другим процессом)
+     * @param handle Дескриптор (разряды выше дескриптора не учитываются)
+     * @return Указатель на запись, либо nullptr (номер вне таблицы, либо запись занята)
+     */
+    T* emplaceAt(Handle handle)
+    {
+        uintptr_t index = handle & INDEX_MASK;
+        uintptr_t generation = (handle >> INDEX_BITS) & GENERATION_MASK;
+        if(index >= records_.size() || generation == 0 || records_[index].used)
+            return nullptr;
+
+        Record& record = records_[index];
+        record.used = true;
+        record.generation = generation;
+        size_++;
+        return &record.value;
+    }
+
+    /**
+     * Найти запись
+     * @param handle Дескриптор (разряды выше дескриптора не учитываются)
+     * @return Указатель на запись, либо nullptr (запись освобождена, либо дескриптор устарел)
+     */
+    T* find(Handle handle)
+    {
+        uintptr_t index = handle & INDEX_MASK;
+        if(index >= records_.size())
+            return nullptr;
+
+        Record& record = records_[index];
+        if(!record.used || record.generation != ((handle >> INDEX_BITS) & GENERATION_MASK))
+            return nullptr;
+        return &record.value;
+    }
+
+    /**
+     * Освободить запись (значение сбрасывается, дескриптор устаревает)
+     * @param handle Дескриптор
+     * @return Была ли запись занята
+     */
+    bool erase(Handle handle)
+    {
+        T* value = this->find(handle);
+        if(value == nullptr)
+            return false;
+
+        uint32_t index = static_cast<uint32_t>(handle & INDEX_MASK);
+        Record& record = records_[index];
+        record.value = T();
+        record.used = false;
+        record.generation = (record.generation + 1) & GENERATION_MASK;
+        if(record.generation == 0) record.generation = 1;
+        free_.push_back(index);
+        size_--;
+        return true;
+    }
+
+    /**
+     * Освободить все записи
+     */
+    void clear()
+    {
+        for(size_t i = 0; i < records_.size(); i++){
+            if(records_[i].used) this->erase(this->handleOf(static_cast<uint32_t>(i)));
+        }
+    }
+
+    /**
+     * Обойти занятые записи (линейно, в порядке размещения)
+     * @param visit Функция, принимающая дескриптор и ссылку на запись (освобождать записи в ней нельзя)
+     */
+    template <typename Visitor>
+    void forEach(Visitor visit)
+    {
+        for(size_t i = 0; i < records_.size(); i++){
+            if(records_[i].used) visit(this->handleOf(static_cast<uint32_t>(i)), records_[i].value);
+        }
+    }
+
+    /**
+     * Кол-во занятых записей
+     * @return Кол-во
+     */
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /**
+     * Кол-во записей
+     * @return Кол-во
+     */
+    size_t capacity() const
+    {
+        return records_.size();
+    }
+
+    /**
+     * Память одной записи
+     * @return Кол-во байт
+     */
+    static constexpr size_t recordFootprint()
+    {
+        return sizeof(Record);
+    }
+
+    /**
+     * Память таблицы (записи размещаются при создании, поэтому не зависит от кол-ва занятых)
+     * @return Кол-во байт
+     */
+    size_t footprint() const
+    {
+        return records_.capacity() * sizeof(Record) + free_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    /**
+     * Дескриптор записи
+     * @param index Номер записи
+     * @return Дескриптор
+     */
+    Handle handleOf(uint32_t index) const
+    {
+        return (records_[index].generation << INDEX_BITS) | index;
+    }
+};
@@ -0,0 +1,761 @@
+#include "UringBackend.h"
+#include "ListenSocket.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <chrono>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+
+constexpr size_t UringBackend::BUFFER_SIZE;
+constexpr uint16_t UringBackend::READ_GROUP;
+
+/**
+ * Данные завершения операции (вид операции, поколение ячейки и номер соединения)
+ * @param operation Вид операции
+ * @param connection Номер соединения
+ * @param generation Поколение ячейки
+ * @return Данные завершения
+ */
+static uint64_t operationTag(uint8_t operation, uint32_t connection, uint32_t generation)
+{
+    return (static_cast<uint64_t>(operation) << 56) | (static_cast<uint64_t>(generation & 0xFFFFFFu) << 32) | connection;
+}
+
+/**
+ * Конструктор (кольцо создается при открытии порта)
+ * @param maxConnections Наибольшее кол-во соединений
+ * @param queueDepth Кол-во элементов очереди отправки
+ */
+UringBackend::UringBackend(uint32_t maxConnections, unsigned queueDepth):
+        handler_(nullptr),
+        queueDepth_(queueDepth > 0 ? queueDepth : 1),
+        ring_(-1),
+        sqRing_(nullptr),
+        sqRingSize_(0),
+        cqRing_(nullptr),
+        cqRingSize_(0),
+        sqes_(nullptr),
+        sqesSize_(0),
+        sqHead_(nullptr),
+        sqTail_(nullptr),
+        sqMask_(0),
+        sqEntries_(0),
+        sqLocalTail_(0),
+        cqHead_(nullptr),
+        cqTail_(nullptr),
+        cqMask_(0),
+        cqes_(nullptr),
+        readPool_(nullptr),
+        readPoolSize_(0),
+        readBuffers_(0),
+        multishotAccept_(true),
+        detaching_(false),
+        slots_(maxConnections)
+{
+    // Свободные ячейки выдаются с начала таблицы
+    free_.reserve(maxConnections);
+    for(uint32_t i = maxConnections; i > 0; i--){
+        slots_[i - 1].fd = -1;
+        slots_[i - 1].generation = 0;
+        free_.push_back(i - 1);
+    }
+}
+
+/**
+ * Деструктор (закрывает все сокеты и кольцо)
+ */
+UringBackend::~UringBackend()
+{
+    for(Slot& slot : slots_){
+        if(slot.fd >= 0) ::close(slot.fd);
+    }
+    for(int listener : listeners_){
+        ::close(listener);
+    }
+    this->destroyRing();
+}
+
+const char* UringBackend::name() const
+{
+    return "io_uring";
+}
+
+bool UringBackend::listen(uint16_t port, IoHandler& handler)
+{
+    // Прием выполняет кольцо, поэтому сокет блокирующий
+    int fd = openListenSocket(port, SOMAXCONN, false);
+    if(fd < 0)
+        return false;
+
+    if(!this->adoptListener(fd, handler)){
+        ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+bool UringBackend::listenLocal(const std::string& path, IoHandler& handler)
+{
+    int fd = openLocalListenSocket(path, SOMAXCONN, false);
+    if(fd < 0)
+        return false;
+
+    if(!this->adoptListener(fd, handler)){
+        ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+void UringBackend::poll(int timeoutMs)
+{
+    // Одним вызовом передаются все подготовленные операции и ожидается хотя бы одно завершение
+    this->enter(1, timeoutMs);
+
+    // Завершения копируются и очередь сразу освобождается (обработка добавляет новые операции)
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    completions_.clear();
+    while(head != tail){
+        completions_.push_back(cqes_[head & cqMask_]);
+        head++;
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+    for(const io_uring_cqe& cqe : completions_){
+        this->complete(cqe);
+    }
+
+    // Буферы обработанных данных уже возвращены в пул - чтение, которому их не хватило, повторяется
+    for(uint32_t connection : starved_){
+        const Slot& slot = slots_[connection];
+        if(slot.fd >= 0 && !slot.broken && !slot.reading && !detaching_) this->submitRead(connection);
+    }
+    starved_.clear();
+}
+
+std::string* UringBackend::outbox(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0 || slot.closing || slot.broken)
+        return nullptr;
+
+    this->markDirty(connection);
+    return &slot.outbox;
+}
+
+void UringBackend::flush()
+{
+    // Операции записи только помещаются в очередь отправки - ядру они передаются в poll
+    // (список может пополняться получателем событий при разрыве соединений медленных получателей)
+    for(size_t i = 0; i < dirty_.size(); i++)
+    {
+        uint32_t connection = dirty_[i];
+        Slot& slot = slots_[connection];
+        slot.dirty = false;
+        if(slot.fd < 0 || slot.broken)
+            continue;
+
+        // Получатель не успевает принимать данные - соединение разрывается, чтобы его очередь не росла без предела
+        if(this->exceedsOutboxLimit(slot.sending.size() - slot.written + slot.outbox.size())){
+            this->teardown(connection, !slot.closing);
+            continue;
+        }
+        if(slot.writing)
+            continue;
+
+        if(slot.written < slot.sending.size() || !slot.outbox.empty()){
+            this->submitWrite(connection);
+        }else if(slot.closing){
+            this->teardown(connection, false);
+        }
+    }
+    dirty_.clear();
+}
+
+void UringBackend::close(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0 || slot.closing || slot.broken)
+        return;
+
+    slot.closing = true;
+    this->markDirty(connection);
+}
+
+bool UringBackend::adoptListener(int fd, IoHandler& handler)
+{
+    if(ring_ < 0 && !this->setupRing())
+        return false;
+
+    // Операции кольца над неблокирующим сокетом завершались бы с EAGAIN
+    if(::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK) != 0)
+        return false;
+
+    listeners_.push_back(fd);
+    acceptArmed_.push_back(false);
+    handler_ = &handler;
+    this->submitAccept(listeners_.size() - 1);
+    return true;
+}
+
+uint32_t UringBackend::adopt(int fd)
+{
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    uint32_t connection = this->attach(fd);
+    if(connection != NO_CONNECTION){
+        this->submitRead(connection);
+    }
+    return connection;
+}
+
+std::vector<int> UringBackend::detach(std::vector<DetachedConnection>& connections)
+{
+    // Ожидающие приема и чтения отменяются сразу, записи - только если не завершились за отведенное время
+    const auto started = std::chrono::steady_clock::now();
+    const auto writesDeadline = started + std::chrono::seconds(2);
+    const auto deadline = started + std::chrono::seconds(5);
+    bool writesCancelled = false;
+
+    detaching_ = true;
+    for(size_t listener = 0; listener < acceptArmed_.size(); listener++){
+        if(acceptArmed_[listener]) this->submitCancel(operationTag(OP_ACCEPT, static_cast<uint32_t>(listener), 0));
+    }
+    for(uint32_t connection = 0; connection < slots_.size(); connection++){
+        const Slot& slot = slots_[connection];
+        if(slot.fd >= 0 && slot.reading) this->submitCancel(operationTag(OP_READ, connection, slot.generation));
+    }
+
+    while(true)
+    {
+        bool idle = std::find(acceptArmed_.begin(), acceptArmed_.end(), true) == acceptArmed_.end();
+        for(const Slot& slot : slots_){
+            if(slot.fd >= 0 && slot.inFlight > 0){
+                idle = false;
+                break;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if(idle || now >= deadline)
+            break;
+
+        if(!writesCancelled && now >= writesDeadline){
+            for(uint32_t connection = 0; connection < slots_.size(); connection++){
+                const Slot& slot = slots_[connection];
+                if(slot.fd >= 0 && slot.writing) this->submitCancel(operationTag(OP_WRITE, connection, slot.generation));
+            }
+            writesCancelled = true;
+        }
+
+        this->poll(100);
+    }
+
+    // Незаписанная часть записываемых данных предшествует очереди
+    for(uint32_t connection = 0; connection < slots_.size(); connection++)
+    {
+        Slot& slot = slots_[connection];
+        slot.dirty = false;
+        if(slot.fd < 0 || slot.broken)
+            continue;
+
+        std::string output = slot.sending.substr(slot.written);
+        output += slot.outbox;
+        connections.push_back(DetachedConnection{connection, slot.fd, std::move(output), slot.closing});
+
+        slot.fd = -1;
+        slot.generation++;
+        slot.closing = false;
+        releaseBuffer(slot.outbox);
+        releaseBuffer(slot.sending);
+        slot.written = 0;
+        free_.push_back(connection);
+    }
+    dirty_.clear();
+    starved_.clear();
+    detaching_ = false;
+
+    std::vector<int> listeners;
+    listeners.swap(listeners_);
+    acceptArmed_.clear();
+    return listeners;
+}
+
+uint32_t UringBackend::capacity() const
+{
+    return static_cast<uint32_t>(slots_.size());
+}
+
+size_t UringBackend::slotFootprint() const
+{
+    // Пул буферов чтения общий для всех соединений
+    return sizeof(Slot);
+}
+
+size_t UringBackend::bufferFootprint(uint32_t connection) const
+{
+    const Slot& slot = slots_[connection];
+    return heapBytes(slot.outbox) + heapBytes(slot.sending);
+}
+
+int UringBackend::descriptor(uint32_t connection) const
+{
+    return connection < slots_.size() ? slots_[connection].fd : -1;
+}
+
+size_t UringBackend::queuedBytes(uint32_t connection) const
+{
+    const Slot& slot = slots_[connection];
+    return slot.sending.size() - slot.written + slot.outbox.size();
+}
+
+/**
+ * Создать кольцо, отобразить его и передать ядру пул буферов чтения
+ * @return Удалось ли (ядро без io_uring, либо без нужных возможностей - нет)
+ */
+bool UringBackend::setupRing()
+{
+    // Очередь завершений вмещает по операции чтения и записи каждого соединения
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = std::max(queueDepth_ * 2, static_cast<unsigned>(slots_.size()) * 2);
+
+    ring_ = static_cast<int>(::syscall(__NR_io_uring_setup, queueDepth_, &params));
+    if(ring_ < 0)
+        return false;
+
+    // Ожидание с ограничением по времени требует IORING_ENTER_EXT_ARG (ядро 5.11+)
+    if(!(params.features & IORING_FEAT_EXT_ARG)){
+        this->destroyRing();
+        return false;
+    }
+
+    // Отображение колец (в новых ядрах - одним отображением)
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMmap){
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED){
+        sqRing_ = nullptr;
+        this->destroyRing();
+        return false;
+    }
+
+    cqRing_ = singleMmap ? sqRing_ : ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+    if(cqRing_ == MAP_FAILED){
+        cqRing_ = nullptr;
+        this->destroyRing();
+        return false;
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED){
+        this->destroyRing();
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqLocalTail_ = *sqTail_;
+
+    // Элемент очереди отправки с индексом i всегда занимает позицию i массива индексов
+    auto sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for(unsigned i = 0; i < sqEntries_; i++){
+        sqArray[i] = i;
+    }
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Пул буферов чтения рассчитан на глубину очереди, а не на кол-во соединений (номер буфера - 16 разрядов)
+    readBuffers_ = std::min(std::max(queueDepth_, 64u), 0xFFFFu);
+    readPoolSize_ = readBuffers_ * BUFFER_SIZE;
+    void* pool = ::mmap(nullptr, readPoolSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pool == MAP_FAILED){
+        this->destroyRing();
+        return false;
+    }
+    readPool_ = static_cast<char*>(pool);
+
+    // Передача пула проверяется сразу (без IORING_OP_PROVIDE_BUFFERS чтение невозможно)
+    this->provideBuffers(0, readBuffers_);
+    this->enter(1, 1000);
+    unsigned head = *cqHead_;
+    bool provided = head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) && cqes_[head & cqMask_].res >= 0;
+    __atomic_store_n(cqHead_, head + (provided ? 1 : 0), __ATOMIC_RELEASE);
+    if(!provided){
+        this->destroyRing();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Освободить кольцо и буферы
+ */
+void UringBackend::destroyRing()
+{
+    if(readPool_ != nullptr) ::munmap(readPool_, readPoolSize_);
+    if(sqes_ != nullptr) ::munmap(sqes_, sqesSize_);
+    if(cqRing_ != nullptr && cqRing_ != sqRing_) ::munmap(cqRing_, cqRingSize_);
+    if(sqRing_ != nullptr) ::munmap(sqRing_, sqRingSize_);
+    if(ring_ >= 0) ::close(ring_);
+
+    readPool_ = nullptr;
+    sqes_ = nullptr;
+    cqRing_ = nullptr;
+    sqRing_ = nullptr;
+    ring_ = -1;
+}
+
+/**
+ * Получить свободный элемент очереди отправки (при заполнении очередь передается ядру)
+ * @return Обнуленный элемент
+ */
+io_uring_sqe* UringBackend::nextSqe()
+{
+    while(sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_){
+        this->enter(0, 0);
+    }
+
+    io_uring_sqe* sqe = &sqes_[sqLocalTail_ & sqMask_];
+    sqLocalTail_++;
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+/**
+ * Передать ядру накопленные операции и (при необходимости) дождаться завершений
+ * @param minComplete Сколько завершений ожидать
+ * @param timeoutMs Наибольшее время ожидания (мс)
+ */
+void UringBackend::enter(unsigned minComplete, int timeoutMs)
+{
+    // Операции, не принятые ядром в прошлый раз, передаются повторно
+    unsigned toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+
+    if(minComplete == 0){
+        if(toSubmit > 0){
+            ::syscall(__NR_io_uring_enter, ring_, toSubmit, 0, 0, nullptr, 0);
+        }
+        return;
+    }
+
+    __kernel_timespec timeout = {};
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&timeout);
+
+    // Истечение времени (ETIME) и прерывание сигналом (EINTR) - штатные исходы
+    ::syscall(__NR_io_uring_enter, ring_, toSubmit, minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+/**
+ * Поставить в очередь прием подключения
+ * @param listener Номер прослушивающего сокета
+ */
+void UringBackend::submitAccept(size_t listener)
+{
+    io_uring_sqe* sqe = this->nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listeners_[listener];
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = multishotAccept_ ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = operationTag(OP_ACCEPT, static_cast<uint32_t>(listener), 0);
+    acceptArmed_[listener] = true;
+}
+
+/**
+ * Поставить в очередь отмену операции
+ * @param userData Данные завершения отменяемой операции
+ */
+void UringBackend::submitCancel(uint64_t userData)
+{
+    io_uring_sqe* sqe = this->nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = operationTag(OP_CANCEL, 0, 0);
+}
+
+/**
+ * Поставить в очередь возврат буферов в пул чтения
+ * @param first Номер первого буфера
+ * @param count Кол-во буферов
+ */
+void UringBackend::provideBuffers(uint16_t first, unsigned count)
+{
+    io_uring_sqe* sqe = this->nextSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(this->readBuffer(first));
+    sqe->len = static_cast<uint32_t>(BUFFER_SIZE);
+    sqe->off = first;
+    sqe->buf_group = READ_GROUP;
+    sqe->user_data = operationTag(OP_PROVIDE, 0, 0);
+}
+
+/**
+ * Занять ячейку под принятый сокет
+ * @param fd Блокирующий сокет (закрывается, если ячейку занять не удалось)
+ * @return Номер соединения, либо NO_CONNECTION
+ */
+uint32_t UringBackend::attach(int fd)
+{
+    // Таблица соединений заполнена - подключение отклоняется
+    if(free_.empty()){
+        ::close(fd);
+        return NO_CONNECTION;
+    }
+
+    uint32_t connection = free_.back();
+    free_.pop_back();
+
+    Slot& slot = slots_[connection];
+    slot.fd = fd;
+    slot.inFlight = 0;
+    slot.reading = false;
+    slot.writing = false;
+    slot.closing = false;
+    slot.broken = false;
+    slot.dirty = false;
+    slot.written = 0;
+
+    // Сообщения короткие - отправляются без задержки
+    int enable = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return connection;
+}
+
+/**
+ * Поставить в очередь чтение соединения
+ * @param connection Номер соединения
+ */
+void UringBackend::submitRead(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    io_uring_sqe* sqe = this->nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = slot.fd;
+    sqe->len = static_cast<uint32_t>(BUFFER_SIZE);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = READ_GROUP;
+    sqe->user_data = operationTag(OP_READ, connection, slot.generation);
+
+    slot.reading = true;
+    slot.inFlight++;
+}
+
+/**
+ * Поставить в очередь запись соединения (записанные данные заменяются очередью)
+ * @param connection Номер соединения
+ */
+void UringBackend::submitWrite(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+
+    // Записанные данные дописаны - на запись передается вся очередь (обменом строк, без копирования)
+    if(slot.written == slot.sending.size())
+    {
+        slot.sending.swap(slot.outbox);
+        slot.outbox.clear();
+        slot.written = 0;
+        if(slot.sending.empty())
+            return;
+    }
+
+    io_uring_sqe* sqe = this->nextSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(slot.sending.data() + slot.written);
+    sqe->len = static_cast<uint32_t>(slot.sending.size() - slot.written);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = operationTag(OP_WRITE, connection, slot.generation);
+
+    slot.writing = true;
+    slot.inFlight++;
+}
+
+/**
+ * Обработать завершение операции
+ * @param cqe Завершение
+ */
+void UringBackend::complete(const io_uring_cqe& cqe)
+{
+    auto operation = static_cast<uint8_t>(cqe.user_data >> 56);
+
+    // Результат отмены не нужен - отмененная операция завершается сама, возврат буферов в пул не отказывает
+    if(operation == OP_CANCEL || operation == OP_PROVIDE)
+        return;
+
+    // Принято подключение (многократная операция остается активной, пока выставлен IORING_CQE_F_MORE)
+    if(operation == OP_ACCEPT)
+    {
+        // Номер прослушивающего сокета - в разрядах номера соединения
+        auto listener = static_cast<size_t>(cqe.user_data & 0xFFFFFFFFu);
+        if(!(cqe.flags & IORING_CQE_F_MORE) && listener < acceptArmed_.size()){
+            acceptArmed_[listener] = false;
+            // Ядро без многократного приема - далее прием однократными операциями
+            if(cqe.res == -EINVAL && multishotAccept_){
+                multishotAccept_ = false;
+            }
+            if(!detaching_) this->submitAccept(listener);
+        }
+
+        if(cqe.res < 0)
+            return;
+
+        // Подключение, принятое во время изъятия, будет передано вместе с остальными (чтение не ставится)
+        uint32_t connection = this->attach(cqe.res);
+        if(connection == NO_CONNECTION)
+            return;
+
+        handler_->onAccepted(connection);
+        if(!slots_[connection].broken && !detaching_){
+            this->submitRead(connection);
+        }
+        return;
+    }
+
+    // Ячейка не освобождается, пока у нее есть операции, поэтому завершение всегда относится к текущему соединению
+    auto connection = static_cast<uint32_t>(cqe.user_data & 0xFFFFFFFFu);
+    Slot& slot = slots_[connection];
+    slot.inFlight--;
+
+    // При изъятии сокетов операции отменяются и не повторяются (отмена - не ошибка соединения)
+    bool retry = cqe.res == -EAGAIN || cqe.res == -EINTR;
+    bool cancelled = detaching_ && (cqe.res == -ECANCELED || retry);
+
+    if(operation == OP_READ)
+    {
+        slot.reading = false;
+        auto buffer = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if(!slot.broken && !cancelled)
+        {
+            if(cqe.res > 0){
+                // Данные закрываемого сервером соединения не нужны (но читаются, чтобы узнать об отключении)
+                if(!slot.closing) handler_->onReceived(connection, this->readBuffer(buffer), static_cast<size_t>(cqe.res));
+                if(!slot.broken && !detaching_) this->submitRead(connection);
+            }else if(cqe.res == -ENOBUFS){
+                starved_.push_back(connection);
+            }else if(retry){
+                this->submitRead(connection);
+            }else{
+                this->teardown(connection, !slot.closing);
+            }
+        }
+
+        // Буфер, выбранный ядром, возвращается в пул сразу после обработки данных
+        if(cqe.flags & IORING_CQE_F_BUFFER){
+            this->provideBuffers(buffer, 1);
+        }
+    }
+    else if(operation == OP_WRITE)
+    {
+        slot.writing = false;
+        if(!slot.broken && !cancelled)
+        {
+            if(cqe.res > 0){
+                slot.written += static_cast<size_t>(cqe.res);
+                // При изъятии остаток передается вместе с сокетом
+                if(slot.written < slot.sending.size() || !slot.outbox.empty()){
+                    if(!detaching_) this->submitWrite(connection);
+                }else if(slot.closing){
+                    this->teardown(connection, false);
+                }else{
+                    // Простаивающее соединение не держит память очередей до следующей записи
+                    releaseBuffer(slot.sending);
+                    releaseBuffer(slot.outbox);
+                    slot.written = 0;
+                }
+            }else if(retry){
+                this->submitWrite(connection);
+            }else{
+                this->teardown(connection, !slot.closing);
+            }
+        }
+    }
+
+    this->releaseIfIdle(connection);
+}
+
+/**
+ * Поставить соединение в список ожидающих записи
+ * @param connection Номер соединения
+ */
+void UringBackend::markDirty(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(!slot.dirty){
+        slot.dirty = true;
+        dirty_.push_back(connection);
+    }
+}
+
+/**
+ * Разорвать соединение (ячейка освобождается после завершения всех операций)
+ * @param connection Номер соединения
+ * @param notify Сообщить ли получателю
+ */
+void UringBackend::teardown(uint32_t connection, bool notify)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0 || slot.broken)
+        return;
+
+    // Незавершенное чтение завершится с нулем байт, после чего ячейка будет освобождена
+    slot.broken = true;
+    releaseBuffer(slot.outbox);
+    ::shutdown(slot.fd, SHUT_RDWR);
+
+    if(notify){
+        handler_->onClosed(connection);
+    }
+    this->releaseIfIdle(connection);
+}
+
+/**
+ * Освободить ячейку, если у нее не осталось операций
+ * @param connection Номер соединения
+ */
+void UringBackend::releaseIfIdle(uint32_t connection)
+{
+    Slot& slot = slots_[connection];
+    if(slot.fd < 0 || !slot.broken || slot.inFlight > 0)
+        return;
+
+    // Записываемые данные освобождаются только здесь - до завершения записи их читает ядро
+    ::close(slot.fd);
+    slot.fd = -1;
+    slot.generation++;
+    slot.broken = false;
+    slot.closing = false;
+    releaseBuffer(slot.sending);
+    slot.written = 0;
+    free_.push_back(connection);
+}
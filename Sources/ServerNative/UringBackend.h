@@ -0,0 +1,245 @@
+#pragma once
+
+#include <vector>
+#include <linux/io_uring.h>
+
+#include "IoBackend.hpp"
+
+/**
+ * Ввод-вывод на io_uring (системные вызовы без liburing)
+ * Операции всех соединений помещаются в очередь отправки и передаются ядру одним вызовом io_uring_enter,
+ * который заодно ожидает завершений, а завершения разбираются пачкой. Буфер чтения ядро выбирает из общего пула
+ * только при поступлении данных (IOSQE_BUFFER_SELECT) и получает обратно сразу после их обработки, а запись идет
+ * прямо из очереди соединения, поэтому простаивающее соединение буферов не держит (только сокет и ячейку).
+ * Зарегистрированные буферы (IORING_REGISTER_BUFFERS, READ_FIXED/WRITE_FIXED) не используются: они закрепляли бы
+ * буфер за каждым соединением
+ */
+class UringBackend final : public IoBackend
+{
+private:
+    /// Размер буфера чтения
+    static constexpr size_t BUFFER_SIZE = 2048;
+    /// Группа буферов чтения
+    static constexpr uint16_t READ_GROUP = 0;
+
+    /// Соединение
+    struct Slot
+    {
+        // Сокет (-1 - ячейка свободна)
+        int fd;
+        // Поколение ячейки (отличает завершения операций закрытого соединения)
+        uint32_t generation;
+        // Кол-во незавершенных операций (ячейка освобождается только когда их нет - ядро пишет в ее буфер)
+        unsigned inFlight;
+        // Выполняется ли чтение и запись
+        bool reading;
+        bool writing;
+        // Закрыто сервером (закрывается после записи очереди)
+        bool closing;
+        // Соединение разорвано (ожидается завершение операций)
+        bool broken;
+        // Ячейка в списке ожидающих записи
+        bool dirty;
+        // Исходящие данные, еще не переданные на запись
+        std::string outbox;
+        // Записываемые данные (ядро читает их до завершения записи) и кол-во уже записанных байт
+        std::string sending;
+        size_t written;
+    };
+
+    /// Получатель событий
+    IoHandler* handler_;
+    /// Наибольшее кол-во элементов очереди отправки
+    unsigned queueDepth_;
+    /// Дескриптор кольца
+    int ring_;
+    /// Отображения колец и массива элементов очереди отправки
+    void* sqRing_;
+    size_t sqRingSize_;
+    void* cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    /// Очередь отправки
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    /// Локальный хвост очереди отправки (публикуется при вызове io_uring_enter)
+    unsigned sqLocalTail_;
+    /// Очередь завершений
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+    /// Пул буферов чтения (общий для всех соединений) и кол-во буферов в нем
+    char* readPool_;
+    size_t readPoolSize_;
+    unsigned readBuffers_;
+    /// Прослушивающие сокеты (порт и, если открыт, локальный сокет)
+    std::vector<int> listeners_;
+    /// Прием подключений многократной операцией (IORING_ACCEPT_MULTISHOT)
+    bool multishotAccept_;
+    /// Операции приема подключений активны (по прослушивающим сокетам)
+    std::vector<bool> acceptArmed_;
+    /// Выполняется изъятие сокетов (новые операции не ставятся)
+    bool detaching_;
+    /// Соединения
+    std::vector<Slot> slots_;
+    /// Свободные ячейки
+    std::vector<uint32_t> free_;
+    /// Ячейки с исходящими данными (или ожидающие закрытия)
+    std::vector<uint32_t> dirty_;
+    /// Соединения, чтению которых не хватило буфера (чтение повторяется после возврата буферов в пул)
+    std::vector<uint32_t> starved_;
+    /// Завершения, разбираемые за один проход
+    std::vector<io_uring_cqe> completions_;
+
+public:
+    /**
+     * Конструктор (кольцо создается при открытии порта)
+     * @param maxConnections Наибольшее кол-во соединений
+     * @param queueDepth Кол-во элементов очереди отправки
+     */
+    UringBackend(uint32_t maxConnections, unsigned queueDepth);
+
+    /**
+     * Деструктор (закрывает все сокеты и кольцо)
+     */
+    ~UringBackend() override;
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    UringBackend(const UringBackend& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    UringBackend& operator=(const UringBackend& other) = delete;
+
+    const char* name() const override;
+    bool listen(uint16_t port, IoHandler& handler) override;
+    bool listenLocal(const std::string& path, IoHandler& handler) override;
+    void poll(int timeoutMs) override;
+    std::string* outbox(uint32_t connection) override;
+    void flush() override;
+    void close(uint32_t connection) override;
+    bool adoptListener(int fd, IoHandler& handler) override;
+    uint32_t adopt(int fd) override;
+    std::vector<int> detach(std::vector<DetachedConnection>& connections) override;
+    uint32_t capacity() const override;
+    size_t slotFootprint() const override;
+    size_t bufferFootprint(uint32_t connection) const override;
+    int descriptor(uint32_t connection) const override;
+    size_t queuedBytes(uint32_t connection) const override;
+
+private:
+    /// Вид операции (старшие разряды user_data)
+    enum Operation : uint8_t {
+        OP_ACCEPT = 1,
+        OP_READ = 2,
+        OP_WRITE = 3,
+        OP_CANCEL = 4,
+        OP_PROVIDE = 5
+    };
+
+    /**
+     * Создать кольцо, отобразить его и передать ядру пул буферов чтения
+     * @return Удалось ли (ядро без io_uring, либо без нужных возможностей - нет)
+     */
+    bool setupRing();
+
+    /**
+     * Освободить кольцо и буферы
+     */
+    void destroyRing();
+
+    /**
+     * Получить свободный элемент очереди отправки (при заполнении очередь передается ядру)
+     * @return Обнуленный элемент
+     */
+    io_uring_sqe* nextSqe();
+
+    /**
+     * Передать ядру накопленные операции и (при необходимости) дождаться завершений
+     * @param minComplete Сколько завершений ожидать
+     * @param timeoutMs Наибольшее время ожидания (мс)
+     */
+    void enter(unsigned minComplete, int timeoutMs);
+
+    /**
+     * Поставить в очередь прием подключения
+     * @param listener Номер прослушивающего сокета
+     */
+    void submitAccept(size_t listener);
+
+    /**
+     * Поставить в очередь отмену операции
+     * @param userData Данные завершения отменяемой операции
+     */
+    void submitCancel(uint64_t userData);
+
+    /**
+     * Поставить в очередь возврат буферов в пул чтения
+     * @param first Номер первого буфера
+     * @param count Кол-во буферов
+     */
+    void provideBuffers(uint16_t first, unsigned count);
+
+    /**
+     * Занять ячейку под принятый сокет
+     * @param fd Блокирующий сокет (закрывается, если ячейку занять не удалось)
+     * @return Номер соединения, либо NO_CONNECTION
+     */
+    uint32_t attach(int fd);
+
+    /**
+     * Поставить в очередь чтение соединения
+     * @param connection Номер соединения
+     */
+    void submitRead(uint32_t connection);
+
+    /**
+     * Поставить в очередь запись соединения (записанные данные заменяются очередью)
+     * @param connection Номер соединения
+     */
+    void submitWrite(uint32_t connection);
+
+    /**
+     * Обработать завершение операции
+     * @param cqe Завершение
+     */
+    void complete(const io_uring_cqe& cqe);
+
+    /**
+     * Поставить соединение в список ожидающих записи
+     * @param connection Номер соединения
+     */
+    void markDirty(uint32_t connection);
+
+    /**
+     * Разорвать соединение (ячейка освобождается после завершения всех операций)
+     * @param connection Номер соединения
+     * @param notify Сообщить ли получателю
+     */
+    void teardown(uint32_t connection, bool notify);
+
+    /**
+     * Освободить ячейку, если у нее не осталось операций
+     * @param connection Номер соединения
+     */
+    void releaseIfIdle(uint32_t connection);
+
+    /**
+     * Буфер пула чтения
+     * @param id Номер буфера
+     * @return Указатель на буфер
+     */
+    char* readBuffer(uint16_t id){
+        return readPool_ + static_cast<size_t>(id) * BUFFER_SIZE;
+    }
+};
@@ -0,0 +1,378 @@
+#include "WebSocketStream.h"
+
+#include <cctype>
+#include <cstring>
+
+/// Строка, добавляемая к ключу клиента при вычислении ответа на запрос установки (RFC 6455)
+static const char* ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/**
+ * Циклический сдвиг влево
+ * @param value Значение
+ * @param bits Кол-во разрядов
+ * @return Результат
+ */
+static uint32_t rotateLeft(uint32_t value, unsigned bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * Хеш SHA-1 (нужен только для ответа на запрос установки соединения)
+ * @param input Данные
+ * @param digest Хеш (20 байт)
+ */
+static void sha1(const std::string& input, uint8_t digest[20])
+{
+    uint32_t h[5] = {0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u};
+
+    // Дополнение: единичный бит, нули и длина в битах (big-endian) до размера, кратного 64 байтам
+    std::string message = input;
+    uint64_t bits = static_cast<uint64_t>(input.size()) * 8;
+    message += static_cast<char>(0x80);
+    while(message.size() % 64 != 56) message += '\0';
+    for(int i = 7; i >= 0; i--) message += static_cast<char>((bits >> (i * 8)) & 0xFF);
+
+    for(size_t block = 0; block < message.size(); block += 64)
+    {
+        uint32_t w[80];
+        for(int i = 0; i < 16; i++){
+            const auto* p = reinterpret_cast<const uint8_t*>(message.data() + block + i * 4);
+            w[i] = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        }
+        for(int i = 16; i < 80; i++){
+            w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for(int i = 0; i < 80; i++){
+            uint32_t f, k;
+            if(i < 20)      { f = (b & c) | (~b & d);           k = 0x5A827999u; }
+            else if(i < 40) { f = b ^ c ^ d;                    k = 0x6ED9EBA1u; }
+            else if(i < 60) { f = (b & c) | (b & d) | (c & d);  k = 0x8F1BBCDCu; }
+            else            { f = b ^ c ^ d;                    k = 0xCA62C1D6u; }
+            uint32_t t = rotateLeft(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rotateLeft(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    for(int i = 0; i < 5; i++){
+        digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+    }
+}
+
+/**
+ * Кодировать в Base64
+ * @param data Данные
+ * @param size Кол-во байт
+ * @return Строка
+ */
+static std::string base64(const uint8_t* data, size_t size)
+{
+    static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for(size_t i = 0; i < size; i += 3){
+        uint32_t chunk = static_cast<uint32_t>(data[i]) << 16;
+        if(i + 1 < size) chunk |= static_cast<uint32_t>(data[i + 1]) << 8;
+        if(i + 2 < size) chunk |= data[i + 2];
+        out += alphabet[(chunk >> 18) & 0x3F];
+        out += alphabet[(chunk >> 12) & 0x3F];
+        out += i + 1 < size ? alphabet[(chunk >> 6) & 0x3F] : '=';
+        out += i + 2 < size ? alphabet[chunk & 0x3F] : '=';
+    }
+    return out;
+}
+
+/**
+ * Сравнить строки без учета регистра
+ * @param a Первая строка
+ * @param b Вторая строка
+ * @return Равны ли
+ */
+static bool equalsIgnoreCase(const std::string& a, const char* b)
+{
+    size_t size = strlen(b);
+    if(a.size() != size)
+        return false;
+    for(size_t i = 0; i < size; i++){
+        if(tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Конструктор
+ */
+WebSocketStream::WebSocketStream():open_(false){}
+
+/**
+ * Похожи ли первые данные клиента на запрос на установку соединения (HTTP GET)
+ * @param data Данные
+ * @param size Кол-во байт
+ * @return Да или нет (тип сообщения протокола не совпадает с первым байтом запроса)
+ */
+bool WebSocketStream::isUpgradeRequest(const char* data, size_t size)
+{
+    return size > 0 && data[0] == 'G';
+}
+
+/**
+ * Разобрать данные клиента
+ * @param data Данные
+ * @param size Кол-во байт
+ * @param payload Полезная нагрузка двоичных кадров (поток сообщений протокола, дописывается)
+ * @param reply Данные для клиента (ответ на запрос установки, ответы на кадры управления, дописываются)
+ * @return Продолжать ли (false - соединение закрывается после записи данных для клиента)
+ */
+bool WebSocketStream::receive(const char* data, size_t size, std::string& payload, std::string& reply)
+{
+    // Целые кадры разбираются прямо из полученных данных, в буфере соединения остается только неполный хвост
+    std::string joined;
+    if(!pending_.empty()){
+        pending_.append(data, size);
+        joined.swap(pending_);
+        data = joined.data();
+        size = joined.size();
+    }
+
+    while(size > 0)
+    {
+        size_t used = 0;
+        bool proceed = open_ ? this->readFrame(data, size, used, payload, reply) : this->acceptHandshake(data, size, used, reply);
+        if(!proceed)
+            return false;
+        if(used == 0)
+            break;
+
+        data += used;
+        size -= used;
+    }
+
+    pending_.assign(data, size);
+    return true;
+}
+
+/**
+ * Дописать заголовок кадра сервера (кадры сервера не маскируются)
+ * @param size Размер полезной нагрузки
+ * @param out Буфер
+ * @param opcode Код операции
+ */
+void WebSocketStream::writeFrameHeader(size_t size, std::string& out, Opcode opcode)
+{
+    out += static_cast<char>(0x80 | opcode);
+    if(size < 126){
+        out += static_cast<char>(size);
+    }else if(size <= 0xFFFF){
+        out += static_cast<char>(126);
+        out += static_cast<char>((size >> 8) & 0xFF);
+        out += static_cast<char>(size & 0xFF);
+    }else{
+        out += static_cast<char>(127);
+        for(int i = 7; i >= 0; i--) out += static_cast<char>((static_cast<uint64_t>(size) >> (i * 8)) & 0xFF);
+    }
+}
+
+/**
+ * Дописать кадр закрытия соединения
+ * @param code Код закрытия
+ * @param out Буфер
+ */
+void WebSocketStream::writeClose(CloseCode code, std::string& out)
+{
+    writeFrameHeader(sizeof(uint16_t), out, OPCODE_CLOSE);
+    out += static_cast<char>((code >> 8) & 0xFF);
+    out += static_cast<char>(code & 0xFF);
+}
+
+/**
+ * Установлено ли соединение
+ * @return Да или нет
+ */
+bool WebSocketStream::isOpen() const
+{
+    return open_;
+}
+
+/**
+ * Получить начало запроса или кадра, полученное не целиком (для передачи другому процессу)
+ * @return Данные
+ */
+const std::string& WebSocketStream::getPending() const
+{
+    return pending_;
+}
+
+/**
+ * Восстановить состояние, переданное другим процессом
+ * @param open Установлено ли соединение
+ * @param pending Начало запроса или кадра
+ */
+void WebSocketStream::restore(bool open, const std::string& pending)
+{
+    open_ = open;
+    pending_ = pending;
+}
+
+/**
+ * Память состояния соединения
+ * @return Кол-во байт
+ */
+size_t WebSocketStream::footprint() const
+{
+    return sizeof(*this) + (pending_.empty() ? 0 : pending_.capacity());
+}
+
+/**
+ * Разобрать запрос на установку соединения
+ * @param data Данные
+ * @param size Кол-во байт
+ * @param used Кол-во разобранных байт (0 - запрос получен не целиком)
+ * @param reply Ответ клиенту
+ * @return Продолжать ли
+ */
+bool WebSocketStream::acceptHandshake(const char* data, size_t size, size_t& used, std::string& reply)
+{
+    static const char* badRequest = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+    // Запрос заканчивается пустой строкой
+    std::string request(data, size < MAX_HANDSHAKE_SIZE ? size : MAX_HANDSHAKE_SIZE);
+    size_t end = request.find("\r\n\r\n");
+    if(end == std::string::npos){
+        if(size < MAX_HANDSHAKE_SIZE)
+            return true;
+        reply += badRequest;
+        return false;
+    }
+    used = end + 4;
+
+    // Нужны метод GET, заголовок Upgrade: websocket и ключ клиента
+    std::string key;
+    bool upgrade = false;
+    size_t line = request.find("\r\n");
+    while(line < end)
+    {
+        size_t next = request.find("\r\n", line + 2);
+        size_t colon = request.find(':', line + 2);
+        if(colon < next){
+            std::string name = request.substr(line + 2, colon - line - 2);
+            size_t valueStart = request.find_first_not_of(" \t", colon + 1);
+            size_t valueEnd = request.find_last_not_of(" \t", next - 1);
+            std::string value = valueStart < next && valueEnd >= valueStart ? request.substr(valueStart, valueEnd - valueStart + 1) : std::string();
+            if(equalsIgnoreCase(name, "Sec-WebSocket-Key")){
+                key = value;
+            }else if(equalsIgnoreCase(name, "Upgrade")){
+                upgrade = equalsIgnoreCase(value, "websocket");
+            }
+        }
+        line = next;
+    }
+
+    if(request.compare(0, 4, "GET ") != 0 || !upgrade || key.empty()){
+        reply += badRequest;
+        return false;
+    }
+
+    uint8_t digest[20];
+    sha1(key + ACCEPT_GUID, digest);
+    reply += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+    reply += base64(digest, sizeof(digest));
+    reply += "\r\n\r\n";
+    open_ = true;
+    return true;
+}
+
+/**
+ * Разобрать очередной кадр
+ * @param data Данные
+ * @param size Кол-во байт
+ * @param used Кол-во разобранных байт (0 - кадр получен не целиком)
+ * @param payload Полезная нагрузка двоичных кадров
+ * @param reply Данные для клиента
+ * @return Продолжать ли
+ */
+bool WebSocketStream::readFrame(const char* data, size_t size, size_t& used, std::string& payload, std::string& reply)
+{
+    if(size < 2)
+        return true;
+
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+    auto opcode = static_cast<Opcode>(bytes[0] & 0x0F);
+    bool final = (bytes[0] & 0x80) != 0;
+    bool masked = (bytes[1] & 0x80) != 0;
+
+    // Кадры клиента всегда маскируются, расширения не согласуются
+    if(!masked || (bytes[0] & 0x70) != 0){
+        writeClose(CLOSE_PROTOCOL_ERROR, reply);
+        return false;
+    }
+
+    // Длина полезной нагрузки (7 разрядов, либо 16 или 64 разряда следом)
+    size_t header = 2;
+    uint64_t length = bytes[1] & 0x7F;
+    if(length >= 126){
+        size_t extra = length == 126 ? 2 : 8;
+        if(size < header + extra)
+            return true;
+        length = 0;
+        for(size_t i = 0; i < extra; i++) length = (length << 8) | bytes[header + i];
+        header += extra;
+    }
+
+    bool control = (opcode & 0x8) != 0;
+    if(length > MAX_FRAME_SIZE || (control && (length > 125 || !final))){
+        writeClose(control ? CLOSE_PROTOCOL_ERROR : CLOSE_TOO_BIG, reply);
+        return false;
+    }
+    if(size < header + 4 + length)
+        return true;
+
+    const uint8_t* mask = bytes + header;
+    const uint8_t* body = mask + 4;
+    used = header + 4 + static_cast<size_t>(length);
+
+    switch(opcode)
+    {
+        // Полезная нагрузка - продолжение потока сообщений протокола (границы кадров не важны)
+        case OPCODE_BINARY:
+        case OPCODE_CONTINUATION:
+        {
+            size_t offset = payload.size();
+            payload.resize(offset + static_cast<size_t>(length));
+            for(size_t i = 0; i < length; i++){
+                payload[offset + i] = static_cast<char>(body[i] ^ mask[i & 3]);
+            }
+            return true;
+        }
+
+        // Проверка соединения клиентом - ответ с той же полезной нагрузкой
+        case OPCODE_PING:
+            writeFrameHeader(static_cast<size_t>(length), reply, OPCODE_PONG);
+            for(size_t i = 0; i < length; i++){
+                reply += static_cast<char>(body[i] ^ mask[i & 3]);
+            }
+            return true;
+
+        case OPCODE_PONG:
+            return true;
+
+        // Клиент закрывает соединение - сервер подтверждает закрытие
+        case OPCODE_CLOSE:
+            writeClose(CLOSE_NORMAL, reply);
+            return false;
+
+        // Текстовые кадры протоколом не используются
+        case OPCODE_TEXT:
+            writeClose(CLOSE_UNSUPPORTED_DATA, reply);
+            return false;
+
+        default:
+            writeClose(CLOSE_PROTOCOL_ERROR, reply);
+            return false;
+    }
+}
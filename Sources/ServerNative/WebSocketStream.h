@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * Сторона сервера соединения WebSocket (RFC 6455) для клиентов в браузере
+ * Двоичные кадры переносят тот же поток сообщений протокола, что и обычное TCP-соединение: полезная нагрузка
+ * кадров клиента после снятия маски передается разбору сообщений (MsgCodec) как есть, а исходящее сообщение
+ * кодируется в очередь соединения сразу за заголовком кадра (см. NativePeer). Поэтому сессии не отличают такие
+ * соединения от обычных. Состояние соединения - только начало кадра, полученное не целиком
+ */
+class WebSocketStream
+{
+public:
+    /// Коды операций кадров
+    enum Opcode : uint8_t {
+        OPCODE_CONTINUATION = 0x0,
+        OPCODE_TEXT = 0x1,
+        OPCODE_BINARY = 0x2,
+        OPCODE_CLOSE = 0x8,
+        OPCODE_PING = 0x9,
+        OPCODE_PONG = 0xA
+    };
+
+    /// Коды закрытия соединения
+    enum CloseCode : uint16_t {
+        CLOSE_NORMAL = 1000,
+        CLOSE_PROTOCOL_ERROR = 1002,
+        CLOSE_UNSUPPORTED_DATA = 1003,
+        CLOSE_TOO_BIG = 1009
+    };
+
+    /// Наибольший размер запроса на установку соединения (байт)
+    static constexpr size_t MAX_HANDSHAKE_SIZE = 4096;
+    /// Наибольший размер полезной нагрузки кадра клиента (байт)
+    static constexpr size_t MAX_FRAME_SIZE = 65536;
+
+private:
+    /// Установлено ли соединение (запрос на установку получен и принят)
+    bool open_;
+    /// Начало запроса на установку, либо кадра, полученное не целиком
+    std::string pending_;
+
+public:
+    /**
+     * Конструктор
+     */
+    WebSocketStream();
+
+    /**
+     * Похожи ли первые данные клиента на запрос на установку соединения (HTTP GET)
+     * @param data Данные
+     * @param size Кол-во байт
+     * @return Да или нет (тип сообщения протокола не совпадает с первым байтом запроса)
+     */
+    static bool isUpgradeRequest(const char* data, size_t size);
+
+    /**
+     * Разобрать данные клиента
+     * @param data Данные
+     * @param size Кол-во байт
+     * @param payload Полезная нагрузка двоичных кадров (поток сообщений протокола, дописывается)
+     * @param reply Данные для клиента (ответ на запрос установки, ответы на кадры управления, дописываются)
+     * @return Продолжать ли (false - соединение закрывается после записи данных для клиента)
+     */
+    bool receive(const char* data, size_t size, std::string& payload, std::string& reply);
+
+    /**
+     * Дописать заголовок кадра сервера (кадры сервера не маскируются)
+     * @param size Размер полезной нагрузки
+     * @param out Буфер
+     * @param opcode Код операции
+     */
+    static void writeFrameHeader(size_t size, std::string& out, Opcode opcode = OPCODE_BINARY);
+
+    /**
+     * Дописать кадр закрытия соединения
+     * @param code Код закрытия
+     * @param out Буфер
+     */
+    static void writeClose(CloseCode code, std::string& out);
+
+    /**
+     * Установлено ли соединение
+     * @return Да или нет
+     */
+    bool isOpen() const;
+
+    /**
+     * Получить начало запроса или кадра, полученное не целиком (для передачи другому процессу)
+     * @return Данные
+     */
+    const std::string& getPending() const;
+
+    /**
+     * Восстановить состояние, переданное другим процессом
+     * @param open Установлено ли соединение
+     * @param pending Начало запроса или кадра
+     */
+    void restore(bool open, const std::string& pending);
+
+    /**
+     * Память состояния соединения
+     * @return Кол-во байт
+     */
+    size_t footprint() const;
+
+private:
+    /**
+     * Разобрать запрос на установку соединения
+     * @param data Данные
+     * @param size Кол-во байт
+     * @param used Кол-во разобранных байт (0 - запрос получен не целиком)
+     * @param reply Ответ клиенту
+     * @return Продолжать ли
+     */
+    bool acceptHandshake(const char* data, size_t size, size_t& used, std::string& reply);
+
+    /**
+     * Разобрать очередной кадр
+     * @param data Данные
+     * @param size Кол-во байт
+     * @param used Кол-во разобранных байт (0 - кадр получен не целиком)
+     * @param payload Полезная нагрузка двоичных кадров
+     * @param reply Данные для клиента
+     * @return Продолжать ли
+     */
+    bool readFrame(const char* data, size_t size, size_t& used, std::string& payload, std::string& reply);
+};
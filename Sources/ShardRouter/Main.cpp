@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <csignal>
+
+#include "ShardRouter.h"
+
+/// Прослушиваемый порт
+unsigned _port;
+/// Маршрутизатор (для остановки по сигналу)
+ShardRouter* _router = nullptr;
+
+/**
+ * Обработчик сигналов остановки
+ * @param signal Номер сигнала
+ */
+static void onStopSignal(int signal)
+{
+    (void)signal;
+    if(_router != nullptr) _router->stop();
+}
+
+/**
+ * Точка входа
+ * @param argc Кол-во аргументов
+ * @param argv Аргументы (адреса серверов вида "хост:порт" или "unix:<путь>", номер шарда - порядковый номер адреса)
+ * @return Код выполнения (выхода)
+ */
+int main(int argc, char* argv[])
+{
+    try
+    {
+        if(argc < 2){
+            throw std::runtime_error("Usage: BattleShipRouter <host:port|unix:path of shard 0> [<host:port|unix:path of shard 1> ...]");
+        }
+
+        // Серверы группы (каждый запущен со своим номером шарда)
+        ServerSettings settings;
+        ShardRouter router(settings);
+        for(int i = 1; i < argc; i++){
+            if(!router.addShard(argv[i])){
+                throw std::runtime_error(std::string("Error: wrong shard address (") + argv[i] + ").");
+            }
+        }
+
+        // Ввод прослушиваемого порта
+        std::cout << "Please enter port: ";
+        std::cin >> _port;
+
+        // Запись в разорванное соединение не должна завершать процесс
+        std::signal(SIGPIPE, SIG_IGN);
+
+        if(!router.listen(static_cast<uint16_t>(_port))){
+            throw std::runtime_error("Error: can't open listening socket.");
+        }
+
+        std::cout << "Listening port (" << _port << "), shards: " << (argc - 1) << "." << std::endl;
+
+        // Основной цикл маршрутизатора (до SIGINT или SIGTERM)
+        _router = &router;
+        std::signal(SIGINT, onStopSignal);
+        std::signal(SIGTERM, onStopSignal);
+        router.run();
+        _router = nullptr;
+    }
+    catch(std::exception& ex)
+    {
+        std::cout << ex.what() << std::endl;
+    }
+    return 0;
+}
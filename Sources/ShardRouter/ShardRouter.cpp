@@ -0,0 +1,572 @@
+#include "ShardRouter.h"
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+
+#include "../NetworkApi/MsgPlayerQuery.hpp"
+#include "../NetworkApi/MsgSpectate.hpp"
+#include "../NetworkApi/MsgResume.hpp"
+#include "../NetworkApi/MsgPlayerResponse.hpp"
+#include "../NetworkApi/MsgChannel.hpp"
+#include "../NetworkApi/SessionKey.hpp"
+
+/// Схема адреса сервера, принимающего подключения через локальный сокет ("unix:<путь>")
+static const std::string LOCAL_SCHEME = "unix:";
+/// Метка прослушивающего сокета в событиях epoll
+static constexpr uint64_t LISTENER_TAG = ~static_cast<uint64_t>(0);
+/// Наибольший размер начала потока клиента до запроса на подключение к игре
+static constexpr size_t MAX_HEAD_SIZE = 256;
+/// Наибольшее кол-во байт, передаваемых через канал за одну операцию
+static constexpr size_t SPLICE_CHUNK = 64 * 1024;
+
+/**
+ * Данные события epoll (поколение связки, номер связки и сторона: 0 - клиент, 1 - сервер)
+ * @param link Номер связки
+ * @param generation Поколение
+ * @param server Событие сокета сервера
+ * @return Данные события
+ */
+static uint64_t eventTag(uint32_t link, uint32_t generation, bool server)
+{
+    return (static_cast<uint64_t>(generation) << 32) | (static_cast<uint64_t>(link) << 1) | (server ? 1 : 0);
+}
+
+/**
+ * Добавить сокет в epoll (edge-triggered)
+ * @param epoll Дескриптор epoll
+ * @param fd Сокет
+ * @param tag Данные события
+ * @return Удалось ли
+ */
+static bool watch(int epoll, int fd, uint64_t tag)
+{
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = tag;
+    return ::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+/**
+ * Конструктор
+ * @param settings Настройки (кол-во соединений, срок рукопожатия, такт таймеров)
+ */
+ShardRouter::ShardRouter(const ServerSettings& settings):
+        settings_(settings),
+        epoll_(::epoll_create1(EPOLL_CLOEXEC)),
+        listener_(-1),
+        links_(settings.maxConnections),
+        events_(settings.ioQueueDepth > 0 ? settings.ioQueueDepth : 1),
+        started_(std::chrono::steady_clock::now()),
+        timers_(settings.timerTick, 0),
+        connectionRate_(settings.rateTableSize, settings.connectionRate, settings.connectionBurst),
+        rateAgedAt_(0),
+        stopRequested_(0)
+{
+    // Свободные ячейки выдаются с начала таблицы
+    free_.reserve(links_.size());
+    for(size_t i = links_.size(); i > 0; i--){
+        Link& link = links_[i - 1];
+        link.stage = FREE;
+        link.generation = 0;
+        link.client = link.server = -1;
+        link.upstream = link.downstream = Pipe{-1, -1, 0};
+        link.deadline = 0;
+        free_.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+/**
+ * Деструктор (закрывает все сокеты)
+ */
+ShardRouter::~ShardRouter()
+{
+    for(uint32_t link = 0; link < links_.size(); link++){
+        this->closeLink(link);
+    }
+    if(listener_ >= 0) ::close(listener_);
+    if(epoll_ >= 0) ::close(epoll_);
+}
+
+/**
+ * Добавить сервер (номер шарда - порядковый номер добавления)
+ * @param address Адрес вида "хост:порт", либо "unix:<путь>" (локальный сокет сервера на той же машине)
+ * @return Удалось ли разобрать адрес
+ */
+bool ShardRouter::addShard(const std::string& address)
+{
+    if(shards_.size() >= net::SessionKey::MAX_SHARDS)
+        return false;
+
+    // Сервер на той же машине - через локальный сокет, минуя стек TCP
+    if(address.compare(0, LOCAL_SCHEME.size(), LOCAL_SCHEME) == 0){
+        std::string path = address.substr(LOCAL_SCHEME.size());
+        sockaddr_un local = {};
+        local.sun_family = AF_UNIX;
+        if(path.empty() || path.size() >= sizeof(local.sun_path))
+            return false;
+        memcpy(local.sun_path, path.data(), path.size());
+
+        Shard shard = {};
+        memcpy(&shard.address, &local, sizeof(local));
+        shard.addressSize = sizeof(local);
+        shard.name = address;
+        shard.load = 0;
+        shards_.push_back(shard);
+        return true;
+    }
+
+    size_t colon = address.rfind(':');
+    if(colon == std::string::npos)
+        return false;
+
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* resolved = nullptr;
+    if(::getaddrinfo(host.c_str(), port.c_str(), &hints, &resolved) != 0 || resolved == nullptr)
+        return false;
+
+    Shard shard = {};
+    memcpy(&shard.address, resolved->ai_addr, resolved->ai_addrlen);
+    shard.addressSize = resolved->ai_addrlen;
+    shard.name = address;
+    shard.load = 0;
+    ::freeaddrinfo(resolved);
+
+    shards_.push_back(shard);
+    return true;
+}
+
+/**
+ * Открыть порт
+ * @param port Порт
+ * @return Удалось ли
+ */
+bool ShardRouter::listen(uint16_t port)
+{
+    if(epoll_ < 0 || shards_.empty())
+        return false;
+
+    listener_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listener_ < 0)
+        return false;
+
+    int enable = 1;
+    ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if(::bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener_, SOMAXCONN) != 0)
+        return false;
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = LISTENER_TAG;
+    return ::epoll_ctl(epoll_, EPOLL_CTL_ADD, listener_, &event) == 0;
+}
+
+/**
+ * Цикл маршрутизатора (до запроса остановки)
+ */
+void ShardRouter::run()
+{
+    while(!stopRequested_)
+    {
+        int count = ::epoll_wait(epoll_, events_.data(), static_cast<int>(events_.size()), settings_.timerTick);
+        for(int i = 0; i < count; i++)
+        {
+            uint64_t tag = events_[i].data.u64;
+            if(tag == LISTENER_TAG){
+                this->acceptAll();
+                continue;
+            }
+
+            // Событие связки, закрытой ранее в этой же пачке, пропускается
+            auto link = static_cast<uint32_t>((tag & 0xFFFFFFFFu) >> 1);
+            Link& l = links_[link];
+            if(l.stage == FREE || l.generation != static_cast<uint32_t>(tag >> 32))
+                continue;
+
+            bool server = (tag & 1) != 0;
+            switch(l.stage)
+            {
+                case HANDSHAKE:
+                    if(!server) this->readHandshake(link);
+                    break;
+                case CONNECTING:
+                    // Данные клиента остаются в сокете до подключения к серверу
+                    if(server) this->onConnected(link);
+                    break;
+                case SPLICED:
+                    this->relay(link);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // Давно не использованные корзины ограничения частоты обнуляются понемногу каждый такт
+        if(this->elapsed() - rateAgedAt_ >= settings_.timerTick){
+            connectionRate_.age(static_cast<int>(this->elapsed() - rateAgedAt_));
+            rateAgedAt_ = this->elapsed();
+        }
+
+        // Не завершившие рукопожатие (или не подключенные к серверу) вовремя - закрываются
+        expiredTimers_.clear();
+        timers_.advance(this->elapsed(), expiredTimers_);
+        for(uint64_t target : expiredTimers_){
+            auto link = static_cast<uint32_t>(target & 0xFFFFFFFFu);
+            Link& l = links_[link];
+            if(l.stage == FREE || l.stage == SPLICED || l.generation != static_cast<uint32_t>(target >> 32))
+                continue;
+
+            l.deadline = 0;
+            if(l.stage == CONNECTING){
+                std::cout << "Shard " << l.shard << " didn't accept connection in time." << std::endl;
+                this->reject(link);
+            }else{
+                this->closeLink(link);
+            }
+        }
+    }
+}
+
+/**
+ * Запросить остановку (допускается из обработчика сигнала)
+ */
+void ShardRouter::stop()
+{
+    stopRequested_ = 1;
+}
+
+/**
+ * Текущее время от запуска
+ * @return Время (мс)
+ */
+int64_t ShardRouter::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_).count();
+}
+
+/**
+ * Принять все ожидающие подключения
+ */
+void ShardRouter::acceptAll()
+{
+    while(true)
+    {
+        sockaddr_storage address = {};
+        socklen_t addressSize = sizeof(address);
+        int fd = ::accept4(listener_, reinterpret_cast<sockaddr*>(&address), &addressSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+
+        // Адрес, подключающийся чаще допустимого, отключается сразу
+        uint64_t peerKey = address.ss_family == AF_INET6
+                ? RateLimiter::keyOf(&reinterpret_cast<const sockaddr_in6&>(address).sin6_addr, sizeof(in6_addr))
+                : RateLimiter::keyOf(&reinterpret_cast<const sockaddr_in&>(address).sin_addr, sizeof(in_addr));
+        if(!connectionRate_.consume(peerKey)){
+            ::close(fd);
+            continue;
+        }
+
+        // Таблица связок заполнена - подключение отклоняется
+        if(free_.empty()){
+            ::close(fd);
+            continue;
+        }
+
+        uint32_t link = free_.back();
+        free_.pop_back();
+
+        Link& l = links_[link];
+        l.stage = HANDSHAKE;
+        l.client = fd;
+        l.server = -1;
+        l.head.clear();
+        l.codec = net::MsgCodec();
+        l.deadline = 0;
+
+        int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        if(!watch(epoll_, fd, eventTag(link, l.generation, false))){
+            this->closeLink(link);
+            continue;
+        }
+
+        l.deadline = timers_.schedule(settings_.handshakeTimeout, (static_cast<uint64_t>(l.generation) << 32) | link);
+    }
+}
+
+/**
+ * Прочесть начало потока клиента и, получив запрос на подключение к игре, выбрать сервер
+ * @param link Номер связки
+ */
+void ShardRouter::readHandshake(uint32_t link)
+{
+    Link& l = links_[link];
+    char buffer[MAX_HEAD_SIZE];
+
+    while(l.stage == HANDSHAKE)
+    {
+        ssize_t received = ::recv(l.client, buffer, sizeof(buffer), 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+        if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if(received <= 0 || l.head.size() + static_cast<size_t>(received) > MAX_HEAD_SIZE){
+            this->closeLink(link);
+            return;
+        }
+
+        // Прочитанное пересылается серверу целиком, поэтому разбирается только для поиска запроса
+        l.head.append(buffer, static_cast<size_t>(received));
+        const char* data = buffer;
+        auto size = static_cast<size_t>(received);
+        net::Msg message(net::MSG_UNDEFINED, 0);
+        while(l.stage == HANDSHAKE && l.codec.decode(data, size, message))
+        {
+            // Запросу может предшествовать расстановка кораблей (ее проверяет сервер)
+            if(message.getType() == net::MSG_FLEET_LAYOUT)
+                continue;
+
+            if(message.getType() == net::MSG_PLR_QUERY){
+                this->route(link, message.toMsgPlayerQuery().getSessionKey());
+            }else if(message.getType() == net::MSG_LOBBY_SUBSCRIBE){
+                this->route(link, net::SESSION_KEY_NEW);
+            }else if(message.getType() == net::MSG_SPECTATE){
+                this->route(link, message.toMsgSpectate().getSessionKey());
+            }else if(message.getType() == net::MSG_RESUME){
+                this->route(link, message.toMsgResume().getQuery().sessionKey);
+            }else if(message.getType() == net::MSG_CHANNEL){
+                this->rejectChannel(link, message.toMsgChannel().getChannel());
+            }else{
+                this->closeLink(link);
+            }
+        }
+    }
+}
+
+/**
+ * Подключить клиента к серверу, владеющему сессией (новые сессии - к наименее загруженному)
+ * @param link Номер связки
+ * @param sessionKey Ключ сессии из запроса
+ */
+void ShardRouter::route(uint32_t link, uintptr_t sessionKey)
+{
+    Link& l = links_[link];
+
+    // Ожидающие любого соперника направляются на один сервер (иначе они не встретятся): чередование серверов
+    // по парам сбивается, если ожидающий игрок отключится
+    if(sessionKey == net::SESSION_KEY_NEW){
+        l.shard = this->leastLoaded();
+    }else if(sessionKey == net::SESSION_KEY_ANY){
+        l.shard = 0;
+    }else{
+        l.shard = net::SessionKey::shardOf(sessionKey);
+        if(l.shard >= shards_.size()){
+            std::cout << "Session key " << sessionKey << " refers to unknown shard " << l.shard << "." << std::endl;
+            this->reject(link);
+            return;
+        }
+    }
+
+    // Каналы для передачи в обе стороны и сокет сервера
+    int upstream[2] = {-1, -1};
+    int downstream[2] = {-1, -1};
+    bool pipes = ::pipe2(upstream, O_NONBLOCK | O_CLOEXEC) == 0 && ::pipe2(downstream, O_NONBLOCK | O_CLOEXEC) == 0;
+    l.upstream = Pipe{upstream[0], upstream[1], 0};
+    l.downstream = Pipe{downstream[0], downstream[1], 0};
+
+    const Shard& shard = shards_[l.shard];
+    l.server = pipes ? ::socket(shard.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) : -1;
+    if(l.server < 0){
+        this->reject(link);
+        return;
+    }
+
+    int enable = 1;
+    if(shard.address.ss_family != AF_UNIX){
+        ::setsockopt(l.server, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+
+    // Завершение подключения (локальный сокет подключается сразу) сообщается событием готовности к записи
+    if((::connect(l.server, reinterpret_cast<const sockaddr*>(&shard.address), shard.addressSize) != 0 && errno != EINPROGRESS) ||
+       !watch(epoll_, l.server, eventTag(link, l.generation, true)))
+    {
+        std::cout << "Can't connect to shard " << l.shard << " (" << shard.name << ")." << std::endl;
+        this->reject(link);
+        return;
+    }
+
+    l.stage = CONNECTING;
+    shards_[l.shard].load++;
+}
+
+/**
+ * Завершить подключение к серверу: переслать начало потока клиента и начать передачу
+ * @param link Номер связки
+ */
+void ShardRouter::onConnected(uint32_t link)
+{
+    Link& l = links_[link];
+
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    if(::getsockopt(l.server, SOL_SOCKET, SO_ERROR, &error, &errorSize) != 0 || error != 0){
+        std::cout << "Can't connect to shard " << l.shard << " (" << shards_[l.shard].name << ")." << std::endl;
+        this->reject(link);
+        return;
+    }
+
+    // Начало потока помещается в канал к серверу (канал вмещает его целиком) и передается вместе с остальным
+    ssize_t written = ::write(l.upstream.writeEnd, l.head.data(), l.head.size());
+    if(written != static_cast<ssize_t>(l.head.size())){
+        this->reject(link);
+        return;
+    }
+
+    l.upstream.pending = l.head.size();
+    l.head.clear();
+    l.stage = SPLICED;
+    timers_.cancel(l.deadline);
+    l.deadline = 0;
+
+    this->relay(link);
+}
+
+/**
+ * Передать данные в обе стороны (пока сокеты и каналы принимают)
+ * @param link Номер связки
+ */
+void ShardRouter::relay(uint32_t link)
+{
+    Link& l = links_[link];
+    if(!this->pump(l.client, l.server, l.upstream) || !this->pump(l.server, l.client, l.downstream)){
+        this->closeLink(link);
+    }
+}
+
+/**
+ * Передать данные из сокета в сокет через канал ядра
+ * @param from Сокет-источник
+ * @param to Сокет-получатель
+ * @param pipe Канал
+ * @return Открыты ли сокеты (false - одна из сторон отключилась)
+ */
+bool ShardRouter::pump(int from, int to, Pipe& pipe)
+{
+    while(true)
+    {
+        // Сначала канал освобождается - получатель может не принять всё
+        while(pipe.pending > 0){
+            ssize_t moved = ::splice(pipe.readEnd, nullptr, to, nullptr, pipe.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(moved > 0){
+                pipe.pending -= static_cast<size_t>(moved);
+                continue;
+            }
+            if(moved < 0 && errno == EINTR)
+                continue;
+            // Получатель заполнен - продолжение по событию готовности к записи
+            return moved < 0 && errno == EAGAIN;
+        }
+
+        ssize_t moved = ::splice(from, nullptr, pipe.writeEnd, nullptr, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(moved > 0){
+            pipe.pending += static_cast<size_t>(moved);
+            continue;
+        }
+        if(moved < 0 && errno == EINTR)
+            continue;
+        // Источник исчерпан (EAGAIN), либо отключился (0)
+        return moved < 0 && errno == EAGAIN;
+    }
+}
+
+/**
+ * Отказать клиенту в подключении к игре и закрыть связку
+ * @param link Номер связки
+ */
+void ShardRouter::reject(uint32_t link)
+{
+    // Ответ короткий - помещается в буфер только что подключенного сокета
+    std::string response;
+    net::MsgCodec::encode(net::MsgPlayerResponse(false), response);
+    ::send(links_[link].client, response.data(), response.size(), MSG_NOSIGNAL);
+    this->closeLink(link);
+}
+
+/**
+ * Отказать клиенту, открывающему канал, и закрыть связку
+ * @param link Номер связки
+ * @param channel Номер канала у клиента
+ * @details Отказ приходит в канале (как ответ сервера на запрос в канале), затем канал закрывается
+ */
+void ShardRouter::rejectChannel(uint32_t link, uint32_t channel)
+{
+    std::cout << "Client " << link << " opened channel " << channel << ". Channels are not routed." << std::endl;
+
+    std::string response;
+    net::MsgCodec::encode(net::MsgChannel(channel), response);
+    net::MsgCodec::encode(net::MsgPlayerResponse(false), response);
+    net::MsgCodec::encode(net::MsgChannel(channel, true), response);
+    ::send(links_[link].client, response.data(), response.size(), MSG_NOSIGNAL);
+    this->closeLink(link);
+}
+
+/**
+ * Закрыть связку
+ * @param link Номер связки
+ */
+void ShardRouter::closeLink(uint32_t link)
+{
+    Link& l = links_[link];
+    if(l.stage == FREE)
+        return;
+
+    if(l.stage == CONNECTING || l.stage == SPLICED){
+        shards_[l.shard].load--;
+    }
+
+    // Закрытие сокетов исключает их из epoll
+    for(int fd : {l.client, l.server, l.upstream.readEnd, l.upstream.writeEnd, l.downstream.readEnd, l.downstream.writeEnd}){
+        if(fd >= 0) ::close(fd);
+    }
+
+    timers_.cancel(l.deadline);
+    l.deadline = 0;
+    l.stage = FREE;
+    l.generation++;
+    l.client = l.server = -1;
+    l.upstream = l.downstream = Pipe{-1, -1, 0};
+    l.head.clear();
+    free_.push_back(link);
+}
+
+/**
+ * Наименее загруженный сервер
+ * @return Номер шарда
+ */
+unsigned ShardRouter::leastLoaded() const
+{
+    unsigned best = 0;
+    for(unsigned i = 1; i < shards_.size(); i++){
+        if(shards_[i].load < shards_[best].load) best = i;
+    }
+    return best;
+}
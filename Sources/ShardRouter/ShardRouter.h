@@ -0,0 +1,241 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "../NetworkApi/MsgCodec.hpp"
+#include "../Server/ServerSettings.hpp"
+#include "../Server/TimerWheel.hpp"
+#include "../Server/RateLimiter.hpp"
+
+/**
+ * Маршрутизатор подключений между несколькими игровыми серверами (шардами)
+ * Принимает подключения, читает начало потока клиента до запроса на подключение к игре и соединяет клиента
+ * с сервером, владеющим сессией (номер шарда - в старших разрядах ключа, см. net::SessionKey). Новые сессии
+ * создаются на наименее загруженном сервере. Далее данные передаются в обе стороны через каналы ядра (splice),
+ * не копируясь в память маршрутизатора. Частоту подключений с одного адреса ограничивает маршрутизатор - серверы
+ * за ним видят только его адрес (их ограничение частоты подключений следует отключить: "--rate 0,<сообщений>" -
+ * частота сообщений ограничивается по соединению, - либо подключать их через локальный сокет - его клиенты не
+ * ограничиваются). Маршрутизируются только клиенты TCP -
+ * клиенты WebSocket подключаются к серверам напрямую. Подписчик списка сессий подключается к наименее загруженному
+ * серверу и видит только его сессии (к ним он и присоединяется), наблюдатель игры и игрок,
+ * возвращающийся в игру после разрыва соединения, - к серверу ее сессии. Поиск любого соперника ведет один сервер
+ * (первый в группе): иначе ожидающие игроки оказались бы на разных серверах и не встретились. Соединение, оставленное
+ * сервером для следующей игры, остается у своего сервера - повторный поиск соперника на нем ведет этот сервер.
+ * Соединения с каналами (несколько игр на одном соединении, см. net::MsgChannel) не маршрутизируются: игры каналов
+ * могут принадлежать разным серверам - клиенту отказывается в первом канале.
+ * Только Linux (epoll)
+ */
+class ShardRouter final
+{
+private:
+    /// Колесо таймеров (цель - поколение и номер связки)
+    typedef TimerWheel<uint64_t> Timers;
+
+    /// Этап связки
+    enum LinkStage {
+        // Ячейка свободна
+        FREE,
+        // Ожидается запрос клиента на подключение к игре
+        HANDSHAKE,
+        // Выполняется подключение к серверу
+        CONNECTING,
+        // Данные передаются в обе стороны
+        SPLICED
+    };
+
+    /// Канал ядра для передачи в одну сторону
+    struct Pipe
+    {
+        // Концы канала (чтение и запись)
+        int readEnd;
+        int writeEnd;
+        // Кол-во байт в канале
+        size_t pending;
+    };
+
+    /// Связка клиента и сервера
+    struct Link
+    {
+        // Этап
+        LinkStage stage;
+        // Поколение ячейки (отличает события закрытой связки)
+        uint32_t generation;
+        // Сокеты клиента и сервера
+        int client;
+        int server;
+        // Номер сервера (шарда)
+        unsigned shard;
+        // Данные клиента, прочитанные до выбора сервера (пересылаются серверу целиком)
+        std::string head;
+        // Разбор начала потока клиента
+        net::MsgCodec codec;
+        // Каналы от клиента к серверу и обратно
+        Pipe upstream;
+        Pipe downstream;
+        // Срок рукопожатия и подключения к серверу
+        Timers::TimerId deadline;
+    };
+
+    /// Сервер (шард)
+    struct Shard
+    {
+        // Адрес
+        sockaddr_storage address;
+        socklen_t addressSize;
+        // Адрес в виде строки (для журнала)
+        std::string name;
+        // Кол-во связок с сервером
+        unsigned load;
+    };
+
+    /// Настройки
+    ServerSettings settings_;
+    /// Серверы (номер в списке - номер шарда)
+    std::vector<Shard> shards_;
+    /// Дескриптор epoll
+    int epoll_;
+    /// Прослушивающий сокет
+    int listener_;
+    /// Связки
+    std::vector<Link> links_;
+    /// Свободные ячейки
+    std::vector<uint32_t> free_;
+    /// События, получаемые за один вызов
+    std::vector<epoll_event> events_;
+    /// Время запуска (отсчет времени колеса таймеров)
+    std::chrono::steady_clock::time_point started_;
+    /// Колесо таймеров и истекшие за такт таймеры
+    Timers timers_;
+    std::vector<uint64_t> expiredTimers_;
+    /// Ограничение частоты подключений по адресу клиента
+    RateLimiter connectionRate_;
+    /// Время последнего обнуления простаивающих корзин ограничения частоты (мс)
+    int64_t rateAgedAt_;
+    /// Запрошена остановка (выставляется обработчиком сигнала)
+    volatile std::sig_atomic_t stopRequested_;
+
+public:
+    /**
+     * Конструктор
+     * @param settings Настройки (кол-во соединений, срок рукопожатия, такт таймеров)
+     */
+    explicit ShardRouter(const ServerSettings& settings);
+
+    /**
+     * Деструктор (закрывает все сокеты)
+     */
+    ~ShardRouter();
+
+    /**
+     * Запрет копирования через инициализацию
+     * @param other Ссылка на копируемый объекта
+     */
+    ShardRouter(const ShardRouter& other) = delete;
+
+    /**
+     * Запрет копирования через присваивание
+     * @param other Ссылка на копируемый объекта
+     * @return Ссылка на текущий объект
+     */
+    ShardRouter& operator=(const ShardRouter& other) = delete;
+
+    /**
+     * Добавить сервер (номер шарда - порядковый номер добавления)
+     * @param address Адрес вида "хост:порт", либо "unix:<путь>" (локальный сокет сервера на той же машине)
+     * @return Удалось ли разобрать адрес
+     */
+    bool addShard(const std::string& address);
+
+    /**
+     * Открыть порт
+     * @param port Порт
+     * @return Удалось ли
+     */
+    bool listen(uint16_t port);
+
+    /**
+     * Цикл маршрутизатора (до запроса остановки)
+     */
+    void run();
+
+    /**
+     * Запросить остановку (допускается из обработчика сигнала)
+     */
+    void stop();
+
+private:
+    /**
+     * Текущее время от запуска
+     * @return Время (мс)
+     */
+    int64_t elapsed() const;
+
+    /**
+     * Принять все ожидающие подключения
+     */
+    void acceptAll();
+
+    /**
+     * Прочесть начало потока клиента и, получив запрос на подключение к игре, выбрать сервер
+     * @param link Номер связки
+     */
+    void readHandshake(uint32_t link);
+
+    /**
+     * Подключить клиента к серверу, владеющему сессией (новые сессии - к наименее загруженному)
+     * @param link Номер связки
+     * @param sessionKey Ключ сессии из запроса
+     */
+    void route(uint32_t link, uintptr_t sessionKey);
+
+    /**
+     * Завершить подключение к серверу: переслать начало потока клиента и начать передачу
+     * @param link Номер связки
+     */
+    void onConnected(uint32_t link);
+
+    /**
+     * Передать данные в обе стороны (пока сокеты и каналы принимают)
+     * @param link Номер связки
+     */
+    void relay(uint32_t link);
+
+    /**
+     * Передать данные из сокета в сокет через канал ядра
+     * @param from Сокет-источник
+     * @param to Сокет-получатель
+     * @param pipe Канал
+     * @return Открыты ли сокеты (false - одна из сторон отключилась)
+     */
+    bool pump(int from, int to, Pipe& pipe);
+
+    /**
+     * Отказать клиенту в подключении к игре и закрыть связку
+     * @param link Номер связки
+     */
+    void reject(uint32_t link);
+
+    /**
+     * Отказать клиенту, открывающему канал, и закрыть связку
+     * @param link Номер связки
+     * @param channel Номер канала у клиента
+     */
+    void rejectChannel(uint32_t link, uint32_t channel);
+
+    /**
+     * Закрыть связку
+     * @param link Номер связки
+     */
+    void closeLink(uint32_t link);
+
+    /**
+     * Наименее загруженный сервер
+     * @return Номер шарда
+     */
+    unsigned leastLoaded() const;
+};